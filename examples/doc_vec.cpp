@@ -0,0 +1,48 @@
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "word_vector.hpp"
+
+// document vectors are addressed by document IDs, erasing a document does not change vectors of other documents
+int main() {
+    try {
+        wordvec::d2vModel_t d2vModel(4);
+        wordvec::vector_t first(4);
+        wordvec::vector_t second(4);
+        wordvec::vector_t third(4);
+        for (std::size_t i = 0; i < 4; ++i) {
+            first[i] = 1.0f + static_cast<float>(i);
+            second[i] = 10.0f + static_cast<float>(i);
+            third[i] = 100.0f + static_cast<float>(i);
+        }
+        d2vModel.set(7, first);
+        d2vModel.set(42, second);
+        d2vModel.set(1000, third);
+
+        // the last row takes the place of the erased one
+        d2vModel.erase(7);
+
+        auto expect = [&d2vModel](std::size_t _docId, const wordvec::vector_t &_vector) {
+            auto found = d2vModel.vector(_docId);
+            if ((found.size() != _vector.size()) || !std::equal(found.begin(), found.end(), _vector.begin())) {
+                throw std::runtime_error("wrong vector of document " + std::to_string(_docId));
+            }
+        };
+        expect(42, second);
+        expect(1000, third);
+        if (!d2vModel.vector(7).empty() || (d2vModel.modelSize() != 2)) {
+            throw std::runtime_error("erased document is still found");
+        }
+
+        std::cout << "documents: " << d2vModel.modelSize() << ", vectors are found by document IDs" << std::endl;
+    } catch (const std::exception &_e) {
+        std::cerr << _e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
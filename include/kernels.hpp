@@ -0,0 +1,302 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__POPCNT__)
+#include <immintrin.h>
+#endif
+
+namespace wordvec {
+    // similarity kernels of quantized model rows. SIMD code is selected at compile time (Release build uses
+    // -march=native), portable scalar code processes the rest of the vector or the whole vector
+
+#if defined(__AVX2__)
+    inline float horizontalSum(__m256 _value) noexcept {
+        auto sum = _mm_add_ps(_mm256_castps256_ps128(_value), _mm256_extractf128_ps(_value, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+
+        return _mm_cvtss_f32(sum);
+    }
+
+    inline int32_t horizontalSum(__m256i _value) noexcept {
+        auto sum = _mm_add_epi32(_mm256_castsi256_si128(_value), _mm256_extracti128_si256(_value, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        return _mm_cvtsi128_si32(sum);
+    }
+#endif
+
+    // dot product of fp32 vectors
+    inline float dotFloat(const float *_row, const float *_vector, uint16_t _size) noexcept {
+        float ret = 0.0f;
+        uint16_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        auto sum0 = _mm256_setzero_ps();
+        auto sum1 = _mm256_setzero_ps();
+        for (; i + 16 <= _size; i += 16) {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(_row + i), _mm256_loadu_ps(_vector + i), sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(_row + i + 8), _mm256_loadu_ps(_vector + i + 8), sum1);
+        }
+        if (i + 8 <= _size) {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(_row + i), _mm256_loadu_ps(_vector + i), sum0);
+            i += 8;
+        }
+        ret = horizontalSum(_mm256_add_ps(sum0, sum1));
+#endif
+        for (; i < _size; ++i) {
+            ret += _row[i] * _vector[i];
+        }
+
+        return ret;
+    }
+
+    // dot products of _count consecutive fp32 rows and the vector. Four rows share each load of the vector, their
+    // independent accumulators hide FMA latency
+    inline void dotRows(const float *_rows, std::size_t _count, const float *_vector, uint16_t _size,
+                        float *_dots) noexcept {
+        std::size_t r = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+        for (; r + 4 <= _count; r += 4) {
+            auto row0 = _rows + r * _size;
+            auto row1 = row0 + _size;
+            auto row2 = row1 + _size;
+            auto row3 = row2 + _size;
+            auto sum0 = _mm256_setzero_ps();
+            auto sum1 = _mm256_setzero_ps();
+            auto sum2 = _mm256_setzero_ps();
+            auto sum3 = _mm256_setzero_ps();
+            uint16_t i = 0;
+            for (; i + 8 <= _size; i += 8) {
+                auto vector = _mm256_loadu_ps(_vector + i);
+                sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(row0 + i), vector, sum0);
+                sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(row1 + i), vector, sum1);
+                sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(row2 + i), vector, sum2);
+                sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(row3 + i), vector, sum3);
+            }
+            // 4 x 8 partial sums are reduced to 4 dot products at once
+            auto sum01 = _mm256_hadd_ps(sum0, sum1);
+            auto sum23 = _mm256_hadd_ps(sum2, sum3);
+            auto sum = _mm256_hadd_ps(sum01, sum23);
+            auto dots = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+            for (; i < _size; ++i) {
+                dots = _mm_add_ps(dots, _mm_mul_ps(_mm_setr_ps(row0[i], row1[i], row2[i], row3[i]),
+                                                   _mm_set1_ps(_vector[i])));
+            }
+            _mm_storeu_ps(_dots + r, dots);
+        }
+#endif
+        for (; r < _count; ++r) {
+            _dots[r] = dotFloat(_rows + r * _size, _vector, _size);
+        }
+    }
+
+    // IEEE 754 half precision conversion, rounds to nearest even
+    inline uint16_t floatToHalf(float _value) noexcept {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &_value, sizeof(bits));
+        auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        auto exponent = static_cast<int32_t>((bits >> 23) & 0xff);
+        uint32_t mantissa = bits & 0x7fffff;
+        if (exponent == 0xff) {
+            return static_cast<uint16_t>(sign | 0x7c00 | ((mantissa != 0) ? 0x200 : 0));
+        }
+        exponent += 15 - 127;
+        if (exponent >= 31) {
+            return static_cast<uint16_t>(sign | 0x7c00);
+        }
+        if (exponent <= 0) {
+            // subnormal half
+            if (exponent < -10) {
+                return sign;
+            }
+            mantissa |= 0x800000;
+            auto shift = static_cast<uint32_t>(14 - exponent);
+            auto half = mantissa >> shift;
+            auto rest = mantissa & ((1U << shift) - 1);
+            auto middle = 1U << (shift - 1);
+            if ((rest > middle) || ((rest == middle) && ((half & 1) != 0))) {
+                ++half;
+            }
+            return static_cast<uint16_t>(sign | half);
+        }
+        auto half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+        auto rest = mantissa & 0x1fff;
+        // carry of the rounding may overflow to the exponent, it is correct up to infinity
+        if ((rest > 0x1000) || ((rest == 0x1000) && ((half & 1) != 0))) {
+            ++half;
+        }
+
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    inline float halfToFloat(uint16_t _value) noexcept {
+        auto sign = static_cast<uint32_t>(_value & 0x8000) << 16;
+        auto exponent = static_cast<uint32_t>(_value >> 10) & 0x1f;
+        auto mantissa = static_cast<uint32_t>(_value) & 0x3ff;
+        if (exponent == 0) {
+            auto ret = static_cast<float>(mantissa) * 5.9604644775390625e-8f; // 2^-24
+            return (sign != 0) ? -ret : ret;
+        }
+        auto bits = sign | (mantissa << 13) | ((exponent == 0x1f) ? 0x7f800000 : ((exponent + 112) << 23));
+        float ret = 0.0f;
+        std::memcpy(&ret, &bits, sizeof(ret));
+
+        return ret;
+    }
+
+    inline void floatToHalf(const float *_vector, uint16_t *_row, uint16_t _size) noexcept {
+        uint16_t i = 0;
+#if defined(__F16C__)
+        for (; i + 8 <= _size; i += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(_row + i),
+                             _mm256_cvtps_ph(_mm256_loadu_ps(_vector + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+#endif
+        for (; i < _size; ++i) {
+            _row[i] = floatToHalf(_vector[i]);
+        }
+    }
+
+    // dot product of fp16 row and fp32 vector
+    inline float dotHalf(const uint16_t *_row, const float *_vector, uint16_t _size) noexcept {
+        float ret = 0.0f;
+        uint16_t i = 0;
+#if defined(__AVX2__) && defined(__F16C__) && defined(__FMA__)
+        auto sum0 = _mm256_setzero_ps();
+        auto sum1 = _mm256_setzero_ps();
+        for (; i + 16 <= _size; i += 16) {
+            auto row0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(_row + i)));
+            auto row1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(_row + i + 8)));
+            sum0 = _mm256_fmadd_ps(row0, _mm256_loadu_ps(_vector + i), sum0);
+            sum1 = _mm256_fmadd_ps(row1, _mm256_loadu_ps(_vector + i + 8), sum1);
+        }
+        ret = horizontalSum(_mm256_add_ps(sum0, sum1));
+#endif
+        for (; i < _size; ++i) {
+            ret += halfToFloat(_row[i]) * _vector[i];
+        }
+
+        return ret;
+    }
+
+    // symmetric quantization to [-127, 127], returns the scale of the row
+    inline float floatToInt8(const float *_vector, int8_t *_row, uint16_t _size) noexcept {
+        float maxAbs = 0.0f;
+        for (uint16_t i = 0; i < _size; ++i) {
+            maxAbs = std::max(maxAbs, std::fabs(_vector[i]));
+        }
+        if (maxAbs <= 0.0f) {
+            std::memset(_row, 0, _size);
+            return 0.0f;
+        }
+        auto inverse = 127.0f / maxAbs;
+        for (uint16_t i = 0; i < _size; ++i) {
+            _row[i] = static_cast<int8_t>(std::lround(_vector[i] * inverse));
+        }
+
+        return maxAbs / 127.0f;
+    }
+
+    // dot product of int8 rows. Unsigned by signed multiplication of pmaddubsw/vpdpbusd gets |a| and b with the sign
+    // of a, -128 is never produced by floatToInt8, so pairs of products do not saturate int16
+    inline int32_t dotInt8(const int8_t *_row, const int8_t *_vector, uint16_t _size) noexcept {
+        int32_t ret = 0;
+        uint16_t i = 0;
+#if defined(__AVX2__)
+        auto sum = _mm256_setzero_si256();
+#if !defined(__AVXVNNI__) && !(defined(__AVX512VNNI__) && defined(__AVX512VL__))
+        auto ones = _mm256_set1_epi16(1);
+#endif
+        for (; i + 32 <= _size; i += 32) {
+            auto row = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_row + i));
+            auto vector = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_vector + i));
+            auto absRow = _mm256_sign_epi8(row, row);
+            auto signedVector = _mm256_sign_epi8(vector, row);
+#if defined(__AVXVNNI__)
+            sum = _mm256_dpbusd_avx_epi32(sum, absRow, signedVector);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+            sum = _mm256_dpbusd_epi32(sum, absRow, signedVector);
+#else
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(absRow, signedVector), ones));
+#endif
+        }
+        ret = horizontalSum(sum);
+#endif
+        for (; i < _size; ++i) {
+            ret += static_cast<int32_t>(_row[i]) * static_cast<int32_t>(_vector[i]);
+        }
+
+        return ret;
+    }
+
+    inline uint32_t popCount(uint64_t _value) noexcept {
+#if defined(__POPCNT__)
+        return static_cast<uint32_t>(_mm_popcnt_u64(_value));
+#else
+        _value -= (_value >> 1) & 0x5555555555555555ULL;
+        _value = (_value & 0x3333333333333333ULL) + ((_value >> 2) & 0x3333333333333333ULL);
+        _value = (_value + (_value >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+
+        return static_cast<uint32_t>((_value * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    // Hamming distances of _count consecutive binary codes of _words 64-bit words and the code of the vector.
+    // AVX-512 VPOPCNTDQ processes 8 codes at once, lanes gather the same word of each code, so short codes do not
+    // waste lanes
+    inline void hammingRows(const uint64_t *_codes, std::size_t _count, const uint64_t *_vector, uint16_t _words,
+                            uint32_t *_distances) noexcept {
+        std::size_t r = 0;
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+        const long long words = _words;
+        auto offsets = _mm512_setr_epi64(0, words, 2 * words, 3 * words, 4 * words, 5 * words, 6 * words, 7 * words);
+        for (; r + 8 <= _count; r += 8) {
+            auto sum = _mm512_setzero_si512();
+            for (uint16_t i = 0; i < _words; ++i) {
+                // masked forms take zero instead of undefined registers, GCC warns of the latter
+                auto codes = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xff, offsets,
+                                                         _codes + r * _words + i, 8);
+                auto vector = _mm512_set1_epi64(static_cast<long long>(_vector[i]));
+                sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(_mm512_xor_si512(codes, vector)));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(_distances + r), _mm512_maskz_cvtepi64_epi32(0xff, sum));
+        }
+#endif
+        for (; r < _count; ++r) {
+            uint32_t distance = 0;
+            for (uint16_t i = 0; i < _words; ++i) {
+                distance += popCount(_codes[r * _words + i] ^ _vector[i]);
+            }
+            _distances[r] = distance;
+        }
+    }
+
+    // sum of lookup table entries selected by product quantization code, tables of subspaces have 256 entries.
+    // 256 entry tables do not fit 16 byte shuffles, so AVX2 gathers 8 subspaces at once
+    inline float dotCodes(const uint8_t *_code, const float *_table, uint16_t _subspaces) noexcept {
+        float ret = 0.0f;
+        uint16_t i = 0;
+#if defined(__AVX2__)
+        auto sum = _mm256_setzero_ps();
+        auto offsets = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+        for (; i + 8 <= _subspaces; i += 8) {
+            auto codes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(_code + i)));
+            sum = _mm256_add_ps(sum, _mm256_i32gather_ps(_table + i * 256, _mm256_add_epi32(codes, offsets), 4));
+        }
+        ret = horizontalSum(sum);
+#endif
+        for (; i < _subspaces; ++i) {
+            ret += _table[i * 256 + _code[i]];
+        }
+
+        return ret;
+    }
+}
+
+#endif
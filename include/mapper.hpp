@@ -39,9 +39,22 @@ namespace wordvec {
         const bool m_wr_flag = false;
 
     public:
+        /// Memory access pattern hints
+        enum class advice_t {
+            normal,
+            random,
+            sequential,
+            willNeed,
+            dontNeed
+        };
+
         explicit file_mapper_t(const std::string &_fileName, bool _wr_flag = false, off_t _size = 0);
         ~file_mapper_t() final;
 
+        /// Flushes changes of a writable mapping to the file, throws std::runtime_error on failure
+        void sync() const;
+        /// Advises the kernel of the access pattern of the region, _size == 0 means up to the end of the mapping
+        void advise(advice_t _advice, off_t _offset = 0, off_t _size = 0) const noexcept;
 
         file_mapper_t(const file_mapper_t &) = delete;
         void operator=(const file_mapper_t &) = delete;
@@ -56,6 +56,15 @@ namespace wordvec {
             m_last_eos = false;
         }
 
+        inline void seek(off_t _offset) {
+            if ((_offset < m_start) || (_offset > m_stop + 1)) {
+                throw std::range_error("wordReader: offset is out of the bounds");
+            }
+            m_offset = _offset;
+            m_pos = 0;
+            m_last_eos = false;
+        }
+
         inline bool next_word(std::string &_word) noexcept {
             while (m_offset <= m_stop) {
                 char ch = m_mapper.data()[m_offset++];
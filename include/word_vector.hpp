@@ -2,16 +2,41 @@
 #define __WORD_VECTOR_H__
 
 #include <cassert>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <queue>
+#include <limits>
+#include <algorithm>
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <cmath>
 #include <stdexcept>
 
+#include "mapper.hpp"
+#include "kernels.hpp"
+
 namespace wordvec {
+    class trainer_t;
+
+    enum class optimizer_t: uint8_t {
+        sgd = 0,
+        adagrad,
+        adam
+    };
+
+    enum class placement_t: uint8_t {
+        none = 0,
+        list,
+        cores,
+        numa
+    };
+
     struct train_setting_t final {
         uint16_t min_freq = 5;
         uint16_t size = 100;
@@ -21,15 +46,241 @@ namespace wordvec {
         float sample = 1e-3f;
         bool with_hs = false;
         uint8_t negative = 5;
-        uint8_t threads = 4;
+        uint16_t threads = 4;
         uint8_t iterations = 5;
         float alpha = 0.05f;
         bool with_sg = false;
         std::string delims = " \n,.-!?:;/\"#$%&'()*+<=>@[]\\^_`{|}~\t\v\f\r";
         std::string eos = ".\n?!";
+        uint8_t readers = 0;
+        uint16_t queue_sz = 64;
+        uint32_t batch_words = 10000;
+        std::string checkpoint_file;
+        uint32_t checkpoint_interval = 600;
+        bool resume = false;
+        std::string base_checkpoint;
+        std::string matrix_file;
+        std::string stats_file;
+        uint32_t stats_interval = 10;
+        std::string vocabulary_file;
+        std::string peers;
+        uint16_t rank = 0;
+        uint16_t sync_rounds = 100;
+        uint32_t hot_rows = 0;
+        uint32_t hot_rows_sync = 4096;
+        optimizer_t optimizer = optimizer_t::sgd;
+        uint32_t ngram_buckets = 0;
+        uint8_t min_ngram = 3;
+        uint8_t max_ngram = 6;
+        bool with_dm = false;
+        bool with_glove = false;
+        float glove_x_max = 100.0f;
+        float glove_power = 0.75f;
+        std::string cooccurrence_file;
+        uint32_t cooccurrence_memory = 1024;
+        placement_t placement = placement_t::none;
+        std::string cpu_list;
+        // threads take CPUs of the placement starting from this position, trainers running at once do not overlap
+        uint32_t cpu_offset = 0;
+        uint32_t progress_interval = 100;
         train_setting_t() = default;
     };
 
+    // model file writing: rows are copied to the mapping of the pre-sized file or written through bounded buffers
+    // by pwrite without pre-sizing the file
+    enum class save_mode_t: uint8_t {
+        mmap = 0,
+        stream
+    };
+
+    struct save_setting_t final {
+        save_mode_t mode = save_mode_t::mmap;
+        // MB, shared by writing threads in stream mode
+        uint32_t buffer_size = 64;
+        // 0 - all cores
+        uint16_t threads = 0;
+        // the model is written to a temporary file renamed to the model file name when it is complete
+        bool atomic = false;
+        save_setting_t() = default;
+    };
+
+    // storage of rows scanned by nearest(), quantized rows are a copy of fp32 rows
+    enum class storage_t: uint8_t {
+        fp32 = 0,
+        fp16,
+        // symmetric int8 with a scale per row
+        int8,
+        // product quantization codes, see pq_setting_t
+        pq
+    };
+
+    struct pq_setting_t final {
+        // bytes of a row code, vector size must be divisible by it. 0 - sub-vectors of 4 or more values
+        uint16_t subspaces = 0;
+        // k-means iterations of each subspace codebook
+        uint16_t iterations = 12;
+        // number of training rows sampled uniformly from the model, 0 - all rows
+        std::size_t sample = 32768;
+        // parametric OPQ: rows are rotated to eigenvectors of their covariance, eigenvalues are balanced between
+        // subspaces
+        bool rotation = false;
+        // 0 - all cores
+        uint16_t threads = 0;
+        pq_setting_t() = default;
+    };
+
+    struct hnsw_setting_t final {
+        // links of a node on upper graph levels, nodes of the bottom level have 2 * m links
+        uint16_t m = 16;
+        // candidates list size of node insertion
+        uint16_t ef_construction = 200;
+        // candidates list size of search, it is at least the amount of nearest vectors. Saved with the index
+        uint16_t ef = 64;
+        // 0 - all cores
+        uint16_t threads = 0;
+        hnsw_setting_t() = default;
+    };
+
+    struct ivf_setting_t final {
+        // number of inverted lists, 0 - square root of the number of rows
+        uint32_t lists = 0;
+        // k-means iterations of the lists centroids
+        uint16_t iterations = 10;
+        // training rows sampled uniformly per list, 0 - all rows
+        uint16_t sample = 64;
+        // number of lists scanned by search. Saved with the index
+        uint16_t nprobe = 8;
+        // residuals of rows to their list centroid are stored as product quantization codes instead of fp32 rows
+        bool with_pq = false;
+        // codebooks training of residuals
+        pq_setting_t pq;
+        // rerank * amount candidates selected by pq scores are re-ranked by fp32 rows, 0 - approximate scores
+        uint16_t rerank = 4;
+        // 0 - all cores
+        uint16_t threads = 0;
+        ivf_setting_t() = default;
+    };
+
+    struct simhash_setting_t final {
+        // bits of a row code, multiple of 64 up to 512. Every bit is the sign of the dot product of the row and a
+        // random hyperplane normal
+        uint16_t bits = 256;
+        // rerank * amount candidates of the least Hamming distances are re-ranked by fp32 rows. Saved with the index
+        uint16_t rerank = 16;
+        // candidates of greater Hamming distance are skipped, 0 - no limit. Near-duplicates differ in a few bits
+        uint16_t max_hamming = 0;
+        uint64_t seed = 1;
+        // 0 - all cores
+        uint16_t threads = 0;
+        simhash_setting_t() = default;
+    };
+
+    struct load_setting_t final {
+        // 0 - all words, otherwise the first max_words words of the file, the most frequent ones if the file is
+        // frequency ordered
+        std::size_t max_words = 0;
+        // vectors of word2vec binary and text files are copied from the file mapping and normalized when they are
+        // accessed for the first time, native model files are always mapped
+        bool lazy = false;
+        // quantized rows are read from native file of the same storage or converted on loading, fp32 rows of
+        // word2vec binary and text files are loaded lazily then
+        storage_t storage = storage_t::fp32;
+        // 0 - nearest() returns quantized distances, otherwise rerank * amount candidates are re-ranked by fp32 rows
+        uint16_t rerank = 0;
+        // codebooks training of pq storage, pq model files are loaded as is
+        pq_setting_t pq;
+        load_setting_t() = default;
+    };
+
+    struct pipeline_stats_t final {
+        std::size_t queue_size = 0;
+        std::size_t batches = 0;
+        std::size_t producer_stalls = 0;
+        std::size_t producer_stall_ms = 0;
+        std::size_t consumer_stalls = 0;
+        std::size_t consumer_stall_ms = 0;
+        std::size_t max_queue_depth = 0;
+        float avg_queue_depth = 0.0f;
+        pipeline_stats_t() = default;
+    };
+
+    struct epoch_stats_t final {
+        std::size_t epoch = 0;
+        std::size_t major_faults = 0;
+        std::size_t minor_faults = 0;
+        float seconds = 0.0f;
+        epoch_stats_t() = default;
+    };
+
+    struct thread_stats_t final {
+        std::size_t words = 0;
+        std::size_t pairs = 0;
+        std::size_t skipped_words = 0;
+        float words_per_sec = 0.0f;
+        float pairs_per_sec = 0.0f;
+        float loss = 0.0f;
+        std::size_t read_ms = 0;
+        std::size_t train_ms = 0;
+        int cpu = -1;
+        thread_stats_t() = default;
+    };
+
+    struct train_stats_t final {
+        float seconds = 0.0f;
+        float interval = 0.0f;
+        thread_stats_t total;
+        std::vector<thread_stats_t> threads;
+        train_stats_t() = default;
+    };
+
+    // read-only view of a model row or of a vector, does not own the data
+    class vector_view_t {
+        private:
+            const float *m_data = nullptr;
+            std::size_t m_size = 0;
+
+        public:
+            vector_view_t() = default;
+
+            vector_view_t(const float *_data, std::size_t _size): m_data(_data), m_size(_size) {}
+
+            vector_view_t(const std::vector<float> &_vector): m_data(_vector.data()), m_size(_vector.size()) {}
+
+            inline const float *data() const noexcept {return m_data;}
+            inline std::size_t size() const noexcept {return m_size;}
+            inline bool empty() const noexcept {return m_size == 0;}
+            inline const float &operator[](std::size_t _i) const noexcept {return m_data[_i];}
+            inline const float *begin() const noexcept {return m_data;}
+            inline const float *end() const noexcept {return m_data + m_size;}
+    };
+
+    // allocator of cache line aligned memory, model matrices start at 64-byte boundary
+    template <class T>
+        struct aligned_allocator_t {
+            using value_type = T;
+            static const std::size_t alignment = 64;
+
+            aligned_allocator_t() = default;
+            template <class U>
+                aligned_allocator_t(const aligned_allocator_t<U> &) noexcept {}
+
+            T *allocate(std::size_t _n) {
+                void *ret = nullptr;
+                if (posix_memalign(&ret, alignment, std::max<std::size_t>(_n * sizeof(T), 1)) != 0) {
+                    throw std::bad_alloc();
+                }
+                return static_cast<T *>(ret);
+            }
+
+            void deallocate(T *_p, std::size_t) noexcept {std::free(_p);}
+        };
+
+    template <class T, class U>
+        bool operator==(const aligned_allocator_t<T> &, const aligned_allocator_t<U> &) noexcept {return true;}
+
+    template <class T, class U>
+        bool operator!=(const aligned_allocator_t<T> &, const aligned_allocator_t<U> &) noexcept {return false;}
+
     class vector_t: public std::vector<float> {
         public:
             vector_t(): std::vector<float>() {}
@@ -40,6 +291,9 @@ namespace wordvec {
             explicit vector_t(const std::vector<float> &_vector): std::vector<float>(_vector) {}
 
 
+            explicit vector_t(const vector_view_t &_view): std::vector<float>(_view.begin(), _view.end()) {}
+
+
             vector_t &operator+=(const vector_t &_from) {
                 if (this != &_from) {
                     assert(size() == _from.size());
@@ -98,102 +352,1114 @@ namespace wordvec {
             }
     };
 
+    // array owned by a model or stored in a mapped model file, mapped data is copied on the first modification
+    template <class T>
+        class array_t {
+            public:
+                using owned_t = std::vector<T, aligned_allocator_t<T>>;
+
+            private:
+                owned_t m_owned;
+                const T *m_view = nullptr;
+                std::size_t m_viewSize = 0;
+
+            public:
+                array_t(): m_owned() {}
+
+                inline const T *data() const noexcept {return (m_view != nullptr) ? m_view : m_owned.data();}
+                inline std::size_t size() const noexcept {return (m_view != nullptr) ? m_viewSize : m_owned.size();}
+                inline bool empty() const noexcept {return size() == 0;}
+                inline const T &operator[](std::size_t _i) const noexcept {return data()[_i];}
+
+                owned_t &owned() {
+                    if (m_view != nullptr) {
+                        m_owned.assign(m_view, m_view + m_viewSize);
+                        m_view = nullptr;
+                        m_viewSize = 0;
+                    }
+
+                    return m_owned;
+                }
+
+                void view(const T *_data, std::size_t _size) {
+                    owned_t().swap(m_owned);
+                    m_view = _data;
+                    m_viewSize = _size;
+                }
+
+                void clear() {
+                    owned_t().swap(m_owned);
+                    m_view = nullptr;
+                    m_viewSize = 0;
+                }
+        };
+
+    // rows of a lazily loaded model, the buffer is allocated but not touched, so memory is committed only for rows
+    // filled by the loader on their first access. Accesses are thread safe
+    class lazy_rows_t {
+        private:
+            enum: uint8_t {
+                empty = 0,
+                filling,
+                ready
+            };
+
+            std::function<void(std::size_t, float *)> m_loader;
+            std::size_t m_rows;
+            uint16_t m_vec_sz;
+            float *m_data;
+            std::unique_ptr<std::atomic<uint8_t>[]> m_states;
+            std::atomic<bool> m_complete;
+
+            void fill(std::size_t _id) noexcept {
+                auto &state = m_states[_id];
+                uint8_t expected = empty;
+                if (state.compare_exchange_strong(expected, filling, std::memory_order_acquire)) {
+                    try {
+                        m_loader(_id, m_data + _id * m_vec_sz);
+                    } catch (...) {
+                        // wrong record is a zero vector
+                        std::fill(m_data + _id * m_vec_sz, m_data + (_id + 1) * m_vec_sz, 0.0f);
+                    }
+                    state.store(ready, std::memory_order_release);
+                    return;
+                }
+                while (state.load(std::memory_order_acquire) != ready) {
+                    std::this_thread::yield();
+                }
+            }
+
+        public:
+            lazy_rows_t(std::size_t _rows, uint16_t _vectorSize, std::function<void(std::size_t, float *)> _loader):
+                    m_loader(std::move(_loader)), m_rows(_rows), m_vec_sz(_vectorSize),
+                    m_data(aligned_allocator_t<float>().allocate(_rows * _vectorSize)),
+                    m_states(new std::atomic<uint8_t>[_rows]), m_complete(false) {
+                for (std::size_t i = 0; i < m_rows; ++i) {
+                    m_states[i].store(empty, std::memory_order_relaxed);
+                }
+            }
+
+            ~lazy_rows_t() {
+                aligned_allocator_t<float>().deallocate(m_data, m_rows * m_vec_sz);
+            }
+
+            lazy_rows_t(const lazy_rows_t &) = delete;
+            void operator=(const lazy_rows_t &) = delete;
+
+            inline const float *row(std::size_t _id) noexcept {
+                if (m_states[_id].load(std::memory_order_acquire) != ready) {
+                    fill(_id);
+                }
+
+                return m_data + _id * m_vec_sz;
+            }
+
+            // fills all rows, full scans of the matrix use it
+            const float *data() noexcept {
+                if (!m_complete.load(std::memory_order_acquire)) {
+                    for (std::size_t i = 0; i < m_rows; ++i) {
+                        row(i);
+                    }
+                    m_complete.store(true, std::memory_order_release);
+                }
+
+                return m_data;
+            }
+    };
+
+    // product quantization codec. Rows are split into subspaces and each sub-vector is replaced by ID of the nearest
+    // centroid of the subspace codebook, so a row code takes one byte per subspace. Rows may be rotated before
+    // splitting. Codec is immutable after construction (its owner may only take the codes), so model copies share it
+    class pq_codec_t {
+        public:
+            static const std::size_t centroids = 256;
+
+        private:
+            uint16_t m_vec_sz = 0;
+            uint16_t m_subspaces = 0;
+            uint16_t m_sub_sz = 0;
+            std::size_t m_rows = 0;
+            // subspaces * centroids * sub-vector size
+            array_t<float> m_codebooks;
+            // vector size * vector size, rows of the matrix are rotated axes, empty - no rotation
+            array_t<float> m_rotation;
+            // rows * subspaces
+            array_t<uint8_t> m_codes;
+
+        public:
+            // trains codebooks on sampled rows and encodes all rows, the row function is called by several threads
+            // and must return normalized row. Throws std::runtime_error on wrong settings
+            pq_codec_t(std::size_t _rows, uint16_t _vectorSize, const std::function<void(std::size_t, float *)> &_row,
+                       const pq_setting_t &_pqSettings);
+            // views codec arrays of a mapped model file, _rotation may be nullptr
+            pq_codec_t(std::size_t _rows, uint16_t _vectorSize, uint16_t _subspaces, const float *_codebooks,
+                       const float *_rotation, const uint8_t *_codes);
+
+            pq_codec_t(const pq_codec_t &) = delete;
+            void operator=(const pq_codec_t &) = delete;
+
+            inline uint16_t subspaces() const noexcept {return m_subspaces;}
+            inline std::size_t rows() const noexcept {return m_rows;}
+            inline const array_t<float> &codebooks() const noexcept {return m_codebooks;}
+            inline const array_t<float> &rotation() const noexcept {return m_rotation;}
+            inline const array_t<uint8_t> &codes() const noexcept {return m_codes;}
+
+            // fills subspaces * centroids table of dot products of the vector and the centroids
+            void lookup(const float *_vector, float *_table) const;
+
+            // asymmetric distance computation: approximate dot product of the lookup table vector and the row
+            inline float dot(std::size_t _id, const float *_table) const noexcept {
+                return dotCodes(m_codes.data() + _id * m_subspaces, _table, m_subspaces);
+            }
+
+            // reconstructs approximate row
+            void decode(std::size_t _id, float *_vector) const;
+
+            // code of a vector which is not one of the encoded rows
+            void encode(const float *_vector, uint8_t *_code) const;
+
+            // codes are moved to their owner, the codec keeps codebooks only
+            inline void releaseCodes() noexcept {
+                m_codes.clear();
+                m_rows = 0;
+            }
+    };
+
+    // bounded min-heap of (score, row ID) pairs, exact and index searches select rows by it
+    class nearest_rows_t final {
+        private:
+            std::vector<std::pair<float, uint32_t>> m_heap;
+            const std::size_t m_amount;
+
+        public:
+            explicit nearest_rows_t(std::size_t _amount): m_heap(), m_amount(_amount) {
+                m_heap.reserve(_amount + 1);
+            }
+
+            // score a row has to exceed to be selected
+            inline float entryLevel() const noexcept {
+                if (m_heap.size() < m_amount) {
+                    return 0.0f;
+                }
+                return (m_amount > 0) ? m_heap.front().first : std::numeric_limits<float>::max();
+            }
+
+            inline void push(float _score, std::size_t _id) {
+                m_heap.emplace_back(_score, static_cast<uint32_t>(_id));
+                std::push_heap(m_heap.begin(), m_heap.end(), std::greater<std::pair<float, uint32_t>>());
+                if (m_heap.size() > m_amount) {
+                    std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<std::pair<float, uint32_t>>());
+                    m_heap.pop_back();
+                }
+            }
+
+            // returns selected rows in descending order of scores
+            inline const std::vector<std::pair<float, uint32_t>> &sorted() {
+                std::sort_heap(m_heap.begin(), m_heap.end(), std::greater<std::pair<float, uint32_t>>());
+                return m_heap;
+            }
+    };
+
+    // approximate nearest neighbours index of model rows, nodes are row IDs and similarity of rows is their dot
+    // product. Rows are passed by the model on every call. Arrays of a loaded index view the mapped index file, they
+    // are copied on the first modification. Search is thread safe, modifications are not
+    class ann_index_t {
+        protected:
+            // fingerprint of the model the index file was saved with, 0 - the index is built
+            uint64_t m_fingerprint = 0;
+
+        public:
+            virtual ~ann_index_t() = default;
+
+            // maps index file of any kind, throws std::runtime_error on wrong format
+            static std::shared_ptr<ann_index_t> load(const std::string &_indexFile);
+
+            virtual std::size_t nodes() const noexcept = 0;
+            virtual uint16_t vectorSize() const noexcept = 0;
+            // candidates list size of graph search, number of probed lists of inverted file search
+            virtual void breadth(uint16_t _breadth) noexcept = 0;
+            // copy modified by a copy of the model
+            virtual std::shared_ptr<ann_index_t> clone() const = 0;
+
+            // indexes rows [nodes(), _rows) of the matrix by several threads
+            virtual void add(const float *_matrix, std::size_t _rows, uint16_t _threads) = 0;
+            // reindexes the modified row
+            virtual void update(const float *_matrix, std::size_t _id) = 0;
+            // removes the node, the last node takes its ID like the last row of the model does
+            virtual void remove(const float *_matrix, std::size_t _id) = 0;
+            // returns found nodes in descending order of dot products, at least _amount of them if possible
+            virtual void search(const float *_matrix, const float *_vector, std::size_t _amount,
+                                std::vector<std::pair<float, uint32_t>> &_found) const = 0;
+            // _fingerprint identifies the model rows are taken from, throws std::runtime_error on failure
+            virtual void save(const std::string &_indexFile, uint64_t _fingerprint) const = 0;
+
+            inline uint64_t fingerprint() const noexcept {return m_fingerprint;}
+    };
+
+    // hierarchical navigable small world graph. Bottom level links of a node take a fixed size block (links count
+    // and 2 * m IDs), blocks of m upper level links of a node follow each other in the upper links pool
+    class hnsw_index_t final: public ann_index_t {
+        public:
+            static const char magic[8];
+            static const uint8_t maxLevel = 16;
+
+        private:
+            struct visited_t;
+
+            uint16_t m_vec_sz = 0;
+            uint16_t m_m = 0;
+            uint16_t m_ef_construction = 0;
+            uint16_t m_ef = 0;
+            std::size_t m_nodes = 0;
+            std::size_t m_entry = 0;
+            uint8_t m_max_level = 0;
+            // nodes * (2 * m + 1)
+            array_t<uint32_t> m_links;
+            array_t<uint8_t> m_levels;
+            // offset of the first upper level block of a node in the pool
+            array_t<uint64_t> m_upper;
+            array_t<uint32_t> m_upper_links;
+            std::shared_ptr<file_mapper_t> m_mapping;
+            // nodes share striped locks of parallel insertion
+            std::unique_ptr<std::mutex[]> m_locks;
+            std::mutex m_entry_lock;
+            // visited marks of searches are reused, their size is the number of nodes
+            mutable std::mutex m_pool_lock;
+            mutable std::vector<std::unique_ptr<visited_t>> m_pool;
+
+            uint8_t randomLevel(std::size_t _id) const noexcept;
+            inline uint32_t *links(std::size_t _id, uint8_t _level) noexcept {
+                return (_level == 0) ? m_links.owned().data() + _id * (2 * m_m + 1)
+                                     : m_upper_links.owned().data() + m_upper[_id] + (_level - 1) * (m_m + 1);
+            }
+            inline const uint32_t *links(std::size_t _id, uint8_t _level) const noexcept {
+                return (_level == 0) ? m_links.data() + _id * (2 * m_m + 1)
+                                     : m_upper_links.data() + m_upper[_id] + (_level - 1) * (m_m + 1);
+            }
+            void neighbours(std::size_t _id, uint8_t _level, bool _locked, std::vector<uint32_t> &_neighbours) const;
+            void greedy(const float *_matrix, const float *_vector, std::size_t &_current, float &_currentDot,
+                        uint8_t _level, bool _locked) const;
+            void searchLevel(const float *_matrix, const float *_vector, std::size_t _entry, std::size_t _ef,
+                             uint8_t _level, bool _locked, std::size_t _exclude,
+                             std::vector<std::pair<float, uint32_t>> &_found) const;
+            void select(const float *_matrix, std::vector<std::pair<float, uint32_t>> &_candidates,
+                        std::size_t _amount) const;
+            void connect(const float *_matrix, std::size_t _id, uint8_t _level, bool _locked,
+                         const std::vector<std::pair<float, uint32_t>> &_candidates);
+            void link(const float *_matrix, std::size_t _id, bool _locked);
+
+        public:
+            // empty index, throws std::runtime_error on wrong settings
+            hnsw_index_t(uint16_t _vectorSize, const hnsw_setting_t &_hnswSettings);
+            // views mapped index file, throws std::runtime_error on wrong format
+            explicit hnsw_index_t(const std::shared_ptr<file_mapper_t> &_mapping);
+            // copies nodes and links, mapped arrays are shared
+            hnsw_index_t(const hnsw_index_t &_index);
+            ~hnsw_index_t() override;
+
+            void operator=(const hnsw_index_t &) = delete;
+
+            inline std::size_t nodes() const noexcept override {return m_nodes;}
+            inline uint16_t vectorSize() const noexcept override {return m_vec_sz;}
+            inline uint16_t ef() const noexcept {return m_ef;}
+            inline void breadth(uint16_t _breadth) noexcept override {m_ef = _breadth;}
+            std::shared_ptr<ann_index_t> clone() const override;
+
+            // links new nodes by several threads
+            void add(const float *_matrix, std::size_t _rows, uint16_t _threads) override;
+            // relinks node of the modified row, its old links from other nodes are kept
+            void update(const float *_matrix, std::size_t _id) override;
+            // links of all nodes are scanned, nodes linked to the removed one are linked to its best neighbour
+            void remove(const float *_matrix, std::size_t _id) override;
+            // returns up to max(ef, _amount) nodes
+            void search(const float *_matrix, const float *_vector, std::size_t _amount,
+                        std::vector<std::pair<float, uint32_t>> &_found) const override;
+            void save(const std::string &_indexFile, uint64_t _fingerprint) const override;
+    };
+
+    // inverted file index: rows are assigned to the nearest of k-means centroids, each list keeps IDs and fp32 rows
+    // (or product quantization codes of residuals to the centroid) of its rows contiguously. Search scans the lists
+    // of the nprobe nearest centroids
+    class ivf_index_t final: public ann_index_t {
+        public:
+            static const char magic[8];
+
+        private:
+            struct list_t {
+                array_t<uint32_t> ids;
+                array_t<float> rows;
+                array_t<uint8_t> codes;
+            };
+
+            uint16_t m_vec_sz = 0;
+            ivf_setting_t m_ivf_settings;
+            std::size_t m_nodes = 0;
+            // lists * vector size
+            array_t<float> m_centroids;
+            // halves of squared centroid norms, x.c - |c|^2 / 2 selects the nearest centroid
+            array_t<float> m_half_norms;
+            std::vector<list_t> m_lists;
+            // list of each node
+            array_t<uint32_t> m_node_lists;
+            std::shared_ptr<pq_codec_t> m_pq;
+            std::shared_ptr<file_mapper_t> m_mapping;
+
+            void train(const float *_matrix, std::size_t _rows, uint16_t _threads);
+            // list of the nearest centroid, _dots keeps dot products of the vector and all centroids
+            std::size_t nearestList(const float *_vector, std::vector<float> &_dots) const;
+            void residual(const float *_row, std::size_t _list, float *_residual) const noexcept;
+            void append(std::size_t _list, std::size_t _id, const float *_row, const uint8_t *_code);
+            // removes the node from its list, the last node of the list takes its place
+            void unlist(std::size_t _id);
+
+        public:
+            // empty index, centroids are trained by the first add(). Throws std::runtime_error on wrong settings
+            ivf_index_t(uint16_t _vectorSize, const ivf_setting_t &_ivfSettings);
+            // views mapped index file, throws std::runtime_error on wrong format
+            explicit ivf_index_t(const std::shared_ptr<file_mapper_t> &_mapping);
+
+            inline std::size_t nodes() const noexcept override {return m_nodes;}
+            inline uint16_t vectorSize() const noexcept override {return m_vec_sz;}
+            inline std::size_t lists() const noexcept {return m_lists.size();}
+            inline void breadth(uint16_t _breadth) noexcept override {m_ivf_settings.nprobe = _breadth;}
+            std::shared_ptr<ann_index_t> clone() const override;
+
+            // trains centroids of an empty index, rows are assigned and encoded by several threads
+            void add(const float *_matrix, std::size_t _rows, uint16_t _threads) override;
+            // moves the row to the list of its nearest centroid
+            void update(const float *_matrix, std::size_t _id) override;
+            void remove(const float *_matrix, std::size_t _id) override;
+            void search(const float *_matrix, const float *_vector, std::size_t _amount,
+                        std::vector<std::pair<float, uint32_t>> &_found) const override;
+            void save(const std::string &_indexFile, uint64_t _fingerprint) const override;
+    };
+
+    // random hyperplane (SimHash) binary codes of rows. Search scans the codes by Hamming distance and re-ranks the
+    // candidates of the least distances by their dot products, so it is a cheap first stage of near-duplicates
+    // detection
+    class simhash_index_t final: public ann_index_t {
+        public:
+            static const char magic[8];
+
+        private:
+            uint16_t m_vec_sz = 0;
+            uint16_t m_bits = 0;
+            uint16_t m_words = 0;
+            uint16_t m_rerank = 0;
+            uint16_t m_max_hamming = 0;
+            std::size_t m_nodes = 0;
+            // bits * vector size hyperplane normals
+            array_t<float> m_planes;
+            // nodes * words
+            array_t<uint64_t> m_codes;
+            std::shared_ptr<file_mapper_t> m_mapping;
+
+            void encode(const float *_vector, uint64_t *_code) const noexcept;
+
+        public:
+            // empty index with random hyperplanes, throws std::runtime_error on wrong settings
+            simhash_index_t(uint16_t _vectorSize, const simhash_setting_t &_simhashSettings);
+            // views mapped index file, throws std::runtime_error on wrong format
+            explicit simhash_index_t(const std::shared_ptr<file_mapper_t> &_mapping);
+
+            inline std::size_t nodes() const noexcept override {return m_nodes;}
+            inline uint16_t vectorSize() const noexcept override {return m_vec_sz;}
+            inline void breadth(uint16_t _breadth) noexcept override {m_rerank = _breadth;}
+            std::shared_ptr<ann_index_t> clone() const override;
+
+            // rows are encoded by several threads
+            void add(const float *_matrix, std::size_t _rows, uint16_t _threads) override;
+            void update(const float *_matrix, std::size_t _id) override;
+            void remove(const float *_matrix, std::size_t _id) override;
+            // returns up to rerank * _amount nodes
+            void search(const float *_matrix, const float *_vector, std::size_t _amount,
+                        std::vector<std::pair<float, uint32_t>> &_found) const override;
+            void save(const std::string &_indexFile, uint64_t _fingerprint) const override;
+    };
+
+    // keys of model rows, hash functions are stable, so hash indexes can be stored in model files
+    template <class key_t>
+        class key_table_t;
+
+    // words are stored in a single chars array, word i occupies chars [offsets[i], offsets[i + 1])
+    template <>
+        class key_table_t<std::string> {
+            private:
+                array_t<uint64_t> m_offsets;
+                array_t<char> m_chars;
+
+            public:
+                key_table_t(): m_offsets(), m_chars() {}
+
+                inline std::size_t size() const noexcept {
+                    return m_offsets.empty() ? 0 : m_offsets.size() - 1;
+                }
+
+                inline std::string key(std::size_t _id) const {
+                    return std::string(m_chars.data() + m_offsets[_id],
+                                       static_cast<std::size_t>(m_offsets[_id + 1] - m_offsets[_id]));
+                }
+
+                inline bool equals(std::size_t _id, const std::string &_key) const noexcept {
+                    auto length = static_cast<std::size_t>(m_offsets[_id + 1] - m_offsets[_id]);
+                    return (length == _key.length())
+                           && (std::char_traits<char>::compare(m_chars.data() + m_offsets[_id], _key.data(),
+                                                               length) == 0);
+                }
+
+                // FNV-1a
+                static inline uint64_t hash(const std::string &_key) noexcept {
+                    uint64_t ret = 14695981039346656037ULL;
+                    for (auto const &i:_key) {
+                        ret ^= static_cast<unsigned char>(i);
+                        ret *= 1099511628211ULL;
+                    }
+
+                    return ret;
+                }
+
+                void reserve(std::size_t _size) {
+                    m_offsets.owned().reserve(_size + 1);
+                }
+
+                void push_back(const std::string &_key) {
+                    auto &offsets = m_offsets.owned();
+                    auto &chars = m_chars.owned();
+                    if (offsets.empty()) {
+                        offsets.push_back(0);
+                    }
+                    chars.insert(chars.end(), _key.begin(), _key.end());
+                    offsets.push_back(chars.size());
+                }
+
+                void clear() {
+                    m_offsets.clear();
+                    m_chars.clear();
+                }
+
+                void view(const uint64_t *_offsets, std::size_t _size, const char *_chars, std::size_t _charsSize) {
+                    m_offsets.view(_offsets, _size + 1);
+                    m_chars.view(_chars, _charsSize);
+                }
+
+                inline const array_t<uint64_t> &offsets() const noexcept {return m_offsets;}
+                inline const array_t<char> &chars() const noexcept {return m_chars;}
+        };
+
+    template <>
+        class key_table_t<std::size_t> {
+            private:
+                array_t<std::size_t> m_keys;
+
+            public:
+                key_table_t(): m_keys() {}
+
+                inline std::size_t size() const noexcept {return m_keys.size();}
+                inline std::size_t key(std::size_t _id) const noexcept {return m_keys[_id];}
+                inline bool equals(std::size_t _id, std::size_t _key) const noexcept {return m_keys[_id] == _key;}
+
+                // splitmix64 finalizer
+                static inline uint64_t hash(std::size_t _key) noexcept {
+                    uint64_t ret = _key;
+                    ret = (ret ^ (ret >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                    ret = (ret ^ (ret >> 27)) * 0x94d049bb133111ebULL;
+
+                    return ret ^ (ret >> 31);
+                }
+
+                void reserve(std::size_t _size) {m_keys.owned().reserve(_size);}
+                void push_back(std::size_t _key) {m_keys.owned().push_back(_key);}
+                void set(std::size_t _id, std::size_t _key) {m_keys.owned()[_id] = _key;}
+                void pop_back() {m_keys.owned().pop_back();}
+                void clear() {m_keys.clear();}
+        };
+
+    // vectors of a model are rows of a single aligned row-major matrix, row IDs are indexes of the keys table.
+    // Arrays are owned by the model or point to a mapped model file shared by all copies of the model
     template <class key_t>
         class model_t {
+            public:
+                // ID of missing keys
+                static const std::size_t npos = static_cast<std::size_t>(-1);
+
             protected:
-                using map_t = std::unordered_map<key_t, vector_t>;
+                static const uint32_t emptySlot = UINT32_MAX;
 
-                map_t m_map;
+                array_t<float> m_matrix;
+                key_table_t<key_t> m_keys;
+                // open addressing (linear probing) hash index of row IDs, keys are stored once in the keys table
+                array_t<uint32_t> m_index;
+                std::shared_ptr<file_mapper_t> m_mapping;
+                // rows of lazily loaded models, shared by copies of the model
+                std::shared_ptr<lazy_rows_t> m_lazy_rows;
+                // quantized copy of rows scanned by nearest()
+                storage_t m_storage = storage_t::fp32;
+                array_t<uint16_t> m_half_rows;
+                array_t<int8_t> m_byte_rows;
+                array_t<float> m_row_scales;
+                std::shared_ptr<const pq_codec_t> m_pq;
+                uint16_t m_rerank = 0;
+                // index searched by nearest(), shared by copies of the model until one of them modifies it
+                std::shared_ptr<ann_index_t> m_ann;
                 uint16_t m_vec_sz = 0;
-                std::size_t m_map_sz = 0;
                 mutable std::string m_err_msg;
 
                 const std::string wrong_format_err = "model: wrong model file format";
 
+                void clear() {
+                    m_matrix.clear();
+                    m_keys.clear();
+                    m_index.clear();
+                    m_mapping.reset();
+                    m_lazy_rows.reset();
+                    dropQuantized();
+                    m_rerank = 0;
+                    m_ann.reset();
+                }
+
+                // rows count and keys in the rows order, identifies the model an index file is saved with
+                uint64_t fingerprint() const {
+                    uint64_t ret = 14695981039346656037ULL ^ m_keys.size();
+                    for (std::size_t i = 0; i < m_keys.size(); ++i) {
+                        ret = (ret ^ key_table_t<key_t>::hash(m_keys.key(i))) * 1099511628211ULL;
+                    }
+
+                    return ret;
+                }
+
+                inline ann_index_t &uniqueIndex() {
+                    if (m_ann.use_count() > 1) {
+                        m_ann = m_ann->clone();
+                    }
+
+                    return *m_ann;
+                }
+
+                // indexes appended rows and reindexes the updated ones
+                void indexRows(const std::vector<std::size_t> &_updated) {
+                    if (!m_ann) {
+                        return;
+                    }
+                    auto &graph = uniqueIndex();
+                    auto matrix = this->matrix();
+                    for (auto const &i:_updated) {
+                        if (i < graph.nodes()) {
+                            graph.update(matrix, i);
+                        }
+                    }
+                    graph.add(matrix, m_keys.size(), 0);
+                }
+
+                // quantized rows are allocated here and set by quantizeRow(), so they can be converted while loading
+                void allocQuantized(storage_t _storage, std::size_t _rows) {
+                    dropQuantized();
+                    if (_storage == storage_t::fp16) {
+                        m_half_rows.owned().resize(_rows * m_vec_sz);
+                    } else if (_storage == storage_t::int8) {
+                        m_byte_rows.owned().resize(_rows * m_vec_sz);
+                        m_row_scales.owned().resize(_rows);
+                    }
+                    m_storage = _storage;
+                }
+
+                // rows may be quantized by several threads
+                void quantizeRow(std::size_t _id, const float *_row) {
+                    if (m_storage == storage_t::fp16) {
+                        floatToHalf(_row, m_half_rows.owned().data() + _id * m_vec_sz, m_vec_sz);
+                    } else if (m_storage == storage_t::int8) {
+                        m_row_scales.owned()[_id] = floatToInt8(_row, m_byte_rows.owned().data() + _id * m_vec_sz,
+                                                                m_vec_sz);
+                    }
+                }
+
+                // modified rows invalidate quantized copy
+                void dropQuantized() {
+                    m_storage = storage_t::fp32;
+                    m_half_rows.clear();
+                    m_byte_rows.clear();
+                    m_row_scales.clear();
+                    m_pq.reset();
+                }
+
+                void reserve(std::size_t _rows) {
+                    if (!m_lazy_rows) {
+                        m_matrix.owned().reserve(_rows * m_vec_sz);
+                    }
+                    m_keys.reserve(_rows);
+                    rehash(_rows);
+                }
+
+                // returns row ID of the key, zeroed row is appended for a new key, rows of lazily loaded model are
+                // preallocated
+                std::size_t insert(const key_t &_key) {
+                    auto ret = id(_key);
+                    if (ret == npos) {
+                        if (m_storage != storage_t::fp32) {
+                            dropQuantized();
+                        }
+                        if (m_keys.size() >= emptySlot) {
+                            throw std::runtime_error("model: too many vectors");
+                        }
+                        ret = m_keys.size();
+                        m_keys.push_back(_key);
+                        if (!m_lazy_rows) {
+                            auto &matrix = m_matrix.owned();
+                            matrix.resize(matrix.size() + m_vec_sz, 0.0f);
+                        }
+                        if (m_keys.size() * 2 > m_index.size()) {
+                            rehash(m_keys.size());
+                        } else {
+                            auto i = slot(_key);
+                            m_index.owned()[i] = static_cast<uint32_t>(ret);
+                        }
+                    }
+
+                    return ret;
+                }
+
+                // returns row of the key, zeroed row is appended for a new key
+                float *row(const key_t &_key) {
+                    auto ret = insert(_key);
+                    if (m_storage != storage_t::fp32) {
+                        dropQuantized();
+                    }
+
+                    return m_matrix.owned().data() + ret * m_vec_sz;
+                }
+
+                // removes row of the key, the last row takes its place
+                void remove(const key_t &_key) {
+                    auto rowId = id(_key);
+                    if (rowId == npos) {
+                        return;
+                    }
+                    if (m_storage != storage_t::fp32) {
+                        dropQuantized();
+                    }
+                    if (m_ann) {
+                        uniqueIndex().remove(this->matrix(), rowId);
+                    }
+                    removeSlot(slot(_key));
+                    auto last = m_keys.size() - 1;
+                    auto &matrix = m_matrix.owned();
+                    if (rowId != last) {
+                        auto i = slot(m_keys.key(last));
+                        m_index.owned()[i] = static_cast<uint32_t>(rowId);
+                        m_keys.set(rowId, m_keys.key(last));
+                        std::copy(matrix.begin() + last * m_vec_sz, matrix.end(), matrix.begin() + rowId * m_vec_sz);
+                    }
+                    m_keys.pop_back();
+                    matrix.resize(last * m_vec_sz);
+                }
+
             private:
-                struct nearest_cmp_t final {
-                    inline bool operator()(const std::pair<key_t, float> &_left,
-                            const std::pair<key_t, float> &_right) const noexcept {
+                bool buildIndex(const std::function<std::shared_ptr<ann_index_t>()> &_index,
+                                uint16_t _threads) noexcept {
+                    try {
+                        auto index = _index();
+                        index->add(this->matrix(), m_keys.size(), _threads);
+                        m_ann = index;
+
+                        return true;
+                    } catch (const std::exception &_e) {
+                        m_err_msg = _e.what();
+                    } catch (...) {
+                        m_err_msg = "model: unknown error";
+                    }
+
+                    return false;
+                }
+
+                // index candidates are filtered like rows of the exact search
+                void nearestIndexed(const vector_view_t &_vec,
+                        std::vector<std::pair<key_t, float>> &_nearest,
+                        std::size_t _amount,
+                        float _minDistance) const noexcept {
+                    auto selfLevel = 0.9999f * 0.9999f * m_vec_sz;
+                    auto minLevel = (_minDistance > 0.0f) ? _minDistance * _minDistance * m_vec_sz : 0.0f;
+                    std::vector<std::pair<float, uint32_t>> found;
+                    // the query itself may take one of the found nodes
+                    m_ann->search(this->matrix(), _vec.data(), _amount + 1, found);
+                    for (auto const &i:found) {
+                        if (_nearest.size() == _amount) {
+                            break;
+                        }
+                        if ((i.first > 0.0f) && (i.first >= minLevel) && (i.first <= selfLevel)) {
+                            _nearest.emplace_back(m_keys.key(i.second), std::sqrt(i.first / m_vec_sz));
+                        }
+                    }
+                }
+
+                // candidates are selected by distances of quantized rows, re-ranked candidates are filtered by
+                // their exact distances
+                void nearestQuantized(const vector_view_t &_vec,
+                        std::vector<std::pair<key_t, float>> &_nearest,
+                        std::size_t _amount,
+                        float _minDistance) const noexcept {
+                    // the query itself may take one of re-ranked candidates
+                    auto candidates = (m_rerank > 0) ? _amount * m_rerank + 1 : _amount;
+                    nearest_rows_t nearestRows(candidates);
+
+                    std::vector<int8_t> byteVec;
+                    float vecScale = 0.0f;
+                    std::vector<float> table;
+                    if (m_storage == storage_t::int8) {
+                        byteVec.resize(m_vec_sz);
+                        vecScale = floatToInt8(_vec.data(), byteVec.data(), m_vec_sz);
+                    } else if (m_storage == storage_t::pq) {
+                        table.resize(m_pq->subspaces() * pq_codec_t::centroids);
+                        m_pq->lookup(_vec.data(), table.data());
+                    }
+                    float entryLevel = 0.0f;
+                    auto rows = m_keys.size();
+                    for (std::size_t i = 0; i < rows; ++i) {
+                        float dot = 0.0f;
+                        if (m_storage == storage_t::int8) {
+                            dot = static_cast<float>(dotInt8(m_byte_rows.data() + i * m_vec_sz, byteVec.data(),
+                                                             m_vec_sz)) * m_row_scales[i] * vecScale;
+                        } else if (m_storage == storage_t::pq) {
+                            dot = m_pq->dot(i, table.data());
+                        } else {
+                            dot = dotHalf(m_half_rows.data() + i * m_vec_sz, _vec.data(), m_vec_sz);
+                        }
+                        auto match = (dot > 0.0f) ? std::sqrt(dot / m_vec_sz) : 0.0f;
+                        if ((m_rerank == 0) && ((match > 0.9999f) || (match < _minDistance))) {
+                            continue;
+                        }
+                        if (match > entryLevel) {
+                            nearestRows.push(match, i);
+                            entryLevel = nearestRows.entryLevel();
+                        }
+                    }
+
+                    auto const &selected = nearestRows.sorted();
+                    std::vector<std::pair<std::size_t, float>> found;
+                    found.reserve(selected.size());
+                    for (auto const &i:selected) {
+                        auto match = i.first;
+                        if (m_rerank > 0) {
+                            match = distance(_vec, vectorAt(i.second));
+                            if ((match > 0.9999f) || (match < _minDistance)) {
+                                continue;
+                            }
+                        }
+                        found.emplace_back(i.second, match);
+                    }
+                    std::sort(found.begin(), found.end(), [](const std::pair<std::size_t, float> &_left,
+                                                            const std::pair<std::size_t, float> &_right) {
                         return _left.second > _right.second;
+                    });
+                    found.resize(std::min(found.size(), _amount));
+                    for (auto const &i:found) {
+                        _nearest.emplace_back(m_keys.key(i.first), i.second);
+                    }
+                }
+
+                // returns slot of the key or the empty slot where it has to be inserted
+                inline std::size_t slot(const key_t &_key) const noexcept {
+                    auto index = m_index.data();
+                    auto mask = m_index.size() - 1;
+                    auto i = static_cast<std::size_t>(key_table_t<key_t>::hash(_key)) & mask;
+                    while ((index[i] != emptySlot) && !m_keys.equals(index[i], _key)) {
+                        i = (i + 1) & mask;
+                    }
+
+                    return i;
+                }
+
+                void rehash(std::size_t _rows) {
+                    std::size_t size = 16;
+                    while (size < _rows * 2) {
+                        size <<= 1;
+                    }
+                    m_index.owned().assign(size, emptySlot);
+                    for (std::size_t i = 0; i < m_keys.size(); ++i) {
+                        auto j = slot(m_keys.key(i));
+                        m_index.owned()[j] = static_cast<uint32_t>(i);
+                    }
+                }
+
+                // backward shift deletion keeps probe sequences unbroken
+                void removeSlot(std::size_t _slot) {
+                    auto &index = m_index.owned();
+                    auto mask = index.size() - 1;
+                    auto i = _slot;
+                    auto j = _slot;
+                    while (true) {
+                        j = (j + 1) & mask;
+                        if (index[j] == emptySlot) {
+                            break;
+                        }
+                        auto k = static_cast<std::size_t>(key_table_t<key_t>::hash(m_keys.key(index[j]))) & mask;
+                        if ((j > i) ? ((k <= i) || (k > j)) : ((k <= i) && (k > j))) {
+                            index[i] = index[j];
+                            i = j;
+                        }
                     }
-                };
+                    index[i] = emptySlot;
+                }
 
             public:
-                model_t(): m_map(), m_err_msg() {}
+                model_t(): m_matrix(), m_keys(), m_index(), m_mapping(), m_lazy_rows(), m_err_msg() {}
                 virtual ~model_t() = default;
 
-                const map_t &map() {return m_map;}
-
                 virtual bool save(const std::string &_model_file) const noexcept = 0;
                 virtual bool load(const std::string &_model_file) noexcept = 0;
 
-                inline const vector_t *vector(const key_t &_key) const noexcept {
-                    auto const &i = m_map.find(_key);
-                    if (i != m_map.end()) {
-                        return &i->second;
+                // returns row ID of the key or npos
+                inline std::size_t id(const key_t &_key) const noexcept {
+                    if (m_index.empty()) {
+                        return npos;
+                    }
+                    auto ret = m_index[slot(_key)];
+
+                    // the index of a truncated mapped model refers to rows beyond the model size
+                    return ((ret != emptySlot) && (ret < m_keys.size())) ? ret : npos;
+                }
+
+                inline key_t key(std::size_t _id) const {return m_keys.key(_id);}
+
+                // returns view of the row, the view is empty for a wrong ID. Row IDs are not stable, removal of a key
+                // moves the last row to its place
+                inline vector_view_t vectorAt(std::size_t _id) const noexcept {
+                    if (_id >= m_keys.size()) {
+                        return vector_view_t();
+                    }
+                    if (m_lazy_rows) {
+                        return vector_view_t(m_lazy_rows->row(_id), m_vec_sz);
+                    }
+
+                    return vector_view_t(m_matrix.data() + _id * m_vec_sz, m_vec_sz);
+                }
+
+                // all rows of lazily loaded models are filled by the first call
+                inline const float *matrix() const noexcept {
+                    return m_lazy_rows ? m_lazy_rows->data() : m_matrix.data();
+                }
+
+                // true if the model arrays point to a mapped model file
+                inline bool mapped() const noexcept {return m_mapping != nullptr;}
+
+                inline storage_t storage() const noexcept {return m_storage;}
+
+                // builds quantized copy of rows scanned by nearest(), fp32 storage drops the copy. _rerank > 0 -
+                // _rerank * amount nearest candidates are re-ranked by fp32 rows
+                bool quantize(storage_t _storage, uint16_t _rerank = 0) noexcept {
+                    if (_storage == storage_t::pq) {
+                        return quantize(pq_setting_t(), _rerank);
+                    }
+                    try {
+                        allocQuantized(_storage, m_keys.size());
+                        for (std::size_t i = 0; i < m_keys.size(); ++i) {
+                            quantizeRow(i, vectorAt(i).data());
+                        }
+                        m_rerank = _rerank;
+
+                        return true;
+                    } catch (const std::exception &_e) {
+                        dropQuantized();
+                        m_err_msg = _e.what();
+                    } catch (...) {
+                        dropQuantized();
+                        m_err_msg = "model: unknown error";
+                    }
+
+                    return false;
+                }
+
+                // re-ranking of quantized search candidates, see quantize()
+                inline void quantizedRerank(uint16_t _rerank) noexcept {m_rerank = _rerank;}
+
+                // memory of the quantized copy of rows: rows, scales, pq codes, codebooks and rotation
+                std::size_t quantizedBytes() const noexcept {
+                    if (m_storage == storage_t::pq) {
+                        return m_pq->codes().size() + (m_pq->codebooks().size() + m_pq->rotation().size())
+                                                      * sizeof(float);
+                    }
+
+                    return m_half_rows.size() * sizeof(uint16_t) + m_byte_rows.size()
+                           + m_row_scales.size() * sizeof(float);
+                }
+
+                // builds product quantization codes of rows scanned by nearest(), see quantize()
+                bool quantize(const pq_setting_t &_pqSettings, uint16_t _rerank = 0) noexcept {
+                    try {
+                        dropQuantized();
+                        m_pq = std::make_shared<pq_codec_t>(m_keys.size(), m_vec_sz,
+                                                            [this](std::size_t _id, float *_row) {
+                            auto row = vectorAt(_id);
+                            std::copy(row.begin(), row.end(), _row);
+                        }, _pqSettings);
+                        m_storage = storage_t::pq;
+                        m_rerank = _rerank;
+
+                        return true;
+                    } catch (const std::exception &_e) {
+                        dropQuantized();
+                        m_err_msg = _e.what();
+                    } catch (...) {
+                        dropQuantized();
+                        m_err_msg = "model: unknown error";
+                    }
+
+                    return false;
+                }
+
+                // builds HNSW graph index of rows by several threads, nearest() searches the index then. The index
+                // follows modifications of the model, loading or training drops it
+                bool buildIndex(const hnsw_setting_t &_hnswSettings = hnsw_setting_t()) noexcept {
+                    return buildIndex([this, &_hnswSettings]() {
+                        return std::make_shared<hnsw_index_t>(m_vec_sz, _hnswSettings);
+                    }, _hnswSettings.threads);
+                }
+
+                // builds inverted file index of rows, see buildIndex()
+                bool buildIndex(const ivf_setting_t &_ivfSettings) noexcept {
+                    return buildIndex([this, &_ivfSettings]() {
+                        return std::make_shared<ivf_index_t>(m_vec_sz, _ivfSettings);
+                    }, _ivfSettings.threads);
+                }
+
+                // builds binary codes index of rows, see buildIndex()
+                bool buildIndex(const simhash_setting_t &_simhashSettings) noexcept {
+                    return buildIndex([this, &_simhashSettings]() {
+                        return std::make_shared<simhash_index_t>(m_vec_sz, _simhashSettings);
+                    }, _simhashSettings.threads);
+                }
+
+                // saves the index, it is loaded with the same model only
+                bool saveIndex(const std::string &_indexFile) const noexcept {
+                    try {
+                        if (!m_ann) {
+                            throw std::runtime_error("model: no index to save");
+                        }
+                        m_ann->save(_indexFile, fingerprint());
+
+                        return true;
+                    } catch (const std::exception &_e) {
+                        m_err_msg = _e.what();
+                    } catch (...) {
+                        m_err_msg = "model: unknown error";
+                    }
+
+                    return false;
+                }
+
+                // maps index file of any kind saved with this model, arrays are copied by the first modification of
+                // the model
+                bool loadIndex(const std::string &_indexFile) noexcept {
+                    try {
+                        auto index = ann_index_t::load(_indexFile);
+                        if ((index->nodes() != m_keys.size()) || (index->vectorSize() != m_vec_sz)
+                            || (index->fingerprint() != fingerprint())) {
+                            throw std::runtime_error("model: index does not match the model");
+                        }
+                        m_ann = index;
+
+                        return true;
+                    } catch (const std::exception &_e) {
+                        m_err_msg = _e.what();
+                    } catch (...) {
+                        m_err_msg = "model: unknown error";
                     }
 
-                    return nullptr;
+                    return false;
+                }
+
+                inline void dropIndex() noexcept {m_ann.reset();}
+
+                inline bool indexed() const noexcept {return m_ann != nullptr;}
+
+                // ef of HNSW search, nprobe of inverted file search, rerank of binary codes search
+                inline void indexBreadth(uint16_t _breadth) {
+                    if (m_ann) {
+                        uniqueIndex().breadth(_breadth);
+                    }
                 }
 
-                inline float distance(const vector_t &_what, const vector_t &_with) const noexcept {
+                inline float distance(const vector_view_t &_what, const vector_view_t &_with) const noexcept {
                     assert(m_vec_sz == _what.size());
                     assert(m_vec_sz == _with.size());
 
-                    float ret = 0.0f;
-                    for (uint16_t i = 0; i < m_vec_sz; ++i) {
-                        ret += _what[i] * _with[i];
-                    }
+                    auto ret = dotFloat(_what.data(), _with.data(), m_vec_sz);
                     if (ret > 0.0f) {
                         return  std::sqrt(ret / m_vec_sz);
                     }
                     return 0.0f;
                 }
 
-                inline void nearest(const vector_t &_vec,
+                inline void nearest(const vector_view_t &_vec,
                         std::vector<std::pair<key_t, float>> &_nearest,
                         std::size_t _amount,
                         float _minDistance = 0.0f) const noexcept {
                     assert(m_vec_sz == _vec.size());
 
                     _nearest.clear();
+                    if (m_ann) {
+                        nearestIndexed(_vec, _nearest, _amount, _minDistance);
+                        return;
+                    }
+                    if (m_storage != storage_t::fp32) {
+                        nearestQuantized(_vec, _nearest, _amount, _minDistance);
+                        return;
+                    }
 
-                    std::priority_queue<std::pair<key_t, float>,
-                        std::vector<std::pair<key_t, float>>,
-                        nearest_cmp_t> nearestVecs;
-
-                    float entryLevel = 0.0f;
-                    for (auto const &i:m_map) {
-                        auto match = distance(_vec, i.second);
-                        if ((match > 0.9999f) || (match < _minDistance)) {
-                            continue;
-                        }
-                        if (match > entryLevel) {
-                            nearestVecs.emplace(std::pair<key_t, float>(i.first, match));
-                            if (nearestVecs.size() > _amount) {
-                                nearestVecs.pop();
-                                entryLevel = nearestVecs.top().second;
+                    // distance() is a monotonic function of the dot product, so rows are compared by dot products and
+                    // distances are computed for the found rows only
+                    const std::size_t blockRows = 256;
+                    float dots[blockRows];
+                    auto selfLevel = 0.9999f * 0.9999f * m_vec_sz;
+                    auto minLevel = (_minDistance > 0.0f) ? _minDistance * _minDistance * m_vec_sz : 0.0f;
+                    nearest_rows_t nearestRows(_amount);
+                    auto entryLevel = std::max(nearestRows.entryLevel(), std::nextafter(minLevel, 0.0f));
+                    auto matrix = this->matrix();
+                    auto rows = m_keys.size();
+                    for (std::size_t block = 0; block < rows; block += blockRows) {
+                        auto count = std::min(blockRows, rows - block);
+                        dotRows(matrix + block * m_vec_sz, count, _vec.data(), m_vec_sz, dots);
+                        for (std::size_t i = 0; i < count; ++i) {
+                            if ((dots[i] > entryLevel) && (dots[i] <= selfLevel)) {
+                                nearestRows.push(dots[i], block + i);
+                                entryLevel = std::max(nearestRows.entryLevel(), entryLevel);
                             }
                         }
                     }
 
-                    auto nSize = nearestVecs.size();
-                    _nearest.resize(nSize);
-                    for (auto j = nSize; j > 0; --j) {
-                        _nearest[j - 1] = nearestVecs.top();
-                        nearestVecs.pop();
+                    auto const &selected = nearestRows.sorted();
+                    _nearest.reserve(selected.size());
+                    for (auto const &i:selected) {
+                        _nearest.emplace_back(m_keys.key(i.second), std::sqrt(i.first / m_vec_sz));
                     }
                 }
 
 
                 inline uint16_t vectorSize() const noexcept {return m_vec_sz;}
 
-                inline std::size_t modelSize() const noexcept {return m_map_sz;}
+                inline std::size_t modelSize() const noexcept {return m_keys.size();}
 
                 inline std::string errMsg() const noexcept {return m_err_msg;}
         };
 
+    template <class key_t>
+        const std::size_t model_t<key_t>::npos;
+
+    template <class key_t>
+        const uint32_t model_t<key_t>::emptySlot;
+
     class w2vModel_t: public model_t<std::string> {
+        private:
+            // hashed character n-grams vectors, used to build vectors of out of vocabulary words
+            uint32_t m_ngram_buckets = 0;
+            uint8_t m_min_ngram = 0;
+            uint8_t m_max_ngram = 0;
+            array_t<float> m_ngram_vectors;
+
+            // maps indexed native model file, arrays point to the mapping, nothing is parsed or copied
+            void loadNative(const std::shared_ptr<file_mapper_t> &_input, const load_setting_t &_loadSettings);
+
+            // copies trained word vectors (and n-gram vectors) from the trainer
+            void assign(const std::vector<std::string> &_words, const trainer_t &_trainer);
+
         public:
 
             using vocabularyProgressCallback_t = std::function<void(float)>;
@@ -202,21 +1468,68 @@ namespace wordvec {
 
             using trainProgressCallback_t = std::function<void(float, float)>;
 
+            using pipelineStatsCallback_t = std::function<void(const pipeline_stats_t &)>;
+
+            using epochStatsCallback_t = std::function<void(const epoch_stats_t &)>;
+
+            using trainStatsCallback_t = std::function<void(const train_stats_t &)>;
+
+            using sweepProgressCallback_t = std::function<void(std::size_t, float, float)>;
+
         public:
 
-            w2vModel_t(): model_t<std::string>() {}
+            w2vModel_t(): model_t<std::string>(), m_ngram_vectors() {}
+
+            // returns view of the word vector, the view is empty for out of vocabulary words
+            inline vector_view_t vector(const std::string &_word) const noexcept {return vectorAt(id(_word));}
 
             bool train(const train_setting_t &_trainSettings,
                     const std::string &_trainFile,
                     const std::string &_stopWordsFile,
                     vocabularyProgressCallback_t _vocabularyProgressCallback,
                     vocabularyStatsCallback_t _vocabularyStatsCallback,
-                    trainProgressCallback_t _trainProgressCallback) noexcept;
+                    trainProgressCallback_t _trainProgressCallback,
+                    pipelineStatsCallback_t _pipelineStatsCallback = nullptr,
+                    epochStatsCallback_t _epochStatsCallback = nullptr,
+                    trainStatsCallback_t _trainStatsCallback = nullptr) noexcept;
 
+            // trains models of several configurations at once on one vocabulary and one copy of the train file
+            // encoded in memory. Vocabulary and tokenization settings (min_freq, delims, eos) are taken from the first
+            // configuration, each configuration trains with its own threads. _stats receives the final throughput
+            // of each configuration, progress callback gets the configuration index and is never called concurrently.
+            // Checkpoints, file backed matrices, distributed, pipelined and GloVe modes are not supported
+            static bool sweep(const std::vector<train_setting_t> &_trainSettings,
+                    const std::string &_trainFile,
+                    const std::string &_stopWordsFile,
+                    std::vector<w2vModel_t> &_models,
+                    std::vector<train_stats_t> &_stats,
+                    std::string &_errMsg,
+                    vocabularyProgressCallback_t _vocabularyProgressCallback,
+                    vocabularyStatsCallback_t _vocabularyStatsCallback,
+                    sweepProgressCallback_t _trainProgressCallback) noexcept;
 
             bool save(const std::string &_model_file) const noexcept override;
 
+            // saves the model in word2vec binary format, rows keep their order (vocabulary frequency order for
+            // trained models) and are written in parallel at offsets computed from the words table
+            bool save(const std::string &_model_file, const save_setting_t &_saveSettings) const noexcept;
+
+            // loads word2vec binary, word2vec/GloVe text or indexed native model file, the file format is detected
+            // by its header. Records of binary and text files are parsed and normalized by all cores
             bool load(const std::string &_model_file) noexcept override;
+
+            // loads the model with top-N words limit or lazily, see load_setting_t
+            bool load(const std::string &_model_file, const load_setting_t &_loadSettings) noexcept;
+
+            // saves the model in indexed native format: versioned header, 64-byte aligned normalized vectors matrix,
+            // n-grams vectors, words table and hash index. Loaded native files are mapped and used without parsing,
+            // page cache is shared by all processes using the model
+            bool saveNative(const std::string &_model_file) const noexcept;
+
+            // builds a vector of any word from its character n-grams, the model must be trained with subwords
+            bool subwordVector(const std::string &_word, vector_t &_vector) const noexcept;
+
+            inline bool withSubwords() const noexcept {return m_ngram_buckets > 0;}
     };
 
     class d2vModel_t: public model_t<std::size_t> {
@@ -225,29 +1538,59 @@ namespace wordvec {
                 m_vec_sz = _vectorSize;
             }
 
+            // returns view of the document vector, the view is empty for unknown documents
+            inline vector_view_t vector(std::size_t _docId) const noexcept {return vectorAt(id(_docId));}
 
-            void set(std::size_t _id, const vector_t &_vector, bool _checkUnique = false) {
+            // rows of an indexed model are linked into the index one by one. Empty model of zero vector size takes
+            // the size of the first vector, throws std::runtime_error on vector of another size
+            void set(std::size_t _docId, const vector_t &_vector, bool _checkUnique = false) {
+                if ((m_vec_sz == 0) && (modelSize() == 0)) {
+                    m_vec_sz = static_cast<uint16_t>(std::min<std::size_t>(_vector.size(), UINT16_MAX));
+                }
+                if ((_vector.size() != m_vec_sz) || (m_vec_sz == 0)) {
+                    throw std::runtime_error("doc2vec: vector size " + std::to_string(_vector.size())
+                                             + " does not match the model vector size "
+                                             + std::to_string(m_vec_sz));
+                }
                 if (_checkUnique) {
-                    for (auto const &i:m_map) {
-                        auto match = distance(_vector, i.second);
+                    for (std::size_t i = 0; i < modelSize(); ++i) {
+                        auto match = distance(_vector, vectorAt(i));
                         if (match > 0.9999f) {
                             return;
                         }
                     }
                 }
 
-                m_map[_id] = _vector;
-                m_map_sz = m_map.size();
+                auto updated = id(_docId);
+                std::copy(_vector.begin(), _vector.end(), row(_docId));
+                indexRows((updated != npos) ? std::vector<std::size_t>{updated} : std::vector<std::size_t>());
             }
 
-            void erase(std::size_t _id) {
-                m_map.erase(_id);
-                m_map_sz = m_map.size();
+            void erase(std::size_t _docId) {
+                remove(_docId);
             }
 
             bool save(const std::string &_model_file) const noexcept override;
 
             bool load(const std::string &_model_file) noexcept override;
+
+            // trains paragraph vectors (PV-DBOW or PV-DM if with_dm is set) of documents - train file lines,
+            // document IDs are line numbers. Final checkpoint holds weights used to infer vectors of new documents
+            bool train(const train_setting_t &_trainSettings,
+                    const std::string &_trainFile,
+                    const std::string &_stopWordsFile,
+                    w2vModel_t::vocabularyProgressCallback_t _vocabularyProgressCallback,
+                    w2vModel_t::vocabularyStatsCallback_t _vocabularyStatsCallback,
+                    w2vModel_t::trainProgressCallback_t _trainProgressCallback) noexcept;
+
+            // infers vectors of documents - lines of the documents file, in parallel with frozen words vectors and
+            // back propagation weights of the final checkpoint. threads, iterations, alpha and sample settings are
+            // used, model settings are taken from the checkpoint. Document IDs are line numbers plus _firstId
+            bool infer(const train_setting_t &_inferSettings,
+                    const std::string &_checkpointFile,
+                    const std::string &_documentsFile,
+                    std::size_t _firstId = 0,
+                    w2vModel_t::trainProgressCallback_t _progressCallback = nullptr) noexcept;
     };
 
     class word2vec_t: public vector_t {
@@ -257,8 +1600,10 @@ namespace wordvec {
             word2vec_t(const std::unique_ptr<w2vModel_t> &_model, const std::string &_word):
                 vector_t(_model->vectorSize()) {
                     auto i = _model->vector(_word);
-                    if (i != nullptr) {
-                        std::copy(i->begin(), i->end(), begin());
+                    if (!i.empty()) {
+                        std::copy(i.begin(), i.end(), begin());
+                    } else {
+                        _model->subwordVector(_word, *this);
                     }
                 }
     };
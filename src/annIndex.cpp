@@ -0,0 +1,23 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+
+namespace wordvec {
+    std::shared_ptr<ann_index_t> ann_index_t::load(const std::string &_indexFile) {
+        auto mapping = std::make_shared<file_mapper_t>(_indexFile);
+        if (static_cast<std::size_t>(mapping->size()) >= sizeof(hnsw_index_t::magic)) {
+            if (std::memcmp(mapping->data(), hnsw_index_t::magic, sizeof(hnsw_index_t::magic)) == 0) {
+                return std::make_shared<hnsw_index_t>(mapping);
+            }
+            if (std::memcmp(mapping->data(), ivf_index_t::magic, sizeof(ivf_index_t::magic)) == 0) {
+                return std::make_shared<ivf_index_t>(mapping);
+            }
+            if (std::memcmp(mapping->data(), simhash_index_t::magic, sizeof(simhash_index_t::magic)) == 0) {
+                return std::make_shared<simhash_index_t>(mapping);
+            }
+        }
+
+        throw std::runtime_error("index: unknown index file format");
+    }
+}
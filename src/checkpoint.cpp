@@ -0,0 +1,513 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <stdexcept>
+
+#include "mapper.hpp"
+#include "checkpoint.hpp"
+#include "matrix.hpp"
+
+namespace wordvec {
+    namespace {
+        const char checkpointMagic[8] = {'w', 'v', 'c', 'k', 'p', 't', '0', '3'};
+        // previous format version, the number of train threads is stored as a single byte
+        const char checkpointMagic02[8] = {'w', 'v', 'c', 'k', 'p', 't', '0', '2'};
+        const std::string wrongFormatErr = "checkpoint: wrong checkpoint file format";
+        const off_t matrixAlignment = 64;
+
+        inline off_t align(off_t _offset) noexcept {
+            return (_offset + matrixAlignment - 1) / matrixAlignment * matrixAlignment;
+        }
+
+        /// sequential writer to a memory region, nullptr region just calculates the size
+        class writer_t final {
+        private:
+            char *m_data;
+            off_t m_offset = 0;
+
+        public:
+            explicit writer_t(char *_data) noexcept: m_data(_data) {}
+
+            inline off_t offset() const noexcept {return m_offset;}
+
+            inline void raw(const void *_data, std::size_t _size) noexcept {
+                if (m_data != nullptr) {
+                    std::memcpy(m_data + m_offset, _data, _size);
+                }
+                m_offset += _size;
+            }
+
+            template <class value_t>
+            inline void value(const value_t &_value) noexcept {
+                raw(&_value, sizeof(value_t));
+            }
+
+            inline void string(const std::string &_value) noexcept {
+                value(static_cast<uint64_t>(_value.length()));
+                raw(_value.data(), _value.length());
+            }
+
+            inline void pad() noexcept {
+                auto aligned = align(m_offset);
+                if (m_data != nullptr) {
+                    std::memset(m_data + m_offset, 0, static_cast<std::size_t>(aligned - m_offset));
+                }
+                m_offset = aligned;
+            }
+        };
+
+        /// sequential reader of a memory region with bounds checks
+        class reader_t final {
+        private:
+            const char *m_data;
+            const off_t m_size;
+            off_t m_offset = 0;
+
+        public:
+            reader_t(const char *_data, off_t _size) noexcept: m_data(_data), m_size(_size) {}
+
+            inline void raw(void *_data, std::size_t _size) {
+                if (m_offset + static_cast<off_t>(_size) > m_size) {
+                    throw std::runtime_error(wrongFormatErr);
+                }
+                std::memcpy(_data, m_data + m_offset, _size);
+                m_offset += _size;
+            }
+
+            template <class value_t>
+            inline value_t value() {
+                value_t ret;
+                raw(&ret, sizeof(value_t));
+                return ret;
+            }
+
+            inline std::string string() {
+                auto length = value<uint64_t>();
+                if (m_offset + static_cast<off_t>(length) > m_size) {
+                    throw std::runtime_error(wrongFormatErr);
+                }
+                std::string ret(m_data + m_offset, length);
+                m_offset += length;
+                return ret;
+            }
+
+            inline void skip(off_t _offset) noexcept {
+                m_offset += _offset;
+            }
+        };
+
+        void threadStates(writer_t &_writer, const std::vector<checkpoint_t::threadState_t> &_states) noexcept {
+            _writer.value(static_cast<uint64_t>(_states.size()));
+            for (auto const &i:_states) {
+                _writer.value(i.iteration);
+                _writer.value(static_cast<int64_t>(i.offset));
+                _writer.value(static_cast<uint64_t>(i.words));
+                _writer.string(i.rng);
+            }
+        }
+
+        void threadStates(reader_t &_reader, std::vector<checkpoint_t::threadState_t> &_states) {
+            _states.resize(_reader.value<uint64_t>());
+            for (auto &i:_states) {
+                i.iteration = _reader.value<uint8_t>();
+                i.offset = static_cast<off_t>(_reader.value<int64_t>());
+                i.words = _reader.value<uint64_t>();
+                i.rng = _reader.string();
+            }
+        }
+
+        void writeHeader(writer_t &_writer, const checkpoint_t &_checkpoint) noexcept {
+            auto matrixSize = _checkpoint.words.size() * _checkpoint.trainSettings.size;
+            _writer.raw(checkpointMagic, sizeof(checkpointMagic));
+            _writer.value(static_cast<uint64_t>(_checkpoint.words.size()));
+            _writer.value(static_cast<uint64_t>(_checkpoint.trainSettings.size));
+            _writer.value(static_cast<uint64_t>(checkpoint_t::metadataOffset(matrixSize)));
+            _writer.pad();
+        }
+
+        void writeMetadata(writer_t &_writer, const checkpoint_t &_checkpoint) noexcept {
+            _writer.value(_checkpoint.trainSettings.min_freq);
+            _writer.value(_checkpoint.trainSettings.size);
+            _writer.value(_checkpoint.trainSettings.window);
+            _writer.value(_checkpoint.trainSettings.sample);
+            _writer.value(static_cast<uint8_t>(_checkpoint.trainSettings.with_hs));
+            _writer.value(_checkpoint.trainSettings.negative);
+            _writer.value(_checkpoint.trainSettings.threads);
+            _writer.value(_checkpoint.trainSettings.readers);
+            _writer.value(_checkpoint.trainSettings.iterations);
+            _writer.value(_checkpoint.trainSettings.alpha);
+            // model flags: skip-gram, paragraph vectors distributed memory
+            _writer.value(static_cast<uint8_t>((_checkpoint.trainSettings.with_sg ? 1 : 0)
+                                               | (_checkpoint.trainSettings.with_dm ? 2 : 0)));
+            _writer.string(_checkpoint.trainSettings.delims);
+            _writer.string(_checkpoint.trainSettings.eos);
+
+            _writer.value(static_cast<uint64_t>(_checkpoint.trainWords));
+            _writer.value(static_cast<uint64_t>(_checkpoint.totalWords));
+            _writer.value(static_cast<uint64_t>(_checkpoint.processedWords));
+            _writer.value(_checkpoint.alpha);
+            threadStates(_writer, _checkpoint.trainThreads);
+            threadStates(_writer, _checkpoint.encoderThreads);
+
+            for (std::size_t i = 0; i < _checkpoint.words.size(); ++i) {
+                _writer.value(static_cast<uint64_t>(_checkpoint.frequencies[i]));
+                _writer.string(_checkpoint.words[i]);
+            }
+        }
+    }
+
+    off_t checkpoint_t::bpWeightsOffset(std::size_t _matrixSize) noexcept {
+        return align(trainMatrixOffset() + static_cast<off_t>(_matrixSize * sizeof(float)));
+    }
+
+    off_t checkpoint_t::metadataOffset(std::size_t _matrixSize) noexcept {
+        return align(bpWeightsOffset(_matrixSize) + static_cast<off_t>(_matrixSize * sizeof(float)));
+    }
+
+    void checkpoint_t::load(const std::string &_file, bool _matrices) {
+        file_mapper_t input(_file);
+        reader_t header(input.data(), std::min(input.size(), trainMatrixOffset()));
+
+        char magic[sizeof(checkpointMagic)];
+        header.raw(magic, sizeof(magic));
+        auto version02 = (std::memcmp(magic, checkpointMagic02, sizeof(magic)) == 0);
+        if (!version02 && (std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0)) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+        auto vocabularySize = header.value<uint64_t>();
+        auto vectorSize = header.value<uint64_t>();
+        auto matrixSize = vocabularySize * vectorSize;
+        if (header.value<uint64_t>() != static_cast<uint64_t>(metadataOffset(matrixSize))) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+
+        reader_t reader(input.data(), input.size());
+        reader.skip(metadataOffset(matrixSize));
+        trainSettings.min_freq = reader.value<uint16_t>();
+        trainSettings.size = reader.value<uint16_t>();
+        trainSettings.window = reader.value<uint8_t>();
+        trainSettings.sample = reader.value<float>();
+        trainSettings.with_hs = (reader.value<uint8_t>() != 0);
+        trainSettings.negative = reader.value<uint8_t>();
+        trainSettings.threads = version02 ? reader.value<uint8_t>() : reader.value<uint16_t>();
+        trainSettings.readers = reader.value<uint8_t>();
+        trainSettings.iterations = reader.value<uint8_t>();
+        trainSettings.alpha = reader.value<float>();
+        auto modelFlags = reader.value<uint8_t>();
+        trainSettings.with_sg = ((modelFlags & 1) != 0);
+        trainSettings.with_dm = ((modelFlags & 2) != 0);
+        trainSettings.delims = reader.string();
+        trainSettings.eos = reader.string();
+        if (trainSettings.size != vectorSize) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+
+        trainWords = reader.value<uint64_t>();
+        totalWords = reader.value<uint64_t>();
+        processedWords = reader.value<uint64_t>();
+        alpha = reader.value<float>();
+        threadStates(reader, trainThreads);
+        threadStates(reader, encoderThreads);
+
+        words.resize(vocabularySize);
+        frequencies.resize(vocabularySize);
+        for (std::size_t i = 0; i < vocabularySize; ++i) {
+            frequencies[i] = reader.value<uint64_t>();
+            words[i] = reader.string();
+        }
+
+        if (!_matrices) {
+            trainMatrix.clear();
+            bpWeights.clear();
+            return;
+        }
+        trainMatrix.resize(matrixSize);
+        bpWeights.resize(matrixSize);
+        std::memcpy(trainMatrix.data(), input.data() + trainMatrixOffset(), matrixSize * sizeof(float));
+        std::memcpy(bpWeights.data(), input.data() + bpWeightsOffset(matrixSize), matrixSize * sizeof(float));
+    }
+
+    void checkpoint_t::save(const std::string &_file, const float *_trainMatrix, const float *_bpWeights) const {
+        auto matrixSize = words.size() * trainSettings.size;
+        writer_t sizeCalc(nullptr);
+        writeMetadata(sizeCalc, *this);
+
+        auto tmpFile = _file + ".tmp";
+        {
+            file_mapper_t output(tmpFile, true, metadataOffset(matrixSize) + sizeCalc.offset());
+            writer_t header(output.data());
+            writeHeader(header, *this);
+            std::memcpy(output.data() + trainMatrixOffset(), _trainMatrix, matrixSize * sizeof(float));
+            std::memcpy(output.data() + bpWeightsOffset(matrixSize), _bpWeights, matrixSize * sizeof(float));
+            writer_t writer(output.data() + metadataOffset(matrixSize));
+            writeMetadata(writer, *this);
+            output.sync();
+        }
+        if (std::rename(tmpFile.c_str(), _file.c_str()) != 0) {
+            throw std::runtime_error(std::string("checkpoint: ") + _file + " - " + std::strerror(errno));
+        }
+    }
+
+    void checkpoint_t::finalize(const std::string &_matricesFile, const std::string &_file) const {
+        auto matrixSize = words.size() * trainSettings.size;
+        writer_t sizeCalc(nullptr);
+        writeMetadata(sizeCalc, *this);
+
+        {
+            // matrices are already in place, just extend the file with header and metadata
+            file_mapper_t output(_matricesFile, true, metadataOffset(matrixSize) + sizeCalc.offset());
+            writer_t header(output.data());
+            writeHeader(header, *this);
+            writer_t writer(output.data() + metadataOffset(matrixSize));
+            writeMetadata(writer, *this);
+            output.sync();
+        }
+        if (std::rename(_matricesFile.c_str(), _file.c_str()) != 0) {
+            throw std::runtime_error(std::string("checkpoint: ") + _file + " - " + std::strerror(errno));
+        }
+    }
+
+    void checkpoint_t::merge(const vocabulary_t &_vocabulary, uint16_t _minFreq) {
+        struct entry_t final {
+            std::size_t row;
+            std::size_t frequency;
+            std::size_t newFrequency;
+            std::string word;
+        };
+        const std::size_t newRow = words.size();
+
+        std::vector<entry_t> entries;
+        std::unordered_map<std::string, std::size_t> known;
+        // skip sentence delimiter (index 0)
+        for (std::size_t i = 1; i < words.size(); ++i) {
+            known[words[i]] = entries.size();
+            entries.push_back(entry_t{i, frequencies[i], 0, words[i]});
+        }
+
+        std::vector<std::string> newWords;
+        _vocabulary.words(newWords);
+        std::vector<std::size_t> newFrequencies;
+        _vocabulary.frequencies(newFrequencies);
+        for (std::size_t i = 1; i < newWords.size(); ++i) {
+            auto j = known.find(newWords[i]);
+            if (j != known.end()) {
+                entries[j->second].frequency += newFrequencies[i];
+                entries[j->second].newFrequency = newFrequencies[i];
+            } else if (newFrequencies[i] >= _minFreq) {
+                entries.push_back(entry_t{newRow, newFrequencies[i], newFrequencies[i], newWords[i]});
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const entry_t &_what, const entry_t &_with) {
+            return _what.frequency > _with.frequency;
+        });
+
+        auto vectorSize = static_cast<std::size_t>(trainSettings.size);
+        std::vector<float> mergedTrainMatrix((entries.size() + 1) * vectorSize);
+        std::vector<float> mergedBpWeights((entries.size() + 1) * vectorSize, 0.0f);
+        std::random_device randomDevice;
+        std::mt19937_64 randomGenerator(randomDevice());
+        std::uniform_real_distribution<float> rndMatrixInitializer(-0.005f, 0.005f);
+
+        words.resize(1);
+        frequencies.resize(1);
+        frequencies[0] = entries.empty() ? 0 : entries[0].frequency + 1;
+        std::copy(&trainMatrix[0], &trainMatrix[vectorSize], &mergedTrainMatrix[0]);
+        std::copy(&bpWeights[0], &bpWeights[vectorSize], &mergedBpWeights[0]);
+        trainWords = 0;
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            auto const &entry = entries[i];
+            auto to = (i + 1) * vectorSize;
+            if (entry.row != newRow) {
+                auto from = entry.row * vectorSize;
+                std::copy(&trainMatrix[from], &trainMatrix[from + vectorSize], &mergedTrainMatrix[to]);
+                std::copy(&bpWeights[from], &bpWeights[from + vectorSize], &mergedBpWeights[to]);
+            } else {
+                std::generate(&mergedTrainMatrix[to], &mergedTrainMatrix[to + vectorSize], [&]() {
+                    return rndMatrixInitializer(randomGenerator);
+                });
+            }
+            words.push_back(entry.word);
+            frequencies.push_back(entry.frequency);
+            trainWords += entry.newFrequency;
+        }
+        trainMatrix.swap(mergedTrainMatrix);
+        bpWeights.swap(mergedBpWeights);
+
+        totalWords = _vocabulary.totalWords();
+        processedWords = 0;
+        trainThreads.clear();
+        encoderThreads.clear();
+    }
+
+    std::string checkpoint_t::rngState(const std::mt19937_64 &_randomGenerator) {
+        std::ostringstream state;
+        state << _randomGenerator;
+        return state.str();
+    }
+
+    void checkpoint_t::rngState(const std::string &_state, std::mt19937_64 &_randomGenerator) {
+        if (_state.empty()) {
+            return;
+        }
+        std::istringstream state(_state);
+        state >> _randomGenerator;
+        if (state.fail()) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+    }
+
+    checkpointer_t::checkpointer_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                                   const std::shared_ptr<vocabulary_t> &_vocabulary,
+                                   const std::shared_ptr<trainMatrices_t> &_matrices,
+                                   const std::shared_ptr<std::atomic<float>> &_alpha,
+                                   const std::shared_ptr<checkpoint_t> &_resumeFrom):
+            m_trainSettings(_trainSettings), m_matrices(_matrices), m_alpha(_alpha), m_checkpoint(),
+            m_generation(0), m_slots(new slot_t[_trainSettings->threads + _trainSettings->readers]),
+            m_trainSlots(_trainSettings->threads), m_slotsNumber(_trainSettings->threads + _trainSettings->readers),
+            m_lock(), m_wakeUp(), m_captured(), m_errMsg(), m_thread() {
+
+        if (m_trainSettings->checkpoint_file.empty()) {
+            throw std::runtime_error("checkpoint file name is not specified");
+        }
+
+        m_checkpoint.trainSettings = *m_trainSettings;
+        _vocabulary->words(m_checkpoint.words);
+        _vocabulary->frequencies(m_checkpoint.frequencies);
+        m_checkpoint.trainWords = _vocabulary->trainWords();
+        m_checkpoint.totalWords = _vocabulary->totalWords();
+        m_checkpoint.trainThreads.resize(m_trainSlots);
+        m_checkpoint.encoderThreads.resize(m_slotsNumber - m_trainSlots);
+
+        if (_resumeFrom && _resumeFrom->resumable()) {
+            for (std::size_t i = 0; i < m_slotsNumber; ++i) {
+                m_slots[i].state = (i < m_trainSlots) ? _resumeFrom->trainThreads[i]
+                                                      : _resumeFrom->encoderThreads[i - m_trainSlots];
+            }
+        }
+    }
+
+    checkpointer_t::~checkpointer_t() {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread->join();
+        }
+    }
+
+    void checkpointer_t::capture(std::size_t _slot, uint32_t _generation,
+                                 const checkpoint_t::threadState_t &_state) noexcept {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_slots[_slot].generation = _generation;
+            m_slots[_slot].state = _state;
+        }
+        m_captured.notify_all();
+    }
+
+    void checkpointer_t::finish(std::size_t _slot, const checkpoint_t::threadState_t &_state) noexcept {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_slots[_slot].done = true;
+            m_slots[_slot].state = _state;
+        }
+        m_captured.notify_all();
+    }
+
+    void checkpointer_t::launch() noexcept {
+        if (m_trainSettings->checkpoint_interval > 0) {
+            m_thread.reset(new std::thread(&checkpointer_t::worker, this));
+        }
+    }
+
+    void checkpointer_t::stop() {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+            m_captured.notify_all();
+            m_thread->join();
+            m_thread.reset();
+        }
+
+        // all threads are done here
+        write(true);
+    }
+
+    std::string checkpointer_t::errMsg() {
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_errMsg;
+    }
+
+    void checkpointer_t::worker() noexcept {
+        const std::chrono::seconds interval(m_trainSettings->checkpoint_interval);
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (true) {
+            if (m_wakeUp.wait_for(lock, interval, [this]() {return m_stop;})) {
+                return;
+            }
+
+            // request states of all threads and wait for their responses
+            auto generation = m_generation.load() + 1;
+            m_generation.store(generation);
+            m_captured.wait(lock, [this, generation]() {
+                if (m_stop) {
+                    return true;
+                }
+                for (std::size_t i = 0; i < m_slotsNumber; ++i) {
+                    if (!m_slots[i].done && (m_slots[i].generation != generation)) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            if (m_stop) {
+                return;
+            }
+
+            lock.unlock();
+            try {
+                write(false);
+            } catch (const std::exception &_e) {
+                lock.lock();
+                m_errMsg = _e.what();
+                continue;
+            }
+            lock.lock();
+        }
+    }
+
+    void checkpointer_t::write(bool _final) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_checkpoint.processedWords = 0;
+            for (std::size_t i = 0; i < m_slotsNumber; ++i) {
+                if (i < m_trainSlots) {
+                    m_checkpoint.trainThreads[i] = m_slots[i].state;
+                    m_checkpoint.processedWords += m_slots[i].state.words;
+                } else {
+                    m_checkpoint.encoderThreads[i - m_trainSlots] = m_slots[i].state;
+                }
+            }
+        }
+        m_checkpoint.alpha = *m_alpha;
+
+        if (_final && m_matrices->fileBacked()) {
+            try {
+                m_matrices->finalize(m_checkpoint, m_trainSettings->checkpoint_file);
+                return;
+            } catch (const std::runtime_error &) {
+                // probably different file systems, copy matrices
+            }
+        }
+        m_checkpoint.save(m_trainSettings->checkpoint_file, m_matrices->trainMatrix(), m_matrices->bpWeights());
+    }
+}
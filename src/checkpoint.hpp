@@ -0,0 +1,200 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <random>
+
+#include "word_vector.hpp"
+#include "vocabulary.hpp"
+
+namespace wordvec {
+    class trainMatrices_t;
+
+    /**
+     * @brief checkpoint class - snapshot of a training process
+     *
+     * Checkpoint holds train settings, vocabulary, progress counters, current learning rate, position and random
+     * generator state of each train/encoder thread and both train matrices - input one and back propagation
+     * weights. Checkpoint file is written through a memory mapping. Matrices go first, right after a 64-byte
+     * header, at 64-byte aligned offsets, metadata (settings, vocabulary and threads states) follows them.
+     * So a file with the same matrices layout, used as a file backed train matrices storage, becomes a checkpoint
+     * just by appending metadata.
+    */
+    class checkpoint_t final {
+    public:
+        /// Train or encoder thread state
+        struct threadState_t final {
+            uint8_t iteration = 0; ///< remaining iterations including the current one, 0 - thread is done
+            off_t offset = 0; ///< train file offset of the next sentence
+            std::size_t words = 0; ///< train words processed by the thread
+            std::string rng; ///< serialized random generator state
+        };
+
+        train_setting_t trainSettings; ///< settings the checkpoint was made with
+        std::vector<std::string> words; ///< vocabulary words ordered by their indexes
+        std::vector<std::size_t> frequencies; ///< vocabulary word frequencies ordered by word indexes
+        std::size_t trainWords = 0; ///< vocabulary train words amount
+        std::size_t totalWords = 0; ///< vocabulary total words amount
+        std::size_t processedWords = 0; ///< words processed by all train threads
+        float alpha = 0.0f; ///< current learning rate
+        std::vector<threadState_t> trainThreads; ///< train threads states
+        std::vector<threadState_t> encoderThreads; ///< encoder threads states
+        std::vector<float> trainMatrix; ///< input matrix, filled by load() only
+        std::vector<float> bpWeights; ///< back propagation weights, filled by load() only
+
+        checkpoint_t() = default;
+
+        /// @returns true if the checkpoint holds threads states, otherwise it holds initial weights only
+        inline bool resumable() const noexcept {return !trainThreads.empty();}
+
+        /**
+         * Loads checkpoint from the file
+         * @param _file checkpoint file name
+         * @param _matrices load matrices too, otherwise trainMatrix and bpWeights stay empty
+         * @throws std::runtime_error on file access failure or wrong file format
+         */
+        void load(const std::string &_file, bool _matrices = true);
+
+        /**
+         * Saves checkpoint with the specified matrices. File is written to a temporary file first and renamed
+         * then, so the previous checkpoint is not lost in case of a failure.
+         * @param _file checkpoint file name
+         * @param _trainMatrix input matrix, words.size() * trainSettings.size values
+         * @param _bpWeights back propagation weights, words.size() * trainSettings.size values
+         * @throws std::runtime_error on file access failure
+         */
+        void save(const std::string &_file, const float *_trainMatrix, const float *_bpWeights) const;
+
+        /**
+         * Turns a file holding train matrices at trainMatrixOffset() and bpWeightsOffset() into the checkpoint.
+         * Metadata is appended to the file in place, the file is renamed then, matrices are not copied.
+         * @param _matricesFile file holding train matrices
+         * @param _file checkpoint file name
+         * @throws std::runtime_error on file access failure
+         */
+        void finalize(const std::string &_matricesFile, const std::string &_file) const;
+
+        /// @returns file offset of the input matrix
+        static constexpr off_t trainMatrixOffset() noexcept {return 64;}
+        /// @returns file offset of back propagation weights, _matrixSize - number of values in each matrix
+        static off_t bpWeightsOffset(std::size_t _matrixSize) noexcept;
+        /// @returns file offset of metadata, _matrixSize - number of values in each matrix
+        static off_t metadataOffset(std::size_t _matrixSize) noexcept;
+
+        /**
+         * Merges vocabulary of a new train data set into the checkpoint to continue training on new data.
+         * Frequencies of known words are accumulated, new words with frequency >= _minFreq are added, then words
+         * are re-ordered by merged frequencies together with their matrix rows. New input rows are initialized
+         * with small random values, new back propagation weights with zeros. Train words amounts are taken from
+         * the new data set and threads states are dropped.
+         * @param _vocabulary vocabulary of a new train data set
+         * @param _minFreq minimum frequency of a new word to be added
+         */
+        void merge(const vocabulary_t &_vocabulary, uint16_t _minFreq);
+
+        /// Serializes random generator state
+        static std::string rngState(const std::mt19937_64 &_randomGenerator);
+        /// Restores random generator state
+        static void rngState(const std::string &_state, std::mt19937_64 &_randomGenerator);
+    };
+
+    /**
+     * @brief checkpointer class - periodic asynchronous checkpoints writer
+     *
+     * Checkpointer thread wakes up each checkpoint_interval seconds and requests a new checkpoint generation.
+     * Train and encoder threads check the request between sentences and store their small state in their slots,
+     * that is all the stall they have. As soon as all active threads responded, matrices are copied to the
+     * checkpoint file while training goes on (like training itself, snapshot is lock-free, Hogwild style).
+    */
+    class checkpointer_t final {
+    private:
+        struct slot_t final {
+            uint32_t generation = 0;
+            bool done = false;
+            checkpoint_t::threadState_t state;
+        };
+
+        std::shared_ptr<train_setting_t> m_trainSettings;
+        std::shared_ptr<trainMatrices_t> m_matrices;
+        std::shared_ptr<std::atomic<float>> m_alpha;
+        checkpoint_t m_checkpoint;
+
+        std::atomic<uint32_t> m_generation;
+        std::unique_ptr<slot_t[]> m_slots;
+        const std::size_t m_trainSlots;
+        const std::size_t m_slotsNumber;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        std::condition_variable m_captured;
+        bool m_stop = false;
+        std::string m_errMsg;
+        std::unique_ptr<std::thread> m_thread;
+
+    public:
+        /**
+         * Constructs a checkpointer object
+         * @param _trainSettings train settings, checkpoint_file and checkpoint_interval are used
+         * @param _vocabulary vocabulary object
+         * @param _matrices train matrices
+         * @param _alpha current learning rate
+         * @param _resumeFrom checkpoint the training is resumed from, nullptr for a new training
+        */
+        checkpointer_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                       const std::shared_ptr<vocabulary_t> &_vocabulary,
+                       const std::shared_ptr<trainMatrices_t> &_matrices,
+                       const std::shared_ptr<std::atomic<float>> &_alpha,
+                       const std::shared_ptr<checkpoint_t> &_resumeFrom);
+        ~checkpointer_t();
+
+        checkpointer_t(const checkpointer_t &) = delete;
+        void operator=(const checkpointer_t &) = delete;
+
+        /// @returns slot ID of the train thread
+        inline std::size_t trainSlot(uint16_t _id) const noexcept {return _id;}
+        /// @returns slot ID of the encoder thread
+        inline std::size_t encoderSlot(uint8_t _id) const noexcept {return m_trainSlots + _id;}
+
+        /**
+         * Checks if a new thread state is requested, it is cheap enough to be called between sentences
+         * @param _generation last generation captured by the thread, updated on return true
+        */
+        inline bool requested(uint32_t &_generation) const noexcept {
+            auto generation = m_generation.load(std::memory_order_relaxed);
+            if (generation != _generation) {
+                _generation = generation;
+                return true;
+            }
+            return false;
+        }
+
+        /// Stores thread state in the slot for the current generation
+        void capture(std::size_t _slot, uint32_t _generation, const checkpoint_t::threadState_t &_state) noexcept;
+        /// Stores final thread state, the thread does not respond to new requests
+        void finish(std::size_t _slot, const checkpoint_t::threadState_t &_state) noexcept;
+
+        /// Launches checkpointer thread
+        void launch() noexcept;
+        /**
+         * Stops checkpointer thread and writes the final checkpoint, file backed matrices become the final
+         * checkpoint without copying if the matrix file and the checkpoint file are on the same file system
+         * @throws std::runtime_error on the final checkpoint writing failure
+         */
+        void stop();
+
+        /// @returns last periodic checkpoint error message, empty if there were no errors
+        std::string errMsg();
+
+    private:
+        void worker() noexcept;
+        void write(bool _final);
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include <thread>
+#include <algorithm>
+
+#include "reader.hpp"
+#include "corpus.hpp"
+
+namespace wordvec {
+    corpus_t::corpus_t(const file_mapper_t &_fileMapper, const vocabulary_t &_vocabulary,
+                       const std::string &_delims, const std::string &_eos, uint16_t _threads):
+            m_words(), m_sentences(), m_frequencies() {
+        _vocabulary.frequencies(m_frequencies);
+
+        auto threads = std::max<uint16_t>(_threads, 1);
+        std::vector<std::vector<uint32_t>> words(threads);
+        std::vector<std::vector<std::size_t>> sentences(threads);
+        std::vector<std::thread> encoders;
+        for (uint16_t id = 0; id < threads; ++id) {
+            encoders.emplace_back([&, id]() {
+                auto shift = _fileMapper.size() / threads;
+                auto startFrom = shift * id;
+                auto stopAt = (id == threads - 1) ? (_fileMapper.size() - 1) : (shift * (id + 1));
+                word_reader_t<file_mapper_t> wordReader(_fileMapper, _delims, _eos, startFrom, stopAt);
+                std::string word;
+                while (wordReader.next_word(word)) {
+                    if (word.empty()) {
+                        // end of sentence, empty sentences are not stored
+                        if (!words[id].empty() && (sentences[id].empty()
+                                                   || (sentences[id].back() != words[id].size()))) {
+                            sentences[id].push_back(words[id].size());
+                        }
+                        continue;
+                    }
+                    auto wordData = _vocabulary.data(word);
+                    if (wordData != nullptr) {
+                        words[id].push_back(static_cast<uint32_t>(wordData->index));
+                    }
+                }
+                if (!words[id].empty() && (sentences[id].empty() || (sentences[id].back() != words[id].size()))) {
+                    sentences[id].push_back(words[id].size());
+                }
+            });
+        }
+        for (auto &i:encoders) {
+            i.join();
+        }
+
+        // concatenate parts in the file order
+        std::size_t totalWords = 0;
+        std::size_t totalSentences = 0;
+        for (uint16_t id = 0; id < threads; ++id) {
+            totalWords += words[id].size();
+            totalSentences += sentences[id].size();
+        }
+        m_words.reserve(totalWords);
+        m_sentences.reserve(totalSentences);
+        for (uint16_t id = 0; id < threads; ++id) {
+            auto base = m_words.size();
+            m_words.insert(m_words.end(), words[id].begin(), words[id].end());
+            std::vector<uint32_t>().swap(words[id]);
+            for (auto const &i:sentences[id]) {
+                m_sentences.push_back(base + i);
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "mapper.hpp"
+#include "vocabulary.hpp"
+
+namespace wordvec {
+    /**
+     * @brief corpus class - train data set encoded to vocabulary indexes once and shared by several trainings
+     *
+     * Train data set file is tokenized by several threads, each of them encodes its own part of the file. Words
+     * are stored as a flat vector of 32-bit indexes with a vector of sentence end offsets, so train threads of any
+     * number of models read sentences from memory. Sentences are not down-sampled, each training applies its own
+     * sample threshold.
+    */
+    class corpus_t final {
+    private:
+        std::vector<uint32_t> m_words;
+        std::vector<std::size_t> m_sentences;
+        std::vector<std::size_t> m_frequencies;
+
+    public:
+        /**
+         * Constructs corpus object encoding the whole train data set file
+         * @param _fileMapper train data set file
+         * @param _vocabulary vocabulary object
+         * @param _delims word delimiter chars
+         * @param _eos end of sentence chars
+         * @param _threads number of encoding threads
+        */
+        corpus_t(const file_mapper_t &_fileMapper, const vocabulary_t &_vocabulary,
+                 const std::string &_delims, const std::string &_eos, uint16_t _threads);
+
+        corpus_t(const corpus_t &) = delete;
+        void operator=(const corpus_t &) = delete;
+
+        /// @returns number of sentences
+        inline std::size_t sentences() const noexcept {return m_sentences.size();}
+        /// @returns pointer to the first word index of the sentence
+        inline const uint32_t *sentenceBegin(std::size_t _sentence) const noexcept {
+            return m_words.data() + ((_sentence > 0) ? m_sentences[_sentence - 1] : 0);
+        }
+        /// @returns pointer past the last word index of the sentence
+        inline const uint32_t *sentenceEnd(std::size_t _sentence) const noexcept {
+            return m_words.data() + m_sentences[_sentence];
+        }
+        /// @returns vocabulary frequency of the word
+        inline std::size_t frequency(uint32_t _index) const noexcept {return m_frequencies[_index];}
+        /// @returns number of encoded words
+        inline std::size_t words() const noexcept {return m_words.size();}
+    };
+}
+
+#endif
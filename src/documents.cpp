@@ -0,0 +1,31 @@
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+#include "documents.hpp"
+
+namespace wordvec {
+    documents_t::documents_t(const file_mapper_t &_fileMapper, uint16_t _vectorSize, bool _frozen):
+            m_vectorSize(_vectorSize), m_frozen(_frozen), m_offsets(), m_vectors() {
+        auto data = _fileMapper.data();
+        auto size = _fileMapper.size();
+        for (off_t offset = 0; offset < size;) {
+            m_offsets.push_back(offset);
+            auto eol = static_cast<const char *>(std::memchr(data + offset, '\n',
+                                                             static_cast<std::size_t>(size - offset)));
+            if (eol == nullptr) {
+                break;
+            }
+            offset = eol - data + 1;
+        }
+
+        // document vectors initialized like the input matrix
+        m_vectors.resize(m_offsets.size() * m_vectorSize);
+        std::random_device randomDevice;
+        std::mt19937_64 randomGenerator(randomDevice());
+        std::uniform_real_distribution<float> rndMatrixInitializer(-0.005f, 0.005f);
+        std::generate(m_vectors.begin(), m_vectors.end(), [&]() {
+            return rndMatrixInitializer(randomGenerator);
+        });
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __DOCUMENTS_H__
+#define __DOCUMENTS_H__
+
+#include <vector>
+
+#include "mapper.hpp"
+
+namespace wordvec {
+    /**
+     * @brief documents class - documents of a train data set file and their paragraph vectors
+     *
+     * Each line of the train data set file is a document, the line number is the document ID. Lines offsets are
+     * indexed once, so train threads process their own ranges of documents. Document vectors are trained together
+     * with words and back propagation weights or with both of them frozen to infer vectors of new documents.
+    */
+    class documents_t final {
+    private:
+        const uint16_t m_vectorSize;
+        const bool m_frozen;
+        std::vector<off_t> m_offsets;
+        std::vector<float> m_vectors;
+
+    public:
+        /**
+         * Constructs documents object, document vectors are initialized with small random values
+         * @param _fileMapper train data set file
+         * @param _vectorSize vector size
+         * @param _frozen words vectors and back propagation weights are not updated (inference)
+        */
+        documents_t(const file_mapper_t &_fileMapper, uint16_t _vectorSize, bool _frozen);
+
+        documents_t(const documents_t &) = delete;
+        void operator=(const documents_t &) = delete;
+
+        /// @returns number of documents
+        inline std::size_t size() const noexcept {return m_offsets.size();}
+        /// @returns file offset of the document
+        inline off_t offset(std::size_t _document) const noexcept {return m_offsets[_document];}
+        /// @returns document vectors, size() rows of vectorSize values
+        inline float *vectors() noexcept {return m_vectors.data();}
+        inline const float *vectors() const noexcept {return m_vectors.data();}
+        inline bool frozen() const noexcept {return m_frozen;}
+    };
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdexcept>
+
+#include "encoder.hpp"
+
+namespace wordvec {
+    encoderThread_t::encoderThread_t(uint8_t _id, uint8_t _readers,
+                                     const std::shared_ptr<train_setting_t> &_trainSettings,
+                                     const std::shared_ptr<vocabulary_t> &_vocabulary,
+                                     const std::shared_ptr<file_mapper_t> &_fileMapper,
+                                     const std::shared_ptr<sentenceQueue_t> &_sentenceQueue,
+                                     const std::shared_ptr<checkpoint_t> &_resumeFrom,
+                                     const std::shared_ptr<checkpointer_t> &_checkpointer):
+            m_trainSettings(_trainSettings), m_vocabulary(_vocabulary), m_sentenceQueue(_sentenceQueue),
+            m_checkpointer(_checkpointer), m_id(_id), m_randomDevice(), m_randomGenerator(m_randomDevice()),
+            m_downSampling(), m_wordReader(), m_iterations(_trainSettings->iterations), m_thread() {
+
+        if (!m_trainSettings) {
+            throw std::runtime_error("train settings are not initialized");
+        }
+        if (!m_vocabulary) {
+            throw std::runtime_error("vocabulary object is not initialized");
+        }
+        if (!m_sentenceQueue) {
+            throw std::runtime_error("sentence queue object is not initialized");
+        }
+        if (!_fileMapper) {
+            throw std::runtime_error("file mapper object is not initialized");
+        }
+
+        if (m_trainSettings->sample > 0.0f) {
+            m_downSampling.reset(new downSampling_t(m_trainSettings->sample, m_vocabulary->frequenciesSum()));
+        }
+
+        auto shift = _fileMapper->size() / _readers;
+        auto startFrom = shift * _id;
+        auto stopAt = (_id == _readers - 1) ? (_fileMapper->size() - 1) : (shift * (_id + 1));
+        m_wordReader.reset(new word_reader_t<file_mapper_t>(*_fileMapper,
+                                                          m_trainSettings->delims,
+                                                          m_trainSettings->eos,
+                                                          startFrom, stopAt));
+
+        if (_resumeFrom && _resumeFrom->resumable()) {
+            if (_resumeFrom->encoderThreads.size() != _readers) {
+                throw std::runtime_error("checkpoint: reader threads number mismatch");
+            }
+            auto const &state = _resumeFrom->encoderThreads[_id];
+            checkpoint_t::rngState(state.rng, m_randomGenerator);
+            m_iterations = state.iteration;
+            if (m_iterations > 0) {
+                m_resumeOffset = state.offset;
+                m_wordReader->seek(m_resumeOffset);
+            }
+        }
+    }
+
+    void encoderThread_t::worker() noexcept {
+        sentenceBatch_t *batch = nullptr;
+        try {
+            std::string word;
+            for (auto i = m_iterations; i > 0; --i) {
+                if (m_resumeOffset < 0) {
+                    m_wordReader->reset();
+                } else {
+                    m_resumeOffset = -1; // reader is already positioned to the resumed sentence
+                }
+                bool exitFlag = false;
+                while (!exitFlag) {
+                    if (batch == nullptr) {
+                        batch = m_sentenceQueue->acquire();
+                    }
+
+                    if (m_checkpointer && m_checkpointer->requested(m_checkpointGeneration)) {
+                        m_checkpointer->capture(m_checkpointer->encoderSlot(m_id), m_checkpointGeneration,
+                                                state(i, m_wordReader->offset()));
+                    }
+
+                    // read sentence
+                    while (true) {
+                        if (!m_wordReader->next_word(word)) {
+                            exitFlag = true; // EOF or end of requested region
+                            break;
+                        }
+                        if (word.empty()) {
+                            break; // end of sentence
+                        }
+
+                        auto wordData = m_vocabulary->data(word);
+                        if (wordData == nullptr) {
+                            continue; // no such word
+                        }
+
+                        batch->processedWords++;
+
+                        if (m_trainSettings->sample > 0.0f) { // down-sampling...
+                            if ((*m_downSampling)(wordData->frequency, m_randomGenerator)) {
+                                continue; // skip this word
+                            }
+                        }
+                        batch->words.push_back(wordData->index);
+                    }
+                    auto sentenceStart = batch->sentences.empty() ? 0 : batch->sentences.back();
+                    if (batch->words.size() > sentenceStart) {
+                        batch->sentences.push_back(batch->words.size());
+                    }
+
+                    if (batch->processedWords >= m_trainSettings->batch_words) {
+                        m_sentenceQueue->push(batch);
+                        batch = nullptr;
+                    }
+                }
+            }
+            if (batch != nullptr) {
+                m_sentenceQueue->push(batch);
+            }
+        } catch (...) {
+            // out of memory, the rest of this thread train data is skipped
+            delete batch;
+        }
+
+        if (m_checkpointer) {
+            m_checkpointer->finish(m_checkpointer->encoderSlot(m_id), state(0, 0));
+        }
+        m_sentenceQueue->producerDone();
+    }
+
+    inline checkpoint_t::threadState_t encoderThread_t::state(uint8_t _iteration, off_t _offset) const noexcept {
+        checkpoint_t::threadState_t ret;
+        ret.iteration = _iteration;
+        ret.offset = _offset;
+        try {
+            ret.rng = checkpoint_t::rngState(m_randomGenerator);
+        } catch (...) {
+            // thread is resumed with a new random generator state
+        }
+
+        return ret;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef __ENCODER_H__
+#define __ENCODER_H__
+
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "word_vector.hpp"
+#include "reader.hpp"
+#include "vocabulary.hpp"
+#include "downSampling.hpp"
+#include "sentenceQueue.hpp"
+#include "checkpoint.hpp"
+
+namespace wordvec {
+    /**
+     * @brief encoderThread class - reader/encoder thread of the pipelined train mode
+     *
+     * encoderThread class tokenizes the specified part of train data set file, encodes words to their vocabulary
+     * indexes, down-samples frequent words and pushes sentence batches into a sentenceQueue object consumed by
+     * train threads. The whole file part is processed once per train iteration.
+    */
+    class encoderThread_t final {
+    private:
+        std::shared_ptr<train_setting_t> m_trainSettings;
+        std::shared_ptr<vocabulary_t> m_vocabulary;
+        std::shared_ptr<sentenceQueue_t> m_sentenceQueue;
+        std::shared_ptr<checkpointer_t> m_checkpointer;
+        const uint8_t m_id;
+
+        std::random_device m_randomDevice;
+        std::mt19937_64 m_randomGenerator;
+        std::unique_ptr<downSampling_t> m_downSampling;
+        std::unique_ptr<word_reader_t<file_mapper_t>> m_wordReader;
+        uint8_t m_iterations = 0;
+        off_t m_resumeOffset = -1;
+        uint32_t m_checkpointGeneration = 0;
+        std::unique_ptr<std::thread> m_thread;
+
+    public:
+        /**
+         * Constructs encoder thread local data
+         * @param _id thread ID, starting from 0
+         * @param _readers total amount of encoder threads, train data file is split on _readers parts
+         * @param _trainSettings trainSettings object
+         * @param _vocabulary vocabulary object
+         * @param _fileMapper fileMapper object related to a train data set file
+         * @param _sentenceQueue queue to push sentence batches to
+         * @param _resumeFrom checkpoint the training is resumed from, may be nullptr
+         * @param _checkpointer periodic checkpoints writer, may be nullptr
+        */
+        encoderThread_t(uint8_t _id, uint8_t _readers,
+                        const std::shared_ptr<train_setting_t> &_trainSettings,
+                        const std::shared_ptr<vocabulary_t> &_vocabulary,
+                        const std::shared_ptr<file_mapper_t> &_fileMapper,
+                        const std::shared_ptr<sentenceQueue_t> &_sentenceQueue,
+                        const std::shared_ptr<checkpoint_t> &_resumeFrom,
+                        const std::shared_ptr<checkpointer_t> &_checkpointer);
+
+        /// Launchs the thread
+        void launch() noexcept {
+            m_thread.reset(new std::thread(&encoderThread_t::worker, this));
+        }
+        /// Joins to the thread
+        void join() noexcept {
+            return m_thread->join();
+        }
+
+    private:
+        void worker() noexcept;
+        inline checkpoint_t::threadState_t state(uint8_t _iteration, off_t _offset) const noexcept;
+    };
+}
+
+#endif
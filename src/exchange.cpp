@@ -0,0 +1,445 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include "exchange.hpp"
+
+namespace wordvec {
+    namespace {
+        const uint64_t exchangeMagic = 0x3130786576777776ULL; // "wvwvex01"
+        const std::chrono::seconds connectTimeout(120);
+        const std::chrono::milliseconds connectRetry(100);
+        const std::chrono::milliseconds progressCheck(50);
+
+        void netError(const std::string &_what) {
+            throw std::runtime_error("exchange: " + _what + " - " + std::strerror(errno));
+        }
+
+        void parsePeer(const std::string &_peer, std::string &_host, std::string &_port) {
+            auto pos = _peer.rfind(':');
+            if ((pos == std::string::npos) || (pos == 0) || (pos == _peer.length() - 1)) {
+                throw std::runtime_error("exchange: wrong peer address " + _peer + ", host:port is expected");
+            }
+            _host = _peer.substr(0, pos);
+            _port = _peer.substr(pos + 1);
+        }
+
+        addrinfo *resolve(const std::string &_host, const std::string &_port, bool _passive) {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = _passive ? AI_PASSIVE : 0;
+            addrinfo *result = nullptr;
+            auto err = getaddrinfo(_passive ? nullptr : _host.c_str(), _port.c_str(), &hints, &result);
+            if (err != 0) {
+                throw std::runtime_error("exchange: " + _host + ":" + _port + " - " + gai_strerror(err));
+            }
+            return result;
+        }
+
+        int listenOn(const std::string &_port) {
+            auto addresses = resolve("", _port, true);
+            int fd = -1;
+            for (auto i = addresses; i != nullptr; i = i->ai_next) {
+                fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+                if (fd < 0) {
+                    continue;
+                }
+                int reuse = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+                if ((bind(fd, i->ai_addr, i->ai_addrlen) == 0) && (listen(fd, SOMAXCONN) == 0)) {
+                    break;
+                }
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(addresses);
+            if (fd < 0) {
+                netError("can not listen on port " + _port);
+            }
+            return fd;
+        }
+
+        int connectTo(const std::string &_host, const std::string &_port) {
+            // peer may be not started yet, retry until timeout
+            auto deadline = std::chrono::steady_clock::now() + connectTimeout;
+            while (true) {
+                auto addresses = resolve(_host, _port, false);
+                int fd = -1;
+                for (auto i = addresses; i != nullptr; i = i->ai_next) {
+                    fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+                    if (fd < 0) {
+                        continue;
+                    }
+                    if (::connect(fd, i->ai_addr, i->ai_addrlen) == 0) {
+                        break;
+                    }
+                    close(fd);
+                    fd = -1;
+                }
+                freeaddrinfo(addresses);
+                if (fd >= 0) {
+                    return fd;
+                }
+                if (std::chrono::steady_clock::now() > deadline) {
+                    netError("can not connect to " + _host + ":" + _port);
+                }
+                std::this_thread::sleep_for(connectRetry);
+            }
+        }
+
+        void sendAll(int _fd, const void *_data, std::size_t _size) {
+            auto data = static_cast<const char *>(_data);
+            while (_size > 0) {
+                auto sent = send(_fd, data, _size, MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    netError("send failed");
+                }
+                data += sent;
+                _size -= static_cast<std::size_t>(sent);
+            }
+        }
+
+        void recvAll(int _fd, void *_data, std::size_t _size) {
+            auto data = static_cast<char *>(_data);
+            while (_size > 0) {
+                auto received = recv(_fd, data, _size, 0);
+                if (received < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    netError("receive failed");
+                }
+                if (received == 0) {
+                    throw std::runtime_error("exchange: connection closed by peer");
+                }
+                data += received;
+                _size -= static_cast<std::size_t>(received);
+            }
+        }
+
+        /// exchange round state of a single peer connection
+        struct transfer_t final {
+            std::size_t sent = 0;
+            uint64_t size = 0;
+            std::size_t received = 0;
+            std::vector<char> message;
+
+            inline bool receiving() const noexcept {
+                return (received < sizeof(size)) || (received < sizeof(size) + size);
+            }
+        };
+    }
+
+    exchange_t::exchange_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                           const std::shared_ptr<trainMatrices_t> &_matrices,
+                           std::size_t _rows,
+                           const std::shared_ptr<std::atomic<std::size_t>> &_processedWords,
+                           std::size_t _wordsPerNode):
+            m_trainSettings(_trainSettings), m_matrices(_matrices), m_processedWords(_processedWords), m_rows(_rows),
+            m_wordsPerRound(std::max<std::size_t>(_wordsPerNode / std::max<uint16_t>(_trainSettings->sync_rounds, 1),
+                                                  1)),
+            m_peers(), m_trainMatrixBase(), m_bpWeightsBase(),
+            m_touchedInput(new std::atomic<uint8_t>[_rows]()), m_touchedOutput(new std::atomic<uint8_t>[_rows]()),
+            m_lock(), m_wakeUp(), m_errMsg(), m_thread() {
+        connect();
+
+        auto matrixSize = m_matrices->size();
+        m_trainMatrixBase.assign(m_matrices->trainMatrix(), m_matrices->trainMatrix() + matrixSize);
+        m_bpWeightsBase.assign(m_matrices->bpWeights(), m_matrices->bpWeights() + matrixSize);
+    }
+
+    exchange_t::~exchange_t() {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_done = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread->join();
+        }
+        for (auto const &i:m_peers) {
+            close(i.socket);
+        }
+    }
+
+    void exchange_t::connect() {
+        std::vector<std::string> peers;
+        for (std::size_t start = 0; start <= m_trainSettings->peers.length();) {
+            auto end = m_trainSettings->peers.find(',', start);
+            if (end == std::string::npos) {
+                end = m_trainSettings->peers.length();
+            }
+            if (end > start) {
+                peers.push_back(m_trainSettings->peers.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        if (m_trainSettings->rank >= peers.size()) {
+            throw std::runtime_error("exchange: node rank is out of peers list");
+        }
+
+        // handshake: magic, rank, nodes number, vocabulary size, vector size
+        uint64_t handshake[5] = {exchangeMagic, m_trainSettings->rank, peers.size(), m_rows, m_trainSettings->size};
+        std::string host;
+        std::string port;
+        parsePeer(peers[m_trainSettings->rank], host, port);
+        int listenSocket = listenOn(port);
+        try {
+            // connect to peers with lower ranks, accept connections from peers with higher ranks
+            for (uint16_t i = 0; i < m_trainSettings->rank; ++i) {
+                parsePeer(peers[i], host, port);
+                peer_t peer;
+                peer.rank = i;
+                peer.socket = connectTo(host, port);
+                m_peers.push_back(peer);
+                sendAll(peer.socket, handshake, sizeof(handshake));
+            }
+            for (std::size_t i = m_trainSettings->rank + 1u; i < peers.size(); ++i) {
+                peer_t peer;
+                peer.socket = accept(listenSocket, nullptr, nullptr);
+                if (peer.socket < 0) {
+                    netError("accept failed");
+                }
+                m_peers.push_back(peer);
+                uint64_t peerHandshake[5] = {0, 0, 0, 0, 0};
+                recvAll(peer.socket, peerHandshake, sizeof(peerHandshake));
+                if ((peerHandshake[0] != exchangeMagic) || (peerHandshake[1] <= m_trainSettings->rank)
+                    || (peerHandshake[1] >= peers.size()) || (peerHandshake[2] != handshake[2])) {
+                    throw std::runtime_error("exchange: wrong peer handshake");
+                }
+                if ((peerHandshake[3] != handshake[3]) || (peerHandshake[4] != handshake[4])) {
+                    throw std::runtime_error("exchange: vocabulary or vector size mismatch between peers");
+                }
+                m_peers.back().rank = static_cast<uint16_t>(peerHandshake[1]);
+            }
+        } catch (...) {
+            close(listenSocket);
+            for (auto const &i:m_peers) {
+                close(i.socket);
+            }
+            m_peers.clear();
+            throw;
+        }
+        close(listenSocket);
+
+        for (auto const &i:m_peers) {
+            int noDelay = 1;
+            setsockopt(i.socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+
+        // all processes start from the same input matrix
+        auto matrixBytes = m_matrices->size() * sizeof(float);
+        for (auto const &i:m_peers) {
+            if (m_trainSettings->rank == 0) {
+                sendAll(i.socket, m_matrices->trainMatrix(), matrixBytes);
+            } else if (i.rank == 0) {
+                recvAll(i.socket, m_matrices->trainMatrix(), matrixBytes);
+            }
+        }
+
+        for (auto const &i:m_peers) {
+            fcntl(i.socket, F_SETFL, fcntl(i.socket, F_GETFL) | O_NONBLOCK);
+        }
+    }
+
+    void exchange_t::launch() {
+        m_thread.reset(new std::thread(&exchange_t::worker, this));
+    }
+
+    void exchange_t::stop() {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_done = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread->join();
+            m_thread.reset();
+        }
+
+        if (!m_errMsg.empty()) {
+            throw std::runtime_error(m_errMsg);
+        }
+    }
+
+    void exchange_t::worker() noexcept {
+        auto rounds = std::max<uint16_t>(m_trainSettings->sync_rounds, 1);
+        try {
+            for (uint16_t i = 1; i <= rounds; ++i) {
+                {
+                    // the last round is made when training is done
+                    auto roundWords = (i < rounds) ? m_wordsPerRound * i : static_cast<std::size_t>(-1);
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    while (!m_done && (m_processedWords->load(std::memory_order_relaxed) < roundWords)) {
+                        m_wakeUp.wait_for(lock, progressCheck);
+                    }
+                }
+                round(i);
+            }
+        } catch (const std::exception &_e) {
+            m_errMsg = _e.what();
+            // let peers know there will be no more rounds
+            for (auto const &i:m_peers) {
+                shutdown(i.socket, SHUT_RDWR);
+            }
+        }
+    }
+
+    void exchange_t::round(uint16_t _round) {
+        std::vector<char> message;
+        collect(message, _round);
+
+        std::vector<transfer_t> transfers(m_peers.size());
+        std::vector<pollfd> pollFds(m_peers.size());
+        while (true) {
+            bool pending = false;
+            for (std::size_t i = 0; i < m_peers.size(); ++i) {
+                pollFds[i].fd = m_peers[i].socket;
+                pollFds[i].events = 0;
+                pollFds[i].revents = 0;
+                if (transfers[i].sent < message.size()) {
+                    pollFds[i].events |= POLLOUT;
+                }
+                if (transfers[i].receiving()) {
+                    pollFds[i].events |= POLLIN;
+                }
+                pending = pending || (pollFds[i].events != 0);
+            }
+            if (!pending) {
+                break;
+            }
+
+            if (poll(pollFds.data(), pollFds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                netError("poll failed");
+            }
+
+            for (std::size_t i = 0; i < m_peers.size(); ++i) {
+                auto &transfer = transfers[i];
+                if ((pollFds[i].revents & POLLOUT) != 0) {
+                    auto sent = send(pollFds[i].fd, message.data() + transfer.sent, message.size() - transfer.sent,
+                                     MSG_NOSIGNAL);
+                    if (sent < 0) {
+                        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                            netError("send failed");
+                        }
+                    } else {
+                        transfer.sent += static_cast<std::size_t>(sent);
+                    }
+                }
+                if ((pollFds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+                    char *buffer = nullptr;
+                    std::size_t size = 0;
+                    if (transfer.received < sizeof(transfer.size)) {
+                        buffer = reinterpret_cast<char *>(&transfer.size) + transfer.received;
+                        size = sizeof(transfer.size) - transfer.received;
+                    } else {
+                        buffer = transfer.message.data() + (transfer.received - sizeof(transfer.size));
+                        size = transfer.size - (transfer.received - sizeof(transfer.size));
+                    }
+                    auto received = recv(pollFds[i].fd, buffer, size, 0);
+                    if (received < 0) {
+                        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                            netError("receive failed");
+                        }
+                    } else if (received == 0) {
+                        throw std::runtime_error("exchange: connection closed by peer");
+                    } else {
+                        transfer.received += static_cast<std::size_t>(received);
+                        if (transfer.received == sizeof(transfer.size)) {
+                            transfer.message.resize(transfer.size);
+                        }
+                    }
+                }
+            }
+        }
+
+        for (auto const &i:transfers) {
+            apply(i.message, _round);
+        }
+    }
+
+    void exchange_t::collect(std::vector<char> &_message, uint16_t _round) {
+        // header: payload size, round, input rows, output rows, then row indexes and delta values
+        std::vector<uint64_t> header(4, 0);
+        header[1] = _round;
+        for (std::size_t i = 0; i < m_rows; ++i) {
+            if (m_touchedInput[i].exchange(0, std::memory_order_relaxed) != 0) {
+                header.push_back(i);
+            }
+        }
+        header[2] = header.size() - 4;
+        for (std::size_t i = 0; i < m_rows; ++i) {
+            if (m_touchedOutput[i].exchange(0, std::memory_order_relaxed) != 0) {
+                header.push_back(i);
+            }
+        }
+        header[3] = header.size() - 4 - header[2];
+
+        std::size_t vectorSize = m_trainSettings->size;
+        auto rows = header.size() - 4;
+        auto headerBytes = header.size() * sizeof(uint64_t);
+        header[0] = headerBytes - sizeof(uint64_t) + rows * vectorSize * sizeof(float);
+        _message.resize(headerBytes + rows * vectorSize * sizeof(float));
+        std::memcpy(_message.data(), header.data(), headerBytes);
+
+        // delta is the difference between the current row and its state known by peers
+        auto values = reinterpret_cast<float *>(_message.data() + headerBytes);
+        for (std::size_t i = 0; i < rows; ++i) {
+            auto row = header[4 + i] * vectorSize;
+            auto current = (i < header[2]) ? m_matrices->trainMatrix() + row : m_matrices->bpWeights() + row;
+            auto base = (i < header[2]) ? &m_trainMatrixBase[row] : &m_bpWeightsBase[row];
+            for (std::size_t j = 0; j < vectorSize; ++j) {
+                auto delta = current[j] - base[j];
+                values[i * vectorSize + j] = delta;
+                base[j] += delta;
+            }
+        }
+    }
+
+    void exchange_t::apply(const std::vector<char> &_message, uint16_t _round) {
+        const std::size_t headerSize = 3 * sizeof(uint64_t);
+        if (_message.size() < headerSize) {
+            throw std::runtime_error("exchange: wrong message format");
+        }
+        uint64_t header[3] = {0, 0, 0};
+        std::memcpy(header, _message.data(), headerSize);
+        std::size_t vectorSize = m_trainSettings->size;
+        auto rows = header[1] + header[2];
+        if ((header[0] != _round)
+            || (_message.size() != headerSize + rows * (sizeof(uint64_t) + vectorSize * sizeof(float)))) {
+            throw std::runtime_error("exchange: wrong message format");
+        }
+
+        auto indexes = reinterpret_cast<const uint64_t *>(_message.data() + headerSize);
+        auto values = reinterpret_cast<const float *>(_message.data() + headerSize + rows * sizeof(uint64_t));
+        for (std::size_t i = 0; i < rows; ++i) {
+            if (indexes[i] >= m_rows) {
+                throw std::runtime_error("exchange: wrong message format");
+            }
+            auto row = indexes[i] * vectorSize;
+            auto current = (i < header[1]) ? m_matrices->trainMatrix() + row : m_matrices->bpWeights() + row;
+            auto base = (i < header[1]) ? &m_trainMatrixBase[row] : &m_bpWeightsBase[row];
+            for (std::size_t j = 0; j < vectorSize; ++j) {
+                current[j] += values[i * vectorSize + j];
+                base[j] += values[i * vectorSize + j];
+            }
+        }
+    }
+}
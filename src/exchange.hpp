@@ -0,0 +1,98 @@
+#ifndef __EXCHANGE_H__
+#define __EXCHANGE_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "word_vector.hpp"
+#include "matrix.hpp"
+
+namespace wordvec {
+    /**
+     * @brief exchange class - parameter exchange service of the distributed training
+     *
+     * Each trainer process trains on its own train data set shard and runs an exchange service connected to all
+     * peers (full mesh of TCP connections). Train threads mark matrix rows they update as touched. The exchange
+     * thread performs sync_rounds exchange rounds evenly distributed over the local training progress. Each round
+     * it sends deltas of touched rows accumulated since the previous round to all peers and adds deltas received
+     * from peers to the local matrices. Training is not stopped by the exchange, except the last round, which is
+     * made after all train threads are done, so all processes end with the same model.
+    */
+    class exchange_t final {
+    private:
+        struct peer_t final {
+            uint16_t rank = 0;
+            int socket = -1;
+        };
+
+        std::shared_ptr<train_setting_t> m_trainSettings;
+        std::shared_ptr<trainMatrices_t> m_matrices;
+        std::shared_ptr<std::atomic<std::size_t>> m_processedWords;
+        const std::size_t m_rows;
+        const std::size_t m_wordsPerRound;
+
+        std::vector<peer_t> m_peers;
+        std::vector<float> m_trainMatrixBase;
+        std::vector<float> m_bpWeightsBase;
+        std::unique_ptr<std::atomic<uint8_t>[]> m_touchedInput;
+        std::unique_ptr<std::atomic<uint8_t>[]> m_touchedOutput;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        bool m_done = false;
+        std::string m_errMsg;
+        std::unique_ptr<std::thread> m_thread;
+
+    public:
+        /**
+         * Constructs exchange service, connects to all peers and synchronizes the initial input matrix - all
+         * processes start with the input matrix of the process with rank 0
+         * @param _trainSettings train settings, peers, rank and sync_rounds are used
+         * @param _matrices train matrices
+         * @param _rows vocabulary size
+         * @param _processedWords words processed by local train threads
+         * @param _wordsPerNode words to be processed by local train threads during the whole training
+         * @throws std::runtime_error on wrong peers list or network failure
+        */
+        exchange_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                   const std::shared_ptr<trainMatrices_t> &_matrices,
+                   std::size_t _rows,
+                   const std::shared_ptr<std::atomic<std::size_t>> &_processedWords,
+                   std::size_t _wordsPerNode);
+        ~exchange_t();
+
+        exchange_t(const exchange_t &) = delete;
+        void operator=(const exchange_t &) = delete;
+
+        /// Marks input matrix row as updated
+        inline void touchInput(std::size_t _row) noexcept {
+            m_touchedInput[_row].store(1, std::memory_order_relaxed);
+        }
+        /// Marks back propagation weights row as updated
+        inline void touchOutput(std::size_t _row) noexcept {
+            m_touchedOutput[_row].store(1, std::memory_order_relaxed);
+        }
+
+        /// Launches exchange thread
+        void launch();
+        /**
+         * Makes the remaining exchange rounds, must be called when all train threads are done
+         * @throws std::runtime_error on network failure
+        */
+        void stop();
+
+    private:
+        void connect();
+        void worker() noexcept;
+        void round(uint16_t _round);
+        void collect(std::vector<char> &_message, uint16_t _round);
+        void apply(const std::vector<char> &_message, uint16_t _round);
+    };
+}
+
+#endif
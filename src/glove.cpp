@@ -0,0 +1,453 @@
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <thread>
+#include <random>
+#include <queue>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "reader.hpp"
+#include "glove.hpp"
+
+namespace wordvec {
+    namespace {
+        // approximate heap memory of a hash table entry, including node, bucket and allocator overhead
+        const std::size_t pairBytes = 64;
+        const std::size_t bufferRecords = 65536;
+        const char cooccurrenceMagic[8] = {'w', 'v', 'c', 'o', 'o', 'c', '0', '1'};
+        const uint32_t cooccurrenceVersion = 1;
+
+        inline uint64_t pairKey(uint32_t _row, uint32_t _column) noexcept {
+            return (static_cast<uint64_t>(_row) << 32) | _column;
+        }
+
+        inline uint64_t pairKey(const cooccurrence_t &_record) noexcept {
+            return pairKey(_record.row, _record.column);
+        }
+
+        // sequential buffered reader of a sorted run file
+        class runReader_t final {
+        private:
+            std::ifstream m_stream;
+            std::vector<cooccurrence_t> m_buffer;
+            std::size_t m_pos = 0;
+            std::size_t m_size = 0;
+
+        public:
+            explicit runReader_t(const std::string &_fileName):
+                    m_stream(_fileName, std::ios::binary), m_buffer(bufferRecords) {
+                if (!m_stream.is_open()) {
+                    throw std::runtime_error("glove: can not open run file " + _fileName);
+                }
+            }
+
+            bool next(cooccurrence_t &_record) {
+                if (m_pos == m_size) {
+                    m_stream.read(reinterpret_cast<char *>(m_buffer.data()),
+                                  static_cast<std::streamsize>(m_buffer.size() * sizeof(cooccurrence_t)));
+                    m_size = static_cast<std::size_t>(m_stream.gcount()) / sizeof(cooccurrence_t);
+                    m_pos = 0;
+                    if (m_size == 0) {
+                        return false;
+                    }
+                }
+                _record = m_buffer[m_pos++];
+                return true;
+            }
+        };
+
+        void writeRecords(std::ofstream &_stream, const std::vector<cooccurrence_t> &_records,
+                          const std::string &_fileName) {
+            _stream.write(reinterpret_cast<const char *>(_records.data()),
+                          static_cast<std::streamsize>(_records.size() * sizeof(cooccurrence_t)));
+            if (!_stream.good()) {
+                throw std::runtime_error("glove: can not write " + _fileName);
+            }
+        }
+    }
+
+    cooccurrences_t::cooccurrences_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                                     const std::shared_ptr<vocabulary_t> &_vocabulary,
+                                     const std::shared_ptr<file_mapper_t> &_fileMapper):
+            m_trainSettings(_trainSettings), m_vocabulary(_vocabulary), m_fileMapper(_fileMapper),
+            m_fileName(), m_runs(), m_runsMtx() {
+    }
+
+    cooccurrenceHeader_t cooccurrences_t::header(const train_setting_t &_trainSettings,
+                                                 const std::vector<std::string> &_words) noexcept {
+        cooccurrenceHeader_t ret{};
+        std::memcpy(ret.magic, cooccurrenceMagic, sizeof(cooccurrenceMagic));
+        ret.version = cooccurrenceVersion;
+        ret.window = _trainSettings.window;
+        ret.minFreq = _trainSettings.min_freq;
+        ret.words = _words.size();
+        // words are terminated by zero chars, so different splits of the same chars differ
+        uint64_t hash = 14695981039346656037ULL;
+        for (auto const &i:_words) {
+            for (std::size_t j = 0; j <= i.size(); ++j) {
+                hash = (hash ^ static_cast<uint8_t>(i.c_str()[j])) * 1099511628211ULL;
+            }
+        }
+        ret.vocabularyHash = hash;
+
+        return ret;
+    }
+
+    bool cooccurrences_t::header(const std::string &_fileName, cooccurrenceHeader_t &_header) {
+        std::ifstream stream(_fileName, std::ios::binary);
+        if (!stream.is_open()) {
+            throw std::runtime_error("glove: can not open co-occurrence file " + _fileName);
+        }
+        stream.read(reinterpret_cast<char *>(&_header), sizeof(_header));
+
+        return (stream.gcount() == sizeof(_header))
+               && (std::memcmp(_header.magic, cooccurrenceMagic, sizeof(cooccurrenceMagic)) == 0);
+    }
+
+    std::size_t cooccurrences_t::build(const std::string &_fileName) {
+        m_fileName = _fileName;
+        m_runs.clear();
+
+        auto threads = std::max<uint16_t>(m_trainSettings->threads, 1);
+        auto maxPairs = std::max<std::size_t>(static_cast<std::size_t>(m_trainSettings->cooccurrence_memory)
+                                              * 1024 * 1024 / pairBytes / threads, 1024);
+        std::vector<std::thread> counters;
+        std::vector<std::exception_ptr> errors(threads);
+        for (uint16_t i = 0; i < threads; ++i) {
+            counters.emplace_back([this, i, maxPairs, &errors]() {
+                try {
+                    count(i, maxPairs);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        for (auto &i:counters) {
+            i.join();
+        }
+
+        try {
+            for (auto const &i:errors) {
+                if (i) {
+                    std::rethrow_exception(i);
+                }
+            }
+            auto records = merge();
+            for (auto const &i:m_runs) {
+                std::remove(i.c_str());
+            }
+            if (records == 0) {
+                throw std::runtime_error("glove: no co-occurrences found in train data");
+            }
+
+            return records;
+        } catch (...) {
+            for (auto const &i:m_runs) {
+                std::remove(i.c_str());
+            }
+            throw;
+        }
+    }
+
+    void cooccurrences_t::count(uint16_t _id, std::size_t _maxPairs) {
+        auto threads = std::max<uint16_t>(m_trainSettings->threads, 1);
+        auto shift = m_fileMapper->size() / threads;
+        auto startFrom = shift * _id;
+        auto stopAt = (_id == threads - 1) ? (m_fileMapper->size() - 1) : (shift * (_id + 1));
+        word_reader_t<file_mapper_t> wordReader(*m_fileMapper,
+                                                m_trainSettings->delims, m_trainSettings->eos,
+                                                startFrom, stopAt);
+
+        // the last window words of the current sentence
+        std::vector<uint32_t> history;
+        shard_t shard;
+        std::string word;
+        while (wordReader.next_word(word)) {
+            if (word.empty()) {
+                history.clear(); // end of sentence
+                continue;
+            }
+            auto wordData = m_vocabulary->data(word);
+            if (wordData == nullptr) {
+                continue; // no such word
+            }
+
+            auto index = static_cast<uint32_t>(wordData->index);
+            auto distance = history.size();
+            for (auto const &i:history) {
+                // symmetric context, pairs are weighted by 1 / distance
+                auto weight = 1.0f / static_cast<float>(distance--);
+                shard[pairKey(index, i)] += weight;
+                shard[pairKey(i, index)] += weight;
+            }
+            history.push_back(index);
+            if (history.size() > m_trainSettings->window) {
+                history.erase(history.begin());
+            }
+
+            if (shard.size() >= _maxPairs) {
+                spill(shard);
+            }
+        }
+        if (!shard.empty()) {
+            spill(shard);
+        }
+    }
+
+    void cooccurrences_t::spill(shard_t &_shard) {
+        std::vector<cooccurrence_t> records;
+        records.reserve(_shard.size());
+        for (auto const &i:_shard) {
+            records.push_back({static_cast<uint32_t>(i.first >> 32), static_cast<uint32_t>(i.first), i.second});
+        }
+        shard_t().swap(_shard);
+        std::sort(records.begin(), records.end(), [](const cooccurrence_t &_left, const cooccurrence_t &_right) {
+            return pairKey(_left) < pairKey(_right);
+        });
+
+        std::string runFile;
+        {
+            std::lock_guard<std::mutex> lck(m_runsMtx);
+            runFile = m_fileName + ".run" + std::to_string(m_runs.size());
+            m_runs.push_back(runFile);
+        }
+        std::ofstream stream(runFile, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open()) {
+            throw std::runtime_error("glove: can not create run file " + runFile);
+        }
+        writeRecords(stream, records, runFile);
+    }
+
+    std::size_t cooccurrences_t::merge() {
+        // partitions are small enough to be shuffled in memory
+        std::size_t runRecords = 0;
+        std::vector<std::unique_ptr<runReader_t>> runs;
+        for (auto const &i:m_runs) {
+            std::ifstream stream(i, std::ios::binary | std::ios::ate);
+            runRecords += static_cast<std::size_t>(stream.tellg()) / sizeof(cooccurrence_t);
+            runs.emplace_back(new runReader_t(i));
+        }
+        auto memory = static_cast<std::size_t>(m_trainSettings->cooccurrence_memory) * 1024 * 1024;
+        auto partitions = runRecords * sizeof(cooccurrence_t) / std::max<std::size_t>(memory, 1) + 1;
+
+        std::vector<std::string> partitionFiles;
+        std::vector<std::ofstream> partitionStreams(partitions);
+        std::vector<std::vector<cooccurrence_t>> partitionBuffers(partitions);
+        for (std::size_t i = 0; i < partitions; ++i) {
+            partitionFiles.push_back(m_fileName + ".part" + std::to_string(i));
+            partitionStreams[i].open(partitionFiles.back(), std::ios::binary | std::ios::trunc);
+            if (!partitionStreams[i].is_open()) {
+                throw std::runtime_error("glove: can not create partition file " + partitionFiles.back());
+            }
+            partitionBuffers[i].reserve(bufferRecords / partitions + 1);
+        }
+
+        std::random_device randomDevice;
+        std::mt19937_64 randomGenerator(randomDevice());
+        std::uniform_int_distribution<std::size_t> rndPartition(0, partitions - 1);
+        std::size_t records = 0;
+        auto emit = [&](const cooccurrence_t &_record) {
+            auto partition = rndPartition(randomGenerator);
+            auto &buffer = partitionBuffers[partition];
+            buffer.push_back(_record);
+            if (buffer.size() == buffer.capacity()) {
+                writeRecords(partitionStreams[partition], buffer, partitionFiles[partition]);
+                buffer.clear();
+            }
+            records++;
+        };
+
+        try {
+            // k-way merge of sorted runs, equal pairs of different runs are summed
+            using head_t = std::pair<uint64_t, std::size_t>;
+            std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t>> heads;
+            std::vector<cooccurrence_t> current(runs.size());
+            for (std::size_t i = 0; i < runs.size(); ++i) {
+                if (runs[i]->next(current[i])) {
+                    heads.emplace(pairKey(current[i]), i);
+                }
+            }
+            bool pending = false;
+            cooccurrence_t merged{0, 0, 0.0f};
+            while (!heads.empty()) {
+                auto run = heads.top().second;
+                heads.pop();
+                if (pending && (pairKey(merged) == pairKey(current[run]))) {
+                    merged.value += current[run].value;
+                } else {
+                    if (pending) {
+                        emit(merged);
+                    }
+                    merged = current[run];
+                    pending = true;
+                }
+                if (runs[run]->next(current[run])) {
+                    heads.emplace(pairKey(current[run]), run);
+                }
+            }
+            if (pending) {
+                emit(merged);
+            }
+            runs.clear();
+            for (std::size_t i = 0; i < partitions; ++i) {
+                writeRecords(partitionStreams[i], partitionBuffers[i], partitionFiles[i]);
+                partitionStreams[i].close();
+                std::vector<cooccurrence_t>().swap(partitionBuffers[i]);
+            }
+
+            // shuffle partitions one by one and concatenate them after the header
+            std::ofstream output(m_fileName, std::ios::binary | std::ios::trunc);
+            if (!output.is_open()) {
+                throw std::runtime_error("glove: can not create co-occurrence file " + m_fileName);
+            }
+            std::vector<std::string> words;
+            m_vocabulary->words(words);
+            auto fileHeader = header(*m_trainSettings, words);
+            output.write(reinterpret_cast<const char *>(&fileHeader), sizeof(fileHeader));
+            for (auto const &i:partitionFiles) {
+                std::ifstream stream(i, std::ios::binary | std::ios::ate);
+                std::vector<cooccurrence_t> partition(static_cast<std::size_t>(stream.tellg())
+                                                      / sizeof(cooccurrence_t));
+                stream.seekg(0);
+                stream.read(reinterpret_cast<char *>(partition.data()),
+                            static_cast<std::streamsize>(partition.size() * sizeof(cooccurrence_t)));
+                if (!stream.good()) {
+                    throw std::runtime_error("glove: can not read partition file " + i);
+                }
+                stream.close();
+                std::remove(i.c_str());
+                std::shuffle(partition.begin(), partition.end(), randomGenerator);
+                writeRecords(output, partition, m_fileName);
+            }
+        } catch (...) {
+            for (auto const &i:partitionFiles) {
+                std::remove(i.c_str());
+            }
+            throw;
+        }
+
+        return records;
+    }
+
+    gloveTrainer_t::gloveTrainer_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                                   const cooccurrenceHeader_t &_header, const std::string &_fileName,
+                                   std::function<void(float, float)> _progressCallback):
+            m_trainSettings(_trainSettings), m_rows(_header.words), m_cooccurrences(new file_mapper_t(_fileName)),
+            m_records(0), m_progress(),
+            m_alpha(std::make_shared<std::atomic<float>>(m_trainSettings->alpha)),
+            m_matrices(new trainMatrices_t(m_trainSettings->matrix_file, m_rows * m_trainSettings->size)),
+            m_wordBiases(m_rows, 0.0f), m_contextBiases(m_rows, 0.0f),
+            m_wordOptimizer(), m_contextOptimizer(), m_wordBiasesOptimizer(), m_contextBiasesOptimizer(),
+            m_processed(0) {
+        auto fileSize = static_cast<std::size_t>(m_cooccurrences->size());
+        if ((fileSize < sizeof(cooccurrenceHeader_t))
+            || ((fileSize - sizeof(cooccurrenceHeader_t)) % sizeof(cooccurrence_t) != 0)) {
+            throw std::runtime_error("glove: wrong co-occurrence file size");
+        }
+        cooccurrenceHeader_t header{};
+        std::memcpy(&header, m_cooccurrences->data(), sizeof(header));
+        if (header != _header) {
+            throw std::runtime_error("glove: co-occurrence file " + _fileName
+                                     + " is built for another vocabulary or window");
+        }
+        m_recordsData = reinterpret_cast<const cooccurrence_t *>(m_cooccurrences->data() + sizeof(header));
+        m_records = (fileSize - sizeof(header)) / sizeof(cooccurrence_t);
+        // workers index vectors and biases by records without checks
+        for (std::size_t i = 0; i < m_records; ++i) {
+            if ((m_recordsData[i].row >= m_rows) || (m_recordsData[i].column >= m_rows)) {
+                throw std::runtime_error("glove: co-occurrence file " + _fileName + " has out of vocabulary words");
+            }
+        }
+        if (_progressCallback != nullptr) {
+            m_progress.reset(new progressReporter_t(_progressCallback, m_trainSettings->progress_interval));
+        }
+
+        // GloVe is trained with per element learning rates, sums of squared gradients start from 1 as in the
+        // reference implementation, so the first steps are not too large
+        auto method = (m_trainSettings->optimizer == optimizer_t::sgd) ? optimizer_t::adagrad
+                                                                       : m_trainSettings->optimizer;
+        m_wordOptimizer.reset(new rowOptimizer_t(method, m_rows, m_trainSettings->size, m_alpha, 1.0f));
+        m_contextOptimizer.reset(new rowOptimizer_t(method, m_rows, m_trainSettings->size, m_alpha, 1.0f));
+        m_wordBiasesOptimizer.reset(new rowOptimizer_t(method, m_rows, 1, m_alpha, 1.0f));
+        m_contextBiasesOptimizer.reset(new rowOptimizer_t(method, m_rows, 1, m_alpha, 1.0f));
+
+        // context vectors are initialized like word vectors, zeros are a saddle point of the objective
+        std::random_device randomDevice;
+        std::mt19937_64 randomGenerator(randomDevice());
+        std::uniform_real_distribution<float> rndMatrixInitializer(-0.005f, 0.005f);
+        std::generate(m_matrices->bpWeights(), m_matrices->bpWeights() + m_matrices->size(), [&]() {
+            return rndMatrixInitializer(randomGenerator);
+        });
+    }
+
+    void gloveTrainer_t::operator()() {
+        if (m_progress) {
+            m_progress->launch();
+        }
+        std::vector<std::thread> threads;
+        for (uint16_t i = 0; i < std::max<uint16_t>(m_trainSettings->threads, 1); ++i) {
+            threads.emplace_back(&gloveTrainer_t::worker, this, i);
+        }
+        for (auto &i:threads) {
+            i.join();
+        }
+        if (m_progress) {
+            m_progress->stop();
+        }
+    }
+
+    void gloveTrainer_t::worker(uint16_t _id) noexcept {
+        auto threads = std::max<uint16_t>(m_trainSettings->threads, 1);
+        auto records = m_recordsData;
+        auto first = m_records * _id / threads;
+        auto last = m_records * (_id + 1u) / threads;
+        auto vectorSize = m_trainSettings->size;
+        auto wordMatrix = m_matrices->trainMatrix();
+        auto contextMatrix = m_matrices->bpWeights();
+        auto recordsPerAllThreads = static_cast<std::size_t>(m_trainSettings->iterations) * m_records;
+        auto recordsPerProgress = recordsPerAllThreads / 10000;
+        const float one = 1.0f;
+
+        std::vector<float> wordRow(vectorSize);
+        std::size_t processed = 0;
+        std::size_t prvProcessed = 0;
+        for (auto i = m_trainSettings->iterations; i > 0; --i) {
+            for (auto r = first; r < last; ++r) {
+                auto const &record = records[r];
+                auto word = wordMatrix + static_cast<std::size_t>(record.row) * vectorSize;
+                auto context = contextMatrix + static_cast<std::size_t>(record.column) * vectorSize;
+
+                float diff = m_wordBiases[record.row] + m_contextBiases[record.column] - std::log(record.value);
+                for (uint16_t j = 0; j < vectorSize; ++j) {
+                    diff += word[j] * context[j];
+                }
+                auto weight = (record.value < m_trainSettings->glove_x_max)
+                              ? std::pow(record.value / m_trainSettings->glove_x_max, m_trainSettings->glove_power)
+                              : 1.0f;
+                auto gradient = weight * diff;
+                if (!std::isfinite(gradient)) {
+                    continue;
+                }
+
+                // both vectors are updated with the gradient of the word vector before its own update
+                std::copy(word, word + vectorSize, wordRow.begin());
+                m_wordOptimizer->update(word, record.row, context, -gradient);
+                m_contextOptimizer->update(context, record.column, wordRow.data(), -gradient);
+                m_wordBiasesOptimizer->update(&m_wordBiases[record.row], record.row, &one, -gradient);
+                m_contextBiasesOptimizer->update(&m_contextBiases[record.column], record.column, &one, -gradient);
+
+                if (++processed - prvProcessed > recordsPerProgress) { // next 0.01% processed
+                    auto allProcessed = (m_processed += processed - prvProcessed);
+                    prvProcessed = processed;
+                    if (m_progress) {
+                        m_progress->publish(m_alpha->load(std::memory_order_relaxed),
+                                            static_cast<float>(allProcessed)
+                                            / static_cast<float>(recordsPerAllThreads + 1) * 100.0f);
+                    }
+                }
+            }
+        }
+    }
+}
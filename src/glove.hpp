@@ -0,0 +1,161 @@
+#ifndef __GLOVE_H__
+#define __GLOVE_H__
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+#include "word_vector.hpp"
+#include "mapper.hpp"
+#include "vocabulary.hpp"
+#include "matrix.hpp"
+#include "optimizer.hpp"
+#include "progress.hpp"
+
+namespace wordvec {
+    /// Co-occurrence file record
+    struct cooccurrence_t final {
+        uint32_t row; ///< word index
+        uint32_t column; ///< context word index
+        float value; ///< co-occurrence count weighted by 1 / distance
+    };
+    static_assert(sizeof(cooccurrence_t) == 12, "cooccurrence_t must be packed");
+
+    /// Co-occurrence file header, records follow it. Records are valid for the same vocabulary and window only
+    struct cooccurrenceHeader_t final {
+        char magic[8];
+        uint32_t version;
+        uint32_t window;
+        uint32_t minFreq;
+        uint32_t reserved[3];
+        uint64_t words; ///< vocabulary size, record indexes are less than it
+        uint64_t vocabularyHash; ///< FNV-1a hash of the vocabulary words ordered by their indexes
+
+        inline bool operator==(const cooccurrenceHeader_t &_header) const noexcept {
+            return std::memcmp(this, &_header, sizeof(_header)) == 0;
+        }
+        inline bool operator!=(const cooccurrenceHeader_t &_header) const noexcept {return !(*this == _header);}
+    };
+    static_assert(sizeof(cooccurrenceHeader_t) % sizeof(cooccurrence_t) == 0,
+                  "cooccurrenceHeader_t size must be a multiple of the record size");
+
+    /**
+     * @brief cooccurrences class - builds the co-occurrence file of a train data set
+     *
+     * Each counting thread reads its own part of the train data set file and counts word pairs within the window
+     * in a thread local hash table. When the table grows over its share of the memory limit, it is sorted and
+     * spilled to a temporary run file. Runs of all threads are merged then, equal pairs are summed, and merged
+     * records are scattered to random partitions, each partition is shuffled in memory and appended to the
+     * co-occurrence file. So the file is a compact shuffled list of non-zero cells of the co-occurrence matrix,
+     * train threads read it sequentially.
+    */
+    class cooccurrences_t final {
+    private:
+        using shard_t = std::unordered_map<uint64_t, float>;
+
+        std::shared_ptr<train_setting_t> m_trainSettings;
+        std::shared_ptr<vocabulary_t> m_vocabulary;
+        std::shared_ptr<file_mapper_t> m_fileMapper;
+        std::string m_fileName;
+        std::vector<std::string> m_runs;
+        std::mutex m_runsMtx;
+
+    public:
+        /**
+         * Constructs cooccurrences object
+         * @param _trainSettings trainSettings object
+         * @param _vocabulary vocabulary object
+         * @param _fileMapper fileMapper object related to a train data set file
+        */
+        cooccurrences_t(const std::shared_ptr<train_setting_t> &_trainSettings,
+                        const std::shared_ptr<vocabulary_t> &_vocabulary,
+                        const std::shared_ptr<file_mapper_t> &_fileMapper);
+
+        cooccurrences_t(const cooccurrences_t &) = delete;
+        void operator=(const cooccurrences_t &) = delete;
+
+        /**
+         * Counts co-occurrences and writes the shuffled co-occurrence file, temporary files are created next to it
+         * @param _fileName co-occurrence file name, existing file is overwritten
+         * @returns number of records
+         * @throws std::runtime_error on file access failure
+        */
+        std::size_t build(const std::string &_fileName);
+
+        /// @returns header of the co-occurrence file of the vocabulary words ordered by their indexes
+        static cooccurrenceHeader_t header(const train_setting_t &_trainSettings,
+                                           const std::vector<std::string> &_words) noexcept;
+        /**
+         * Reads header of an existing file
+         * @returns false if the file is not a co-occurrence file
+        */
+        static bool header(const std::string &_fileName, cooccurrenceHeader_t &_header);
+
+    private:
+        void count(uint16_t _id, std::size_t _maxPairs);
+        void spill(shard_t &_shard);
+        std::size_t merge();
+    };
+
+    /**
+     * @brief gloveTrainer class - trains GloVe word and context vectors on a co-occurrence file
+     *
+     * Weighted least squares objective f(X) * (w * c + b + b~ - log(X))^2 is minimized by AdaGrad (or Adam, if
+     * it is selected), train threads process their own parts of the co-occurrence file without locks. Word vectors
+     * are stored in the input matrix, context vectors in the back propagation weights, the model vector of a word
+     * is the sum of both.
+    */
+    class gloveTrainer_t final {
+    private:
+        std::shared_ptr<train_setting_t> m_trainSettings;
+        std::size_t m_rows;
+        std::unique_ptr<file_mapper_t> m_cooccurrences;
+        const cooccurrence_t *m_recordsData = nullptr;
+        std::size_t m_records;
+        std::unique_ptr<progressReporter_t> m_progress;
+        std::shared_ptr<std::atomic<float>> m_alpha;
+        std::unique_ptr<trainMatrices_t> m_matrices;
+        std::vector<float> m_wordBiases;
+        std::vector<float> m_contextBiases;
+        std::unique_ptr<rowOptimizer_t> m_wordOptimizer;
+        std::unique_ptr<rowOptimizer_t> m_contextOptimizer;
+        std::unique_ptr<rowOptimizer_t> m_wordBiasesOptimizer;
+        std::unique_ptr<rowOptimizer_t> m_contextBiasesOptimizer;
+        std::atomic<std::size_t> m_processed;
+
+    public:
+        /**
+         * Constructs GloVe trainer, the co-occurrence file is mapped to memory
+         * @param _trainSettings trainSettings object
+         * @param _header expected header of the file, see cooccurrences_t::header()
+         * @param _fileName co-occurrence file built by cooccurrences_t
+         * @param _progressCallback callback function to be called on each new 0.01% processed records from a
+         * reporter thread each progress_interval milliseconds, may be nullptr
+         * @throws std::runtime_error on file access failure, wrong file size, other header or out of vocabulary
+         * record indexes
+        */
+        gloveTrainer_t(const std::shared_ptr<train_setting_t> &_trainSettings, const cooccurrenceHeader_t &_header,
+                       const std::string &_fileName, std::function<void(float, float)> _progressCallback);
+
+        gloveTrainer_t(const gloveTrainer_t &) = delete;
+        void operator=(const gloveTrainer_t &) = delete;
+
+        /// Runs iterations train passes over the co-occurrence file
+        void operator()();
+
+        /// @returns trained word vectors, valid while the trainer object exists
+        inline const float *wordMatrix() const noexcept {return m_matrices->trainMatrix();}
+        /// @returns trained context vectors, valid while the trainer object exists
+        inline const float *contextMatrix() const noexcept {return m_matrices->bpWeights();}
+
+    private:
+        void worker(uint16_t _id) noexcept;
+    };
+}
+
+#endif
@@ -0,0 +1,518 @@
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "word_vector.hpp"
+#include "modelFile.hpp"
+
+namespace wordvec {
+    namespace {
+        const uint32_t hnswVersion = 2;
+        // number of locks shared by nodes during parallel insertion
+        const std::size_t lockStripes = 65536;
+        const std::size_t noNode = static_cast<std::size_t>(-1);
+
+        // index file header. Sections follow at 64-byte aligned offsets: bottom level links, nodes levels, offsets of
+        // upper level blocks and upper level links pool
+        struct hnswHeader_t {
+            char magic[8];
+            uint32_t version;
+            uint16_t vectorSize;
+            uint16_t m;
+            uint16_t efConstruction;
+            uint16_t ef;
+            uint8_t maxLevel;
+            uint8_t reserved[3];
+            uint64_t nodes;
+            uint64_t entry;
+            uint64_t upperSize;
+            uint64_t linksOffset;
+            uint64_t levelsOffset;
+            uint64_t upperOffset;
+            uint64_t upperLinksOffset;
+            uint64_t fileSize;
+            // fingerprint of the model the index is saved with
+            uint64_t fingerprint;
+        };
+
+        inline uint64_t alignSection(uint64_t _offset) noexcept {
+            return (_offset + 63) & ~static_cast<uint64_t>(63);
+        }
+
+        // the first cache line of the row is requested before dot products of all neighbours are computed
+        inline void prefetch(const float *_row) noexcept {
+#if defined(__SSE__)
+            _mm_prefetch(reinterpret_cast<const char *>(_row), _MM_HINT_T0);
+#else
+            (void) _row;
+#endif
+        }
+
+        using scored_t = std::pair<float, uint32_t>;
+    }
+
+    const char hnsw_index_t::magic[8] = {'w', 'v', 'h', 'n', 's', 'w', '0', '1'};
+    const uint8_t hnsw_index_t::maxLevel;
+
+    struct hnsw_index_t::visited_t {
+        std::vector<uint32_t> marks;
+        uint32_t mark = 0;
+    };
+
+    hnsw_index_t::hnsw_index_t(uint16_t _vectorSize, const hnsw_setting_t &_hnswSettings):
+            m_vec_sz(_vectorSize), m_m(_hnswSettings.m), m_ef_construction(_hnswSettings.ef_construction),
+            m_ef(_hnswSettings.ef), m_links(), m_levels(), m_upper(), m_upper_links(), m_mapping(), m_locks(),
+            m_entry_lock(), m_pool_lock(), m_pool() {
+        if ((m_vec_sz == 0) || (m_m < 2) || (m_m > 1024) || (m_ef_construction == 0)) {
+            throw std::runtime_error("hnsw: wrong index settings");
+        }
+    }
+
+    hnsw_index_t::hnsw_index_t(const std::shared_ptr<file_mapper_t> &_mapping):
+            m_links(), m_levels(), m_upper(), m_upper_links(), m_mapping(_mapping), m_locks(), m_entry_lock(),
+            m_pool_lock(), m_pool() {
+        hnswHeader_t header{};
+        auto fileSize = static_cast<uint64_t>(m_mapping->size());
+        if (fileSize < sizeof(header)) {
+            throw std::runtime_error("hnsw: wrong index file format");
+        }
+        std::memcpy(&header, m_mapping->data(), sizeof(header));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("hnsw: wrong index file format");
+        }
+        if (header.version != hnswVersion) {
+            throw std::runtime_error("hnsw: unsupported index file version " + std::to_string(header.version));
+        }
+        // sections are checked in O(1), links are trusted
+        auto section = [fileSize](uint64_t _offset, uint64_t _size) {
+            return ((_offset % 64) == 0) && (_offset >= sizeof(hnswHeader_t)) && (_offset <= fileSize)
+                   && (_size <= fileSize - _offset);
+        };
+        if ((header.fileSize != fileSize) || (header.vectorSize == 0) || (header.m < 2) || (header.m > 1024)
+            || (header.efConstruction == 0) || (header.maxLevel > maxLevel)
+            || ((header.nodes > 0) && (header.entry >= header.nodes))
+            || !section(header.linksOffset, header.nodes * (2 * header.m + 1) * sizeof(uint32_t))
+            || !section(header.levelsOffset, header.nodes)
+            || !section(header.upperOffset, header.nodes * sizeof(uint64_t))
+            || !section(header.upperLinksOffset, header.upperSize * sizeof(uint32_t))) {
+            throw std::runtime_error("hnsw: wrong index file format");
+        }
+
+        m_vec_sz = header.vectorSize;
+        m_m = header.m;
+        m_ef_construction = header.efConstruction;
+        m_ef = header.ef;
+        m_nodes = header.nodes;
+        m_fingerprint = header.fingerprint;
+        m_entry = header.entry;
+        m_max_level = header.maxLevel;
+        auto data = static_cast<const char *>(m_mapping->data());
+        m_links.view(reinterpret_cast<const uint32_t *>(data + header.linksOffset), m_nodes * (2 * m_m + 1));
+        m_levels.view(reinterpret_cast<const uint8_t *>(data + header.levelsOffset), m_nodes);
+        m_upper.view(reinterpret_cast<const uint64_t *>(data + header.upperOffset), m_nodes);
+        m_upper_links.view(reinterpret_cast<const uint32_t *>(data + header.upperLinksOffset), header.upperSize);
+        m_mapping->advise(file_mapper_t::advice_t::random);
+    }
+
+    hnsw_index_t::hnsw_index_t(const hnsw_index_t &_index):
+            m_vec_sz(_index.m_vec_sz), m_m(_index.m_m), m_ef_construction(_index.m_ef_construction),
+            m_ef(_index.m_ef), m_nodes(_index.m_nodes), m_entry(_index.m_entry), m_max_level(_index.m_max_level),
+            m_links(_index.m_links), m_levels(_index.m_levels), m_upper(_index.m_upper),
+            m_upper_links(_index.m_upper_links), m_mapping(_index.m_mapping), m_locks(), m_entry_lock(),
+            m_pool_lock(), m_pool() {}
+
+    hnsw_index_t::~hnsw_index_t() = default;
+
+    std::shared_ptr<ann_index_t> hnsw_index_t::clone() const {
+        return std::make_shared<hnsw_index_t>(*this);
+    }
+
+    uint8_t hnsw_index_t::randomLevel(std::size_t _id) const noexcept {
+        // splitmix64 of node ID, so levels do not depend on the order of insertion by several threads
+        uint64_t value = static_cast<uint64_t>(_id) + 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        value ^= value >> 31;
+        // uniform (0, 1], levels are distributed exponentially with 1 / ln(m) scale
+        auto uniform = (static_cast<double>(value >> 11) + 1.0) / 9007199254740992.0;
+        auto level = -std::log(uniform) / std::log(static_cast<double>(m_m));
+
+        return static_cast<uint8_t>(std::min(level, static_cast<double>(maxLevel)));
+    }
+
+    void hnsw_index_t::neighbours(std::size_t _id, uint8_t _level, bool _locked,
+                                  std::vector<uint32_t> &_neighbours) const {
+        std::unique_lock<std::mutex> lock;
+        if (_locked) {
+            lock = std::unique_lock<std::mutex>(m_locks[_id % lockStripes]);
+        }
+        auto block = links(_id, _level);
+        _neighbours.assign(block + 1, block + 1 + block[0]);
+    }
+
+    void hnsw_index_t::greedy(const float *_matrix, const float *_vector, std::size_t &_current, float &_currentDot,
+                              uint8_t _level, bool _locked) const {
+        std::vector<uint32_t> linked;
+        auto changed = true;
+        while (changed) {
+            changed = false;
+            neighbours(_current, _level, _locked, linked);
+            for (auto const &i:linked) {
+                auto dot = dotFloat(_matrix + static_cast<std::size_t>(i) * m_vec_sz, _vector, m_vec_sz);
+                if (dot > _currentDot) {
+                    _currentDot = dot;
+                    _current = i;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    void hnsw_index_t::searchLevel(const float *_matrix, const float *_vector, std::size_t _entry, std::size_t _ef,
+                                   uint8_t _level, bool _locked, std::size_t _exclude,
+                                   std::vector<std::pair<float, uint32_t>> &_found) const {
+        std::unique_ptr<visited_t> visited;
+        {
+            std::lock_guard<std::mutex> lock(m_pool_lock);
+            if (!m_pool.empty()) {
+                visited = std::move(m_pool.back());
+                m_pool.pop_back();
+            }
+        }
+        if (!visited) {
+            visited.reset(new visited_t());
+        }
+        if (visited->marks.size() < m_nodes) {
+            visited->marks.resize(m_nodes, 0);
+        }
+        if (++visited->mark == 0) {
+            std::fill(visited->marks.begin(), visited->marks.end(), 0);
+            visited->mark = 1;
+        }
+        auto marks = visited->marks.data();
+        auto mark = visited->mark;
+
+        // candidates are expanded best first, the found list keeps the best _ef nodes, its worst node is on top
+        std::priority_queue<scored_t> candidates;
+        std::priority_queue<scored_t, std::vector<scored_t>, std::greater<scored_t>> best;
+        auto entryDot = dotFloat(_matrix + _entry * m_vec_sz, _vector, m_vec_sz);
+        marks[_entry] = mark;
+        candidates.emplace(entryDot, static_cast<uint32_t>(_entry));
+        if (_entry != _exclude) {
+            best.emplace(entryDot, static_cast<uint32_t>(_entry));
+        }
+        std::vector<uint32_t> linked;
+        while (!candidates.empty()) {
+            auto current = candidates.top();
+            if ((best.size() >= _ef) && (current.first < best.top().first)) {
+                break;
+            }
+            candidates.pop();
+            neighbours(current.second, _level, _locked, linked);
+            for (auto const &i:linked) {
+                prefetch(_matrix + static_cast<std::size_t>(i) * m_vec_sz);
+            }
+            for (auto const &i:linked) {
+                if (marks[i] == mark) {
+                    continue;
+                }
+                marks[i] = mark;
+                auto dot = dotFloat(_matrix + static_cast<std::size_t>(i) * m_vec_sz, _vector, m_vec_sz);
+                if ((best.size() < _ef) || (dot > best.top().first)) {
+                    candidates.emplace(dot, i);
+                    if (i != _exclude) {
+                        best.emplace(dot, i);
+                        if (best.size() > _ef) {
+                            best.pop();
+                        }
+                    }
+                }
+            }
+        }
+
+        _found.resize(best.size());
+        for (auto j = _found.size(); j > 0; --j) {
+            _found[j - 1] = best.top();
+            best.pop();
+        }
+
+        std::lock_guard<std::mutex> lock(m_pool_lock);
+        m_pool.push_back(std::move(visited));
+    }
+
+    void hnsw_index_t::select(const float *_matrix, std::vector<std::pair<float, uint32_t>> &_candidates,
+                              std::size_t _amount) const {
+        if (_candidates.size() <= _amount) {
+            return;
+        }
+
+        // a candidate closer to one of the selected nodes than to the base node is reachable through that node
+        std::vector<scored_t> selected;
+        selected.reserve(_amount);
+        for (auto const &i:_candidates) {
+            if (selected.size() >= _amount) {
+                break;
+            }
+            auto row = _matrix + static_cast<std::size_t>(i.second) * m_vec_sz;
+            auto diverse = std::none_of(selected.begin(), selected.end(), [&](const scored_t &_selected) {
+                return dotFloat(row, _matrix + static_cast<std::size_t>(_selected.second) * m_vec_sz,
+                                m_vec_sz) > i.first;
+            });
+            if (diverse) {
+                selected.push_back(i);
+            }
+        }
+        _candidates.swap(selected);
+    }
+
+    void hnsw_index_t::connect(const float *_matrix, std::size_t _id, uint8_t _level, bool _locked,
+                               const std::vector<std::pair<float, uint32_t>> &_candidates) {
+        std::size_t maxLinks = (_level == 0) ? 2 * m_m : m_m;
+        {
+            std::unique_lock<std::mutex> lock;
+            if (_locked) {
+                lock = std::unique_lock<std::mutex>(m_locks[_id % lockStripes]);
+            }
+            auto block = links(_id, _level);
+            block[0] = static_cast<uint32_t>(_candidates.size());
+            for (std::size_t i = 0; i < _candidates.size(); ++i) {
+                block[i + 1] = _candidates[i].second;
+            }
+        }
+
+        std::vector<scored_t> shrunk;
+        for (auto const &i:_candidates) {
+            std::unique_lock<std::mutex> lock;
+            if (_locked) {
+                lock = std::unique_lock<std::mutex>(m_locks[i.second % lockStripes]);
+            }
+            auto block = links(i.second, _level);
+            auto end = block + 1 + block[0];
+            if (std::find(block + 1, end, static_cast<uint32_t>(_id)) != end) {
+                continue;
+            }
+            if (block[0] < maxLinks) {
+                *end = static_cast<uint32_t>(_id);
+                ++block[0];
+                continue;
+            }
+
+            // full node keeps the best of its links and the new one
+            auto row = _matrix + static_cast<std::size_t>(i.second) * m_vec_sz;
+            shrunk.clear();
+            shrunk.emplace_back(i.first, static_cast<uint32_t>(_id));
+            for (auto j = block + 1; j != end; ++j) {
+                shrunk.emplace_back(dotFloat(row, _matrix + static_cast<std::size_t>(*j) * m_vec_sz, m_vec_sz), *j);
+            }
+            std::sort(shrunk.begin(), shrunk.end(), std::greater<scored_t>());
+            select(_matrix, shrunk, maxLinks);
+            block[0] = static_cast<uint32_t>(shrunk.size());
+            for (std::size_t j = 0; j < shrunk.size(); ++j) {
+                block[j + 1] = shrunk[j].second;
+            }
+        }
+    }
+
+    void hnsw_index_t::link(const float *_matrix, std::size_t _id, bool _locked) {
+        auto level = m_levels[_id];
+        auto vector = _matrix + _id * m_vec_sz;
+
+        // node of a new top level holds the entry lock until it becomes the entry point
+        std::unique_lock<std::mutex> entryLock(m_entry_lock);
+        auto maxLevel = m_max_level;
+        auto current = m_entry;
+        if (level <= maxLevel) {
+            entryLock.unlock();
+        }
+
+        auto currentDot = dotFloat(_matrix + current * m_vec_sz, vector, m_vec_sz);
+        for (auto l = maxLevel; l > level; --l) {
+            greedy(_matrix, vector, current, currentDot, l, _locked);
+        }
+        std::vector<scored_t> candidates;
+        for (auto l = static_cast<int>(std::min(level, maxLevel)); l >= 0; --l) {
+            searchLevel(_matrix, vector, current, m_ef_construction, static_cast<uint8_t>(l), _locked, _id,
+                        candidates);
+            if (!candidates.empty()) {
+                current = candidates.front().second;
+            }
+            select(_matrix, candidates, m_m);
+            connect(_matrix, _id, static_cast<uint8_t>(l), _locked, candidates);
+        }
+        if (level > maxLevel) {
+            m_entry = _id;
+            m_max_level = level;
+        }
+    }
+
+    void hnsw_index_t::add(const float *_matrix, std::size_t _rows, uint16_t _threads) {
+        if (_rows <= m_nodes) {
+            return;
+        }
+        if (_rows > UINT32_MAX) {
+            throw std::runtime_error("hnsw: too many nodes");
+        }
+
+        // arrays are owned and sized before insertion threads are started
+        auto first = m_nodes;
+        m_links.owned().resize(_rows * (2 * m_m + 1), 0);
+        auto &levels = m_levels.owned();
+        auto &upper = m_upper.owned();
+        auto &upperLinks = m_upper_links.owned();
+        levels.resize(_rows);
+        upper.resize(_rows, 0);
+        for (auto i = first; i < _rows; ++i) {
+            levels[i] = randomLevel(i);
+            if (levels[i] > 0) {
+                upper[i] = upperLinks.size();
+                upperLinks.resize(upperLinks.size() + levels[i] * (m_m + 1), 0);
+            }
+        }
+        m_nodes = _rows;
+        if (first == 0) {
+            m_entry = 0;
+            m_max_level = levels[0];
+            first = 1;
+        }
+        if (!m_locks) {
+            m_locks.reset(new std::mutex[lockStripes]);
+        }
+
+        modelFile_t::parallel(_rows - first, [this, _matrix, first](std::size_t _begin, std::size_t _end) {
+            for (auto i = _begin; i < _end; ++i) {
+                link(_matrix, first + i, true);
+            }
+        }, _threads, 256);
+    }
+
+    void hnsw_index_t::update(const float *_matrix, std::size_t _id) {
+        if ((_id >= m_nodes) || (m_nodes == 1)) {
+            return;
+        }
+        m_links.owned();
+        m_upper_links.owned();
+        link(_matrix, _id, false);
+    }
+
+    void hnsw_index_t::remove(const float *_matrix, std::size_t _id) {
+        if (_id >= m_nodes) {
+            return;
+        }
+        auto last = m_nodes - 1;
+        auto &bottom = m_links.owned();
+        auto &levels = m_levels.owned();
+        auto &upper = m_upper.owned();
+        m_upper_links.owned();
+
+        for (std::size_t n = 0; n < m_nodes; ++n) {
+            if (n == _id) {
+                continue;
+            }
+            auto row = _matrix + n * m_vec_sz;
+            for (int l = 0; l <= levels[n]; ++l) {
+                auto block = links(n, static_cast<uint8_t>(l));
+                auto end = block + 1 + block[0];
+                auto pos = std::find(block + 1, end, static_cast<uint32_t>(_id));
+                if (pos != end) {
+                    // the best neighbour of the removed node takes its place
+                    auto removed = links(_id, static_cast<uint8_t>(l));
+                    auto best = noNode;
+                    auto bestDot = 0.0f;
+                    for (auto j = removed + 1; j != removed + 1 + removed[0]; ++j) {
+                        if ((*j == n) || (std::find(block + 1, end, *j) != end)) {
+                            continue;
+                        }
+                        auto dot = dotFloat(row, _matrix + static_cast<std::size_t>(*j) * m_vec_sz, m_vec_sz);
+                        if ((best == noNode) || (dot > bestDot)) {
+                            best = *j;
+                            bestDot = dot;
+                        }
+                    }
+                    if (best != noNode) {
+                        *pos = static_cast<uint32_t>(best);
+                    } else {
+                        *pos = *(end - 1);
+                        --block[0];
+                    }
+                }
+                std::replace(block + 1, block + 1 + block[0], static_cast<uint32_t>(last),
+                             static_cast<uint32_t>(_id));
+            }
+        }
+
+        // upper level blocks of the removed node stay in the pool unused
+        auto blockSize = static_cast<std::size_t>(2 * m_m + 1);
+        if (_id != last) {
+            std::copy(bottom.begin() + last * blockSize, bottom.end(), bottom.begin() + _id * blockSize);
+            levels[_id] = levels[last];
+            upper[_id] = upper[last];
+        }
+        bottom.resize(last * blockSize);
+        levels.resize(last);
+        upper.resize(last);
+        m_nodes = last;
+
+        if (m_entry == _id) {
+            m_entry = 0;
+            m_max_level = 0;
+            for (std::size_t i = 0; i < m_nodes; ++i) {
+                if (levels[i] > m_max_level) {
+                    m_entry = i;
+                    m_max_level = levels[i];
+                }
+            }
+        } else if (m_entry == last) {
+            m_entry = _id;
+        }
+    }
+
+    void hnsw_index_t::search(const float *_matrix, const float *_vector, std::size_t _amount,
+                              std::vector<std::pair<float, uint32_t>> &_found) const {
+        _found.clear();
+        if (m_nodes == 0) {
+            return;
+        }
+
+        auto current = m_entry;
+        auto currentDot = dotFloat(_matrix + current * m_vec_sz, _vector, m_vec_sz);
+        for (auto l = m_max_level; l > 0; --l) {
+            greedy(_matrix, _vector, current, currentDot, l, false);
+        }
+        searchLevel(_matrix, _vector, current, std::max<std::size_t>(m_ef, _amount), 0, false, noNode, _found);
+    }
+
+    void hnsw_index_t::save(const std::string &_indexFile, uint64_t _fingerprint) const {
+        hnswHeader_t header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = hnswVersion;
+        header.fingerprint = _fingerprint;
+        header.vectorSize = m_vec_sz;
+        header.m = m_m;
+        header.efConstruction = m_ef_construction;
+        header.ef = m_ef;
+        header.maxLevel = m_max_level;
+        header.nodes = m_nodes;
+        header.entry = m_entry;
+        header.upperSize = m_upper_links.size();
+        header.linksOffset = alignSection(sizeof(header));
+        header.levelsOffset = alignSection(header.linksOffset + m_links.size() * sizeof(uint32_t));
+        header.upperOffset = alignSection(header.levelsOffset + m_levels.size());
+        header.upperLinksOffset = alignSection(header.upperOffset + m_upper.size() * sizeof(uint64_t));
+        header.fileSize = header.upperLinksOffset + m_upper_links.size() * sizeof(uint32_t);
+
+        file_mapper_t output(_indexFile, true, static_cast<off_t>(header.fileSize));
+        std::memset(output.data(), 0, header.fileSize);
+        std::memcpy(output.data(), &header, sizeof(header));
+        std::memcpy(output.data() + header.linksOffset, m_links.data(), m_links.size() * sizeof(uint32_t));
+        std::memcpy(output.data() + header.levelsOffset, m_levels.data(), m_levels.size());
+        std::memcpy(output.data() + header.upperOffset, m_upper.data(), m_upper.size() * sizeof(uint64_t));
+        std::memcpy(output.data() + header.upperLinksOffset, m_upper_links.data(),
+                    m_upper_links.size() * sizeof(uint32_t));
+    }
+}
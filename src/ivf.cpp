@@ -0,0 +1,501 @@
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+#include "modelFile.hpp"
+
+namespace wordvec {
+    namespace {
+        const uint32_t ivfVersion = 2;
+        // rows of a list are scanned by blocks, dot products of a block stay in L1 cache
+        const std::size_t blockRows = 256;
+        // rows assigned to centroids by one thread
+        const std::size_t assignMin = 1024;
+
+        // index file header. Sections follow at 64-byte aligned offsets: centroids, offsets of lists in the
+        // following sections (lists + 1), IDs of all lists, rows or codes of all lists, list of each node, pq
+        // codebooks and rotation
+        struct ivfHeader_t {
+            char magic[8];
+            uint32_t version;
+            uint16_t vectorSize;
+            uint16_t nprobe;
+            uint16_t rerank;
+            // 0 - fp32 rows
+            uint16_t subspaces;
+            uint8_t withPq;
+            uint8_t rotation;
+            uint8_t reserved[2];
+            uint64_t lists;
+            uint64_t nodes;
+            uint64_t centroidsOffset;
+            uint64_t listOffsetsOffset;
+            uint64_t idsOffset;
+            uint64_t rowsOffset;
+            uint64_t nodeListsOffset;
+            uint64_t codebooksOffset;
+            uint64_t rotationOffset;
+            uint64_t fileSize;
+            // fingerprint of the model the index is saved with
+            uint64_t fingerprint;
+        };
+
+        inline uint64_t alignSection(uint64_t _offset) noexcept {
+            return (_offset + 63) & ~static_cast<uint64_t>(63);
+        }
+
+        using scored_t = std::pair<float, uint32_t>;
+    }
+
+    const char ivf_index_t::magic[8] = {'w', 'v', 'i', 'v', 'f', 'i', '0', '1'};
+
+    ivf_index_t::ivf_index_t(uint16_t _vectorSize, const ivf_setting_t &_ivfSettings):
+            m_vec_sz(_vectorSize), m_ivf_settings(_ivfSettings), m_centroids(), m_half_norms(), m_lists(),
+            m_node_lists(), m_pq(), m_mapping() {
+        if ((m_vec_sz == 0) || (m_ivf_settings.iterations == 0)) {
+            throw std::runtime_error("ivf: wrong index settings");
+        }
+    }
+
+    ivf_index_t::ivf_index_t(const std::shared_ptr<file_mapper_t> &_mapping):
+            m_ivf_settings(), m_centroids(), m_half_norms(), m_lists(), m_node_lists(), m_pq(), m_mapping(_mapping) {
+        ivfHeader_t header{};
+        auto fileSize = static_cast<uint64_t>(m_mapping->size());
+        if (fileSize < sizeof(header)) {
+            throw std::runtime_error("ivf: wrong index file format");
+        }
+        std::memcpy(&header, m_mapping->data(), sizeof(header));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("ivf: wrong index file format");
+        }
+        if (header.version != ivfVersion) {
+            throw std::runtime_error("ivf: unsupported index file version " + std::to_string(header.version));
+        }
+        auto section = [fileSize](uint64_t _offset, uint64_t _size) {
+            return ((_offset % 64) == 0) && (_offset >= sizeof(ivfHeader_t)) && (_offset <= fileSize)
+                   && (_size <= fileSize - _offset);
+        };
+        auto rowSize = (header.subspaces > 0) ? header.subspaces : header.vectorSize * sizeof(float);
+        auto rotationSize = uint64_t{header.vectorSize} * header.vectorSize * sizeof(float);
+        auto subSize = (header.subspaces > 0) ? header.vectorSize / header.subspaces : 0;
+        if ((header.fileSize != fileSize) || (header.vectorSize == 0) || ((header.lists == 0) && (header.nodes > 0))
+            || ((header.subspaces > 0) && ((header.withPq == 0) || ((header.vectorSize % header.subspaces) != 0)))
+            || ((header.withPq != 0) && (header.lists > 0) && (header.subspaces == 0))
+            || !section(header.centroidsOffset, header.lists * header.vectorSize * sizeof(float))
+            || !section(header.listOffsetsOffset, (header.lists + 1) * sizeof(uint64_t))
+            || !section(header.idsOffset, header.nodes * sizeof(uint32_t))
+            || !section(header.rowsOffset, header.nodes * rowSize)
+            || !section(header.nodeListsOffset, header.nodes * sizeof(uint32_t))
+            || !section(header.codebooksOffset, header.subspaces * pq_codec_t::centroids * subSize * sizeof(float))
+            || ((header.rotation != 0) && !section(header.rotationOffset, rotationSize))) {
+            throw std::runtime_error("ivf: wrong index file format");
+        }
+        auto data = static_cast<const char *>(m_mapping->data());
+        auto listOffsets = reinterpret_cast<const uint64_t *>(data + header.listOffsetsOffset);
+        for (uint64_t i = 0; i < header.lists; ++i) {
+            if (listOffsets[i] > listOffsets[i + 1]) {
+                throw std::runtime_error("ivf: wrong index file format");
+            }
+        }
+        if ((listOffsets[0] != 0) || (listOffsets[header.lists] != header.nodes)) {
+            throw std::runtime_error("ivf: wrong index file format");
+        }
+
+        m_vec_sz = header.vectorSize;
+        m_nodes = header.nodes;
+        m_fingerprint = header.fingerprint;
+        m_ivf_settings.lists = static_cast<uint32_t>(header.lists);
+        m_ivf_settings.nprobe = header.nprobe;
+        m_ivf_settings.rerank = header.rerank;
+        m_ivf_settings.with_pq = (header.withPq != 0);
+        m_centroids.view(reinterpret_cast<const float *>(data + header.centroidsOffset), header.lists * m_vec_sz);
+        auto &halfNorms = m_half_norms.owned();
+        halfNorms.resize(header.lists);
+        for (std::size_t c = 0; c < header.lists; ++c) {
+            halfNorms[c] = 0.5f * dotFloat(m_centroids.data() + c * m_vec_sz, m_centroids.data() + c * m_vec_sz,
+                                           m_vec_sz);
+        }
+        if (header.subspaces > 0) {
+            auto rotation = (header.rotation != 0) ? reinterpret_cast<const float *>(data + header.rotationOffset)
+                                                   : nullptr;
+            m_pq = std::make_shared<pq_codec_t>(0, m_vec_sz, header.subspaces,
+                                                reinterpret_cast<const float *>(data + header.codebooksOffset),
+                                                rotation, nullptr);
+        }
+        auto ids = reinterpret_cast<const uint32_t *>(data + header.idsOffset);
+        m_lists.resize(header.lists);
+        for (std::size_t i = 0; i < header.lists; ++i) {
+            auto begin = listOffsets[i];
+            auto size = listOffsets[i + 1] - begin;
+            m_lists[i].ids.view(ids + begin, size);
+            if (m_pq) {
+                m_lists[i].codes.view(reinterpret_cast<const uint8_t *>(data + header.rowsOffset)
+                                      + begin * header.subspaces, size * header.subspaces);
+            } else {
+                m_lists[i].rows.view(reinterpret_cast<const float *>(data + header.rowsOffset) + begin * m_vec_sz,
+                                     size * m_vec_sz);
+            }
+        }
+        m_node_lists.view(reinterpret_cast<const uint32_t *>(data + header.nodeListsOffset), m_nodes);
+    }
+
+    std::shared_ptr<ann_index_t> ivf_index_t::clone() const {
+        return std::make_shared<ivf_index_t>(*this);
+    }
+
+    void ivf_index_t::train(const float *_matrix, std::size_t _rows, uint16_t _threads) {
+        std::size_t lists = m_ivf_settings.lists;
+        if (lists == 0) {
+            lists = static_cast<std::size_t>(std::lround(std::sqrt(static_cast<double>(_rows))));
+        }
+        lists = std::max<std::size_t>(std::min(lists, _rows), 1);
+
+        // uniform sample of rows
+        auto sampleSize = _rows;
+        if ((m_ivf_settings.sample > 0) && (lists * m_ivf_settings.sample < _rows)) {
+            sampleSize = lists * m_ivf_settings.sample;
+        }
+        std::vector<float> sample(sampleSize * m_vec_sz);
+        for (std::size_t i = 0; i < sampleSize; ++i) {
+            auto row = _matrix + (i * _rows / sampleSize) * m_vec_sz;
+            std::copy(row, row + m_vec_sz, sample.begin() + i * m_vec_sz);
+        }
+
+        // Lloyd's k-means, initial centroids are spread over the sample. Points are assigned in parallel, every
+        // thread accumulates its own sums
+        auto &centroids = m_centroids.owned();
+        centroids.resize(lists * m_vec_sz);
+        for (std::size_t c = 0; c < lists; ++c) {
+            auto point = sample.begin() + (c * sampleSize / lists) * m_vec_sz;
+            std::copy(point, point + m_vec_sz, centroids.begin() + c * m_vec_sz);
+        }
+        auto &halfNorms = m_half_norms.owned();
+        halfNorms.resize(lists);
+        std::vector<double> sums(lists * m_vec_sz);
+        std::vector<std::size_t> counts(lists);
+        std::mutex sumsLock;
+        for (uint16_t iteration = 0; iteration <= m_ivf_settings.iterations; ++iteration) {
+            for (std::size_t c = 0; c < lists; ++c) {
+                auto centroid = centroids.data() + c * m_vec_sz;
+                halfNorms[c] = 0.5f * dotFloat(centroid, centroid, m_vec_sz);
+            }
+            // the last pass computes half norms of the final centroids only
+            if (iteration == m_ivf_settings.iterations) {
+                break;
+            }
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(counts.begin(), counts.end(), 0);
+            modelFile_t::parallel(sampleSize, [&](std::size_t _begin, std::size_t _end) {
+                std::vector<double> threadSums(lists * m_vec_sz);
+                std::vector<std::size_t> threadCounts(lists);
+                std::vector<float> dots(lists);
+                for (auto i = _begin; i < _end; ++i) {
+                    auto point = sample.data() + i * m_vec_sz;
+                    auto c = nearestList(point, dots);
+                    ++threadCounts[c];
+                    for (uint16_t k = 0; k < m_vec_sz; ++k) {
+                        threadSums[c * m_vec_sz + k] += point[k];
+                    }
+                }
+                std::lock_guard<std::mutex> lock(sumsLock);
+                for (std::size_t j = 0; j < sums.size(); ++j) {
+                    sums[j] += threadSums[j];
+                }
+                for (std::size_t c = 0; c < lists; ++c) {
+                    counts[c] += threadCounts[c];
+                }
+            }, _threads, assignMin);
+            for (std::size_t c = 0; c < lists; ++c) {
+                if (counts[c] == 0) {
+                    // empty cluster is moved to some point of the sample
+                    auto point = sample.begin() + ((c * 7919 + iteration * 104729) % sampleSize) * m_vec_sz;
+                    std::copy(point, point + m_vec_sz, centroids.begin() + c * m_vec_sz);
+                    continue;
+                }
+                for (uint16_t k = 0; k < m_vec_sz; ++k) {
+                    centroids[c * m_vec_sz + k] = static_cast<float>(sums[c * m_vec_sz + k] / counts[c]);
+                }
+            }
+        }
+        m_lists.resize(lists);
+    }
+
+    std::size_t ivf_index_t::nearestList(const float *_vector, std::vector<float> &_dots) const {
+        auto lists = m_half_norms.size();
+        dotRows(m_centroids.data(), lists, _vector, m_vec_sz, _dots.data());
+        std::size_t ret = 0;
+        for (std::size_t c = 1; c < lists; ++c) {
+            if (_dots[c] - m_half_norms[c] > _dots[ret] - m_half_norms[ret]) {
+                ret = c;
+            }
+        }
+
+        return ret;
+    }
+
+    void ivf_index_t::residual(const float *_row, std::size_t _list, float *_residual) const noexcept {
+        auto centroid = m_centroids.data() + _list * m_vec_sz;
+        for (uint16_t k = 0; k < m_vec_sz; ++k) {
+            _residual[k] = _row[k] - centroid[k];
+        }
+    }
+
+    void ivf_index_t::append(std::size_t _list, std::size_t _id, const float *_row, const uint8_t *_code) {
+        auto &list = m_lists[_list];
+        list.ids.owned().push_back(static_cast<uint32_t>(_id));
+        if (_code != nullptr) {
+            auto &codes = list.codes.owned();
+            codes.insert(codes.end(), _code, _code + m_pq->subspaces());
+        } else {
+            auto &rows = list.rows.owned();
+            rows.insert(rows.end(), _row, _row + m_vec_sz);
+        }
+        m_node_lists.owned()[_id] = static_cast<uint32_t>(_list);
+    }
+
+    void ivf_index_t::unlist(std::size_t _id) {
+        auto &list = m_lists[m_node_lists[_id]];
+        auto &ids = list.ids.owned();
+        auto pos = static_cast<std::size_t>(std::find(ids.begin(), ids.end(), static_cast<uint32_t>(_id))
+                                            - ids.begin());
+        auto last = ids.size() - 1;
+        ids[pos] = ids[last];
+        ids.pop_back();
+        if (m_pq) {
+            auto &codes = list.codes.owned();
+            std::size_t size = m_pq->subspaces();
+            std::copy(codes.begin() + last * size, codes.end(), codes.begin() + pos * size);
+            codes.resize(last * size);
+        } else {
+            auto &rows = list.rows.owned();
+            std::copy(rows.begin() + last * m_vec_sz, rows.end(), rows.begin() + pos * m_vec_sz);
+            rows.resize(last * m_vec_sz);
+        }
+    }
+
+    void ivf_index_t::add(const float *_matrix, std::size_t _rows, uint16_t _threads) {
+        if (_rows <= m_nodes) {
+            return;
+        }
+        if (m_lists.empty()) {
+            train(_matrix, _rows, _threads);
+        }
+
+        auto first = m_nodes;
+        auto count = _rows - first;
+        std::vector<uint32_t> assigned(count);
+        modelFile_t::parallel(count, [&](std::size_t _begin, std::size_t _end) {
+            std::vector<float> dots(m_lists.size());
+            for (auto i = _begin; i < _end; ++i) {
+                assigned[i] = static_cast<uint32_t>(nearestList(_matrix + (first + i) * m_vec_sz, dots));
+            }
+        }, _threads, assignMin);
+
+        // residuals of the first rows train the codebooks
+        std::vector<uint8_t> codes;
+        if (m_ivf_settings.with_pq) {
+            auto rowResidual = [&](std::size_t _i, float *_residual) {
+                residual(_matrix + (first + _i) * m_vec_sz, assigned[_i], _residual);
+            };
+            if (!m_pq) {
+                auto pqSettings = m_ivf_settings.pq;
+                pqSettings.threads = _threads;
+                m_pq = std::make_shared<pq_codec_t>(count, m_vec_sz, rowResidual, pqSettings);
+                codes.assign(m_pq->codes().data(), m_pq->codes().data() + m_pq->codes().size());
+                m_pq->releaseCodes();
+            } else {
+                codes.resize(count * m_pq->subspaces());
+                modelFile_t::parallel(count, [&](std::size_t _begin, std::size_t _end) {
+                    std::vector<float> vector(m_vec_sz);
+                    for (auto i = _begin; i < _end; ++i) {
+                        rowResidual(i, vector.data());
+                        m_pq->encode(vector.data(), codes.data() + i * m_pq->subspaces());
+                    }
+                }, _threads, assignMin);
+            }
+        }
+
+        std::vector<std::size_t> listSizes(m_lists.size());
+        for (auto const &i:assigned) {
+            ++listSizes[i];
+        }
+        for (std::size_t i = 0; i < m_lists.size(); ++i) {
+            auto size = m_lists[i].ids.size() + listSizes[i];
+            m_lists[i].ids.owned().reserve(size);
+            if (m_pq) {
+                m_lists[i].codes.owned().reserve(size * m_pq->subspaces());
+            } else {
+                m_lists[i].rows.owned().reserve(size * m_vec_sz);
+            }
+        }
+        m_node_lists.owned().resize(_rows);
+        for (std::size_t i = 0; i < count; ++i) {
+            append(assigned[i], first + i, _matrix + (first + i) * m_vec_sz,
+                   m_pq ? codes.data() + i * m_pq->subspaces() : nullptr);
+        }
+        m_nodes = _rows;
+    }
+
+    void ivf_index_t::update(const float *_matrix, std::size_t _id) {
+        unlist(_id);
+        auto row = _matrix + _id * m_vec_sz;
+        std::vector<float> dots(m_lists.size());
+        auto list = nearestList(row, dots);
+        std::vector<uint8_t> code;
+        if (m_pq) {
+            std::vector<float> vector(m_vec_sz);
+            residual(row, list, vector.data());
+            code.resize(m_pq->subspaces());
+            m_pq->encode(vector.data(), code.data());
+        }
+        append(list, _id, row, m_pq ? code.data() : nullptr);
+    }
+
+    void ivf_index_t::remove(const float *, std::size_t _id) {
+        unlist(_id);
+        auto last = m_nodes - 1;
+        auto &nodeLists = m_node_lists.owned();
+        if (_id != last) {
+            auto &ids = m_lists[nodeLists[last]].ids.owned();
+            *std::find(ids.begin(), ids.end(), static_cast<uint32_t>(last)) = static_cast<uint32_t>(_id);
+            nodeLists[_id] = nodeLists[last];
+        }
+        nodeLists.pop_back();
+        --m_nodes;
+    }
+
+    void ivf_index_t::search(const float *_matrix, const float *_vector, std::size_t _amount,
+                             std::vector<std::pair<float, uint32_t>> &_found) const {
+        _found.clear();
+        if ((m_nodes == 0) || (_amount == 0)) {
+            return;
+        }
+
+        // nprobe lists of the nearest centroids, dot products of centroids are kept for pq scores
+        auto lists = m_lists.size();
+        std::vector<float> dots(std::max(lists, blockRows));
+        dotRows(m_centroids.data(), lists, _vector, m_vec_sz, dots.data());
+        std::vector<scored_t> probes(lists);
+        for (std::size_t c = 0; c < lists; ++c) {
+            probes[c] = scored_t(dots[c] - m_half_norms[c], static_cast<uint32_t>(c));
+        }
+        auto nprobe = std::min<std::size_t>(std::max<uint16_t>(m_ivf_settings.nprobe, 1), lists);
+        std::partial_sort(probes.begin(), probes.begin() + static_cast<std::ptrdiff_t>(nprobe), probes.end(),
+                          std::greater<scored_t>());
+        probes.resize(nprobe);
+
+        auto rerank = (m_pq && (m_ivf_settings.rerank > 0)) ? m_ivf_settings.rerank : 1;
+        nearest_rows_t nearestRows(_amount * rerank);
+        if (!m_pq) {
+            for (auto const &probe:probes) {
+                auto const &list = m_lists[probe.second];
+                auto size = list.ids.size();
+                for (std::size_t block = 0; block < size; block += blockRows) {
+                    auto blockSize = std::min(blockRows, size - block);
+                    dotRows(list.rows.data() + block * m_vec_sz, blockSize, _vector, m_vec_sz, dots.data());
+                    auto entryLevel = nearestRows.entryLevel();
+                    for (std::size_t i = 0; i < blockSize; ++i) {
+                        if (dots[i] > entryLevel) {
+                            nearestRows.push(dots[i], list.ids[block + i]);
+                            entryLevel = nearestRows.entryLevel();
+                        }
+                    }
+                }
+            }
+            _found = nearestRows.sorted();
+            return;
+        }
+
+        // row is approximated by its centroid and the decoded residual, so its dot product is the centroid dot
+        // product plus the lookup table sum
+        auto subspaces = m_pq->subspaces();
+        std::vector<float> table(subspaces * pq_codec_t::centroids);
+        m_pq->lookup(_vector, table.data());
+        for (auto const &probe:probes) {
+            auto const &list = m_lists[probe.second];
+            auto centroidDot = probe.first + m_half_norms[probe.second];
+            auto codes = list.codes.data();
+            auto entryLevel = nearestRows.entryLevel();
+            for (std::size_t i = 0; i < list.ids.size(); ++i) {
+                auto dot = centroidDot + dotCodes(codes + i * subspaces, table.data(), subspaces);
+                if (dot > entryLevel) {
+                    nearestRows.push(dot, list.ids[i]);
+                    entryLevel = nearestRows.entryLevel();
+                }
+            }
+        }
+        _found = nearestRows.sorted();
+        if (m_ivf_settings.rerank > 0) {
+            for (auto &i:_found) {
+                i.first = dotFloat(_matrix + static_cast<std::size_t>(i.second) * m_vec_sz, _vector, m_vec_sz);
+            }
+            std::sort(_found.begin(), _found.end(), std::greater<scored_t>());
+        }
+    }
+
+    void ivf_index_t::save(const std::string &_indexFile, uint64_t _fingerprint) const {
+        ivfHeader_t header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = ivfVersion;
+        header.fingerprint = _fingerprint;
+        header.vectorSize = m_vec_sz;
+        header.nprobe = m_ivf_settings.nprobe;
+        header.rerank = m_ivf_settings.rerank;
+        header.subspaces = m_pq ? m_pq->subspaces() : 0;
+        header.withPq = m_ivf_settings.with_pq ? 1 : 0;
+        header.rotation = (m_pq && !m_pq->rotation().empty()) ? 1 : 0;
+        header.lists = m_lists.size();
+        header.nodes = m_nodes;
+        auto rowSize = m_pq ? header.subspaces : m_vec_sz * sizeof(float);
+        header.centroidsOffset = alignSection(sizeof(header));
+        header.listOffsetsOffset = alignSection(header.centroidsOffset + m_centroids.size() * sizeof(float));
+        header.idsOffset = alignSection(header.listOffsetsOffset + (header.lists + 1) * sizeof(uint64_t));
+        header.rowsOffset = alignSection(header.idsOffset + m_nodes * sizeof(uint32_t));
+        header.nodeListsOffset = alignSection(header.rowsOffset + m_nodes * rowSize);
+        header.codebooksOffset = alignSection(header.nodeListsOffset + m_nodes * sizeof(uint32_t));
+        auto codebooksSize = m_pq ? m_pq->codebooks().size() * sizeof(float) : 0;
+        header.rotationOffset = alignSection(header.codebooksOffset + codebooksSize);
+        auto rotationSize = m_pq ? m_pq->rotation().size() * sizeof(float) : 0;
+        header.fileSize = header.rotationOffset + rotationSize;
+
+        file_mapper_t output(_indexFile, true, static_cast<off_t>(header.fileSize));
+        std::memset(output.data(), 0, header.fileSize);
+        std::memcpy(output.data(), &header, sizeof(header));
+        if (!m_centroids.empty()) {
+            std::memcpy(output.data() + header.centroidsOffset, m_centroids.data(),
+                        m_centroids.size() * sizeof(float));
+        }
+        auto listOffsets = reinterpret_cast<uint64_t *>(output.data() + header.listOffsetsOffset);
+        uint64_t offset = 0;
+        for (std::size_t i = 0; i < m_lists.size(); ++i) {
+            auto const &list = m_lists[i];
+            listOffsets[i] = offset;
+            if (list.ids.empty()) {
+                continue;
+            }
+            std::memcpy(output.data() + header.idsOffset + offset * sizeof(uint32_t), list.ids.data(),
+                        list.ids.size() * sizeof(uint32_t));
+            if (m_pq) {
+                std::memcpy(output.data() + header.rowsOffset + offset * rowSize, list.codes.data(),
+                            list.codes.size());
+            } else {
+                std::memcpy(output.data() + header.rowsOffset + offset * rowSize, list.rows.data(),
+                            list.rows.size() * sizeof(float));
+            }
+            offset += list.ids.size();
+        }
+        listOffsets[m_lists.size()] = offset;
+        if (m_nodes > 0) {
+            std::memcpy(output.data() + header.nodeListsOffset, m_node_lists.data(), m_nodes * sizeof(uint32_t));
+        }
+        if (m_pq) {
+            std::memcpy(output.data() + header.codebooksOffset, m_pq->codebooks().data(), codebooksSize);
+        }
+        if (rotationSize > 0) {
+            std::memcpy(output.data() + header.rotationOffset, m_pq->rotation().data(), rotationSize);
+        }
+    }
+}
@@ -54,6 +54,46 @@ namespace wordvec {
         }
     }
 
+    void file_mapper_t::sync() const {
+        if (m_wr_flag && (msync(m_data.rw_data, static_cast<size_t>(m_size), MS_SYNC) < 0)) {
+            std::string err = std::string("fileMapper: ") + m_fileName + " - " + std::strerror(errno);
+            throw std::runtime_error(err);
+        }
+    }
+
+    void file_mapper_t::advise(advice_t _advice, off_t _offset, off_t _size) const noexcept {
+        if ((_offset < 0) || (_offset >= m_size)) {
+            return;
+        }
+        if ((_size <= 0) || (_size > m_size - _offset)) {
+            _size = m_size - _offset;
+        }
+
+        int advice = MADV_NORMAL;
+        switch (_advice) {
+            case advice_t::normal:
+                break;
+            case advice_t::random:
+                advice = MADV_RANDOM;
+                break;
+            case advice_t::sequential:
+                advice = MADV_SEQUENTIAL;
+                break;
+            case advice_t::willNeed:
+                advice = MADV_WILLNEED;
+                break;
+            case advice_t::dontNeed:
+                advice = MADV_DONTNEED;
+                break;
+        }
+
+        // madvise requires page aligned address
+        auto pageSize = static_cast<off_t>(sysconf(_SC_PAGESIZE));
+        auto start = _offset / pageSize * pageSize;
+        // it is just a hint, failure is not an error
+        madvise(m_data.rw_data + start, static_cast<size_t>(_size + _offset - start), advice);
+    }
+
     file_mapper_t::~file_mapper_t() {
 #if defined(sun) || defined(__sun)
         munmap(m_data.rw_data, static_cast<size_t>(m_size));
@@ -0,0 +1,166 @@
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "matrix.hpp"
+
+namespace wordvec {
+    namespace {
+        void pageFaults(std::size_t &_major, std::size_t &_minor) noexcept {
+            struct rusage usage{};
+            if (getrusage(RUSAGE_SELF, &usage) == 0) {
+                _major = static_cast<std::size_t>(usage.ru_majflt);
+                _minor = static_cast<std::size_t>(usage.ru_minflt);
+            }
+        }
+    }
+
+    trainMatrices_t::trainMatrices_t(const std::string &_fileName, std::size_t _size):
+            m_fileName(_fileName), m_size(_size), m_trainMatrix(), m_bpWeights(), m_fileMapper() {
+        if (m_fileName.empty()) {
+            m_trainMatrix.resize(m_size);
+            m_bpWeights.resize(m_size, 0.0f);
+            m_trainMatrixData = m_trainMatrix.data();
+            m_bpWeightsData = m_bpWeights.data();
+        } else {
+            // the file is created exclusively, a file of another run or a user file is never overwritten.
+            // New file is filled with zeros, so back propagation weights are initialized already
+            auto fd = ::open(m_fileName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0) {
+                if (errno == EEXIST) {
+                    throw std::runtime_error("matrices: file " + m_fileName + " already exists, remove it to proceed");
+                }
+                throw std::runtime_error("matrices: failed to create file " + m_fileName);
+            }
+            ::close(fd);
+            m_fileMapper.reset(new file_mapper_t(m_fileName, true, checkpoint_t::metadataOffset(m_size)));
+            auto data = m_fileMapper->data();
+            m_trainMatrixData = reinterpret_cast<float *>(data + checkpoint_t::trainMatrixOffset());
+            m_bpWeightsData = reinterpret_cast<float *>(data + checkpoint_t::bpWeightsOffset(m_size));
+        }
+
+        // input matrix initialized with small random values
+        std::random_device randomDevice;
+        std::mt19937_64 randomGenerator(randomDevice());
+        std::uniform_real_distribution<float> rndMatrixInitializer(-0.005f, 0.005f);
+        std::generate(m_trainMatrixData, m_trainMatrixData + m_size, [&]() {
+            return rndMatrixInitializer(randomGenerator);
+        });
+    }
+
+    trainMatrices_t::~trainMatrices_t() {
+        if (m_fileMapper) {
+            m_fileMapper.reset();
+            if (!m_persisted) {
+                std::remove(m_fileName.c_str());
+            }
+        }
+    }
+
+    void trainMatrices_t::assign(std::vector<float> &_trainMatrix, std::vector<float> &_bpWeights) {
+        if ((_trainMatrix.size() != m_size) || (_bpWeights.size() != m_size)) {
+            throw std::runtime_error("checkpoint: matrix size mismatch");
+        }
+
+        if (m_fileMapper) {
+            std::copy(_trainMatrix.begin(), _trainMatrix.end(), m_trainMatrixData);
+            std::copy(_bpWeights.begin(), _bpWeights.end(), m_bpWeightsData);
+            std::vector<float>().swap(_trainMatrix);
+            std::vector<float>().swap(_bpWeights);
+        } else {
+            m_trainMatrix.swap(_trainMatrix);
+            m_bpWeights.swap(_bpWeights);
+            m_trainMatrixData = m_trainMatrix.data();
+            m_bpWeightsData = m_bpWeights.data();
+        }
+    }
+
+    void trainMatrices_t::assign(const std::string &_checkpointFile) {
+        file_mapper_t input(_checkpointFile);
+        if (input.size() < checkpoint_t::metadataOffset(m_size)) {
+            throw std::runtime_error("checkpoint: matrix size mismatch");
+        }
+
+        input.advise(file_mapper_t::advice_t::sequential);
+        std::memcpy(m_trainMatrixData, input.data() + checkpoint_t::trainMatrixOffset(), m_size * sizeof(float));
+        std::memcpy(m_bpWeightsData, input.data() + checkpoint_t::bpWeightsOffset(m_size), m_size * sizeof(float));
+    }
+
+    void trainMatrices_t::advise(std::size_t _hotRows, uint16_t _vectorSize) const noexcept {
+        if (!m_fileMapper) {
+            return;
+        }
+
+        // rows are accessed in the order of words in sentences, so read-ahead is useless
+        m_fileMapper->advise(file_mapper_t::advice_t::random);
+        auto hotSize = static_cast<off_t>(std::min(_hotRows * _vectorSize, m_size) * sizeof(float));
+        if (hotSize > 0) {
+            m_fileMapper->advise(file_mapper_t::advice_t::willNeed, checkpoint_t::trainMatrixOffset(), hotSize);
+            m_fileMapper->advise(file_mapper_t::advice_t::willNeed, checkpoint_t::bpWeightsOffset(m_size), hotSize);
+        }
+    }
+
+    void trainMatrices_t::finalize(const checkpoint_t &_checkpoint, const std::string &_checkpointFile) {
+        if (!m_fileMapper) {
+            throw std::runtime_error("matrices are not file backed");
+        }
+
+        m_fileMapper->sync();
+        _checkpoint.finalize(m_fileName, _checkpointFile);
+        m_persisted = true;
+    }
+
+    epochMonitor_t::epochMonitor_t(std::size_t _wordsPerEpoch, std::size_t _processedWords) noexcept:
+            m_wordsPerEpoch(_wordsPerEpoch),
+            m_epoch((_wordsPerEpoch > 0) ? _processedWords / _wordsPerEpoch : 0),
+            m_lock(), m_stats(), m_startTime(std::chrono::steady_clock::now()) {
+        pageFaults(m_majorFaults, m_minorFaults);
+    }
+
+    void epochMonitor_t::finish(std::size_t _processedWords) noexcept {
+        if ((m_wordsPerEpoch > 0) && (_processedWords > m_epoch.load() * m_wordsPerEpoch)) {
+            mark(m_epoch.load() + 1);
+        }
+    }
+
+    std::vector<epoch_stats_t> epochMonitor_t::stats() {
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_stats;
+    }
+
+    void epochMonitor_t::mark(std::size_t _epoch) noexcept {
+        std::unique_lock<std::mutex> lock(m_lock);
+        auto epoch = m_epoch.load();
+        if (_epoch <= epoch) {
+            return; // already closed by another thread
+        }
+
+        std::size_t majorFaults = m_majorFaults;
+        std::size_t minorFaults = m_minorFaults;
+        pageFaults(majorFaults, minorFaults);
+        auto now = std::chrono::steady_clock::now();
+
+        epoch_stats_t stats;
+        stats.epoch = epoch + 1;
+        stats.major_faults = majorFaults - m_majorFaults;
+        stats.minor_faults = minorFaults - m_minorFaults;
+        stats.seconds = std::chrono::duration<float>(now - m_startTime).count();
+        try {
+            m_stats.push_back(stats);
+        } catch (...) {
+            // out of memory, stats are lost
+        }
+
+        m_majorFaults = majorFaults;
+        m_minorFaults = minorFaults;
+        m_startTime = now;
+        m_epoch = _epoch;
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef __MATRIX_H__
+#define __MATRIX_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "word_vector.hpp"
+#include "mapper.hpp"
+#include "checkpoint.hpp"
+
+namespace wordvec {
+    /**
+     * @brief trainMatrices class - storage of the input matrix and back propagation weights
+     *
+     * Matrices are allocated on the heap or, if a matrix file is specified, backed by a writable shared mapping
+     * of this file, so the vocabulary size is not limited by RAM. Vocabulary words are ordered by frequency, so
+     * hot rows are placed at the beginning of each matrix and stay resident while cold rows are paged in on
+     * demand. The file has the same layout as a checkpoint file and becomes the final checkpoint by appending
+     * metadata and renaming.
+    */
+    class trainMatrices_t final {
+    private:
+        const std::string m_fileName;
+        const std::size_t m_size;
+        std::vector<float> m_trainMatrix;
+        std::vector<float> m_bpWeights;
+        std::unique_ptr<file_mapper_t> m_fileMapper;
+        float *m_trainMatrixData = nullptr;
+        float *m_bpWeightsData = nullptr;
+        bool m_persisted = false;
+
+    public:
+        /**
+         * Constructs train matrices, the input matrix is initialized with small random values, back propagation
+         * weights with zeros
+         * @param _fileName matrix file name, empty string - matrices are allocated on the heap. The file must not
+         * exist.
+         * @param _size number of values in each matrix
+         * @throws std::runtime_error on file access failure or if the file exists
+        */
+        trainMatrices_t(const std::string &_fileName, std::size_t _size);
+        /// Removes the matrix file unless it became a checkpoint
+        ~trainMatrices_t();
+
+        trainMatrices_t(const trainMatrices_t &) = delete;
+        void operator=(const trainMatrices_t &) = delete;
+
+        inline float *trainMatrix() noexcept {return m_trainMatrixData;}
+        inline const float *trainMatrix() const noexcept {return m_trainMatrixData;}
+        inline float *bpWeights() noexcept {return m_bpWeightsData;}
+        inline const float *bpWeights() const noexcept {return m_bpWeightsData;}
+        /// @returns number of values in each matrix
+        inline std::size_t size() const noexcept {return m_size;}
+        inline bool fileBacked() const noexcept {return static_cast<bool>(m_fileMapper);}
+
+        /**
+         * Replaces matrices values, vectors are swapped in heap mode and copied and released in file backed mode
+         * @throws std::runtime_error on size mismatch
+        */
+        void assign(std::vector<float> &_trainMatrix, std::vector<float> &_bpWeights);
+        /**
+         * Copies matrices from a checkpoint file without loading them to memory
+         * @throws std::runtime_error on file access failure or size mismatch
+        */
+        void assign(const std::string &_checkpointFile);
+
+        /**
+         * Advises the kernel of matrices access pattern - random access, and prefetches hot rows
+         * @param _hotRows number of the most frequent words rows to prefetch
+         * @param _vectorSize row size
+        */
+        void advise(std::size_t _hotRows, uint16_t _vectorSize) const noexcept;
+
+        /**
+         * Turns the matrix file into the checkpoint, matrices are not copied
+         * @throws std::runtime_error on file access failure
+        */
+        void finalize(const checkpoint_t &_checkpoint, const std::string &_checkpointFile);
+    };
+
+    /**
+     * @brief epochMonitor class - page faults and time per train epoch
+     *
+     * Train threads are not synchronized on epochs, so an epoch boundary is the moment the total amount of
+     * processed words reaches the next multiple of train words. Page faults are counted for the whole process.
+    */
+    class epochMonitor_t final {
+    private:
+        const std::size_t m_wordsPerEpoch;
+        std::atomic<std::size_t> m_epoch;
+        std::mutex m_lock;
+        std::vector<epoch_stats_t> m_stats;
+        std::size_t m_majorFaults = 0;
+        std::size_t m_minorFaults = 0;
+        std::chrono::steady_clock::time_point m_startTime;
+
+    public:
+        /**
+         * Constructs epoch monitor and starts the current epoch
+         * @param _wordsPerEpoch train words amount
+         * @param _processedWords words already processed (resumed training)
+        */
+        epochMonitor_t(std::size_t _wordsPerEpoch, std::size_t _processedWords) noexcept;
+
+        /// Closes the epoch if _processedWords crossed its boundary, cheap enough to be called on each alpha update
+        inline void update(std::size_t _processedWords) noexcept {
+            if ((m_wordsPerEpoch > 0)
+                && (_processedWords / m_wordsPerEpoch > m_epoch.load(std::memory_order_relaxed))) {
+                mark(_processedWords / m_wordsPerEpoch);
+            }
+        }
+        /// Closes the last epoch unless it is already closed
+        void finish(std::size_t _processedWords) noexcept;
+
+        /// @returns stats of all closed epochs
+        std::vector<epoch_stats_t> stats();
+
+    private:
+        void mark(std::size_t _epoch) noexcept;
+    };
+}
+
+#endif
@@ -0,0 +1,304 @@
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "modelFile.hpp"
+
+namespace wordvec {
+    namespace {
+        const std::string wrongFormatErr = "model: wrong model file format";
+        // records are processed by one thread if there are less of them
+        const std::size_t parallelMin = 4096;
+
+        inline bool isSpace(char _ch) noexcept {
+            return (_ch == ' ') || (_ch == '\t') || (_ch == '\r');
+        }
+
+        inline bool isDigit(char _ch) noexcept {
+            return (_ch >= '0') && (_ch <= '9');
+        }
+
+        // parses unsigned decimal integer, returns false if there are no digits
+        bool parseUnsigned(const char *&_pos, const char *_end, std::size_t &_value) noexcept {
+            _value = 0;
+            auto begin = _pos;
+            while ((_pos < _end) && isDigit(*_pos) && (_value < (SIZE_MAX / 10))) {
+                _value = _value * 10 + static_cast<std::size_t>(*_pos - '0');
+                ++_pos;
+            }
+
+            return (_pos != begin) && ((_pos == _end) || !isDigit(*_pos));
+        }
+
+        // parses decimal float without locale and strtod overhead: up to 19 significant digits are accumulated in
+        // an integer mantissa, then scaled by exact powers of ten in double precision
+        bool parseFloat(const char *&_pos, const char *_end, float &_value) noexcept {
+            static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+            while ((_pos < _end) && isSpace(*_pos)) {
+                ++_pos;
+            }
+            auto negative = false;
+            if ((_pos < _end) && ((*_pos == '-') || (*_pos == '+'))) {
+                negative = (*_pos == '-');
+                ++_pos;
+            }
+            uint64_t mantissa = 0;
+            int digits = 0;
+            int exponent = 0;
+            auto any = false;
+            for (; (_pos < _end) && isDigit(*_pos); ++_pos) {
+                any = true;
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + static_cast<uint64_t>(*_pos - '0');
+                    digits += (mantissa > 0) ? 1 : 0;
+                } else {
+                    ++exponent;
+                }
+            }
+            if ((_pos < _end) && (*_pos == '.')) {
+                for (++_pos; (_pos < _end) && isDigit(*_pos); ++_pos) {
+                    any = true;
+                    if (digits < 19) {
+                        mantissa = mantissa * 10 + static_cast<uint64_t>(*_pos - '0');
+                        digits += (mantissa > 0) ? 1 : 0;
+                        --exponent;
+                    }
+                }
+            }
+            if (!any) {
+                return false;
+            }
+            if ((_pos < _end) && ((*_pos == 'e') || (*_pos == 'E'))) {
+                ++_pos;
+                auto negativeExp = false;
+                if ((_pos < _end) && ((*_pos == '-') || (*_pos == '+'))) {
+                    negativeExp = (*_pos == '-');
+                    ++_pos;
+                }
+                std::size_t exp = 0;
+                if (!parseUnsigned(_pos, _end, exp)) {
+                    return false;
+                }
+                exp = std::min<std::size_t>(exp, 1000);
+                exponent += negativeExp ? -static_cast<int>(exp) : static_cast<int>(exp);
+            }
+
+            auto value = static_cast<double>(mantissa);
+            if (mantissa != 0) {
+                if ((exponent >= 0) && (exponent <= 22)) {
+                    value *= powers[exponent];
+                } else if ((exponent < 0) && (exponent >= -22)) {
+                    value /= powers[-exponent];
+                } else {
+                    value *= std::pow(10.0, exponent);
+                }
+            }
+            _value = static_cast<float>(negative ? -value : value);
+
+            return true;
+        }
+    }
+
+    modelFile_t::modelFile_t(const mapper_t &_input, std::size_t _maxRecords): m_input(_input), m_records() {
+        auto data = m_input.data();
+        auto size = static_cast<std::size_t>(m_input.size());
+        auto lineEnd = static_cast<const char *>(std::memchr(data, '\n', size));
+        if (lineEnd == nullptr) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+
+        // word2vec header is "words vector_size"
+        std::size_t words = 0;
+        std::size_t vectorSize = 0;
+        auto pos = data;
+        auto withHeader = parseUnsigned(pos, lineEnd, words) && (pos < lineEnd) && isSpace(*pos);
+        if (withHeader) {
+            while ((pos < lineEnd) && isSpace(*pos)) {
+                ++pos;
+            }
+            withHeader = parseUnsigned(pos, lineEnd, vectorSize);
+            while ((pos < lineEnd) && isSpace(*pos)) {
+                ++pos;
+            }
+            withHeader = withHeader && (pos == lineEnd);
+        }
+
+        std::size_t offset = 0;
+        if (withHeader) {
+            offset = static_cast<std::size_t>(lineEnd - data) + 1;
+            // binary floats of the first record are not decimal numbers
+            auto recordBegin = offset;
+            while ((recordBegin < size) && (data[recordBegin] == '\n')) {
+                ++recordBegin;
+            }
+            auto wordEnd = static_cast<const char *>(std::memchr(data + recordBegin, ' ', size - recordBegin));
+            if (wordEnd == nullptr) {
+                throw std::runtime_error(wrongFormatErr);
+            }
+            auto vectorBegin = static_cast<std::size_t>(wordEnd - data) + 1;
+            auto vectorEnd = std::min(size, vectorBegin + vectorSize * sizeof(float));
+            m_format = std::all_of(data + vectorBegin, data + vectorEnd, [](char _ch) {
+                return isDigit(_ch) || isSpace(_ch) || ((_ch != '\0') && (std::strchr(".-+eE\n", _ch) != nullptr));
+            }) ? format_t::text : format_t::binary;
+        } else {
+            // GloVe text file, vector size is the number of values in the first line
+            m_format = format_t::text;
+            words = SIZE_MAX;
+            vectorSize = 0;
+            auto inToken = false;
+            for (pos = data; pos < lineEnd; ++pos) {
+                if (isSpace(*pos)) {
+                    inToken = false;
+                } else if (!inToken) {
+                    inToken = true;
+                    ++vectorSize;
+                }
+            }
+            vectorSize = (vectorSize > 0) ? vectorSize - 1 : 0;
+        }
+        if ((vectorSize == 0) || (vectorSize > UINT16_MAX) || (words == 0)) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+        m_vectorSize = static_cast<uint16_t>(vectorSize);
+
+        auto maxRecords = (_maxRecords > 0) ? _maxRecords : SIZE_MAX;
+        if (m_format == format_t::binary) {
+            indexBinary(offset, words, maxRecords);
+        } else {
+            indexText(offset, words, maxRecords);
+        }
+        if (m_records.empty() || (withHeader && (m_records.size() != std::min(words, maxRecords)))) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+    }
+
+    void modelFile_t::indexBinary(std::size_t _offset, std::size_t _words, std::size_t _maxRecords) {
+        auto data = m_input.data();
+        auto size = static_cast<std::size_t>(m_input.size());
+        auto vectorLength = static_cast<std::size_t>(m_vectorSize) * sizeof(float);
+        m_records.reserve(std::min({_words, _maxRecords, size / (vectorLength + 2)}));
+        for (std::size_t i = 0; i < _words; ++i) {
+            // records may be separated by '\n' char
+            while ((_offset < size) && (data[_offset] == '\n')) {
+                ++_offset;
+            }
+            if (_offset >= size) {
+                throw std::runtime_error(wrongFormatErr);
+            }
+            auto wordEnd = static_cast<const char *>(std::memchr(data + _offset, ' ', size - _offset));
+            if (wordEnd == nullptr) {
+                throw std::runtime_error(wrongFormatErr);
+            }
+            record_t record{};
+            record.word = _offset;
+            record.wordLength = static_cast<uint32_t>(wordEnd - (data + _offset));
+            record.vector = _offset + record.wordLength + 1;
+            record.vectorLength = static_cast<uint32_t>(vectorLength);
+            if (record.vector + vectorLength > size) {
+                throw std::runtime_error(wrongFormatErr);
+            }
+            // skipped records are scanned only, subword vectors follow the last record
+            if (i < _maxRecords) {
+                m_records.push_back(record);
+            }
+            _offset = record.vector + vectorLength;
+        }
+        m_end = _offset;
+    }
+
+    void modelFile_t::indexText(std::size_t _offset, std::size_t _words, std::size_t _maxRecords) {
+        auto data = m_input.data();
+        auto size = static_cast<std::size_t>(m_input.size());
+        auto words = std::min(_words, _maxRecords);
+        while ((_offset < size) && (m_records.size() < words)) {
+            auto lineEnd = static_cast<const char *>(std::memchr(data + _offset, '\n', size - _offset));
+            auto end = (lineEnd != nullptr) ? static_cast<std::size_t>(lineEnd - data) : size;
+            auto begin = _offset;
+            _offset = end + 1;
+            while ((begin < end) && isSpace(data[begin])) {
+                ++begin;
+            }
+            if (begin == end) {
+                continue; // empty line
+            }
+            auto wordEnd = begin;
+            while ((wordEnd < end) && (data[wordEnd] != ' ') && (data[wordEnd] != '\t')) {
+                ++wordEnd;
+            }
+            if (wordEnd == end) {
+                throw std::runtime_error(wrongFormatErr);
+            }
+            record_t record{};
+            record.word = begin;
+            record.wordLength = static_cast<uint32_t>(wordEnd - begin);
+            record.vector = wordEnd + 1;
+            record.vectorLength = static_cast<uint32_t>(end - record.vector);
+            m_records.push_back(record);
+        }
+        m_end = std::min(_offset, size);
+    }
+
+    void modelFile_t::vector(std::size_t _record, float *_vector) const {
+        auto const &record = m_records[_record];
+        auto begin = m_input.data() + record.vector;
+        if (m_format == format_t::binary) {
+            std::memcpy(_vector, begin, record.vectorLength);
+            return;
+        }
+
+        auto end = begin + record.vectorLength;
+        for (uint16_t i = 0; i < m_vectorSize; ++i) {
+            if (!parseFloat(begin, end, _vector[i])) {
+                throw std::runtime_error(wrongFormatErr);
+            }
+        }
+        while ((begin < end) && isSpace(*begin)) {
+            ++begin;
+        }
+        if (begin != end) {
+            throw std::runtime_error(wrongFormatErr);
+        }
+    }
+
+    void modelFile_t::parallel(std::size_t _size, const std::function<void(std::size_t, std::size_t)> &_func,
+                               uint16_t _threads, std::size_t _minSize) {
+        std::size_t threads = (_threads > 0) ? _threads : std::max(std::thread::hardware_concurrency(), 1U);
+        auto minSize = (_minSize > 0) ? _minSize : parallelMin;
+        threads = std::min(threads, (_size + minSize - 1) / minSize);
+        if (threads <= 1) {
+            _func(0, _size);
+            return;
+        }
+
+        std::exception_ptr error;
+        std::mutex errorLock;
+        std::vector<std::thread> workers;
+        auto shift = _size / threads;
+        for (std::size_t i = 0; i < threads; ++i) {
+            auto begin = shift * i;
+            auto end = (i == threads - 1) ? _size : shift * (i + 1);
+            workers.emplace_back([&, begin, end]() {
+                try {
+                    _func(begin, end);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorLock);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (auto &i:workers) {
+            i.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef __MODEL_FILE_H__
+#define __MODEL_FILE_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "mapper.hpp"
+
+namespace wordvec {
+    /**
+     * @brief modelFile class - record index of word2vec binary and text model files
+     *
+     * Record boundaries are indexed by a serial scan: binary records are a word, a space char and raw floats, text
+     * records are lines of a word and decimal numbers (word2vec text with "words size" header line or GloVe text
+     * without it). Format is detected by the header line and the first record. Vectors are parsed (text) or copied
+     * (binary) by record index, so records can be processed by several threads.
+    */
+    class modelFile_t final {
+    public:
+        enum class format_t {
+            binary,
+            text
+        };
+
+    private:
+        struct record_t {
+            std::size_t word;
+            std::size_t vector;
+            uint32_t wordLength;
+            uint32_t vectorLength;
+        };
+
+        const mapper_t &m_input;
+        format_t m_format = format_t::binary;
+        uint16_t m_vectorSize = 0;
+        std::vector<record_t> m_records;
+        std::size_t m_end = 0;
+
+    public:
+        /**
+         * Constructs model file index, throws std::runtime_error on wrong format
+         * @param _input mapped model file
+         * @param _maxRecords number of indexed records, 0 - all records. The rest of binary file is still scanned
+         * to find its end
+        */
+        explicit modelFile_t(const mapper_t &_input, std::size_t _maxRecords = 0);
+
+        modelFile_t(const modelFile_t &) = delete;
+        void operator=(const modelFile_t &) = delete;
+
+        inline format_t format() const noexcept {return m_format;}
+        inline uint16_t vectorSize() const noexcept {return m_vectorSize;}
+        inline std::size_t records() const noexcept {return m_records.size();}
+        /// @returns offset following the last record
+        inline std::size_t end() const noexcept {return m_end;}
+
+        inline std::string word(std::size_t _record) const {
+            return std::string(m_input.data() + m_records[_record].word, m_records[_record].wordLength);
+        }
+
+        /// Copies or parses vector of the record, throws std::runtime_error on wrong format
+        void vector(std::size_t _record, float *_vector) const;
+
+        /**
+         * Calls function for ranges of [0, _size) in several threads, the first exception is rethrown
+         * @param _size number of items
+         * @param _func function called with [begin, end) range
+         * @param _threads number of threads, 0 - all cores
+         * @param _minSize minimal number of items of a thread, 0 - default for model records
+        */
+        static void parallel(std::size_t _size, const std::function<void(std::size_t, std::size_t)> &_func,
+                             uint16_t _threads = 0, std::size_t _minSize = 0);
+
+    private:
+        void indexBinary(std::size_t _offset, std::size_t _words, std::size_t _maxRecords);
+        void indexText(std::size_t _offset, std::size_t _words, std::size_t _maxRecords);
+    };
+}
+
+#endif
@@ -0,0 +1,187 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#include "modelFile.hpp"
+#include "modelWriter.hpp"
+
+namespace wordvec {
+    namespace {
+        // minimal buffer of a writing thread
+        const std::size_t minBufferSize = 64 * 1024;
+
+        std::string tmpName(const std::string &_fileName, bool _atomic) {
+            return _atomic ? (_fileName + ".tmp." + std::to_string(::getpid())) : _fileName;
+        }
+
+        void ioError(const std::string &_fileName) {
+            throw std::runtime_error("modelWriter: " + _fileName + " - " + std::strerror(errno));
+        }
+
+        class mappingSink_t final: public modelWriter_t::sink_t {
+        private:
+            char *m_data;
+
+        public:
+            explicit mappingSink_t(char *_data): m_data(_data) {}
+
+            void write(off_t _offset, const char *_data, std::size_t _size) override {
+                std::memcpy(m_data + _offset, _data, _size);
+            }
+
+            void flush() override {}
+        };
+
+        class streamSink_t final: public modelWriter_t::sink_t {
+        private:
+            const std::string &m_fileName;
+            const int m_fd;
+            std::vector<char> m_buffer;
+            std::size_t m_used = 0;
+            off_t m_offset = 0;
+
+        public:
+            streamSink_t(const std::string &_fileName, int _fd, std::size_t _bufferSize):
+                    m_fileName(_fileName), m_fd(_fd), m_buffer(_bufferSize) {}
+
+            void write(off_t _offset, const char *_data, std::size_t _size) override {
+                // only adjacent regions are collected in the buffer
+                if ((m_used > 0) && ((_offset != m_offset + static_cast<off_t>(m_used))
+                                     || (m_used + _size > m_buffer.size()))) {
+                    flush();
+                }
+                if (_size > m_buffer.size()) {
+                    writeAll(_offset, _data, _size);
+                    return;
+                }
+                if (m_used == 0) {
+                    m_offset = _offset;
+                }
+                std::memcpy(m_buffer.data() + m_used, _data, _size);
+                m_used += _size;
+            }
+
+            void flush() override {
+                if (m_used > 0) {
+                    writeAll(m_offset, m_buffer.data(), m_used);
+                    m_used = 0;
+                }
+            }
+
+        private:
+            void writeAll(off_t _offset, const char *_data, std::size_t _size) const {
+                while (_size > 0) {
+                    auto written = ::pwrite(m_fd, _data, _size, _offset);
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        ioError(m_fileName);
+                    }
+                    _data += written;
+                    _size -= static_cast<std::size_t>(written);
+                    _offset += written;
+                }
+            }
+        };
+    }
+
+    modelWriter_t::modelWriter_t(const std::string &_fileName, off_t _size, const save_setting_t &_saveSettings):
+            m_fileName(_fileName), m_tmpName(tmpName(_fileName, _saveSettings.atomic)),
+            m_saveSettings(_saveSettings), m_mapping() {
+        if (m_saveSettings.mode == save_mode_t::mmap) {
+            // the mapper creates the file before sizing and mapping it, the destructor is not called on failure
+            try {
+                m_mapping.reset(new file_mapper_t(m_tmpName, true, _size));
+            } catch (...) {
+                if (m_saveSettings.atomic) {
+                    std::remove(m_tmpName.c_str());
+                }
+                throw;
+            }
+        } else {
+            m_fd = ::open(m_tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (m_fd < 0) {
+                ioError(m_tmpName);
+            }
+        }
+    }
+
+    modelWriter_t::~modelWriter_t() {
+        close();
+        if (!m_committed && m_saveSettings.atomic) {
+            std::remove(m_tmpName.c_str());
+        }
+    }
+
+    void modelWriter_t::write(std::size_t _size,
+                              const std::function<void(std::size_t, std::size_t, sink_t &)> &_func) {
+        std::size_t threads = (m_saveSettings.threads > 0)
+                              ? m_saveSettings.threads : std::max(std::thread::hardware_concurrency(), 1U);
+        auto bufferSize = std::max(static_cast<std::size_t>(m_saveSettings.buffer_size) * 1024 * 1024 / threads,
+                                   minBufferSize);
+        modelFile_t::parallel(_size, [this, &_func, bufferSize](std::size_t _begin, std::size_t _end) {
+            auto threadSink = sink(bufferSize);
+            _func(_begin, _end, *threadSink);
+            threadSink->flush();
+        }, static_cast<uint16_t>(threads));
+    }
+
+    void modelWriter_t::commit() {
+        if (m_mapping) {
+            // data must reach the disk before the rename
+            if (m_saveSettings.atomic) {
+                m_mapping->sync();
+            }
+            m_mapping.reset();
+        } else {
+            if (m_saveSettings.atomic && (::fsync(m_fd) < 0)) {
+                ioError(m_tmpName);
+            }
+            // deferred write errors of network filesystems are reported by close
+            auto fd = m_fd;
+            m_fd = -1;
+            if (::close(fd) < 0) {
+                ioError(m_tmpName);
+            }
+        }
+        if (m_saveSettings.atomic) {
+            if (std::rename(m_tmpName.c_str(), m_fileName.c_str()) != 0) {
+                ioError(m_fileName);
+            }
+            // the rename itself is made durable by the directory sync
+            auto slash = m_fileName.rfind('/');
+            auto dirName = (slash == std::string::npos) ? std::string(".") : m_fileName.substr(0, slash + 1);
+            auto dirFd = ::open(dirName.c_str(), O_RDONLY);
+            if (dirFd >= 0) {
+                ::fsync(dirFd);
+                ::close(dirFd);
+            }
+        }
+        m_committed = true;
+    }
+
+    std::unique_ptr<modelWriter_t::sink_t> modelWriter_t::sink(std::size_t _bufferSize) {
+        if (m_mapping) {
+            return std::unique_ptr<sink_t>(new mappingSink_t(m_mapping->data()));
+        }
+
+        return std::unique_ptr<sink_t>(new streamSink_t(m_tmpName, m_fd, _bufferSize));
+    }
+
+    void modelWriter_t::close() noexcept {
+        m_mapping.reset();
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+}
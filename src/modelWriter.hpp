@@ -0,0 +1,69 @@
+#ifndef __MODEL_WRITER_H__
+#define __MODEL_WRITER_H__
+
+#include <memory>
+#include <string>
+#include <functional>
+
+#include "word_vector.hpp"
+#include "mapper.hpp"
+
+namespace wordvec {
+    /**
+     * @brief modelWriter class - writes model file regions at precomputed offsets from several threads
+     *
+     * In mmap mode the file is pre-sized and mapped, regions are copied to the mapping. In stream mode each thread
+     * collects adjacent regions in its own bounded buffer and writes it by pwrite, the file is not pre-sized.
+     * Atomic writer fills a temporary file, it is synced and renamed to the model file name on commit, so readers
+     * never see a partially written model. Not committed temporary file is removed on destruction.
+    */
+    class modelWriter_t final {
+    public:
+        /// Thread local writer of file regions
+        class sink_t {
+        public:
+            virtual ~sink_t() = default;
+            /// Writes data at the file offset, throws std::runtime_error on failure
+            virtual void write(off_t _offset, const char *_data, std::size_t _size) = 0;
+            /// Writes buffered data
+            virtual void flush() = 0;
+        };
+
+    private:
+        const std::string m_fileName;
+        const std::string m_tmpName;
+        const save_setting_t m_saveSettings;
+        std::unique_ptr<file_mapper_t> m_mapping;
+        int m_fd = -1;
+        bool m_committed = false;
+
+    public:
+        /**
+         * Constructs writer and creates the file
+         * @param _fileName model file name
+         * @param _size model file size, the file is pre-sized in mmap mode only
+         * @param _saveSettings writing settings
+        */
+        modelWriter_t(const std::string &_fileName, off_t _size, const save_setting_t &_saveSettings);
+        ~modelWriter_t();
+
+        modelWriter_t(const modelWriter_t &) = delete;
+        void operator=(const modelWriter_t &) = delete;
+
+        /**
+         * Calls function for ranges of [0, _size) items in writing threads, each thread gets its own sink
+         * @param _size number of items
+         * @param _func function called with [begin, end) range and the sink of the thread
+        */
+        void write(std::size_t _size, const std::function<void(std::size_t, std::size_t, sink_t &)> &_func);
+
+        /// Completes writing: syncs the file and renames the temporary file in atomic mode
+        void commit();
+
+    private:
+        std::unique_ptr<sink_t> sink(std::size_t _bufferSize);
+        void close() noexcept;
+    };
+}
+
+#endif
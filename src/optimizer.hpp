@@ -0,0 +1,114 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cmath>
+
+#include "word_vector.hpp"
+
+namespace wordvec {
+    /**
+     * @brief rowOptimizer class - applies gradients to matrix rows and keeps per element optimizer state
+     *
+     * SGD adds the gradient multiplied by the global learning rate. AdaGrad keeps sums of squared gradients, lazy
+     * Adam keeps first and second moments and per row powers of betas. Both scale learning rate per element, state
+     * of a row is updated only when the row gets a gradient, so an update costs the same single pass over the row
+     * as SGD does. State is updated without locks like matrices themselves.
+    */
+    class rowOptimizer_t final {
+    private:
+        const float beta1 = 0.9f;
+        const float beta2 = 0.999f;
+        const float epsilon = 1e-6f;
+
+        const optimizer_t m_method;
+        const std::size_t m_vectorSize;
+        std::shared_ptr<std::atomic<float>> m_alpha;
+        std::vector<float> m_moments;
+        std::vector<float> m_variances;
+        std::vector<float> m_beta1Powers;
+        std::vector<float> m_beta2Powers;
+
+    public:
+        /**
+         * Constructs optimizer state of a matrix
+         * @param _method optimization method
+         * @param _rows number of matrix rows
+         * @param _vectorSize row size
+         * @param _alpha current learning rate
+         * @param _initialVariance initial sums of squared gradients of AdaGrad
+        */
+        rowOptimizer_t(optimizer_t _method, std::size_t _rows, std::size_t _vectorSize,
+                       const std::shared_ptr<std::atomic<float>> &_alpha, float _initialVariance = 0.0f):
+                m_method(_method), m_vectorSize(_vectorSize), m_alpha(_alpha),
+                m_moments(), m_variances(), m_beta1Powers(), m_beta2Powers() {
+            if (m_method == optimizer_t::adagrad) {
+                m_variances.resize(_rows * _vectorSize, _initialVariance);
+            } else if (m_method == optimizer_t::adam) {
+                m_moments.resize(_rows * _vectorSize, 0.0f);
+                m_variances.resize(_rows * _vectorSize, 0.0f);
+                m_beta1Powers.resize(_rows, 1.0f);
+                m_beta2Powers.resize(_rows, 1.0f);
+            }
+        }
+
+        rowOptimizer_t(const rowOptimizer_t &) = delete;
+        void operator=(const rowOptimizer_t &) = delete;
+
+        /**
+         * @returns factor of errors propagated to the previous layer - SGD propagates errors multiplied by the
+         * learning rate, adaptive methods propagate raw gradients and scale them per element on update
+        */
+        inline float errorScale() const noexcept {
+            return (m_method == optimizer_t::sgd) ? m_alpha->load(std::memory_order_relaxed) : 1.0f;
+        }
+
+        /**
+         * Applies a gradient _scale * _direction to the row
+         * @param _row row values, may be a thread private copy of the matrix row
+         * @param _index row index in the matrix
+         * @param _direction gradient direction
+         * @param _scale gradient multiplier, includes the learning rate in case of SGD (see errorScale())
+        */
+        inline void update(float *_row, std::size_t _index, const float *_direction, float _scale) noexcept {
+            switch (m_method) {
+                case optimizer_t::sgd: {
+                    for (std::size_t j = 0; j < m_vectorSize; ++j) {
+                        _row[j] += _scale * _direction[j];
+                    }
+                    break;
+                }
+                case optimizer_t::adagrad: {
+                    auto alpha = m_alpha->load(std::memory_order_relaxed);
+                    auto variances = &m_variances[_index * m_vectorSize];
+                    for (std::size_t j = 0; j < m_vectorSize; ++j) {
+                        auto gradient = _scale * _direction[j];
+                        variances[j] += gradient * gradient;
+                        _row[j] += alpha * gradient / (std::sqrt(variances[j]) + epsilon);
+                    }
+                    break;
+                }
+                case optimizer_t::adam: {
+                    // bias correction uses the number of the row updates instead of the global step (lazy Adam)
+                    m_beta1Powers[_index] *= beta1;
+                    m_beta2Powers[_index] *= beta2;
+                    auto alpha = m_alpha->load(std::memory_order_relaxed)
+                                 * std::sqrt(1.0f - m_beta2Powers[_index]) / (1.0f - m_beta1Powers[_index]);
+                    auto moments = &m_moments[_index * m_vectorSize];
+                    auto variances = &m_variances[_index * m_vectorSize];
+                    for (std::size_t j = 0; j < m_vectorSize; ++j) {
+                        auto gradient = _scale * _direction[j];
+                        moments[j] = beta1 * moments[j] + (1.0f - beta1) * gradient;
+                        variances[j] = beta2 * variances[j] + (1.0f - beta2) * gradient * gradient;
+                        _row[j] += alpha * moments[j] / (std::sqrt(variances[j]) + epsilon);
+                    }
+                    break;
+                }
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,358 @@
+#include <cmath>
+#include <numeric>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+#include "modelFile.hpp"
+
+namespace wordvec {
+    namespace {
+        // cyclic Jacobi eigenvalue algorithm of symmetric matrix, eigenvectors are columns of _vectors
+        void eigen(std::vector<double> &_matrix, std::vector<double> &_vectors, uint16_t _size) {
+            const std::size_t n = _size;
+            _vectors.assign(n * n, 0.0);
+            for (std::size_t i = 0; i < n; ++i) {
+                _vectors[i * n + i] = 1.0;
+            }
+            for (int sweep = 0; sweep < 50; ++sweep) {
+                double off = 0.0;
+                double diagonal = 0.0;
+                for (std::size_t p = 0; p < n; ++p) {
+                    diagonal += _matrix[p * n + p] * _matrix[p * n + p];
+                    for (std::size_t q = p + 1; q < n; ++q) {
+                        off += _matrix[p * n + q] * _matrix[p * n + q];
+                    }
+                }
+                if (off <= 1e-22 * diagonal) {
+                    break;
+                }
+                for (std::size_t p = 0; p < n; ++p) {
+                    for (std::size_t q = p + 1; q < n; ++q) {
+                        auto apq = _matrix[p * n + q];
+                        if (std::fabs(apq) < 1e-300) {
+                            continue;
+                        }
+                        auto theta = (_matrix[q * n + q] - _matrix[p * n + p]) / (2.0 * apq);
+                        auto t = ((theta >= 0.0) ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                        auto c = 1.0 / std::sqrt(t * t + 1.0);
+                        auto s = t * c;
+                        for (std::size_t k = 0; k < n; ++k) {
+                            auto kp = _matrix[k * n + p];
+                            auto kq = _matrix[k * n + q];
+                            _matrix[k * n + p] = c * kp - s * kq;
+                            _matrix[k * n + q] = s * kp + c * kq;
+                        }
+                        for (std::size_t k = 0; k < n; ++k) {
+                            auto pk = _matrix[p * n + k];
+                            auto qk = _matrix[q * n + k];
+                            _matrix[p * n + k] = c * pk - s * qk;
+                            _matrix[q * n + k] = s * pk + c * qk;
+                        }
+                        for (std::size_t k = 0; k < n; ++k) {
+                            auto kp = _vectors[k * n + p];
+                            auto kq = _vectors[k * n + q];
+                            _vectors[k * n + p] = c * kp - s * kq;
+                            _vectors[k * n + q] = s * kp + c * kq;
+                        }
+                    }
+                }
+            }
+        }
+
+        // parametric OPQ: eigenvectors of the rows covariance are allocated to subspaces greedily, so products of
+        // subspace eigenvalues are balanced. Returns rotation matrix, its rows are the allocated eigenvectors
+        std::vector<float> trainRotation(const std::vector<float> &_sample, std::size_t _size, uint16_t _vectorSize,
+                                         uint16_t _subspaces) {
+            const std::size_t n = _vectorSize;
+            std::vector<float> covariance(n * n, 0.0f);
+            for (std::size_t r = 0; r < _size; ++r) {
+                auto row = _sample.data() + r * n;
+                for (std::size_t i = 0; i < n; ++i) {
+                    auto value = row[i];
+                    auto dst = covariance.data() + i * n;
+                    for (std::size_t k = 0; k < n; ++k) {
+                        dst[k] += value * row[k];
+                    }
+                }
+            }
+            std::vector<double> matrix(covariance.begin(), covariance.end());
+            for (auto &i:matrix) {
+                i /= static_cast<double>(_size);
+            }
+            std::vector<double> vectors;
+            eigen(matrix, vectors, _vectorSize);
+
+            std::vector<std::size_t> order(n);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&matrix, n](std::size_t _left, std::size_t _right) {
+                return matrix[_left * n + _left] > matrix[_right * n + _right];
+            });
+            std::size_t subSize = n / _subspaces;
+            std::vector<double> logProducts(_subspaces, 0.0);
+            std::vector<std::size_t> filled(_subspaces, 0);
+            std::vector<float> ret(n * n);
+            for (auto i:order) {
+                std::size_t best = _subspaces;
+                for (std::size_t m = 0; m < _subspaces; ++m) {
+                    if ((filled[m] < subSize) && ((best == _subspaces) || (logProducts[m] < logProducts[best]))) {
+                        best = m;
+                    }
+                }
+                logProducts[best] += std::log(std::max(matrix[i * n + i], 1e-12));
+                auto dst = ret.data() + (best * subSize + filled[best]) * n;
+                for (std::size_t k = 0; k < n; ++k) {
+                    dst[k] = static_cast<float>(vectors[k * n + i]);
+                }
+                ++filled[best];
+            }
+
+            return ret;
+        }
+
+        void rotate(const float *_rotation, const float *_vector, float *_rotated, uint16_t _size) noexcept {
+            for (uint16_t i = 0; i < _size; ++i) {
+                auto axis = _rotation + static_cast<std::size_t>(i) * _size;
+                float value = 0.0f;
+                for (uint16_t k = 0; k < _size; ++k) {
+                    value += axis[k] * _vector[k];
+                }
+                _rotated[i] = value;
+            }
+        }
+
+        // codebook is transposed (sub-vector size * centroids), so distances to all centroids are vectorized
+        struct transposed_t final {
+            std::vector<float> values;
+            std::vector<float> norms;
+            std::vector<float> distances;
+
+            transposed_t(): values(), norms(pq_codec_t::centroids), distances(pq_codec_t::centroids) {}
+
+            void assign(const float *_codebook, uint16_t _subSize) {
+                const std::size_t k = pq_codec_t::centroids;
+                values.resize(k * _subSize);
+                std::fill(norms.begin(), norms.end(), 0.0f);
+                for (std::size_t c = 0; c < k; ++c) {
+                    for (uint16_t j = 0; j < _subSize; ++j) {
+                        auto value = _codebook[c * _subSize + j];
+                        values[j * k + c] = value;
+                        norms[c] += value * value;
+                    }
+                }
+            }
+
+            // returns ID of the nearest centroid, ||c||^2 - 2 * x.c is compared
+            uint8_t nearest(const float *_vector, uint16_t _subSize) noexcept {
+                const std::size_t k = pq_codec_t::centroids;
+                auto dst = distances.data();
+                std::copy(norms.begin(), norms.end(), dst);
+                for (uint16_t j = 0; j < _subSize; ++j) {
+                    auto value = -2.0f * _vector[j];
+                    auto src = values.data() + j * k;
+                    for (std::size_t c = 0; c < k; ++c) {
+                        dst[c] += value * src[c];
+                    }
+                }
+
+                return static_cast<uint8_t>(std::min_element(dst, dst + k) - dst);
+            }
+        };
+
+        // Lloyd's k-means of contiguous sub-vectors, initial centroids are spread over the sample
+        void kmeans(const std::vector<float> &_points, std::size_t _size, uint16_t _subSize, uint16_t _iterations,
+                    float *_codebook) {
+            const std::size_t k = pq_codec_t::centroids;
+            for (std::size_t c = 0; c < k; ++c) {
+                auto point = (c * _size / k) % _size;
+                std::copy(_points.begin() + point * _subSize, _points.begin() + (point + 1) * _subSize,
+                          _codebook + c * _subSize);
+            }
+            transposed_t transposed;
+            std::vector<double> sums(k * _subSize);
+            std::vector<std::size_t> counts(k);
+            for (uint16_t iteration = 0; iteration < _iterations; ++iteration) {
+                transposed.assign(_codebook, _subSize);
+                std::fill(sums.begin(), sums.end(), 0.0);
+                std::fill(counts.begin(), counts.end(), 0);
+                for (std::size_t i = 0; i < _size; ++i) {
+                    auto point = _points.data() + i * _subSize;
+                    auto c = transposed.nearest(point, _subSize);
+                    ++counts[c];
+                    for (uint16_t j = 0; j < _subSize; ++j) {
+                        sums[c * _subSize + j] += point[j];
+                    }
+                }
+                for (std::size_t c = 0; c < k; ++c) {
+                    if (counts[c] == 0) {
+                        // empty cluster is moved to some point of the sample
+                        auto point = (c * 7919 + iteration * 104729) % _size;
+                        std::copy(_points.begin() + point * _subSize, _points.begin() + (point + 1) * _subSize,
+                                  _codebook + c * _subSize);
+                        continue;
+                    }
+                    for (uint16_t j = 0; j < _subSize; ++j) {
+                        _codebook[c * _subSize + j] = static_cast<float>(sums[c * _subSize + j] / counts[c]);
+                    }
+                }
+            }
+        }
+    }
+
+    const std::size_t pq_codec_t::centroids;
+
+    pq_codec_t::pq_codec_t(std::size_t _rows, uint16_t _vectorSize,
+                           const std::function<void(std::size_t, float *)> &_row, const pq_setting_t &_pqSettings):
+            m_vec_sz(_vectorSize), m_subspaces(_pqSettings.subspaces), m_rows(_rows),
+            m_codebooks(), m_rotation(), m_codes() {
+        if ((m_rows == 0) || (m_vec_sz == 0)) {
+            throw std::runtime_error("pq: nothing to quantize");
+        }
+        if (m_subspaces == 0) {
+            m_subspaces = 1;
+            for (uint16_t subSize = 4; subSize <= m_vec_sz; ++subSize) {
+                if ((m_vec_sz % subSize) == 0) {
+                    m_subspaces = static_cast<uint16_t>(m_vec_sz / subSize);
+                    break;
+                }
+            }
+        }
+        if ((m_subspaces > m_vec_sz) || ((m_vec_sz % m_subspaces) != 0)) {
+            throw std::runtime_error("pq: vector size must be divisible by the number of subspaces");
+        }
+        m_sub_sz = static_cast<uint16_t>(m_vec_sz / m_subspaces);
+
+        // uniform sample of rows
+        auto sampleSize = ((_pqSettings.sample > 0) && (_pqSettings.sample < m_rows)) ? _pqSettings.sample : m_rows;
+        std::vector<float> sample(sampleSize * m_vec_sz);
+        modelFile_t::parallel(sampleSize, [&](std::size_t _begin, std::size_t _end) {
+            for (auto i = _begin; i < _end; ++i) {
+                _row(i * m_rows / sampleSize, sample.data() + i * m_vec_sz);
+            }
+        }, _pqSettings.threads);
+        if (_pqSettings.rotation) {
+            auto rotation = trainRotation(sample, sampleSize, m_vec_sz, m_subspaces);
+            std::vector<float> rotated(m_vec_sz);
+            for (std::size_t i = 0; i < sampleSize; ++i) {
+                rotate(rotation.data(), sample.data() + i * m_vec_sz, rotated.data(), m_vec_sz);
+                std::copy(rotated.begin(), rotated.end(), sample.begin() + i * m_vec_sz);
+            }
+            m_rotation.owned().assign(rotation.begin(), rotation.end());
+        }
+
+        // subspace codebooks are independent, so they are trained in parallel
+        auto &codebooks = m_codebooks.owned();
+        codebooks.resize(static_cast<std::size_t>(m_subspaces) * centroids * m_sub_sz);
+        modelFile_t::parallel(m_subspaces, [&](std::size_t _begin, std::size_t _end) {
+            std::vector<float> points(sampleSize * m_sub_sz);
+            for (auto m = _begin; m < _end; ++m) {
+                for (std::size_t i = 0; i < sampleSize; ++i) {
+                    auto src = sample.data() + i * m_vec_sz + m * m_sub_sz;
+                    std::copy(src, src + m_sub_sz, points.begin() + i * m_sub_sz);
+                }
+                kmeans(points, sampleSize, m_sub_sz, _pqSettings.iterations,
+                       codebooks.data() + m * centroids * m_sub_sz);
+            }
+        }, _pqSettings.threads, 1);
+
+        auto &codes = m_codes.owned();
+        codes.resize(m_rows * m_subspaces);
+        modelFile_t::parallel(m_rows, [&](std::size_t _begin, std::size_t _end) {
+            std::vector<transposed_t> transposed(m_subspaces);
+            for (std::size_t m = 0; m < m_subspaces; ++m) {
+                transposed[m].assign(codebooks.data() + m * centroids * m_sub_sz, m_sub_sz);
+            }
+            std::vector<float> row(m_vec_sz);
+            std::vector<float> rotated(m_vec_sz);
+            for (auto i = _begin; i < _end; ++i) {
+                _row(i, row.data());
+                auto vector = row.data();
+                if (!m_rotation.empty()) {
+                    rotate(m_rotation.data(), row.data(), rotated.data(), m_vec_sz);
+                    vector = rotated.data();
+                }
+                for (std::size_t m = 0; m < m_subspaces; ++m) {
+                    codes[i * m_subspaces + m] = transposed[m].nearest(vector + m * m_sub_sz, m_sub_sz);
+                }
+            }
+        }, _pqSettings.threads);
+    }
+
+    pq_codec_t::pq_codec_t(std::size_t _rows, uint16_t _vectorSize, uint16_t _subspaces, const float *_codebooks,
+                           const float *_rotation, const uint8_t *_codes):
+            m_vec_sz(_vectorSize), m_subspaces(_subspaces), m_sub_sz(static_cast<uint16_t>(_vectorSize / _subspaces)),
+            m_rows(_rows), m_codebooks(), m_rotation(), m_codes() {
+        m_codebooks.view(_codebooks, static_cast<std::size_t>(m_subspaces) * centroids * m_sub_sz);
+        if (_rotation != nullptr) {
+            m_rotation.view(_rotation, static_cast<std::size_t>(m_vec_sz) * m_vec_sz);
+        }
+        m_codes.view(_codes, m_rows * m_subspaces);
+    }
+
+    void pq_codec_t::lookup(const float *_vector, float *_table) const {
+        std::vector<float> rotated;
+        if (!m_rotation.empty()) {
+            rotated.resize(m_vec_sz);
+            rotate(m_rotation.data(), _vector, rotated.data(), m_vec_sz);
+            _vector = rotated.data();
+        }
+        for (std::size_t m = 0; m < m_subspaces; ++m) {
+            auto subVector = _vector + m * m_sub_sz;
+            auto codebook = m_codebooks.data() + m * centroids * m_sub_sz;
+            for (std::size_t c = 0; c < centroids; ++c) {
+                float dot = 0.0f;
+                for (uint16_t k = 0; k < m_sub_sz; ++k) {
+                    dot += codebook[c * m_sub_sz + k] * subVector[k];
+                }
+                _table[m * centroids + c] = dot;
+            }
+        }
+    }
+
+    void pq_codec_t::encode(const float *_vector, uint8_t *_code) const {
+        std::vector<float> rotated;
+        if (!m_rotation.empty()) {
+            rotated.resize(m_vec_sz);
+            rotate(m_rotation.data(), _vector, rotated.data(), m_vec_sz);
+            _vector = rotated.data();
+        }
+        for (std::size_t m = 0; m < m_subspaces; ++m) {
+            auto subVector = _vector + m * m_sub_sz;
+            auto codebook = m_codebooks.data() + m * centroids * m_sub_sz;
+            auto best = std::numeric_limits<float>::max();
+            for (std::size_t c = 0; c < centroids; ++c) {
+                float distance = 0.0f;
+                for (uint16_t k = 0; k < m_sub_sz; ++k) {
+                    auto diff = codebook[c * m_sub_sz + k] - subVector[k];
+                    distance += diff * diff;
+                }
+                if (distance < best) {
+                    best = distance;
+                    _code[m] = static_cast<uint8_t>(c);
+                }
+            }
+        }
+    }
+
+    void pq_codec_t::decode(std::size_t _id, float *_vector) const {
+        auto code = m_codes.data() + _id * m_subspaces;
+        std::vector<float> rotated(m_vec_sz);
+        for (std::size_t m = 0; m < m_subspaces; ++m) {
+            auto centroid = m_codebooks.data() + (m * centroids + code[m]) * m_sub_sz;
+            std::copy(centroid, centroid + m_sub_sz, rotated.begin() + m * m_sub_sz);
+        }
+        if (m_rotation.empty()) {
+            std::copy(rotated.begin(), rotated.end(), _vector);
+            return;
+        }
+        // inverse of the orthogonal rotation is its transpose
+        std::fill(_vector, _vector + m_vec_sz, 0.0f);
+        for (uint16_t i = 0; i < m_vec_sz; ++i) {
+            auto axis = m_rotation.data() + static_cast<std::size_t>(i) * m_vec_sz;
+            for (uint16_t k = 0; k < m_vec_sz; ++k) {
+                _vector[k] += axis[k] * rotated[i];
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#include "progress.hpp"
+
+namespace wordvec {
+    progressReporter_t::progressReporter_t(callback_t _callback, uint32_t _interval):
+            m_callback(std::move(_callback)), m_interval(_interval), m_slot(0), m_lock(), m_wakeUp(), m_thread() {
+    }
+
+    progressReporter_t::~progressReporter_t() {
+        stop();
+    }
+
+    void progressReporter_t::launch() {
+        if (m_interval.count() > 0) {
+            m_thread.reset(new std::thread(&progressReporter_t::worker, this));
+        }
+    }
+
+    void progressReporter_t::stop() noexcept {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread->join();
+            m_thread.reset();
+            // publishers are done here
+            deliver();
+        }
+    }
+
+    void progressReporter_t::worker() noexcept {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (!m_wakeUp.wait_for(lock, m_interval, [this]() {return m_stop;})) {
+            lock.unlock();
+            deliver();
+            lock.lock();
+        }
+    }
+
+    void progressReporter_t::deliver() noexcept {
+        auto value = m_slot.load(std::memory_order_relaxed);
+        if (value == m_reported) {
+            return;
+        }
+        m_reported = value;
+
+        auto alphaBits = static_cast<uint32_t>(value);
+        auto percentBits = static_cast<uint32_t>(value >> 32);
+        float alpha = 0.0f;
+        float percent = 0.0f;
+        std::memcpy(&alpha, &alphaBits, sizeof(alpha));
+        std::memcpy(&percent, &percentBits, sizeof(percent));
+        try {
+            m_callback(alpha, percent);
+        } catch (...) {
+            // reporting must not break training
+        }
+    }
+}
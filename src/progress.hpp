@@ -0,0 +1,78 @@
+#ifndef __PROGRESS_H__
+#define __PROGRESS_H__
+
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <functional>
+
+namespace wordvec {
+    /**
+     * @brief progressReporter class - single slot progress mailbox and its reporter thread
+     *
+     * Train threads publish learning rate and progress percent to a single 64-bit atomic slot, the slot keeps
+     * the greatest percent, so a publication is a few relaxed loads and a compare-and-swap and never waits.
+     * Reporter thread wakes up each interval and calls the callback if the slot has changed, the last value is
+     * delivered on stop. Zero interval disables the reporter thread, the callback is called by publishers.
+    */
+    class progressReporter_t final {
+    public:
+        using callback_t = std::function<void(float, float)>;
+
+    private:
+        callback_t m_callback;
+        const std::chrono::milliseconds m_interval;
+        std::atomic<uint64_t> m_slot;
+        uint64_t m_reported = 0;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        bool m_stop = false;
+        std::unique_ptr<std::thread> m_thread;
+
+    public:
+        /**
+         * Constructs progress reporter
+         * @param _callback function called with learning rate and progress percent
+         * @param _interval reporting interval in milliseconds, 0 - callback is called by publishers
+        */
+        progressReporter_t(callback_t _callback, uint32_t _interval);
+        ~progressReporter_t();
+
+        progressReporter_t(const progressReporter_t &) = delete;
+        void operator=(const progressReporter_t &) = delete;
+
+        /// Publishes progress, lower percent than already published one is ignored
+        inline void publish(float _alpha, float _percent) noexcept {
+            if (m_interval.count() == 0) {
+                m_callback(_alpha, _percent);
+                return;
+            }
+            // non-negative floats are ordered like their bit patterns, percent goes to the high half
+            uint32_t alphaBits = 0;
+            uint32_t percentBits = 0;
+            std::memcpy(&alphaBits, &_alpha, sizeof(alphaBits));
+            std::memcpy(&percentBits, &_percent, sizeof(percentBits));
+            auto value = (static_cast<uint64_t>(percentBits) << 32) | alphaBits;
+            auto current = m_slot.load(std::memory_order_relaxed);
+            while ((value > current)
+                   && !m_slot.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        /// Launches reporter thread
+        void launch();
+        /// Stops reporter thread and delivers the last published progress
+        void stop() noexcept;
+
+    private:
+        void worker() noexcept;
+        void deliver() noexcept;
+    };
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+namespace wordvec {
+    /**
+     * @brief ringBuffer class - bounded lock-free MPMC queue
+     *
+     * Fixed size ring of cells where each cell carries its own sequence number, so producers and consumers
+     * synchronize on the cell they touch only (D. Vyukov's bounded MPMC queue). Capacity is rounded up to the
+     * next power of two. Works for SPSC as well as for MPMC scenarios.
+    */
+    template <class value_t>
+    class ringBuffer_t final {
+    private:
+        static const std::size_t cacheLine = 64;
+
+        struct cell_t final {
+            std::atomic<std::size_t> sequence;
+            value_t data;
+        };
+
+        std::unique_ptr<cell_t[]> m_cells;
+        const std::size_t m_mask;
+        char m_pad0[cacheLine];
+        std::atomic<std::size_t> m_enqueuePos;
+        char m_pad1[cacheLine - sizeof(std::atomic<std::size_t>)];
+        std::atomic<std::size_t> m_dequeuePos;
+        char m_pad2[cacheLine - sizeof(std::atomic<std::size_t>)];
+
+        static std::size_t roundUp(std::size_t _value) noexcept {
+            std::size_t ret = 2;
+            while (ret < _value) {
+                ret <<= 1;
+            }
+            return ret;
+        }
+
+    public:
+        /**
+         * Constructs a ringBuffer object
+         * @param _capacity minimum number of elements the buffer can hold
+         */
+        explicit ringBuffer_t(std::size_t _capacity):
+                m_cells(new cell_t[roundUp(_capacity)]), m_mask(roundUp(_capacity) - 1),
+                m_pad0(), m_enqueuePos(0), m_pad1(), m_dequeuePos(0), m_pad2() {
+            if (_capacity == 0) {
+                throw std::runtime_error("ringBuffer: capacity must be greater than 0");
+            }
+            for (std::size_t i = 0; i <= m_mask; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ringBuffer_t(const ringBuffer_t &) = delete;
+        void operator=(const ringBuffer_t &) = delete;
+
+        /**
+         * Tries to put a value into the buffer
+         * @param _value value to be moved into the buffer
+         * @returns true on success or false if the buffer is full
+         */
+        inline bool push(value_t &_value) noexcept {
+            cell_t *cell = nullptr;
+            auto pos = m_enqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &m_cells[pos & m_mask];
+                auto seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = std::move(_value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * Tries to get a value from the buffer
+         * @param[out] _value value moved out of the buffer
+         * @returns true on success or false if the buffer is empty
+         */
+        inline bool pop(value_t &_value) noexcept {
+            cell_t *cell = nullptr;
+            auto pos = m_dequeuePos.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &m_cells[pos & m_mask];
+                auto seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0) {
+                    if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+            _value = std::move(cell->data);
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /// @returns approximate number of elements in the buffer
+        inline std::size_t size() const noexcept {
+            auto enq = m_enqueuePos.load(std::memory_order_relaxed);
+            auto deq = m_dequeuePos.load(std::memory_order_relaxed);
+            return (enq > deq) ? (enq - deq) : 0;
+        }
+
+        /// @returns buffer capacity
+        inline std::size_t capacity() const noexcept {
+            return m_mask + 1;
+        }
+    };
+}
+
+#endif
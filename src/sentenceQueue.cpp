@@ -0,0 +1,117 @@
+#include <thread>
+#include <chrono>
+
+#include "sentenceQueue.hpp"
+
+namespace wordvec {
+    namespace {
+        const std::size_t yieldRounds = 64;
+        const std::chrono::microseconds sleepTime(50);
+
+        inline void backoff(std::size_t _round) noexcept {
+            if (_round < yieldRounds) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(sleepTime);
+            }
+        }
+
+        inline std::size_t elapsedUs(const std::chrono::steady_clock::time_point &_since) noexcept {
+            return static_cast<std::size_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - _since).count());
+        }
+    }
+
+    sentenceQueue_t::sentenceQueue_t(std::size_t _capacity, std::size_t _producers):
+            m_queue(_capacity), m_free(_capacity * 2), m_producers(_producers),
+            m_batches(), m_producerStalls(), m_producerStallTime(), m_consumerStalls(), m_consumerStallTime(),
+            m_depthSum(), m_depthSamples(), m_maxDepth() {
+    }
+
+    sentenceQueue_t::~sentenceQueue_t() {
+        sentenceBatch_t *batch = nullptr;
+        while (m_queue.pop(batch)) {
+            delete batch;
+        }
+        while (m_free.pop(batch)) {
+            delete batch;
+        }
+    }
+
+    sentenceBatch_t *sentenceQueue_t::acquire() {
+        sentenceBatch_t *batch = nullptr;
+        if (m_free.pop(batch)) {
+            batch->clear();
+            return batch;
+        }
+
+        return new sentenceBatch_t();
+    }
+
+    void sentenceQueue_t::release(sentenceBatch_t *_batch) noexcept {
+        if (!m_free.push(_batch)) {
+            delete _batch;
+        }
+    }
+
+    void sentenceQueue_t::push(sentenceBatch_t *_batch) noexcept {
+        if (!m_queue.push(_batch)) {
+            m_producerStalls.value.fetch_add(1, std::memory_order_relaxed);
+            auto stallStart = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; !m_queue.push(_batch); ++i) {
+                backoff(i);
+            }
+            m_producerStallTime.value.fetch_add(elapsedUs(stallStart), std::memory_order_relaxed);
+        }
+        m_batches.value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    sentenceBatch_t *sentenceQueue_t::pop() noexcept {
+        auto depth = m_queue.size();
+        m_depthSum.value.fetch_add(depth, std::memory_order_relaxed);
+        m_depthSamples.value.fetch_add(1, std::memory_order_relaxed);
+        auto maxDepth = m_maxDepth.value.load(std::memory_order_relaxed);
+        while ((depth > maxDepth)
+               && !m_maxDepth.value.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed)) {
+        }
+
+        sentenceBatch_t *batch = nullptr;
+        if (m_queue.pop(batch)) {
+            return batch;
+        }
+
+        m_consumerStalls.value.fetch_add(1, std::memory_order_relaxed);
+        auto stallStart = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; !m_queue.pop(batch); ++i) {
+            if (m_producers.load(std::memory_order_acquire) == 0) {
+                // producers may push their last batches right before they are done
+                if (!m_queue.pop(batch)) {
+                    batch = nullptr;
+                }
+                break;
+            }
+            backoff(i);
+        }
+        m_consumerStallTime.value.fetch_add(elapsedUs(stallStart), std::memory_order_relaxed);
+
+        return batch;
+    }
+
+    void sentenceQueue_t::producerDone() noexcept {
+        m_producers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void sentenceQueue_t::stats(pipeline_stats_t &_stats) const noexcept {
+        _stats.queue_size = m_queue.capacity();
+        _stats.batches = m_batches.value.load(std::memory_order_relaxed);
+        _stats.producer_stalls = m_producerStalls.value.load(std::memory_order_relaxed);
+        _stats.producer_stall_ms = m_producerStallTime.value.load(std::memory_order_relaxed) / 1000;
+        _stats.consumer_stalls = m_consumerStalls.value.load(std::memory_order_relaxed);
+        _stats.consumer_stall_ms = m_consumerStallTime.value.load(std::memory_order_relaxed) / 1000;
+        _stats.max_queue_depth = m_maxDepth.value.load(std::memory_order_relaxed);
+        auto samples = m_depthSamples.value.load(std::memory_order_relaxed);
+        _stats.avg_queue_depth = (samples > 0)
+                                 ? static_cast<float>(m_depthSum.value.load(std::memory_order_relaxed)) / samples
+                                 : 0.0f;
+    }
+}
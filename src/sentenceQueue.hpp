@@ -0,0 +1,102 @@
+#ifndef __SENTENCEQUEUE_H__
+#define __SENTENCEQUEUE_H__
+
+#include <memory>
+#include <vector>
+#include <atomic>
+
+#include "word_vector.hpp"
+#include "ringBuffer.hpp"
+
+namespace wordvec {
+    /**
+     * @brief sentenceBatch structure - a bunch of already encoded and down-sampled sentences
+     *
+     * Sentences are stored as a flat vector of word indexes with a vector of sentence end offsets.
+    */
+    struct sentenceBatch_t final {
+        std::vector<std::size_t> words; ///< word indexes of all sentences
+        std::vector<std::size_t> sentences; ///< end offset of each sentence in words vector
+        std::size_t processedWords = 0; ///< vocabulary words read from a train file, including down-sampled ones
+
+        /// Clears batch data keeping allocated memory
+        inline void clear() noexcept {
+            words.clear();
+            sentences.clear();
+            processedWords = 0;
+        }
+    };
+
+    /**
+     * @brief sentenceQueue class - bounded queue of sentence batches between reader and train threads
+     *
+     * Reader (encoder) threads acquire an empty batch, fill it and push it into the queue, train threads pop
+     * batches and release them back after processing, so batch memory is reused. Both sides wait with
+     * backoff when the queue is full/empty and the waits are counted as producer/consumer stalls.
+    */
+    class sentenceQueue_t final {
+    private:
+        struct counter_t final {
+            std::atomic<std::size_t> value;
+            char pad[64 - sizeof(std::atomic<std::size_t>)];
+
+            counter_t(): value(0), pad() {}
+        };
+
+        ringBuffer_t<sentenceBatch_t *> m_queue;
+        ringBuffer_t<sentenceBatch_t *> m_free;
+        std::atomic<std::size_t> m_producers;
+
+        counter_t m_batches;
+        counter_t m_producerStalls;
+        counter_t m_producerStallTime;
+        counter_t m_consumerStalls;
+        counter_t m_consumerStallTime;
+        counter_t m_depthSum;
+        counter_t m_depthSamples;
+        counter_t m_maxDepth;
+
+    public:
+        /**
+         * Constructs a sentenceQueue object
+         * @param _capacity maximum amount of batches in the queue
+         * @param _producers amount of producer threads, queue is closed when all of them are done
+         */
+        sentenceQueue_t(std::size_t _capacity, std::size_t _producers);
+        ~sentenceQueue_t();
+
+        sentenceQueue_t(const sentenceQueue_t &) = delete;
+        void operator=(const sentenceQueue_t &) = delete;
+
+        /// @returns empty batch, reused one or newly allocated
+        sentenceBatch_t *acquire();
+        /// Returns processed batch to the free list
+        void release(sentenceBatch_t *_batch) noexcept;
+
+        /**
+         * Pushes a filled batch into the queue, waits while the queue is full
+         * @param _batch batch to be pushed, ownership is passed to the queue
+         */
+        void push(sentenceBatch_t *_batch) noexcept;
+
+        /**
+         * Pops a batch from the queue, waits while the queue is empty and producers are active
+         * @returns batch or nullptr when all producers are done and the queue is empty
+         */
+        sentenceBatch_t *pop() noexcept;
+
+        /// Marks one of producers as finished
+        void producerDone() noexcept;
+
+        /// @returns approximate queue depth
+        inline std::size_t depth() const noexcept {return m_queue.size();}
+
+        /**
+         * Requests queue statistics
+         * @param[out] _stats queue depth and stall metrics
+         */
+        void stats(pipeline_stats_t &_stats) const noexcept;
+    };
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+#include "modelFile.hpp"
+
+namespace wordvec {
+    namespace {
+        const uint32_t simhashVersion = 2;
+        const uint16_t maxBits = 512;
+        // codes are scanned by blocks, distances of a block stay in L1 cache
+        const std::size_t blockRows = 256;
+
+        // index file header. Sections follow at 64-byte aligned offsets: hyperplane normals and codes
+        struct simhashHeader_t {
+            char magic[8];
+            uint32_t version;
+            uint16_t vectorSize;
+            uint16_t bits;
+            uint16_t rerank;
+            uint16_t maxHamming;
+            uint8_t reserved[4];
+            uint64_t nodes;
+            uint64_t planesOffset;
+            uint64_t codesOffset;
+            uint64_t fileSize;
+            // fingerprint of the model the index is saved with
+            uint64_t fingerprint;
+        };
+
+        inline uint64_t alignSection(uint64_t _offset) noexcept {
+            return (_offset + 63) & ~static_cast<uint64_t>(63);
+        }
+
+        using scored_t = std::pair<float, uint32_t>;
+    }
+
+    const char simhash_index_t::magic[8] = {'w', 'v', 's', 'i', 'm', 'h', '0', '1'};
+
+    simhash_index_t::simhash_index_t(uint16_t _vectorSize, const simhash_setting_t &_simhashSettings):
+            m_vec_sz(_vectorSize), m_bits(_simhashSettings.bits), m_words(static_cast<uint16_t>(m_bits / 64)),
+            m_rerank(_simhashSettings.rerank), m_max_hamming(_simhashSettings.max_hamming), m_planes(), m_codes(),
+            m_mapping() {
+        if ((m_vec_sz == 0) || (m_bits == 0) || (m_bits > maxBits) || ((m_bits % 64) != 0)) {
+            throw std::runtime_error("simhash: wrong index settings");
+        }
+
+        // gaussian normals are uniformly distributed directions
+        std::mt19937_64 randomGenerator(_simhashSettings.seed);
+        std::normal_distribution<float> distribution(0.0f, 1.0f);
+        auto &planes = m_planes.owned();
+        planes.resize(static_cast<std::size_t>(m_bits) * m_vec_sz);
+        for (auto &i:planes) {
+            i = distribution(randomGenerator);
+        }
+    }
+
+    simhash_index_t::simhash_index_t(const std::shared_ptr<file_mapper_t> &_mapping):
+            m_planes(), m_codes(), m_mapping(_mapping) {
+        simhashHeader_t header{};
+        auto fileSize = static_cast<uint64_t>(m_mapping->size());
+        if (fileSize < sizeof(header)) {
+            throw std::runtime_error("simhash: wrong index file format");
+        }
+        std::memcpy(&header, m_mapping->data(), sizeof(header));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+            throw std::runtime_error("simhash: wrong index file format");
+        }
+        if (header.version != simhashVersion) {
+            throw std::runtime_error("simhash: unsupported index file version " + std::to_string(header.version));
+        }
+        auto section = [fileSize](uint64_t _offset, uint64_t _size) {
+            return ((_offset % 64) == 0) && (_offset >= sizeof(simhashHeader_t)) && (_offset <= fileSize)
+                   && (_size <= fileSize - _offset);
+        };
+        if ((header.fileSize != fileSize) || (header.vectorSize == 0) || (header.bits == 0)
+            || (header.bits > maxBits) || ((header.bits % 64) != 0)
+            || !section(header.planesOffset, uint64_t{header.bits} * header.vectorSize * sizeof(float))
+            || !section(header.codesOffset, header.nodes * (header.bits / 64) * sizeof(uint64_t))) {
+            throw std::runtime_error("simhash: wrong index file format");
+        }
+
+        m_vec_sz = header.vectorSize;
+        m_bits = header.bits;
+        m_words = static_cast<uint16_t>(m_bits / 64);
+        m_rerank = header.rerank;
+        m_max_hamming = header.maxHamming;
+        m_nodes = header.nodes;
+        m_fingerprint = header.fingerprint;
+        auto data = static_cast<const char *>(m_mapping->data());
+        m_planes.view(reinterpret_cast<const float *>(data + header.planesOffset),
+                      static_cast<std::size_t>(m_bits) * m_vec_sz);
+        m_codes.view(reinterpret_cast<const uint64_t *>(data + header.codesOffset), m_nodes * m_words);
+    }
+
+    std::shared_ptr<ann_index_t> simhash_index_t::clone() const {
+        return std::make_shared<simhash_index_t>(*this);
+    }
+
+    void simhash_index_t::encode(const float *_vector, uint64_t *_code) const noexcept {
+        float dots[maxBits];
+        dotRows(m_planes.data(), m_bits, _vector, m_vec_sz, dots);
+        std::fill(_code, _code + m_words, 0);
+        for (uint16_t i = 0; i < m_bits; ++i) {
+            if (dots[i] > 0.0f) {
+                _code[i / 64] |= uint64_t{1} << (i % 64);
+            }
+        }
+    }
+
+    void simhash_index_t::add(const float *_matrix, std::size_t _rows, uint16_t _threads) {
+        if (_rows <= m_nodes) {
+            return;
+        }
+
+        auto first = m_nodes;
+        auto &codes = m_codes.owned();
+        codes.resize(_rows * m_words);
+        modelFile_t::parallel(_rows - first, [&](std::size_t _begin, std::size_t _end) {
+            for (auto i = first + _begin; i < first + _end; ++i) {
+                encode(_matrix + i * m_vec_sz, codes.data() + i * m_words);
+            }
+        }, _threads);
+        m_nodes = _rows;
+    }
+
+    void simhash_index_t::update(const float *_matrix, std::size_t _id) {
+        encode(_matrix + _id * m_vec_sz, m_codes.owned().data() + _id * m_words);
+    }
+
+    void simhash_index_t::remove(const float *, std::size_t _id) {
+        auto &codes = m_codes.owned();
+        auto last = m_nodes - 1;
+        std::copy(codes.begin() + last * m_words, codes.end(), codes.begin() + _id * m_words);
+        codes.resize(last * m_words);
+        --m_nodes;
+    }
+
+    void simhash_index_t::search(const float *_matrix, const float *_vector, std::size_t _amount,
+                                 std::vector<std::pair<float, uint32_t>> &_found) const {
+        _found.clear();
+        if ((m_nodes == 0) || (_amount == 0)) {
+            return;
+        }
+
+        uint64_t code[maxBits / 64];
+        encode(_vector, code);
+        // the nearest codes take the greatest scores, opposite codes are never selected
+        auto maxHamming = (m_max_hamming > 0) ? std::min(m_max_hamming, m_bits) : m_bits;
+        nearest_rows_t nearestRows(_amount * std::max<uint16_t>(m_rerank, 1));
+        uint32_t distances[blockRows];
+        for (std::size_t block = 0; block < m_nodes; block += blockRows) {
+            auto blockSize = std::min(blockRows, m_nodes - block);
+            hammingRows(m_codes.data() + block * m_words, blockSize, code, m_words, distances);
+            auto entryLevel = nearestRows.entryLevel();
+            for (std::size_t i = 0; i < blockSize; ++i) {
+                if (distances[i] > maxHamming) {
+                    continue;
+                }
+                auto score = static_cast<float>(m_bits - distances[i]);
+                if (score > entryLevel) {
+                    nearestRows.push(score, block + i);
+                    entryLevel = nearestRows.entryLevel();
+                }
+            }
+        }
+
+        _found = nearestRows.sorted();
+        for (auto &i:_found) {
+            i.first = dotFloat(_matrix + static_cast<std::size_t>(i.second) * m_vec_sz, _vector, m_vec_sz);
+        }
+        std::sort(_found.begin(), _found.end(), std::greater<scored_t>());
+    }
+
+    void simhash_index_t::save(const std::string &_indexFile, uint64_t _fingerprint) const {
+        simhashHeader_t header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = simhashVersion;
+        header.fingerprint = _fingerprint;
+        header.vectorSize = m_vec_sz;
+        header.bits = m_bits;
+        header.rerank = m_rerank;
+        header.maxHamming = m_max_hamming;
+        header.nodes = m_nodes;
+        header.planesOffset = alignSection(sizeof(header));
+        header.codesOffset = alignSection(header.planesOffset + m_planes.size() * sizeof(float));
+        header.fileSize = header.codesOffset + m_codes.size() * sizeof(uint64_t);
+
+        file_mapper_t output(_indexFile, true, static_cast<off_t>(header.fileSize));
+        std::memset(output.data(), 0, header.fileSize);
+        std::memcpy(output.data(), &header, sizeof(header));
+        std::memcpy(output.data() + header.planesOffset, m_planes.data(), m_planes.size() * sizeof(float));
+        if (!m_codes.empty()) {
+            std::memcpy(output.data() + header.codesOffset, m_codes.data(), m_codes.size() * sizeof(uint64_t));
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "subwords.hpp"
+
+namespace wordvec {
+    subwords_t::subwords_t(const std::vector<std::string> &_words,
+                           uint8_t _minNgram, uint8_t _maxNgram, uint32_t _buckets, uint16_t _vectorSize):
+            m_minNgram(_minNgram), m_maxNgram(_maxNgram), m_buckets(_buckets), m_vectorSize(_vectorSize),
+            m_offsets(), m_ngrams(), m_vectors() {
+        if ((m_minNgram == 0) || (m_minNgram > m_maxNgram) || (m_buckets == 0)) {
+            throw std::runtime_error("subwords: wrong n-gram parameters");
+        }
+
+        m_offsets.reserve(_words.size() + 1);
+        m_offsets.push_back(0);
+        for (auto const &i:_words) {
+            ngrams(i, m_minNgram, m_maxNgram, m_buckets, m_ngrams);
+            m_offsets.push_back(m_ngrams.size());
+        }
+        m_ngrams.shrink_to_fit();
+
+        // bucket vectors initialized like the input matrix
+        m_vectors.resize(static_cast<std::size_t>(m_buckets) * m_vectorSize);
+        std::random_device randomDevice;
+        std::mt19937_64 randomGenerator(randomDevice());
+        std::uniform_real_distribution<float> rndMatrixInitializer(-0.005f, 0.005f);
+        std::generate(m_vectors.begin(), m_vectors.end(), [&]() {
+            return rndMatrixInitializer(randomGenerator);
+        });
+    }
+
+    void subwords_t::ngrams(const std::string &_word, uint8_t _minNgram, uint8_t _maxNgram, uint32_t _buckets,
+                            std::vector<uint32_t> &_ngrams) noexcept {
+        const std::string word = "<" + _word + ">";
+        for (std::size_t i = 0; i < word.size(); ++i) {
+            if ((word[i] & 0xC0) == 0x80) {
+                continue; // UTF-8 continuation byte
+            }
+            // FNV-1a hash of the n-gram, extended character by character
+            uint32_t hash = 2166136261u;
+            std::size_t j = i;
+            for (uint8_t n = 1; (n <= _maxNgram) && (j < word.size()); ++n) {
+                do {
+                    hash ^= static_cast<uint32_t>(static_cast<uint8_t>(word[j++]));
+                    hash *= 16777619u;
+                } while ((j < word.size()) && ((word[j] & 0xC0) == 0x80));
+                if (n >= _minNgram) {
+                    _ngrams.push_back(hash % _buckets);
+                }
+            }
+        }
+    }
+}
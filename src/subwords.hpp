@@ -0,0 +1,72 @@
+#ifndef __SUBWORDS_H__
+#define __SUBWORDS_H__
+
+#include <string>
+#include <vector>
+
+namespace wordvec {
+    /**
+     * @brief subwords class - hashed character n-grams of vocabulary words and their bucket vectors
+     *
+     * Word is represented by the average of its own input vector and vectors of its character n-grams. N-grams
+     * are taken from the word surrounded by '<' and '>', so prefixes and suffixes differ from other n-grams, and
+     * hashed into a fixed number of buckets, so the table size does not depend on the vocabulary size. Bucket IDs
+     * of vocabulary words are precomputed once and stored in a flat CSR array.
+    */
+    class subwords_t final {
+    private:
+        const uint8_t m_minNgram;
+        const uint8_t m_maxNgram;
+        const uint32_t m_buckets;
+        const uint16_t m_vectorSize;
+        std::vector<std::size_t> m_offsets;
+        std::vector<uint32_t> m_ngrams;
+        std::vector<float> m_vectors;
+
+    public:
+        /**
+         * Constructs subwords object, bucket vectors are initialized with small random values
+         * @param _words vocabulary words ordered by their indexes
+         * @param _minNgram minimum n-gram length in characters
+         * @param _maxNgram maximum n-gram length in characters
+         * @param _buckets number of buckets
+         * @param _vectorSize vector size
+         * @throws std::runtime_error on wrong n-gram parameters
+        */
+        subwords_t(const std::vector<std::string> &_words,
+                   uint8_t _minNgram, uint8_t _maxNgram, uint32_t _buckets, uint16_t _vectorSize);
+
+        subwords_t(const subwords_t &) = delete;
+        void operator=(const subwords_t &) = delete;
+
+        /**
+         * Calculates bucket IDs of a word n-grams, UTF-8 multibyte characters are not split
+         * @param _word word
+         * @param _minNgram minimum n-gram length in characters
+         * @param _maxNgram maximum n-gram length in characters
+         * @param _buckets number of buckets
+         * @param[out] _ngrams bucket IDs are appended to this vector
+        */
+        static void ngrams(const std::string &_word, uint8_t _minNgram, uint8_t _maxNgram, uint32_t _buckets,
+                           std::vector<uint32_t> &_ngrams) noexcept;
+
+        /// @returns pointer to the first bucket ID of the word n-grams
+        inline const uint32_t *ngramsBegin(std::size_t _index) const noexcept {
+            return m_ngrams.data() + m_offsets[_index];
+        }
+        /// @returns pointer past the last bucket ID of the word n-grams
+        inline const uint32_t *ngramsEnd(std::size_t _index) const noexcept {
+            return m_ngrams.data() + m_offsets[_index + 1];
+        }
+
+        /// @returns bucket vectors, buckets() rows of vectorSize values
+        inline float *vectors() noexcept {return m_vectors.data();}
+        inline const float *vectors() const noexcept {return m_vectors.data();}
+
+        inline uint32_t buckets() const noexcept {return m_buckets;}
+        inline uint8_t minNgram() const noexcept {return m_minNgram;}
+        inline uint8_t maxNgram() const noexcept {return m_maxNgram;}
+    };
+}
+
+#endif
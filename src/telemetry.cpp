@@ -0,0 +1,160 @@
+#include <stdexcept>
+
+#include "telemetry.hpp"
+
+namespace wordvec {
+    namespace {
+        void writeJson(std::ostream &_output, const thread_stats_t &_stats) {
+            _output << "\"words\":" << _stats.words
+                    << ",\"pairs\":" << _stats.pairs
+                    << ",\"skipped_words\":" << _stats.skipped_words
+                    << ",\"words_per_sec\":" << _stats.words_per_sec
+                    << ",\"pairs_per_sec\":" << _stats.pairs_per_sec
+                    << ",\"loss\":" << _stats.loss
+                    << ",\"read_ms\":" << _stats.read_ms
+                    << ",\"train_ms\":" << _stats.train_ms;
+        }
+    }
+
+    telemetry_t::telemetry_t(std::size_t _threads, uint32_t _interval, const std::string &_statsFile,
+                             callback_t _callback):
+            m_threads(_threads), m_interval(_interval), m_callback(_callback), m_counters(new counters_t[_threads]),
+            m_last(_threads), m_cpus(), m_statsFile(), m_startTime(), m_lastTime(), m_lock(), m_wakeUp(), m_thread() {
+        if (!_statsFile.empty()) {
+            m_statsFile.reset(new std::ofstream(_statsFile, std::ios::out | std::ios::trunc));
+            if (!m_statsFile->is_open()) {
+                throw std::runtime_error("telemetry: can not create stats file " + _statsFile);
+            }
+        }
+    }
+
+    telemetry_t::~telemetry_t() {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread->join();
+        }
+    }
+
+    void telemetry_t::layout(const std::vector<int> &_cpus) {
+        m_cpus = _cpus;
+        if (m_statsFile && !m_cpus.empty()) {
+            auto &output = *m_statsFile;
+            output << "{\"layout\":[";
+            for (std::size_t i = 0; i < m_cpus.size(); ++i) {
+                output << ((i > 0) ? ",{" : "{") << "\"id\":" << i << ",\"cpu\":" << m_cpus[i] << "}";
+            }
+            output << "]}" << std::endl;
+        }
+    }
+
+    void telemetry_t::launch() {
+        m_startTime = m_lastTime = std::chrono::steady_clock::now();
+        if (m_interval.count() > 0) {
+            m_thread.reset(new std::thread(&telemetry_t::worker, this));
+        }
+    }
+
+    void telemetry_t::stop() noexcept {
+        if (m_thread) {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread->join();
+            m_thread.reset();
+        }
+
+        // train threads are done here
+        report();
+    }
+
+    void telemetry_t::worker() noexcept {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (!m_wakeUp.wait_for(lock, m_interval, [this]() {return m_stop;})) {
+            lock.unlock();
+            report();
+            lock.lock();
+        }
+    }
+
+    void telemetry_t::report() noexcept {
+        auto now = std::chrono::steady_clock::now();
+        train_stats_t stats;
+        stats.seconds = std::chrono::duration<float>(now - m_startTime).count();
+        stats.interval = std::chrono::duration<float>(now - m_lastTime).count();
+        m_lastTime = now;
+
+        try {
+            stats.threads.resize(m_threads);
+            std::size_t lossSamples = 0;
+            double lossSum = 0.0;
+            for (std::size_t i = 0; i < m_threads; ++i) {
+                auto const &counters = m_counters[i];
+                snapshot_t current;
+                current.words = counters.words.load(std::memory_order_relaxed);
+                current.pairs = counters.pairs.load(std::memory_order_relaxed);
+                current.skippedWords = counters.skippedWords.load(std::memory_order_relaxed);
+                current.readTime = counters.readTime.load(std::memory_order_relaxed);
+                current.trainTime = counters.trainTime.load(std::memory_order_relaxed);
+                current.lossSamples = counters.lossSamples.load(std::memory_order_relaxed);
+                current.lossSum = counters.lossSum.load(std::memory_order_relaxed);
+
+                auto &last = m_last[i];
+                auto &threadStats = stats.threads[i];
+                threadStats.cpu = (i < m_cpus.size()) ? m_cpus[i] : -1;
+                threadStats.words = current.words - last.words;
+                threadStats.pairs = current.pairs - last.pairs;
+                threadStats.skipped_words = current.skippedWords - last.skippedWords;
+                threadStats.read_ms = (current.readTime - last.readTime) / 1000;
+                threadStats.train_ms = (current.trainTime - last.trainTime) / 1000;
+                if (current.lossSamples > last.lossSamples) {
+                    threadStats.loss = static_cast<float>((current.lossSum - last.lossSum)
+                                                          / (current.lossSamples - last.lossSamples));
+                }
+                if (stats.interval > 0.0f) {
+                    threadStats.words_per_sec = threadStats.words / stats.interval;
+                    threadStats.pairs_per_sec = threadStats.pairs / stats.interval;
+                }
+
+                stats.total.words += threadStats.words;
+                stats.total.pairs += threadStats.pairs;
+                stats.total.skipped_words += threadStats.skipped_words;
+                stats.total.words_per_sec += threadStats.words_per_sec;
+                stats.total.pairs_per_sec += threadStats.pairs_per_sec;
+                stats.total.read_ms += threadStats.read_ms;
+                stats.total.train_ms += threadStats.train_ms;
+                lossSamples += current.lossSamples - last.lossSamples;
+                lossSum += current.lossSum - last.lossSum;
+
+                last = current;
+            }
+            if (lossSamples > 0) {
+                stats.total.loss = static_cast<float>(lossSum / lossSamples);
+            }
+
+            if (m_statsFile) {
+                auto &output = *m_statsFile;
+                output << "{\"seconds\":" << stats.seconds << ",\"interval\":" << stats.interval << ",";
+                writeJson(output, stats.total);
+                output << ",\"threads\":[";
+                for (std::size_t i = 0; i < stats.threads.size(); ++i) {
+                    output << ((i > 0) ? ",{" : "{") << "\"id\":" << i << ",\"cpu\":" << stats.threads[i].cpu << ",";
+                    writeJson(output, stats.threads[i]);
+                    output << "}";
+                }
+                output << "]}" << std::endl;
+            }
+
+            if (m_callback != nullptr) {
+                m_callback(stats);
+            }
+        } catch (...) {
+            // monitoring must not break training, this report is lost
+        }
+    }
+}
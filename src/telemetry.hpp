@@ -0,0 +1,113 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <functional>
+
+#include "word_vector.hpp"
+
+namespace wordvec {
+    /**
+     * @brief telemetry class - train threads counters and their reporter thread
+     *
+     * Each train thread owns a slot of counters and updates it once per sentence (or batch) with relaxed
+     * atomic stores, slots are padded to separate cache lines. Reporter thread wakes up each stats_interval
+     * seconds, aggregates counters deltas and publishes them to the callback and to the JSON lines file, so
+     * train threads never wait for monitoring.
+    */
+    class telemetry_t final {
+    public:
+        /// Counters of a single train thread, written by the owner thread only
+        struct counters_t final {
+            std::atomic<std::size_t> words; ///< processed words including down-sampled ones
+            std::atomic<std::size_t> pairs; ///< trained (target, context) pairs
+            std::atomic<std::size_t> skippedWords; ///< down-sampled words
+            std::atomic<std::size_t> readTime; ///< microseconds spent on reading/encoding sentences
+            std::atomic<std::size_t> trainTime; ///< microseconds spent on training
+            std::atomic<std::size_t> lossSamples; ///< amount of sampled loss values
+            std::atomic<double> lossSum; ///< sum of sampled loss values
+            char pad[64]; ///< keeps counters of different threads in different cache lines
+
+            counters_t(): words(0), pairs(0), skippedWords(0), readTime(0), trainTime(0), lossSamples(0),
+                          lossSum(0.0), pad() {}
+
+            /// Adds a value to the counter, the only writer does not need an atomic read-modify-write
+            template <class value_t>
+            static inline void add(std::atomic<value_t> &_counter, value_t _value) noexcept {
+                _counter.store(_counter.load(std::memory_order_relaxed) + _value, std::memory_order_relaxed);
+            }
+        };
+
+        using callback_t = std::function<void(const train_stats_t &)>;
+
+    private:
+        struct snapshot_t final {
+            std::size_t words = 0;
+            std::size_t pairs = 0;
+            std::size_t skippedWords = 0;
+            std::size_t readTime = 0;
+            std::size_t trainTime = 0;
+            std::size_t lossSamples = 0;
+            double lossSum = 0.0;
+        };
+
+        const std::size_t m_threads;
+        const std::chrono::seconds m_interval;
+        callback_t m_callback;
+        std::unique_ptr<counters_t[]> m_counters;
+        std::vector<snapshot_t> m_last;
+        std::vector<int> m_cpus;
+        std::unique_ptr<std::ofstream> m_statsFile;
+        std::chrono::steady_clock::time_point m_startTime;
+        std::chrono::steady_clock::time_point m_lastTime;
+
+        std::mutex m_lock;
+        std::condition_variable m_wakeUp;
+        bool m_stop = false;
+        std::unique_ptr<std::thread> m_thread;
+
+    public:
+        /**
+         * Constructs telemetry object
+         * @param _threads amount of train threads
+         * @param _interval reporting interval in seconds, 0 - final report only
+         * @param _statsFile JSON lines file name, may be empty
+         * @param _callback function called on each report from the reporter thread, may be nullptr
+         * @throws std::runtime_error if the stats file can not be created
+        */
+        telemetry_t(std::size_t _threads, uint32_t _interval, const std::string &_statsFile, callback_t _callback);
+        ~telemetry_t();
+
+        telemetry_t(const telemetry_t &) = delete;
+        void operator=(const telemetry_t &) = delete;
+
+        /// @returns counters slot of the train thread
+        inline counters_t *counters(uint16_t _id) noexcept {return &m_counters[_id];}
+
+        /**
+         * Sets CPUs train threads are pinned to, the layout is written to the stats file and reported with
+         * threads counters
+         * @param _cpus CPU ID of each train thread
+        */
+        void layout(const std::vector<int> &_cpus);
+
+        /// Launches reporter thread
+        void launch();
+        /// Stops reporter thread and publishes the final report
+        void stop() noexcept;
+
+    private:
+        void worker() noexcept;
+        void report() noexcept;
+    };
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <stdexcept>
+
+#include "topology.hpp"
+
+namespace wordvec {
+    namespace {
+        const std::string sysfsCpu = "/sys/devices/system/cpu/";
+        const std::string sysfsNode = "/sys/devices/system/node/";
+
+        bool readLine(const std::string &_file, std::string &_line) {
+            std::ifstream input(_file);
+            return static_cast<bool>(std::getline(input, _line));
+        }
+
+        int readInt(const std::string &_file, int _default) {
+            std::string line;
+            if (!readLine(_file, line)) {
+                return _default;
+            }
+            try {
+                return std::stoi(line);
+            } catch (...) {
+                return _default;
+            }
+        }
+    }
+
+    topology_t::topology_t(): m_cpus() {
+#ifdef __linux__
+        std::string online;
+        if (!readLine(sysfsCpu + "online", online)) {
+            return;
+        }
+        cpu_set_t affinity;
+        CPU_ZERO(&affinity);
+        auto withAffinity = (sched_getaffinity(0, sizeof(affinity), &affinity) == 0);
+
+        std::map<int, int> nodes;
+        std::string nodesOnline;
+        if (readLine(sysfsNode + "online", nodesOnline)) {
+            for (auto const &i:parse(nodesOnline)) {
+                std::string cpuList;
+                if (readLine(sysfsNode + "node" + std::to_string(i) + "/cpulist", cpuList) && !cpuList.empty()) {
+                    for (auto const &j:parse(cpuList)) {
+                        nodes[j] = i;
+                    }
+                }
+            }
+        }
+
+        for (auto const &i:parse(online)) {
+            if (withAffinity && ((i >= CPU_SETSIZE) || !CPU_ISSET(i, &affinity))) {
+                continue;
+            }
+            cpu_t cpu;
+            cpu.id = i;
+            auto topology = sysfsCpu + "cpu" + std::to_string(i) + "/topology/";
+            cpu.core = readInt(topology + "core_id", i);
+            cpu.package = readInt(topology + "physical_package_id", 0);
+            auto node = nodes.find(i);
+            cpu.node = (node != nodes.end()) ? node->second : 0;
+            m_cpus.push_back(cpu);
+        }
+
+        // SMT siblings of a core are numbered in CPU IDs order
+        std::map<std::pair<int, int>, int> siblings;
+        for (auto &i:m_cpus) {
+            i.sibling = siblings[std::make_pair(i.package, i.core)]++;
+        }
+#endif
+    }
+
+    std::vector<int> topology_t::layout(placement_t _placement, const std::string &_cpuList,
+                                        std::size_t _threads, std::size_t _offset) const {
+        std::vector<int> cpus;
+        switch (_placement) {
+            case placement_t::none:
+                return std::vector<int>();
+            case placement_t::list: {
+                cpus = parse(_cpuList);
+                for (auto const &i:cpus) {
+                    if (!m_cpus.empty() && std::none_of(m_cpus.begin(), m_cpus.end(), [i](const cpu_t &_cpu) {
+                        return _cpu.id == i;
+                    })) {
+                        throw std::runtime_error("placement: CPU " + std::to_string(i) + " is not available");
+                    }
+                }
+                break;
+            }
+            case placement_t::cores:
+            case placement_t::numa: {
+                auto ordered = m_cpus;
+                if (_placement == placement_t::cores) {
+                    // the first CPU of each physical core, nodes take turns, SMT siblings only after all cores.
+                    // Rank of a CPU is its position among CPUs of the same node and sibling index
+                    std::sort(ordered.begin(), ordered.end(), [](const cpu_t &_left, const cpu_t &_right) {
+                        return std::make_tuple(_left.sibling, _left.node, _left.package, _left.core, _left.id)
+                               < std::make_tuple(_right.sibling, _right.node, _right.package, _right.core, _right.id);
+                    });
+                    std::map<std::pair<int, int>, int> ranks;
+                    std::vector<std::pair<int, cpu_t>> ranked;
+                    for (auto const &i:ordered) {
+                        ranked.emplace_back(ranks[std::make_pair(i.sibling, i.node)]++, i);
+                    }
+                    std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<int, cpu_t> &_left,
+                                                                      const std::pair<int, cpu_t> &_right) {
+                        return std::make_tuple(_left.second.sibling, _left.first, _left.second.node)
+                               < std::make_tuple(_right.second.sibling, _right.first, _right.second.node);
+                    });
+                    for (std::size_t i = 0; i < ranked.size(); ++i) {
+                        ordered[i] = ranked[i].second;
+                    }
+                } else {
+                    // fill cores of a node first, then their SMT siblings, then the next node
+                    std::sort(ordered.begin(), ordered.end(), [](const cpu_t &_left, const cpu_t &_right) {
+                        return std::make_tuple(_left.node, _left.sibling, _left.package, _left.core, _left.id)
+                               < std::make_tuple(_right.node, _right.sibling, _right.package, _right.core, _right.id);
+                    });
+                }
+                for (auto const &i:ordered) {
+                    cpus.push_back(i.id);
+                }
+                break;
+            }
+        }
+        if (cpus.empty()) {
+            return cpus;
+        }
+
+        std::vector<int> ret(_threads);
+        for (std::size_t i = 0; i < _threads; ++i) {
+            ret[i] = cpus[(_offset + i) % cpus.size()];
+        }
+
+        return ret;
+    }
+
+    std::vector<int> topology_t::parse(const std::string &_list) {
+        std::vector<int> ret;
+        std::size_t pos = 0;
+        while (pos < _list.size()) {
+            auto end = _list.find(',', pos);
+            if (end == std::string::npos) {
+                end = _list.size();
+            }
+            auto item = _list.substr(pos, end - pos);
+            pos = end + 1;
+            if (item.empty() || (item.find_first_not_of("0123456789-\n ") != std::string::npos)) {
+                throw std::runtime_error("placement: wrong CPU list " + _list);
+            }
+            auto dash = item.find('-');
+            auto first = std::stoi(item.substr(0, dash));
+            auto last = (dash == std::string::npos) ? first : std::stoi(item.substr(dash + 1));
+            if (last < first) {
+                throw std::runtime_error("placement: wrong CPU list " + _list);
+            }
+            for (auto i = first; i <= last; ++i) {
+                ret.push_back(i);
+            }
+        }
+
+        return ret;
+    }
+
+    bool topology_t::pin(std::thread &_thread, int _cpu) noexcept {
+#ifdef __linux__
+        if ((_cpu < 0) || (_cpu >= CPU_SETSIZE)) {
+            return false;
+        }
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(_cpu, &cpus);
+        return pthread_setaffinity_np(_thread.native_handle(), sizeof(cpus), &cpus) == 0;
+#else
+        (void) _thread;
+        (void) _cpu;
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef __TOPOLOGY_H__
+#define __TOPOLOGY_H__
+
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "word_vector.hpp"
+
+namespace wordvec {
+    /**
+     * @brief topology class - logical CPUs available to the process and their cores and NUMA nodes
+     *
+     * Topology is read from Linux sysfs: online CPUs, core and package IDs of each CPU and CPU lists of NUMA nodes.
+     * Only CPUs of the process affinity mask are used, so cgroup/taskset restrictions are respected. On other
+     * systems or if sysfs is not available the topology is empty and threads are not pinned.
+    */
+    class topology_t final {
+    public:
+        /// Logical CPU
+        struct cpu_t final {
+            int id = 0; ///< logical CPU ID
+            int core = 0; ///< physical core ID, unique within the package
+            int package = 0; ///< physical package (socket) ID
+            int node = 0; ///< NUMA node ID
+            int sibling = 0; ///< index of the CPU among SMT siblings of its core, 0 - the first one
+        };
+
+    private:
+        std::vector<cpu_t> m_cpus;
+
+    public:
+        /// Reads topology of CPUs available to the process
+        topology_t();
+
+        topology_t(const topology_t &) = delete;
+        void operator=(const topology_t &) = delete;
+
+        /// @returns available CPUs ordered by their IDs
+        inline const std::vector<cpu_t> &cpus() const noexcept {return m_cpus;}
+
+        /**
+         * Places threads on CPUs
+         * @param _placement placement policy
+         * @param _cpuList explicit CPU list, e.g. "0-3,8,10", used by placement_t::list
+         * @param _threads number of threads
+         * @param _offset position of the first thread's CPU in the placement order
+         * @returns CPU ID of each thread, threads wrap around if there are less CPUs than threads. Empty vector
+         * if placement is none or the topology is unknown
+         * @throws std::runtime_error on wrong CPU list or CPUs not available to the process
+        */
+        std::vector<int> layout(placement_t _placement, const std::string &_cpuList, std::size_t _threads,
+                                std::size_t _offset = 0) const;
+
+        /**
+         * Parses a CPU list in the sysfs format
+         * @param _list comma separated CPU IDs and ranges
+         * @returns CPU IDs
+         * @throws std::runtime_error on wrong list format
+        */
+        static std::vector<int> parse(const std::string &_list);
+
+        /**
+         * Pins the thread to the CPU
+         * @returns true if the thread is pinned
+        */
+        static bool pin(std::thread &_thread, int _cpu) noexcept;
+    };
+}
+
+#endif
@@ -6,7 +6,13 @@ namespace wordvec {
     trainer_t::trainer_t(const std::shared_ptr<train_setting_t> &_trainSettings,
                          const std::shared_ptr<vocabulary_t> &_vocabulary,
                          const std::shared_ptr<file_mapper_t> &_fileMapper,
-                         std::function<void(float, float)> _progressCallback): m_threads() {
+                         std::function<void(float, float)> _progressCallback,
+                         const std::shared_ptr<checkpoint_t> &_resumeFrom,
+                         telemetry_t::callback_t _statsCallback,
+                         const std::shared_ptr<documents_t> &_documents,
+                         const std::shared_ptr<corpus_t> &_corpus):
+            m_matrices(), m_processedWords(), m_epochMonitor(), m_threads(), m_encoders(), m_sentenceQueue(),
+            m_resumeFrom(_resumeFrom), m_checkpointer(), m_telemetry(), m_exchange(), m_subwords(), m_progress() {
         trainThread_t::sharedData_t sharedData;
 
         if (!_trainSettings) {
@@ -19,12 +25,43 @@ namespace wordvec {
         }
         sharedData.vocabulary = _vocabulary;
 
-        if (!_fileMapper) {
+        if (!_fileMapper && !_corpus) {
             throw std::runtime_error("file mapper object is not initialized");
         }
         sharedData.fileMapper = _fileMapper;
+        if (_corpus) {
+            // encoded sentences have no file offsets to be checkpointed or shared with peers
+            if ((_trainSettings->readers > 0) || _documents) {
+                throw std::runtime_error("corpus can not be trained in pipelined or paragraph vectors mode");
+            }
+            if (!_trainSettings->checkpoint_file.empty() || !_trainSettings->peers.empty()) {
+                throw std::runtime_error("corpus: checkpoints and distributed training are not supported");
+            }
+            sharedData.corpus = _corpus;
+        }
 
-        sharedData.bpWeights.reset(new std::vector<float>(_trainSettings->size * _vocabulary->size(), 0.0f));
+        m_matrices.reset(new trainMatrices_t(_trainSettings->matrix_file,
+                                             _trainSettings->size * _vocabulary->size()));
+        if (m_resumeFrom) {
+            if (m_resumeFrom->trainMatrix.empty()) {
+                // matrices were not loaded to memory, copy them from the checkpoint file directly
+                m_matrices->assign(_trainSettings->checkpoint_file);
+            } else {
+                m_matrices->assign(m_resumeFrom->trainMatrix, m_resumeFrom->bpWeights);
+            }
+        }
+        if (m_matrices->fileBacked()) {
+            // rows of the most frequent words covering 90% of train words occurrences are kept resident
+            std::vector<std::size_t> frequencies;
+            _vocabulary->frequencies(frequencies);
+            auto hotWords = _vocabulary->frequenciesSum() / 10 * 9;
+            std::size_t hotRows = 0;
+            for (std::size_t sum = 0; (hotRows < frequencies.size()) && (sum < hotWords); ++hotRows) {
+                sum += frequencies[hotRows];
+            }
+            m_matrices->advise(hotRows, _trainSettings->size);
+        }
+        sharedData.matrices = m_matrices;
         sharedData.expTable.reset(new std::vector<float>(_trainSettings->table_sz));
         for (uint16_t i = 0; i < _trainSettings->table_sz; ++i) {
             // Precompute the exp() table
@@ -42,35 +79,146 @@ namespace wordvec {
         }
 
         if (_progressCallback != nullptr) {
-            sharedData.progressCallback = _progressCallback;
+            // train threads publish progress to the mailbox and never wait for the callback
+            m_progress.reset(new progressReporter_t(_progressCallback, _trainSettings->progress_interval));
+            auto progress = m_progress.get();
+            sharedData.progressCallback = [progress](float _alpha, float _percent) {
+                progress->publish(_alpha, _percent);
+            };
+        }
+
+        m_processedWords.reset(new std::atomic<std::size_t>(m_resumeFrom ? m_resumeFrom->processedWords : 0));
+        sharedData.processedWords = m_processedWords;
+        sharedData.alpha.reset(new std::atomic<float>(m_resumeFrom ? m_resumeFrom->alpha : _trainSettings->alpha));
+        // optimizer state is not a part of checkpoints, resumed training restarts adaptive learning rates
+        sharedData.inputOptimizer.reset(new rowOptimizer_t(_trainSettings->optimizer, _vocabulary->size(),
+                                                           _trainSettings->size, sharedData.alpha));
+        sharedData.outputOptimizer.reset(new rowOptimizer_t(_trainSettings->optimizer, _vocabulary->size(),
+                                                            _trainSettings->size, sharedData.alpha));
+        if (_documents) {
+            if (_trainSettings->readers > 0) {
+                throw std::runtime_error("paragraph vectors can not be trained in pipelined mode");
+            }
+            sharedData.documents = _documents;
+            sharedData.documentsOptimizer.reset(new rowOptimizer_t(_trainSettings->optimizer, _documents->size(),
+                                                                   _trainSettings->size, sharedData.alpha));
+        }
+        if (_trainSettings->ngram_buckets > 0) {
+            std::vector<std::string> words;
+            _vocabulary->words(words);
+            m_subwords.reset(new subwords_t(words, _trainSettings->min_ngram, _trainSettings->max_ngram,
+                                            _trainSettings->ngram_buckets, _trainSettings->size));
+            sharedData.subwords = m_subwords;
+            sharedData.subwordsOptimizer.reset(new rowOptimizer_t(_trainSettings->optimizer,
+                                                                  _trainSettings->ngram_buckets,
+                                                                  _trainSettings->size, sharedData.alpha));
+        }
+        m_epochMonitor.reset(new epochMonitor_t(_vocabulary->trainWords(), *m_processedWords));
+        sharedData.epochMonitor = m_epochMonitor;
+
+        if (!_trainSettings->checkpoint_file.empty()) {
+            m_checkpointer.reset(new checkpointer_t(_trainSettings, _vocabulary, m_matrices,
+                                                    sharedData.alpha, m_resumeFrom));
+        }
+        if (!_trainSettings->peers.empty()) {
+            // distributed training, connect to peers and get the common initial input matrix
+            m_exchange.reset(new exchange_t(_trainSettings, m_matrices, _vocabulary->size(), m_processedWords,
+                                            _trainSettings->iterations * _vocabulary->trainWords()));
+            sharedData.exchange = m_exchange;
         }
 
-        sharedData.processedWords.reset(new std::atomic<std::size_t>(0));
-        sharedData.alpha.reset(new std::atomic<float>(_trainSettings->alpha));
+        if ((_statsCallback != nullptr) || !_trainSettings->stats_file.empty()) {
+            m_telemetry.reset(new telemetry_t(_trainSettings->threads, _trainSettings->stats_interval,
+                                              _trainSettings->stats_file, _statsCallback));
+            sharedData.telemetry = m_telemetry;
+        }
+        sharedData.resumeFrom = m_resumeFrom;
+        sharedData.checkpointer = m_checkpointer;
 
-        m_matrixSize = sharedData.trainSettings->size * sharedData.vocabulary->size();
+        if (_trainSettings->readers > 0) {
+            m_sentenceQueue.reset(new sentenceQueue_t(_trainSettings->queue_sz, _trainSettings->readers));
+            sharedData.sentenceQueue = m_sentenceQueue;
+            for (uint8_t i = 0; i < _trainSettings->readers; ++i) {
+                m_encoders.emplace_back(new encoderThread_t(i, _trainSettings->readers, _trainSettings,
+                                                            _vocabulary, _fileMapper, m_sentenceQueue,
+                                                            m_resumeFrom, m_checkpointer));
+            }
+        }
 
-        for (uint8_t i = 0; i < _trainSettings->threads; ++i) {
+        if (_trainSettings->placement != placement_t::none) {
+            topology_t topology;
+            sharedData.cpus = std::make_shared<std::vector<int>>(topology.layout(_trainSettings->placement,
+                                                                                 _trainSettings->cpu_list,
+                                                                                 _trainSettings->threads,
+                                                                                 _trainSettings->cpu_offset));
+            if (m_telemetry) {
+                m_telemetry->layout(*sharedData.cpus);
+            }
+        }
+
+        for (uint16_t i = 0; i < _trainSettings->threads; ++i) {
             m_threads.emplace_back(new trainThread_t(i, sharedData));
         }
     }
 
-    void trainer_t::operator()(std::vector<float> &_trainMatrix) noexcept {
-        // input matrix initialized with small random values
-        std::random_device randomDevice;
-        std::mt19937_64 randomGenerator(randomDevice());
-        std::uniform_real_distribution<float> rndMatrixInitializer(-0.005f, 0.005f);
-        _trainMatrix.resize(m_matrixSize);
-        std::generate(_trainMatrix.begin(), _trainMatrix.end(), [&]() {
-            return rndMatrixInitializer(randomGenerator);
-        });
+    void trainer_t::operator()() {
+        launch();
+        join();
+    }
 
+    void trainer_t::launch() {
+        if (m_progress) {
+            m_progress->launch();
+        }
+        if (m_checkpointer) {
+            m_checkpointer->launch();
+        }
+        if (m_telemetry) {
+            m_telemetry->launch();
+        }
+        if (m_exchange) {
+            m_exchange->launch();
+        }
+
+        for (auto &i:m_encoders) {
+            i->launch();
+        }
         for (auto &i:m_threads) {
-            i->launch(_trainMatrix);
+            i->launch();
         }
+    }
 
+    void trainer_t::join() {
         for (auto &i:m_threads) {
             i->join();
         }
+        for (auto &i:m_encoders) {
+            i->join();
+        }
+        if (m_progress) {
+            m_progress->stop();
+        }
+        if (m_exchange) {
+            m_exchange->stop();
+        }
+        m_epochMonitor->finish(*m_processedWords);
+        if (m_telemetry) {
+            m_telemetry->stop();
+        }
+
+        if (m_checkpointer) {
+            m_checkpointer->stop();
+        }
+    }
+
+    std::vector<epoch_stats_t> trainer_t::epochStats() const {
+        return m_epochMonitor->stats();
+    }
+
+    void trainer_t::pipelineStats(pipeline_stats_t &_stats) const noexcept {
+        _stats = pipeline_stats_t();
+        if (m_sentenceQueue) {
+            m_sentenceQueue->stats(_stats);
+        }
     }
 }
@@ -9,6 +9,12 @@
 #include "reader.hpp"
 #include "vocabulary.hpp"
 #include "worker.hpp"
+#include "encoder.hpp"
+#include "checkpoint.hpp"
+#include "matrix.hpp"
+#include "telemetry.hpp"
+#include "exchange.hpp"
+#include "progress.hpp"
 
 namespace wordvec {
     /**
@@ -19,8 +25,18 @@ namespace wordvec {
     */
     class trainer_t {
     private:
-        std::size_t m_matrixSize = 0;
+        std::shared_ptr<trainMatrices_t> m_matrices;
+        std::shared_ptr<std::atomic<std::size_t>> m_processedWords;
+        std::shared_ptr<epochMonitor_t> m_epochMonitor;
         std::vector<std::unique_ptr<trainThread_t>> m_threads;
+        std::vector<std::unique_ptr<encoderThread_t>> m_encoders;
+        std::shared_ptr<sentenceQueue_t> m_sentenceQueue;
+        std::shared_ptr<checkpoint_t> m_resumeFrom;
+        std::shared_ptr<checkpointer_t> m_checkpointer;
+        std::shared_ptr<telemetry_t> m_telemetry;
+        std::shared_ptr<exchange_t> m_exchange;
+        std::shared_ptr<subwords_t> m_subwords;
+        std::unique_ptr<progressReporter_t> m_progress;
 
     public:
         /**
@@ -28,18 +44,56 @@ namespace wordvec {
          * @param _trainSettings trainSattings object
          * @param _vocabulary vocabulary object
          * @param _fileMapper fileMapper object related to a train data set file
-         * @param _progressCallback callback function to be called on each new 0.01% processed train data
+         * @param _progressCallback callback function to be called on each new 0.01% processed train data, it is
+         * called from a reporter thread each progress_interval milliseconds
+         * @param _resumeFrom checkpoint to resume training from, nullptr to start a new training. Checkpoint
+         * without threads states just provides initial matrices and learning rate.
+         * @param _statsCallback callback function to be called with train threads telemetry each stats_interval
+         * seconds from a dedicated reporter thread, may be nullptr
+         * @param _documents documents of the train data set file to train paragraph vectors of, nullptr to train
+         * word vectors
+         * @param _corpus train data set encoded in memory, shared by several trainers, nullptr to read sentences
+         * from the train data set file. _fileMapper may be nullptr if the corpus is specified
         */
         trainer_t(const std::shared_ptr<train_setting_t> &_trainSettings,
                   const std::shared_ptr<vocabulary_t> &_vocabulary,
                   const std::shared_ptr<file_mapper_t> &_fileMapper,
-                  std::function<void(float, float)> _progressCallback);
+                  std::function<void(float, float)> _progressCallback,
+                  const std::shared_ptr<checkpoint_t> &_resumeFrom = nullptr,
+                  telemetry_t::callback_t _statsCallback = nullptr,
+                  const std::shared_ptr<documents_t> &_documents = nullptr,
+                  const std::shared_ptr<corpus_t> &_corpus = nullptr);
 
         /**
          * Runs training process
-         * @param[out] _trainMatrix train model matrix
+         * @throws std::runtime_error if the final checkpoint can not be written or parameters exchange failed
         */
-        void operator()(std::vector<float> &_trainMatrix) noexcept;
+        void operator()();
+
+        /// Starts training process without waiting for it, so several trainers may run at once
+        void launch();
+        /**
+         * Waits for the training process started by launch()
+         * @throws std::runtime_error if the final checkpoint can not be written or parameters exchange failed
+        */
+        void join();
+
+        /// @returns trained input matrix, valid while the trainer object exists
+        inline const float *trainMatrix() const noexcept {return m_matrices->trainMatrix();}
+        /// @returns words n-grams and their trained bucket vectors, nullptr if subwords are disabled
+        inline const std::shared_ptr<subwords_t> &subwords() const noexcept {return m_subwords;}
+
+        /**
+         * Requests per epoch statistics
+         * @returns page faults and duration of each completed epoch
+        */
+        std::vector<epoch_stats_t> epochStats() const;
+
+        /**
+         * Requests pipelined mode statistics
+         * @param[out] _stats sentence queue depth and stall metrics, all zeros if pipelined mode is off
+        */
+        void pipelineStats(pipeline_stats_t &_stats) const noexcept;
     };
 }
 
@@ -1,3 +1,6 @@
+#include <stdexcept>
+#include <fstream>
+
 #include "vocabulary.hpp"
 #include "reader.hpp"
 
@@ -89,6 +92,7 @@ namespace wordvec {
             i.word = "</s>";
             i.frequency = wordsFreq[0].second;
         }
+        m_frequencies = m_trainWords;
         // fill index values
         for (std::size_t i = 0; i < wordsFreq.size(); ++i) {
             auto &w = tmpWords[wordsFreq[i].first];
@@ -99,4 +103,97 @@ namespace wordvec {
             _statsCallback(m_words.size(), m_trainWords, m_totalWords);
         }
     }
+
+    vocabulary_t::vocabulary_t(const std::vector<std::string> &_words,
+                               const std::vector<std::size_t> &_frequencies,
+                               std::size_t _trainWords,
+                               std::size_t _totalWords):
+            m_trainWords(_trainWords), m_totalWords(_totalWords), m_words() {
+        if (_words.size() != _frequencies.size()) {
+            throw std::runtime_error("vocabulary: words and frequencies sizes mismatch");
+        }
+        m_words.reserve(_words.size());
+        for (std::size_t i = 0; i < _words.size(); ++i) {
+            m_words[_words[i]] = wordData_t(i, _frequencies[i]);
+            if (i > 0) { // skip sentence delimiter
+                m_frequencies += _frequencies[i];
+            }
+        }
+    }
+
+    vocabulary_t::vocabulary_t(const std::string &_vocabularyFile): m_words() {
+        std::ifstream input(_vocabularyFile);
+        if (!input.is_open()) {
+            throw std::runtime_error("vocabulary: can not open file " + _vocabularyFile);
+        }
+
+        // one "word<TAB>frequency" record per line, words may contain spaces
+        std::string line;
+        while (std::getline(input, line)) {
+            auto tab = line.rfind('\t');
+            if ((tab == std::string::npos) || (tab + 1 == line.size())
+                || (line.find_first_not_of("0123456789", tab + 1) != std::string::npos)) {
+                throw std::runtime_error("vocabulary: wrong vocabulary file format");
+            }
+            std::size_t frequency = 0;
+            try {
+                frequency = static_cast<std::size_t>(std::stoull(line.substr(tab + 1)));
+            } catch (...) {
+                throw std::runtime_error("vocabulary: wrong vocabulary file format");
+            }
+            auto index = m_words.size();
+            if (!m_words.emplace(line.substr(0, tab), wordData_t(index, frequency)).second) {
+                throw std::runtime_error("vocabulary: wrong vocabulary file format");
+            }
+            if (index > 0) { // skip sentence delimiter
+                m_frequencies += frequency;
+            }
+        }
+        if (input.bad() || m_words.empty()) {
+            throw std::runtime_error("vocabulary: wrong vocabulary file format");
+        }
+        m_trainWords = m_frequencies;
+        m_totalWords = m_frequencies;
+    }
+
+    void vocabulary_t::save(const std::string &_vocabularyFile) const {
+        std::vector<std::string> sortedWords;
+        words(sortedWords);
+
+        std::ofstream output(_vocabularyFile, std::ios::out | std::ios::trunc);
+        for (auto const &i:sortedWords) {
+            output << i << "\t" << m_words.find(i)->second.frequency << "\n";
+        }
+        output.flush();
+        if (!output.good()) {
+            throw std::runtime_error("vocabulary: can not write file " + _vocabularyFile);
+        }
+    }
+
+    void vocabulary_t::count(const std::shared_ptr<file_mapper_t> &_trainWordsMapper,
+                             const std::string &_delims,
+                             const std::string &_eos,
+                             w2vModel_t::vocabularyProgressCallback_t _progressCallback) noexcept {
+        m_trainWords = 0;
+        m_totalWords = 0;
+        off_t progressOffset = 0;
+        word_reader_t<file_mapper_t> wordReader(*_trainWordsMapper, _delims, _eos);
+        std::string word;
+        while (wordReader.next_word(word)) {
+            if (word.empty()) {
+                continue; // sentence delimiter
+            }
+            m_totalWords++;
+            if (data(word) != nullptr) {
+                m_trainWords++;
+            }
+
+            if (_progressCallback != nullptr) {
+                if (wordReader.offset() - progressOffset >= _trainWordsMapper->size() / 10000 - 1) {
+                    _progressCallback(static_cast<float>(wordReader.offset()) / _trainWordsMapper->size() * 100.0f);
+                    progressOffset = wordReader.offset();
+                }
+            }
+        }
+    }
 }
@@ -40,6 +40,7 @@ namespace wordvec {
 
         std::size_t m_trainWords = 0;
         std::size_t m_totalWords = 0;
+        std::size_t m_frequencies = 0;
 
         wordMap_t m_words;
 
@@ -62,6 +63,43 @@ namespace wordvec {
                      w2vModel_t::vocabularyProgressCallback_t _progressCallback,
                      w2vModel_t::vocabularyStatsCallback_t _statsCallback) noexcept;
 
+        /**
+         * Constructs a vocabulary object from already known words, e.g. stored in a checkpoint
+         * @param _words words ordered by their indexes, the first one is the sentence delimiter
+         * @param _frequencies word frequencies ordered by word indexes, may be accumulated over several data sets
+         * @param _trainWords train words amount of a train data set
+         * @param _totalWords total words amount of a train data set
+        */
+        vocabulary_t(const std::vector<std::string> &_words,
+                     const std::vector<std::size_t> &_frequencies,
+                     std::size_t _trainWords,
+                     std::size_t _totalWords);
+
+        /**
+         * Constructs a vocabulary object from a vocabulary file saved by save()
+         * @param _vocabularyFile file name
+         * @throws std::runtime_error on file access failure or wrong file format
+        */
+        explicit vocabulary_t(const std::string &_vocabularyFile);
+
+        /**
+         * Saves vocabulary as a text file, one "word<TAB>frequency" record per line ordered by word indexes
+         * @param _vocabularyFile file name
+         * @throws std::runtime_error on file access failure
+        */
+        void save(const std::string &_vocabularyFile) const;
+
+        /**
+         * Counts train and total words amounts of a train data set, e.g. of a shard of the data set the vocabulary
+         * was built from. Word frequencies are not changed.
+         * @param _trainWordsMapper fileMapper object related to a train data set file
+         * @param _progressCallback callback function to be called on each new 0.01% processed train data
+        */
+        void count(const std::shared_ptr<file_mapper_t> &_trainWordsMapper,
+                   const std::string &_delims,
+                   const std::string &_eos,
+                   w2vModel_t::vocabularyProgressCallback_t _progressCallback) noexcept;
+
         /**
          * Requests a data (index, frequency, word) associated with the _word
          * @param[in] _word key value
@@ -91,6 +129,11 @@ namespace wordvec {
             return m_trainWords;
         }
 
+        /// @returns sum of vocabulary word frequencies, equals to trainWords unless frequencies are merged
+        inline std::size_t frequenciesSum() const noexcept  {
+            return m_frequencies;
+        }
+
         /**
          * Requests word frequencies
          * @param[out] _output - vector of word frequencies where vector indexes are word indexes and vector values
@@ -1,56 +1,360 @@
+#include <unistd.h>
+#include <cstdio>
+#include <cstddef>
 #include <stdexcept>
+#include <fstream>
+#include <mutex>
 
 #include "word_vector.hpp"
 #include "reader.hpp"
 #include "vocabulary.hpp"
 #include "trainer.hpp"
+#include "checkpoint.hpp"
+#include "subwords.hpp"
+#include "documents.hpp"
+#include "glove.hpp"
+#include "corpus.hpp"
+#include "progress.hpp"
+#include "modelFile.hpp"
+#include "modelWriter.hpp"
 
 namespace wordvec {
+    namespace {
+        const char subwordsMagic[8] = {'w', 'v', 's', 'u', 'b', 'w', '0', '1'};
+        const char nativeMagic[8] = {'w', 'v', 'n', 'a', 't', 'i', 'v', 'e'};
+        const uint32_t nativeVersion = 3;
+
+        // indexed native model file header. Sections follow at 64-byte aligned offsets: normalized vectors matrix,
+        // n-grams vectors, words offsets (words + 1 values), words chars, hash index of words rows and optional
+        // quantized rows
+        struct nativeHeader_t {
+            char magic[8];
+            uint32_t version;
+            uint16_t vectorSize;
+            uint8_t minNgram;
+            uint8_t maxNgram;
+            uint64_t words;
+            uint64_t ngramBuckets;
+            uint64_t indexSlots;
+            uint64_t charsSize;
+            uint64_t matrixOffset;
+            uint64_t ngramsOffset;
+            uint64_t offsetsOffset;
+            uint64_t charsOffset;
+            uint64_t indexOffset;
+            uint64_t fileSize;
+            // version 2: optional quantized copy of rows, fp32 rows are stored anyway
+            uint64_t storage;
+            uint64_t quantizedOffset;
+            uint64_t scalesOffset;
+            // version 3: product quantization codebooks and optional rotation, pq model has no fp32 rows
+            uint64_t subspaces;
+            uint64_t codebooksOffset;
+            uint64_t rotationOffset;
+        };
+
+        // header of earlier versions is shorter, fields of later versions are zeroed
+        std::size_t nativeHeaderSize(uint32_t _version) noexcept {
+            switch (_version) {
+                case 1:
+                    return offsetof(nativeHeader_t, storage);
+                case 2:
+                    return offsetof(nativeHeader_t, subspaces);
+                default:
+                    return sizeof(nativeHeader_t);
+            }
+        }
+
+        inline uint64_t alignNative(uint64_t _offset) noexcept {
+            return (_offset + 63) & ~static_cast<uint64_t>(63);
+        }
+
+        // vocabulary progress is reported from a reporter thread, so parsing never waits for the callback
+        class vocabularyProgress_t final {
+        private:
+            std::unique_ptr<progressReporter_t> m_reporter;
+
+        public:
+            w2vModel_t::vocabularyProgressCallback_t progressCallback = nullptr;
+            w2vModel_t::vocabularyStatsCallback_t statsCallback = nullptr;
+
+            vocabularyProgress_t(const w2vModel_t::vocabularyProgressCallback_t &_progressCallback,
+                                 const w2vModel_t::vocabularyStatsCallback_t &_statsCallback, uint32_t _interval):
+                    m_reporter() {
+                if (_progressCallback != nullptr) {
+                    m_reporter.reset(new progressReporter_t([_progressCallback](float, float _percent) {
+                        _progressCallback(_percent);
+                    }, _interval));
+                    m_reporter->launch();
+                    auto reporter = m_reporter.get();
+                    progressCallback = [reporter](float _percent) {
+                        reporter->publish(0.0f, _percent);
+                    };
+                }
+                if (_statsCallback != nullptr) {
+                    // the last progress is delivered before the stats
+                    auto reporter = m_reporter.get();
+                    statsCallback = [reporter, _statsCallback](std::size_t _vocWords, std::size_t _trainWords,
+                                                               std::size_t _totalWords) {
+                        if (reporter != nullptr) {
+                            reporter->stop();
+                        }
+                        _statsCallback(_vocWords, _trainWords, _totalWords);
+                    };
+                }
+            }
+        };
+
+        // normalizes the vector in place, returns false for zero vector
+        bool normalize(float *_vector, uint16_t _size) noexcept {
+            float med = 0.0f;
+            for (uint16_t i = 0; i < _size; ++i) {
+                med += _vector[i] * _vector[i];
+            }
+            if (med <= 0.0f) {
+                return false;
+            }
+            med = std::sqrt(med / _size);
+            for (uint16_t i = 0; i < _size; ++i) {
+                _vector[i] /= med;
+            }
+
+            return true;
+        }
+
+        // copies a trained row to the model row normalized like vectors of loaded models
+        void normalize(const float *_row, uint16_t _size, float *_vector) {
+            std::copy(_row, _row + _size, _vector);
+            normalize(_vector, _size);
+        }
+    }
+
     bool w2vModel_t::train(const train_setting_t &_trainSettings,
                            const std::string &_trainFile,
                            const std::string &_stopWordsFile,
                            vocabularyProgressCallback_t _vocabularyProgressCallback,
                            vocabularyStatsCallback_t _vocabularyStatsCallback,
-                           trainProgressCallback_t _trainProgressCallback) noexcept {
+                           trainProgressCallback_t _trainProgressCallback,
+                           pipelineStatsCallback_t _pipelineStatsCallback,
+                           epochStatsCallback_t _epochStatsCallback,
+                           trainStatsCallback_t _trainStatsCallback) noexcept {
         try {
+            auto trainSettings = std::make_shared<train_setting_t>(_trainSettings);
+            vocabularyProgress_t vocabularyProgress(_vocabularyProgressCallback, _vocabularyStatsCallback,
+                                                    trainSettings->progress_interval);
+            if (!trainSettings->peers.empty()) {
+                // all processes must have the same vocabulary and initial state
+                if (trainSettings->vocabulary_file.empty()) {
+                    throw std::runtime_error("vocabulary file is required for distributed training");
+                }
+                if (trainSettings->resume || !trainSettings->base_checkpoint.empty()) {
+                    throw std::runtime_error("checkpoints can not be resumed in distributed training");
+                }
+            }
+            if (trainSettings->ngram_buckets > 0) {
+                // bucket vectors are not a part of checkpoints and exchanged rows
+                if (!trainSettings->checkpoint_file.empty() || !trainSettings->base_checkpoint.empty()) {
+                    throw std::runtime_error("subwords: checkpoints are not supported");
+                }
+                if (!trainSettings->peers.empty()) {
+                    throw std::runtime_error("subwords: distributed training is not supported");
+                }
+            }
+            if (trainSettings->with_glove) {
+                // GloVe does not train on sentences, so it has no threads states and exchanged rows
+                if (trainSettings->resume || !trainSettings->base_checkpoint.empty()
+                    || !trainSettings->checkpoint_file.empty()) {
+                    throw std::runtime_error("glove: checkpoints are not supported");
+                }
+                if (!trainSettings->peers.empty()) {
+                    throw std::runtime_error("glove: distributed training is not supported");
+                }
+                if (trainSettings->ngram_buckets > 0) {
+                    throw std::runtime_error("glove: subwords are not supported");
+                }
+            }
+            // load the last checkpoint if training is resumed
+            std::shared_ptr<checkpoint_t> checkpoint;
+            if (trainSettings->resume) {
+                if (trainSettings->checkpoint_file.empty()) {
+                    throw std::runtime_error("checkpoint file name is not specified");
+                }
+                if (std::ifstream(trainSettings->checkpoint_file).good()) {
+                    checkpoint.reset(new checkpoint_t());
+                    // file backed matrices are copied from the checkpoint file directly
+                    checkpoint->load(trainSettings->checkpoint_file, trainSettings->matrix_file.empty());
+                    // continue with the same model and learning rate schedule
+                    trainSettings->min_freq = checkpoint->trainSettings.min_freq;
+                    trainSettings->size = checkpoint->trainSettings.size;
+                    trainSettings->window = checkpoint->trainSettings.window;
+                    trainSettings->sample = checkpoint->trainSettings.sample;
+                    trainSettings->with_hs = checkpoint->trainSettings.with_hs;
+                    trainSettings->negative = checkpoint->trainSettings.negative;
+                    trainSettings->threads = checkpoint->trainSettings.threads;
+                    trainSettings->readers = checkpoint->trainSettings.readers;
+                    trainSettings->iterations = checkpoint->trainSettings.iterations;
+                    trainSettings->alpha = checkpoint->trainSettings.alpha;
+                    trainSettings->with_sg = checkpoint->trainSettings.with_sg;
+                    trainSettings->delims = checkpoint->trainSettings.delims;
+                    trainSettings->eos = checkpoint->trainSettings.eos;
+                }
+            }
+
             // map train data set file to memory
             std::shared_ptr<file_mapper_t> trainWordsMapper(new file_mapper_t(_trainFile));
-            // map stop-words file to memory
-            std::shared_ptr<file_mapper_t> stopWordsMapper;
-            if (!_stopWordsFile.empty()) {
-                stopWordsMapper.reset(new file_mapper_t(_stopWordsFile));
-            }
 
-            // build vocabulary, skip stop-words and words with frequency < min_freq
-            std::shared_ptr<vocabulary_t> vocabulary(new vocabulary_t(trainWordsMapper,
-                                                                      stopWordsMapper,
-                                                                      _trainSettings.delims,
-                                                                      _trainSettings.eos,
-                                                                      _trainSettings.min_freq,
-                                                                      _vocabularyProgressCallback,
-                                                                      _vocabularyStatsCallback));
+            std::shared_ptr<vocabulary_t> vocabulary;
+            if (checkpoint) {
+                // restore vocabulary, train data must be the same as it was
+                vocabulary.reset(new vocabulary_t(checkpoint->words,
+                                                  checkpoint->frequencies,
+                                                  checkpoint->trainWords,
+                                                  checkpoint->totalWords));
+                if (vocabularyProgress.statsCallback != nullptr) {
+                    vocabularyProgress.statsCallback(vocabulary->size(), vocabulary->trainWords(),
+                                                     vocabulary->totalWords());
+                }
+            } else if (!trainSettings->base_checkpoint.empty()) {
+                // continue training of a model from its final checkpoint on a new train data set
+                checkpoint.reset(new checkpoint_t());
+                checkpoint->load(trainSettings->base_checkpoint);
+                trainSettings->size = checkpoint->trainSettings.size;
+                trainSettings->with_hs = checkpoint->trainSettings.with_hs;
+
+                std::shared_ptr<file_mapper_t> stopWordsMapper;
+                if (!_stopWordsFile.empty()) {
+                    stopWordsMapper.reset(new file_mapper_t(_stopWordsFile));
+                }
+                // count all words of the new data set, min_freq is applied to new words only
+                vocabulary_t newVocabulary(trainWordsMapper,
+                                           stopWordsMapper,
+                                           trainSettings->delims,
+                                           trainSettings->eos,
+                                           1,
+                                           vocabularyProgress.progressCallback,
+                                           nullptr);
+                checkpoint->merge(newVocabulary, trainSettings->min_freq);
+                checkpoint->trainSettings = *trainSettings;
+                checkpoint->alpha = trainSettings->alpha;
+
+                vocabulary.reset(new vocabulary_t(checkpoint->words,
+                                                  checkpoint->frequencies,
+                                                  checkpoint->trainWords,
+                                                  checkpoint->totalWords));
+                if (vocabularyProgress.statsCallback != nullptr) {
+                    vocabularyProgress.statsCallback(vocabulary->size(), vocabulary->trainWords(),
+                                                     vocabulary->totalWords());
+                }
+            } else if (!trainSettings->vocabulary_file.empty()
+                       && std::ifstream(trainSettings->vocabulary_file).good()) {
+                // common vocabulary, train and total words amounts are counted on the local train data set
+                vocabulary.reset(new vocabulary_t(trainSettings->vocabulary_file));
+                vocabulary->count(trainWordsMapper, trainSettings->delims, trainSettings->eos,
+                                  vocabularyProgress.progressCallback);
+                if (vocabularyProgress.statsCallback != nullptr) {
+                    vocabularyProgress.statsCallback(vocabulary->size(), vocabulary->trainWords(),
+                                                     vocabulary->totalWords());
+                }
+            } else {
+                // map stop-words file to memory
+                std::shared_ptr<file_mapper_t> stopWordsMapper;
+                if (!_stopWordsFile.empty()) {
+                    stopWordsMapper.reset(new file_mapper_t(_stopWordsFile));
+                }
+
+                // build vocabulary, skip stop-words and words with frequency < min_freq
+                vocabulary.reset(new vocabulary_t(trainWordsMapper,
+                                                  stopWordsMapper,
+                                                  trainSettings->delims,
+                                                  trainSettings->eos,
+                                                  trainSettings->min_freq,
+                                                  vocabularyProgress.progressCallback,
+                                                  vocabularyProgress.statsCallback));
+                if (!trainSettings->vocabulary_file.empty()) {
+                    vocabulary->save(trainSettings->vocabulary_file);
+                }
+            }
             // key words descending ordered by their indexes
             std::vector<std::string> words;
             vocabulary->words(words);
-            m_vec_sz = _trainSettings.size;
-            m_map_sz = vocabulary->size();
+            m_vec_sz = trainSettings->size;
+
+            if (trainSettings->with_glove) {
+                // co-occurrence file is built once, existing file is reused by the next trainings with the same
+                // vocabulary and window. The temporary file name is unique per process
+                auto header = cooccurrences_t::header(*trainSettings, words);
+                auto cooccurrenceFile = trainSettings->cooccurrence_file.empty()
+                                        ? _trainFile + ".cooc." + std::to_string(::getpid())
+                                        : trainSettings->cooccurrence_file;
+                auto build = true;
+                if (!trainSettings->cooccurrence_file.empty() && std::ifstream(cooccurrenceFile).good()) {
+                    cooccurrenceHeader_t existing{};
+                    if (!cooccurrences_t::header(cooccurrenceFile, existing)) {
+                        throw std::runtime_error("word2vec: " + cooccurrenceFile + " is not a co-occurrence file");
+                    }
+                    // file of another vocabulary or window is rebuilt
+                    build = (existing != header);
+                }
+                if (build) {
+                    cooccurrences_t(trainSettings, vocabulary, trainWordsMapper).build(cooccurrenceFile);
+                }
+                trainWordsMapper.reset();
+
+                std::unique_ptr<gloveTrainer_t> glove;
+                try {
+                    glove.reset(new gloveTrainer_t(trainSettings, header, cooccurrenceFile,
+                                                   _trainProgressCallback));
+                    (*glove)();
+                } catch (...) {
+                    if (trainSettings->cooccurrence_file.empty()) {
+                        std::remove(cooccurrenceFile.c_str());
+                    }
+                    throw;
+                }
+                if (trainSettings->cooccurrence_file.empty()) {
+                    std::remove(cooccurrenceFile.c_str());
+                }
+
+                // word vector is the sum of word and context vectors
+                auto wordMatrix = glove->wordMatrix();
+                auto contextMatrix = glove->contextMatrix();
+                clear();
+                reserve(words.size());
+                std::size_t wordIndex = 0;
+                for (auto const &i:words) {
+                    auto v = row(i);
+                    for (uint16_t k = 0; k < m_vec_sz; ++k) {
+                        v[k] = wordMatrix[wordIndex * m_vec_sz + k] + contextMatrix[wordIndex * m_vec_sz + k];
+                    }
+                    wordIndex++;
+                }
+                m_ngram_buckets = 0;
+                m_ngram_vectors.clear();
+
+                return true;
+            }
 
             // train model
-            std::vector<float> _trainMatrix;
-            trainer_t(std::make_shared<train_setting_t>(_trainSettings),
-                      vocabulary,
-                      trainWordsMapper,
-                      _trainProgressCallback)(_trainMatrix);
-
-            std::size_t wordIndex = 0;
-            for (auto const &i:words) {
-                auto &v = m_map[i];
-                v.resize(m_vec_sz);
-                std::copy(&_trainMatrix[wordIndex * m_vec_sz],
-                          &_trainMatrix[(wordIndex + 1) * m_vec_sz],
-                          &v[0]);
-                wordIndex++;
+            trainer_t trainer(trainSettings,
+                              vocabulary,
+                              trainWordsMapper,
+                              _trainProgressCallback,
+                              checkpoint,
+                              _trainStatsCallback);
+            checkpoint.reset();
+            trainer();
+            if ((trainSettings->readers > 0) && (_pipelineStatsCallback != nullptr)) {
+                pipeline_stats_t pipelineStats;
+                trainer.pipelineStats(pipelineStats);
+                _pipelineStatsCallback(pipelineStats);
             }
+            if (_epochStatsCallback != nullptr) {
+                for (auto const &i:trainer.epochStats()) {
+                    _epochStatsCallback(i);
+                }
+            }
+
+            assign(words, trainer);
 
             return true;
         } catch (const std::exception &_e) {
@@ -62,133 +366,578 @@ namespace wordvec {
         return false;
     }
 
+    void w2vModel_t::assign(const std::vector<std::string> &_words, const trainer_t &_trainer) {
+        auto trainMatrix = _trainer.trainMatrix();
+        auto subwords = _trainer.subwords();
+        clear();
+        reserve(_words.size());
+        std::size_t wordIndex = 0;
+        for (auto const &i:_words) {
+            auto v = row(i);
+            std::copy(trainMatrix + wordIndex * m_vec_sz,
+                      trainMatrix + (wordIndex + 1) * m_vec_sz,
+                      v);
+            if (subwords) {
+                // word vector is the average of the word row and its n-grams vectors
+                auto ngramsBegin = subwords->ngramsBegin(wordIndex);
+                auto ngramsEnd = subwords->ngramsEnd(wordIndex);
+                for (auto j = ngramsBegin; j != ngramsEnd; ++j) {
+                    auto ngramRow = subwords->vectors() + static_cast<std::size_t>(*j) * m_vec_sz;
+                    for (uint16_t k = 0; k < m_vec_sz; ++k) {
+                        v[k] += ngramRow[k];
+                    }
+                }
+                for (uint16_t k = 0; k < m_vec_sz; ++k) {
+                    v[k] /= static_cast<float>(ngramsEnd - ngramsBegin + 1);
+                }
+            }
+            wordIndex++;
+        }
+        if (subwords) {
+            m_ngram_buckets = subwords->buckets();
+            m_min_ngram = subwords->minNgram();
+            m_max_ngram = subwords->maxNgram();
+            m_ngram_vectors.owned().assign(subwords->vectors(), subwords->vectors()
+                                                                + static_cast<std::size_t>(m_ngram_buckets) * m_vec_sz);
+        } else {
+            m_ngram_buckets = 0;
+            m_ngram_vectors.clear();
+        }
+    }
+
+    bool w2vModel_t::sweep(const std::vector<train_setting_t> &_trainSettings,
+                           const std::string &_trainFile,
+                           const std::string &_stopWordsFile,
+                           std::vector<w2vModel_t> &_models,
+                           std::vector<train_stats_t> &_stats,
+                           std::string &_errMsg,
+                           vocabularyProgressCallback_t _vocabularyProgressCallback,
+                           vocabularyStatsCallback_t _vocabularyStatsCallback,
+                           sweepProgressCallback_t _trainProgressCallback) noexcept {
+        try {
+            if (_trainSettings.empty()) {
+                throw std::runtime_error("sweep: no configurations specified");
+            }
+            std::vector<std::shared_ptr<train_setting_t>> trainSettings;
+            std::size_t threads = 0;
+            for (auto const &i:_trainSettings) {
+                if (i.with_glove || (i.readers > 0) || i.resume || !i.base_checkpoint.empty()
+                    || !i.checkpoint_file.empty() || !i.peers.empty()) {
+                    throw std::runtime_error("sweep: checkpoints, distributed, pipelined and GloVe modes "
+                                             "are not supported");
+                }
+                if (!i.matrix_file.empty()) {
+                    // every configuration would map its matrices over the same file
+                    throw std::runtime_error("sweep: file backed matrices are not supported");
+                }
+                trainSettings.emplace_back(std::make_shared<train_setting_t>(i));
+                // a single final report covers the whole training, configurations do not share the stats file
+                trainSettings.back()->stats_interval = 0;
+                trainSettings.back()->stats_file.clear();
+                // trainers pinned by a common placement take the next CPUs one after another
+                trainSettings.back()->cpu_offset = i.cpu_offset + static_cast<uint32_t>(threads);
+                threads += i.threads;
+            }
+            auto const &common = *trainSettings.front();
+            vocabularyProgress_t vocabularyProgress(_vocabularyProgressCallback, _vocabularyStatsCallback,
+                                                    common.progress_interval);
+
+            // vocabulary is built and the train data set is tokenized once for all configurations
+            std::shared_ptr<vocabulary_t> vocabulary;
+            std::shared_ptr<corpus_t> corpus;
+            {
+                std::shared_ptr<file_mapper_t> trainWordsMapper(new file_mapper_t(_trainFile));
+                std::shared_ptr<file_mapper_t> stopWordsMapper;
+                if (!_stopWordsFile.empty()) {
+                    stopWordsMapper.reset(new file_mapper_t(_stopWordsFile));
+                }
+                vocabulary.reset(new vocabulary_t(trainWordsMapper,
+                                                  stopWordsMapper,
+                                                  common.delims,
+                                                  common.eos,
+                                                  common.min_freq,
+                                                  vocabularyProgress.progressCallback,
+                                                  vocabularyProgress.statsCallback));
+                if (!common.vocabulary_file.empty()) {
+                    vocabulary->save(common.vocabulary_file);
+                }
+                corpus.reset(new corpus_t(*trainWordsMapper, *vocabulary, common.delims, common.eos,
+                                          static_cast<uint16_t>(std::min<std::size_t>(threads, UINT16_MAX))));
+            }
+            std::vector<std::string> words;
+            vocabulary->words(words);
+
+            // all configurations are trained at once, each with its own matrices and threads
+            _stats.assign(trainSettings.size(), train_stats_t());
+            std::vector<std::unique_ptr<trainer_t>> trainers;
+            // progress is reported by threads of all trainers, the callback is called by one of them at a time
+            std::mutex progressLock;
+            for (std::size_t i = 0; i < trainSettings.size(); ++i) {
+                trainProgressCallback_t progressCallback = nullptr;
+                if (_trainProgressCallback != nullptr) {
+                    progressCallback = [i, _trainProgressCallback, &progressLock](float _alpha, float _percent) {
+                        std::lock_guard<std::mutex> lock(progressLock);
+                        _trainProgressCallback(i, _alpha, _percent);
+                    };
+                }
+                auto stats = &_stats[i];
+                trainers.emplace_back(new trainer_t(trainSettings[i], vocabulary, nullptr, progressCallback, nullptr,
+                                                    [stats](const train_stats_t &_trainStats) {
+                                                        *stats = _trainStats;
+                                                    },
+                                                    nullptr, corpus));
+            }
+            for (auto &i:trainers) {
+                i->launch();
+            }
+            for (auto &i:trainers) {
+                i->join();
+            }
+
+            _models.clear();
+            _models.resize(trainers.size());
+            for (std::size_t i = 0; i < trainers.size(); ++i) {
+                _models[i].m_vec_sz = trainSettings[i]->size;
+                _models[i].assign(words, *trainers[i]);
+                trainers[i].reset();
+            }
+
+            return true;
+        } catch (const std::exception &_e) {
+            _errMsg = _e.what();
+        } catch (...) {
+            _errMsg = "unknown error";
+        }
+
+        return false;
+    }
+
     bool w2vModel_t::save(const std::string &_model_file) const noexcept {
+        return save(_model_file, save_setting_t());
+    }
+
+    bool w2vModel_t::save(const std::string &_model_file, const save_setting_t &_saveSettings) const noexcept {
         try {
             // save trained data in original word2vec format
             // file header
-            std::string fileHeader = std::to_string(m_map_sz)
+            std::string fileHeader = std::to_string(m_keys.size())
                                      + " "
                                      + std::to_string(m_vec_sz)
                                      + "\n";
             // calc output size
-            // header size
-            auto outputSize = static_cast<off_t>(fileHeader.length() * sizeof(char));
-            for (auto const &i:m_map) {
-                // size of (word + space char + vector size + size of cartridge return char)
-                outputSize += (i.first.length() + 2) * sizeof(char) + m_vec_sz * sizeof(float);
+            auto headerSize = static_cast<off_t>(fileHeader.length() * sizeof(char));
+            // size of a record besides its word: space char + vector + cartridge return char
+            auto recordSize = static_cast<off_t>(2 * sizeof(char) + m_vec_sz * sizeof(float));
+            auto recordsSize = static_cast<off_t>(m_keys.chars().size() * sizeof(char))
+                               + static_cast<off_t>(m_keys.size()) * recordSize;
+            auto outputSize = headerSize + recordsSize;
+            if (m_ngram_buckets > 0) {
+                // n-grams vectors follow the words, original word2vec readers ignore them
+                outputSize += sizeof(subwordsMagic) + sizeof(m_ngram_buckets) + sizeof(m_min_ngram)
+                              + sizeof(m_max_ngram) + m_ngram_vectors.size() * sizeof(float);
             }
-            // write data to the file
-            file_mapper_t output(_model_file, true, outputSize);
-            char sp = ' ';
-            char cr = '\n';
-            off_t offset = 0;
-            // write file header
-            std::memcpy(reinterpret_cast<void *>(output.data() + offset),
-                        fileHeader.data(), fileHeader.length() * sizeof(char));
-            offset += fileHeader.length() * sizeof(char);
 
-            // write words and their vectors
-            for (auto const &i:m_map) {
-                std::memcpy(reinterpret_cast<void *>(output.data() + offset),
-                            i.first.data(), i.first.length() * sizeof(char));
-                offset += i.first.length() * sizeof(char);
-                std::memcpy(reinterpret_cast<void *>(output.data() + offset), &sp, sizeof(char));
-                offset += sizeof(char);
+            // record offsets are known from the words table, so ranges of records are written in parallel
+            modelWriter_t writer(_model_file, outputSize, _saveSettings);
+            auto offsets = m_keys.offsets().data();
+            auto chars = m_keys.chars().data();
+            auto matrix = this->matrix();
+            auto rows = m_keys.size();
+            writer.write(rows, [&](std::size_t _begin, std::size_t _end, modelWriter_t::sink_t &_sink) {
+                const char sp = ' ';
+                const char cr = '\n';
+                if (_begin == 0) {
+                    _sink.write(0, fileHeader.data(), fileHeader.length() * sizeof(char));
+                }
+                for (auto i = _begin; i < _end; ++i) {
+                    auto offset = headerSize + static_cast<off_t>(offsets[i]) + static_cast<off_t>(i) * recordSize;
+                    auto wordLength = static_cast<std::size_t>(offsets[i + 1] - offsets[i]);
+                    _sink.write(offset, chars + offsets[i], wordLength * sizeof(char));
+                    offset += wordLength * sizeof(char);
+                    _sink.write(offset, &sp, sizeof(char));
+                    offset += sizeof(char);
+                    _sink.write(offset, reinterpret_cast<const char *>(matrix + i * m_vec_sz),
+                                m_vec_sz * sizeof(float));
+                    offset += m_vec_sz * sizeof(float);
+                    _sink.write(offset, &cr, sizeof(char));
+                }
+                if ((_end == rows) && (m_ngram_buckets > 0)) {
+                    std::string subwordsHeader(subwordsMagic, sizeof(subwordsMagic));
+                    subwordsHeader.append(reinterpret_cast<const char *>(&m_ngram_buckets), sizeof(m_ngram_buckets));
+                    subwordsHeader.append(reinterpret_cast<const char *>(&m_min_ngram), sizeof(m_min_ngram));
+                    subwordsHeader.append(reinterpret_cast<const char *>(&m_max_ngram), sizeof(m_max_ngram));
+                    auto offset = headerSize + recordsSize;
+                    _sink.write(offset, subwordsHeader.data(), subwordsHeader.length());
+                    offset += subwordsHeader.length();
+                    _sink.write(offset, reinterpret_cast<const char *>(m_ngram_vectors.data()),
+                                m_ngram_vectors.size() * sizeof(float));
+                }
+            });
+            writer.commit();
 
-                auto shift = m_vec_sz * sizeof(float);
-                std::memcpy(reinterpret_cast<void *>(output.data() + offset), i.second.data(), shift);
-                offset += shift;
+            return true;
+        } catch (const std::exception &_e) {
+            m_err_msg = _e.what();
+        } catch (...) {
+            m_err_msg = "unknown error";
+        }
+
+        return false;
+    }
 
-                std::memcpy(reinterpret_cast<void *>(output.data() + offset), &cr, sizeof(char));
-                offset += sizeof(char);
+    bool w2vModel_t::saveNative(const std::string &_model_file) const noexcept {
+        try {
+            if (m_keys.size() == 0) {
+                throw std::runtime_error("model: nothing to save");
+            }
+            nativeHeader_t header{};
+            std::memcpy(header.magic, nativeMagic, sizeof(nativeMagic));
+            header.version = nativeVersion;
+            header.vectorSize = m_vec_sz;
+            header.minNgram = m_min_ngram;
+            header.maxNgram = m_max_ngram;
+            header.words = m_keys.size();
+            header.ngramBuckets = m_ngram_buckets;
+            header.indexSlots = m_index.size();
+            header.charsSize = m_keys.chars().size();
+            // fp32 rows of pq model are reconstructed from codes
+            auto matrixSize = (m_storage == storage_t::pq) ? 0 : m_keys.size() * m_vec_sz * sizeof(float);
+            header.matrixOffset = alignNative(sizeof(header));
+            header.ngramsOffset = alignNative(header.matrixOffset + matrixSize);
+            header.offsetsOffset = alignNative(header.ngramsOffset + m_ngram_vectors.size() * sizeof(float));
+            header.charsOffset = alignNative(header.offsetsOffset + m_keys.offsets().size() * sizeof(uint64_t));
+            header.indexOffset = alignNative(header.charsOffset + header.charsSize);
+            header.fileSize = header.indexOffset + m_index.size() * sizeof(uint32_t);
+            header.storage = static_cast<uint64_t>(m_storage);
+            if (m_storage == storage_t::fp16) {
+                header.quantizedOffset = alignNative(header.fileSize);
+                header.fileSize = header.quantizedOffset + m_half_rows.size() * sizeof(uint16_t);
+            } else if (m_storage == storage_t::int8) {
+                header.quantizedOffset = alignNative(header.fileSize);
+                header.scalesOffset = alignNative(header.quantizedOffset + m_byte_rows.size() * sizeof(int8_t));
+                header.fileSize = header.scalesOffset + m_row_scales.size() * sizeof(float);
+            } else if (m_storage == storage_t::pq) {
+                header.subspaces = m_pq->subspaces();
+                header.quantizedOffset = alignNative(header.fileSize);
+                header.codebooksOffset = alignNative(header.quantizedOffset + m_keys.size() * m_pq->subspaces());
+                header.fileSize = header.codebooksOffset + m_pq->codebooks().size() * sizeof(float);
+                if (!m_pq->rotation().empty()) {
+                    header.rotationOffset = alignNative(header.fileSize);
+                    header.fileSize = header.rotationOffset + m_pq->rotation().size() * sizeof(float);
+                }
+            }
+
+            file_mapper_t output(_model_file, true, static_cast<off_t>(header.fileSize));
+            std::memset(output.data(), 0, header.fileSize);
+            std::memcpy(output.data(), &header, sizeof(header));
+            // vectors are stored normalized, loaded model uses them as is
+            if (m_storage != storage_t::pq) {
+                auto rows = this->matrix();
+                auto matrix = reinterpret_cast<float *>(output.data() + header.matrixOffset);
+                for (std::size_t i = 0; i < m_keys.size(); ++i) {
+                    normalize(rows + i * m_vec_sz, m_vec_sz, matrix + i * m_vec_sz);
+                }
+            }
+            std::memcpy(output.data() + header.ngramsOffset, m_ngram_vectors.data(),
+                        m_ngram_vectors.size() * sizeof(float));
+            std::memcpy(output.data() + header.offsetsOffset, m_keys.offsets().data(),
+                        m_keys.offsets().size() * sizeof(uint64_t));
+            std::memcpy(output.data() + header.charsOffset, m_keys.chars().data(), header.charsSize);
+            // in-memory index uses the same stable hash function, so it is stored as is
+            std::memcpy(output.data() + header.indexOffset, m_index.data(), m_index.size() * sizeof(uint32_t));
+            if (m_storage == storage_t::fp16) {
+                std::memcpy(output.data() + header.quantizedOffset, m_half_rows.data(),
+                            m_half_rows.size() * sizeof(uint16_t));
+            } else if (m_storage == storage_t::int8) {
+                std::memcpy(output.data() + header.quantizedOffset, m_byte_rows.data(),
+                            m_byte_rows.size() * sizeof(int8_t));
+                std::memcpy(output.data() + header.scalesOffset, m_row_scales.data(),
+                            m_row_scales.size() * sizeof(float));
+            } else if (m_storage == storage_t::pq) {
+                std::memcpy(output.data() + header.quantizedOffset, m_pq->codes().data(),
+                            m_keys.size() * m_pq->subspaces());
+                std::memcpy(output.data() + header.codebooksOffset, m_pq->codebooks().data(),
+                            m_pq->codebooks().size() * sizeof(float));
+                std::memcpy(output.data() + header.rotationOffset, m_pq->rotation().data(),
+                            m_pq->rotation().size() * sizeof(float));
             }
 
             return true;
         } catch (const std::exception &_e) {
             m_err_msg = _e.what();
         } catch (...) {
-            m_err_msg = "unknown error";
+            m_err_msg = "model: unknown error";
         }
 
         return false;
     }
 
+    void w2vModel_t::loadNative(const std::shared_ptr<file_mapper_t> &_input, const load_setting_t &_loadSettings) {
+        nativeHeader_t header{};
+        auto fileSize = static_cast<uint64_t>(_input->size());
+        if (fileSize < sizeof(header)) {
+            throw std::runtime_error(wrong_format_err);
+        }
+        std::memcpy(&header, _input->data(), nativeHeaderSize(1));
+        if ((header.version == 0) || (header.version > nativeVersion)) {
+            throw std::runtime_error("model: unsupported native model file version "
+                                     + std::to_string(header.version));
+        }
+        auto headerSize = nativeHeaderSize(header.version);
+        std::memcpy(&header, _input->data(), headerSize);
+        // sections are checked in O(1), words offsets and index entries are trusted
+        auto section = [headerSize, fileSize](uint64_t _offset, uint64_t _size) {
+            return ((_offset % 64) == 0) && (_offset >= headerSize) && (_offset <= fileSize)
+                   && (_size <= fileSize - _offset);
+        };
+        auto slots = header.indexSlots;
+        if ((header.fileSize != fileSize) || (header.words == 0) || (header.vectorSize == 0)
+            || (slots <= header.words) || ((slots & (slots - 1)) != 0)
+            || !section(header.matrixOffset, (header.storage == static_cast<uint64_t>(storage_t::pq))
+                                             ? 0 : header.words * header.vectorSize * sizeof(float))
+            || !section(header.ngramsOffset, header.ngramBuckets * header.vectorSize * sizeof(float))
+            || !section(header.offsetsOffset, (header.words + 1) * sizeof(uint64_t))
+            || !section(header.charsOffset, header.charsSize)
+            || !section(header.indexOffset, slots * sizeof(uint32_t))
+            || ((header.ngramBuckets > 0) && ((header.minNgram == 0) || (header.minNgram > header.maxNgram)))
+            || (header.storage > static_cast<uint64_t>(storage_t::pq))
+            || ((header.storage == static_cast<uint64_t>(storage_t::fp16))
+                && !section(header.quantizedOffset, header.words * header.vectorSize * sizeof(uint16_t)))
+            || ((header.storage == static_cast<uint64_t>(storage_t::int8))
+                && (!section(header.quantizedOffset, header.words * header.vectorSize * sizeof(int8_t))
+                    || !section(header.scalesOffset, header.words * sizeof(float))))
+            || ((header.storage == static_cast<uint64_t>(storage_t::pq))
+                && ((header.subspaces == 0) || (header.subspaces > header.vectorSize)
+                    || ((header.vectorSize % header.subspaces) != 0)
+                    || !section(header.quantizedOffset, header.words * header.subspaces)
+                    || !section(header.codebooksOffset, pq_codec_t::centroids * header.vectorSize * sizeof(float))
+                    || ((header.rotationOffset != 0)
+                        && !section(header.rotationOffset, header.vectorSize * header.vectorSize * sizeof(float)))))) {
+            throw std::runtime_error(wrong_format_err);
+        }
+        auto data = static_cast<const char *>(_input->data());
+        auto offsets = reinterpret_cast<const uint64_t *>(data + header.offsetsOffset);
+        if (offsets[header.words] != header.charsSize) {
+            throw std::runtime_error(wrong_format_err);
+        }
+
+        // truncated model views the first rows, the index entries of the rest are skipped by id()
+        auto words = ((_loadSettings.max_words > 0) && (_loadSettings.max_words < header.words))
+                     ? _loadSettings.max_words : header.words;
+        m_vec_sz = header.vectorSize;
+        if (header.storage != static_cast<uint64_t>(storage_t::pq)) {
+            m_matrix.view(reinterpret_cast<const float *>(data + header.matrixOffset), words * m_vec_sz);
+        }
+        m_keys.view(offsets, words, data + header.charsOffset, offsets[words]);
+        m_index.view(reinterpret_cast<const uint32_t *>(data + header.indexOffset), slots);
+        m_ngram_buckets = static_cast<uint32_t>(header.ngramBuckets);
+        m_min_ngram = header.minNgram;
+        m_max_ngram = header.maxNgram;
+        if (m_ngram_buckets > 0) {
+            m_ngram_vectors.view(reinterpret_cast<const float *>(data + header.ngramsOffset),
+                                 header.ngramBuckets * m_vec_sz);
+        }
+        m_mapping = _input;
+        m_rerank = _loadSettings.rerank;
+
+        // pq model is loaded as is whatever storage is requested, its rows are reconstructed on the first access
+        if (header.storage == static_cast<uint64_t>(storage_t::pq)) {
+            auto rotation = (header.rotationOffset != 0)
+                            ? reinterpret_cast<const float *>(data + header.rotationOffset) : nullptr;
+            std::shared_ptr<const pq_codec_t> pq = std::make_shared<pq_codec_t>(
+                    words, m_vec_sz, static_cast<uint16_t>(header.subspaces),
+                    reinterpret_cast<const float *>(data + header.codebooksOffset), rotation,
+                    reinterpret_cast<const uint8_t *>(data + header.quantizedOffset));
+            auto vectorSize = m_vec_sz;
+            m_lazy_rows = std::make_shared<lazy_rows_t>(words, m_vec_sz,
+                                                        [pq, _input, vectorSize](std::size_t _id, float *_row) {
+                pq->decode(_id, _row);
+                normalize(_row, vectorSize);
+            });
+            m_pq = pq;
+            m_storage = storage_t::pq;
+            return;
+        }
+
+        // quantized rows of the requested storage are mapped, otherwise they are converted from fp32 rows
+        auto storage = _loadSettings.storage;
+        if (storage == storage_t::pq) {
+            m_pq = std::make_shared<pq_codec_t>(words, m_vec_sz, [this](std::size_t _id, float *_row) {
+                std::copy(m_matrix.data() + _id * m_vec_sz, m_matrix.data() + (_id + 1) * m_vec_sz, _row);
+            }, _loadSettings.pq);
+            m_storage = storage_t::pq;
+            _input->advise(file_mapper_t::advice_t::dontNeed, static_cast<off_t>(header.matrixOffset),
+                           static_cast<off_t>(words * m_vec_sz * sizeof(float)));
+        } else if ((storage != storage_t::fp32) && (header.storage == static_cast<uint64_t>(storage))) {
+            m_storage = storage;
+            if (storage == storage_t::fp16) {
+                m_half_rows.view(reinterpret_cast<const uint16_t *>(data + header.quantizedOffset), words * m_vec_sz);
+            } else {
+                m_byte_rows.view(reinterpret_cast<const int8_t *>(data + header.quantizedOffset), words * m_vec_sz);
+                m_row_scales.view(reinterpret_cast<const float *>(data + header.scalesOffset), words);
+            }
+        } else if (storage != storage_t::fp32) {
+            allocQuantized(storage, words);
+            modelFile_t::parallel(words, [this](std::size_t _begin, std::size_t _end) {
+                for (auto i = _begin; i < _end; ++i) {
+                    quantizeRow(i, m_matrix.data() + i * m_vec_sz);
+                }
+            });
+            // fp32 rows are paged in again for re-ranking and lookups only
+            _input->advise(file_mapper_t::advice_t::dontNeed, static_cast<off_t>(header.matrixOffset),
+                           static_cast<off_t>(words * m_vec_sz * sizeof(float)));
+        }
+    }
+
     bool w2vModel_t::load(const std::string &_model_file) noexcept {
+        return load(_model_file, load_setting_t());
+    }
+
+    bool w2vModel_t::load(const std::string &_model_file, const load_setting_t &_loadSettings) noexcept {
         try {
-            m_map.clear();
+            clear();
+            m_ngram_buckets = 0;
+            m_ngram_vectors.clear();
 
             // map model file, exception will be thrown on empty file
-            file_mapper_t input(_model_file);
-
-            // parse header
-            off_t offset = 0;
-            // get words number
-            std::string nwStr;
-            char ch = 0;
-            while ((ch = (*(input.data() + offset))) != ' ') {
-                nwStr += ch;
-                if (++offset >= input.size()) {
-                    throw std::runtime_error(wrong_format_err);
-                }
+            std::shared_ptr<file_mapper_t> mapping(new file_mapper_t(_model_file));
+            if ((mapping->size() >= static_cast<off_t>(sizeof(nativeMagic)))
+                && (std::memcmp(mapping->data(), nativeMagic, sizeof(nativeMagic)) == 0)) {
+                loadNative(mapping, _loadSettings);
+                return true;
             }
+            auto const &input = *mapping;
 
-            // get vector size
-            offset++; // skip ' ' char
-            std::string vsStr;
-            while ((ch = (*(input.data() + offset))) != '\n') {
-                vsStr += ch;
-                if (++offset >= input.size()) {
-                    throw std::runtime_error(wrong_format_err);
+            // records are indexed by a serial scan, then copied (parsed) and normalized by all cores or, in lazy
+            // mode, on the first access to the row
+            mapping->advise(file_mapper_t::advice_t::sequential);
+            std::shared_ptr<modelFile_t> modelFile(new modelFile_t(input, _loadSettings.max_words));
+            m_vec_sz = modelFile->vectorSize();
+            std::shared_ptr<std::vector<std::size_t>> rowRecords(new std::vector<std::size_t>());
+            auto vectorSize = m_vec_sz;
+            // the loader keeps the file mapping and the record index of lazily loaded model
+            auto loadRow = [mapping, modelFile, rowRecords, vectorSize](std::size_t _id, float *_row) {
+                modelFile->vector((*rowRecords)[_id], _row);
+                if (!normalize(_row, vectorSize)) {
+                    throw std::runtime_error("failed to normalize vectors");
                 }
+            };
+            // fp32 rows of quantized model are needed for lookups and re-ranking only
+            auto lazy = _loadSettings.lazy || (_loadSettings.storage != storage_t::fp32);
+            if (lazy) {
+                // repeated words are rare, the rest of untouched buffer costs no memory
+                m_lazy_rows.reset(new lazy_rows_t(modelFile->records(), m_vec_sz, loadRow));
             }
-
-            try {
-                m_map_sz = static_cast<std::size_t>(std::stoll(nwStr));
-                m_vec_sz = static_cast<uint16_t>(std::stoi(vsStr));
-            } catch (...) {
-                throw std::runtime_error(wrong_format_err);
+            reserve(modelFile->records());
+            // the last record of a repeated word wins
+            rowRecords->reserve(modelFile->records());
+            for (std::size_t i = 0; i < modelFile->records(); ++i) {
+                auto rowId = insert(modelFile->word(i));
+                if (rowId == rowRecords->size()) {
+                    rowRecords->push_back(i);
+                } else {
+                    (*rowRecords)[rowId] = i;
+                }
             }
-
-            // get pairs of word and vector
-            offset++; // skip last '\n' char
-            std::string word;
-            for (std::size_t i = 0; i < m_map_sz; ++i) {
-                // get word
-                word.clear();
-                while ((ch = (*(input.data() + offset))) != ' ') {
-                    if (ch != '\n') {
-                        word += ch;
-                    }
-                    // move to the next char and check boundaries
-                    if (++offset >= input.size()) {
-                        throw std::runtime_error(wrong_format_err);
+            if (_loadSettings.storage == storage_t::pq) {
+                m_pq = std::make_shared<pq_codec_t>(rowRecords->size(), m_vec_sz, loadRow, _loadSettings.pq);
+                m_storage = storage_t::pq;
+                m_rerank = _loadSettings.rerank;
+            } else if (_loadSettings.storage != storage_t::fp32) {
+                allocQuantized(_loadSettings.storage, rowRecords->size());
+                m_rerank = _loadSettings.rerank;
+                modelFile_t::parallel(rowRecords->size(), [this, &loadRow](std::size_t _begin, std::size_t _end) {
+                    std::vector<float> row(m_vec_sz);
+                    for (auto i = _begin; i < _end; ++i) {
+                        loadRow(i, row.data());
+                        quantizeRow(i, row.data());
                     }
+                });
+            }
+            if (lazy) {
+                if (rowRecords->size() < modelFile->records()) {
+                    m_lazy_rows.reset(new lazy_rows_t(rowRecords->size(), m_vec_sz, loadRow));
                 }
+                // pages touched by the index scan are released, rows are paged in by the accesses
+                mapping->advise(file_mapper_t::advice_t::dontNeed);
+                mapping->advise(file_mapper_t::advice_t::random);
+            } else {
+                auto matrix = m_matrix.owned().data();
+                modelFile_t::parallel(rowRecords->size(), [this, &loadRow, matrix](std::size_t _begin,
+                                                                                   std::size_t _end) {
+                    for (auto i = _begin; i < _end; ++i) {
+                        loadRow(i, matrix + i * m_vec_sz);
+                    }
+                });
+            }
+            if (modelFile->format() == modelFile_t::format_t::text) {
+                return true;
+            }
 
-                // skip last ' ' char and check boundaries
-                if (static_cast<off_t>(++offset + m_vec_sz * sizeof(float)) > input.size()) {
+            auto offset = static_cast<off_t>(modelFile->end());
+            // optional n-grams vectors
+            if ((offset < input.size()) && (*(input.data() + offset) == '\n')) {
+                offset++; // vectors may be followed by '\n' char
+            }
+            auto subwordsHeader = static_cast<off_t>(sizeof(subwordsMagic) + sizeof(m_ngram_buckets)
+                                                     + sizeof(m_min_ngram) + sizeof(m_max_ngram));
+            if ((offset + subwordsHeader <= input.size())
+                && (std::memcmp(input.data() + offset, subwordsMagic, sizeof(subwordsMagic)) == 0)) {
+                offset += sizeof(subwordsMagic);
+                std::memcpy(&m_ngram_buckets, input.data() + offset, sizeof(m_ngram_buckets));
+                offset += sizeof(m_ngram_buckets);
+                std::memcpy(&m_min_ngram, input.data() + offset, sizeof(m_min_ngram));
+                offset += sizeof(m_min_ngram);
+                std::memcpy(&m_max_ngram, input.data() + offset, sizeof(m_max_ngram));
+                offset += sizeof(m_max_ngram);
+                auto vectorsSize = static_cast<std::size_t>(m_ngram_buckets) * m_vec_sz;
+                if ((m_ngram_buckets == 0) || (m_min_ngram == 0) || (m_min_ngram > m_max_ngram)
+                    || (static_cast<off_t>(offset + vectorsSize * sizeof(float)) > input.size())) {
+                    m_ngram_buckets = 0;
                     throw std::runtime_error(wrong_format_err);
                 }
+                auto &ngramVectors = m_ngram_vectors.owned();
+                ngramVectors.resize(vectorsSize);
+                std::memcpy(ngramVectors.data(), input.data() + offset, vectorsSize * sizeof(float));
+            }
 
-                // get word's vector
-                auto &v = m_map[word];
-                v.resize(m_vec_sz);
-                std::memcpy(v.data(), input.data() + offset, m_vec_sz * sizeof(float));
-                offset += m_vec_sz * sizeof(float); // vector size
+            return true;
+        } catch (const std::exception &_e) {
+            m_err_msg = _e.what();
+        } catch (...) {
+            m_err_msg = "model: unknown error";
+        }
 
-                // normalize vector
-                float med = 0.0f;
-                for (auto const &j:v) {
-                    med += j * j;
-                }
-                if (med <= 0.0f) {
-                    throw std::runtime_error("failed to normalize vectors");
-                }
-                med = std::sqrt(med / v.size());
-                for (auto &j:v) {
-                    j /= med;
+        return false;
+    }
+
+    bool w2vModel_t::subwordVector(const std::string &_word, vector_t &_vector) const noexcept {
+        if (m_ngram_buckets == 0) {
+            return false;
+        }
+        try {
+            std::vector<uint32_t> ngrams;
+            subwords_t::ngrams(_word, m_min_ngram, m_max_ngram, m_ngram_buckets, ngrams);
+            vector_t v(m_vec_sz);
+            for (auto i:ngrams) {
+                auto ngramRow = m_ngram_vectors.data() + static_cast<std::size_t>(i) * m_vec_sz;
+                for (uint16_t j = 0; j < m_vec_sz; ++j) {
+                    v[j] += ngramRow[j];
                 }
             }
+            // normalize vector like vectors of vocabulary words
+            float med = 0.0f;
+            for (auto const &i:v) {
+                med += i * i;
+            }
+            if (med <= 0.0f) {
+                return false;
+            }
+            med = std::sqrt(med / v.size());
+            for (auto &i:v) {
+                i /= med;
+            }
+            _vector = std::move(v);
 
             return true;
         } catch (const std::exception &_e) {
@@ -202,27 +951,27 @@ namespace wordvec {
 
     bool d2vModel_t::save(const std::string &_model_file) const noexcept {
         try {
-            auto msSize = sizeof(m_map_sz);
+            std::size_t rows = m_keys.size();
+            auto msSize = sizeof(rows);
             auto vsSize = sizeof(m_vec_sz);
             off_t fileSize = msSize + vsSize  // header size
                                    + (sizeof(std::size_t)
-                                      + m_vec_sz * sizeof(float)) * m_map_sz; // record size
+                                      + m_vec_sz * sizeof(float)) * rows; // record size
             // write data to the file
             file_mapper_t output(_model_file, true, fileSize);
             off_t offset = 0;
-            std::memcpy(output.data() + offset, &m_map_sz, msSize);
+            std::memcpy(output.data() + offset, &rows, msSize);
             offset += msSize;
             std::memcpy(output.data() + offset, &m_vec_sz, vsSize);
             offset += vsSize;
             auto idSize = sizeof(std::size_t);
             auto elmSize = sizeof(float);
-            for (const auto &i:m_map) {
-                std::memcpy(output.data() + offset, &(i.first), idSize);
+            for (std::size_t i = 0; i < rows; ++i) {
+                auto id = m_keys.key(i);
+                std::memcpy(output.data() + offset, &id, idSize);
                 offset += idSize;
-                for (const auto &j:i.second) {
-                    std::memcpy(output.data() + offset, &j, elmSize);
-                    offset += elmSize;
-                }
+                std::memcpy(output.data() + offset, m_matrix.data() + i * m_vec_sz, elmSize * m_vec_sz);
+                offset += elmSize * m_vec_sz;
             }
 
             return true;
@@ -237,35 +986,35 @@ namespace wordvec {
 
     bool d2vModel_t::load(const std::string &_model_file) noexcept {
         try {
-            m_map.clear();
+            clear();
 
             // map model file
             file_mapper_t input(_model_file);
 
-            auto msSize = sizeof(m_map_sz);
+            std::size_t rows = 0;
+            auto msSize = sizeof(rows);
             auto vsSize = sizeof(m_vec_sz);
             if (static_cast<off_t>(msSize + vsSize) > input.size()) {
                 throw std::runtime_error(wrong_format_err);
             }
             off_t offset = 0;
-            std::memcpy(&m_map_sz, input.data() + offset, msSize);
+            std::memcpy(&rows, input.data() + offset, msSize);
             offset += msSize;
             std::memcpy(&m_vec_sz, input.data() + offset, vsSize);
             offset += vsSize;
 
             auto idSize = sizeof(std::size_t);
             auto elmSize = sizeof(float);
-            if (static_cast<off_t>(msSize + vsSize + (idSize + elmSize * m_vec_sz) * m_map_sz) != input.size()) {
+            if (static_cast<off_t>(msSize + vsSize + (idSize + elmSize * m_vec_sz) * rows) != input.size()) {
                 throw std::runtime_error(wrong_format_err);
             }
 
-            for (std::size_t i = 0; i < m_map_sz; ++i) {
+            reserve(rows);
+            for (std::size_t i = 0; i < rows; ++i) {
                 std::size_t id = 0;
                 std::memcpy(&id, input.data() + offset, idSize);
                 offset += idSize;
-                auto &v = m_map[id];
-                v.resize(m_vec_sz);
-                std::memcpy(v.data(), input.data() + offset, m_vec_sz * sizeof(float));
+                std::memcpy(row(id), input.data() + offset, m_vec_sz * sizeof(float));
                 offset += m_vec_sz * sizeof(float);
             }
 
@@ -279,6 +1028,133 @@ namespace wordvec {
         return false;
     }
 
+    bool d2vModel_t::train(const train_setting_t &_trainSettings,
+                           const std::string &_trainFile,
+                           const std::string &_stopWordsFile,
+                           w2vModel_t::vocabularyProgressCallback_t _vocabularyProgressCallback,
+                           w2vModel_t::vocabularyStatsCallback_t _vocabularyStatsCallback,
+                           w2vModel_t::trainProgressCallback_t _trainProgressCallback) noexcept {
+        try {
+            auto trainSettings = std::make_shared<train_setting_t>(_trainSettings);
+            vocabularyProgress_t vocabularyProgress(_vocabularyProgressCallback, _vocabularyStatsCallback,
+                                                    trainSettings->progress_interval);
+            if (trainSettings->resume || !trainSettings->base_checkpoint.empty() || !trainSettings->peers.empty()) {
+                throw std::runtime_error("paragraph vectors training can not be resumed or distributed");
+            }
+            if ((trainSettings->ngram_buckets > 0) && !trainSettings->checkpoint_file.empty()) {
+                throw std::runtime_error("subwords: checkpoints are not supported");
+            }
+            // each line is a document
+            trainSettings->eos = "\n";
+            if (trainSettings->delims.find('\n') == std::string::npos) {
+                trainSettings->delims += '\n';
+            }
+
+            std::shared_ptr<file_mapper_t> trainWordsMapper(new file_mapper_t(_trainFile));
+            std::shared_ptr<file_mapper_t> stopWordsMapper;
+            if (!_stopWordsFile.empty()) {
+                stopWordsMapper.reset(new file_mapper_t(_stopWordsFile));
+            }
+            std::shared_ptr<vocabulary_t> vocabulary(new vocabulary_t(trainWordsMapper,
+                                                                      stopWordsMapper,
+                                                                      trainSettings->delims,
+                                                                      trainSettings->eos,
+                                                                      trainSettings->min_freq,
+                                                                      vocabularyProgress.progressCallback,
+                                                                      vocabularyProgress.statsCallback));
+            std::shared_ptr<documents_t> documents(new documents_t(*trainWordsMapper, trainSettings->size, false));
+
+            trainer_t trainer(trainSettings, vocabulary, trainWordsMapper, _trainProgressCallback,
+                              nullptr, nullptr, documents);
+            trainer();
+
+            clear();
+            m_vec_sz = trainSettings->size;
+            reserve(documents->size());
+            for (std::size_t i = 0; i < documents->size(); ++i) {
+                normalize(documents->vectors() + i * m_vec_sz, m_vec_sz, row(i));
+            }
+
+            return true;
+        } catch (const std::exception &_e) {
+            m_err_msg = _e.what();
+        } catch (...) {
+            m_err_msg = "unknown error";
+        }
+
+        return false;
+    }
+
+    bool d2vModel_t::infer(const train_setting_t &_inferSettings,
+                           const std::string &_checkpointFile,
+                           const std::string &_documentsFile,
+                           std::size_t _firstId,
+                           w2vModel_t::trainProgressCallback_t _progressCallback) noexcept {
+        try {
+            std::shared_ptr<checkpoint_t> checkpoint(new checkpoint_t());
+            checkpoint->load(_checkpointFile);
+            if ((m_vec_sz != 0) && (m_vec_sz != checkpoint->trainSettings.size)) {
+                throw std::runtime_error("checkpoint: vector size mismatch");
+            }
+
+            // model is taken from the checkpoint, training process settings from the caller
+            auto inferSettings = std::make_shared<train_setting_t>();
+            inferSettings->threads = _inferSettings.threads;
+            inferSettings->iterations = _inferSettings.iterations;
+            inferSettings->alpha = _inferSettings.alpha;
+            inferSettings->sample = _inferSettings.sample;
+            inferSettings->optimizer = _inferSettings.optimizer;
+            inferSettings->progress_interval = _inferSettings.progress_interval;
+            inferSettings->min_freq = checkpoint->trainSettings.min_freq;
+            inferSettings->size = checkpoint->trainSettings.size;
+            inferSettings->window = checkpoint->trainSettings.window;
+            inferSettings->with_hs = checkpoint->trainSettings.with_hs;
+            inferSettings->negative = checkpoint->trainSettings.negative;
+            inferSettings->with_dm = checkpoint->trainSettings.with_dm;
+            inferSettings->delims = checkpoint->trainSettings.delims;
+            inferSettings->eos = "\n";
+
+            std::shared_ptr<file_mapper_t> documentsMapper(new file_mapper_t(_documentsFile));
+            std::shared_ptr<vocabulary_t> vocabulary(new vocabulary_t(checkpoint->words,
+                                                                      checkpoint->frequencies,
+                                                                      checkpoint->trainWords,
+                                                                      checkpoint->totalWords));
+            // learning rate schedule depends on the documents words amount
+            vocabulary->count(documentsMapper, inferSettings->delims, inferSettings->eos, nullptr);
+            std::shared_ptr<documents_t> documents(new documents_t(*documentsMapper, inferSettings->size, true));
+
+            // checkpoint provides frozen weights only
+            checkpoint->alpha = inferSettings->alpha;
+            checkpoint->processedWords = 0;
+            checkpoint->trainThreads.clear();
+            checkpoint->encoderThreads.clear();
+            trainer_t trainer(inferSettings, vocabulary, documentsMapper, _progressCallback,
+                              checkpoint, nullptr, documents);
+            checkpoint.reset();
+            trainer();
+
+            m_vec_sz = inferSettings->size;
+            std::vector<std::size_t> updated;
+            for (std::size_t i = 0; i < documents->size(); ++i) {
+                auto rowId = id(_firstId + i);
+                if (rowId != npos) {
+                    updated.push_back(rowId);
+                }
+                normalize(documents->vectors() + i * m_vec_sz, m_vec_sz, row(_firstId + i));
+            }
+            // new documents are linked into the index by all cores
+            indexRows(updated);
+
+            return true;
+        } catch (const std::exception &_e) {
+            m_err_msg = _e.what();
+        } catch (...) {
+            m_err_msg = "unknown error";
+        }
+
+        return false;
+    }
+
     doc2vec_t::doc2vec_t(const std::unique_ptr<w2vModel_t> &_model,
                          const std::string &_doc,
                          const std::string &_delims): vector_t(_model->vectorSize()) {
@@ -289,12 +1165,16 @@ namespace wordvec {
             if (word.empty()) {
                 continue;
             }
+            vector_t subwordVector;
             auto next = _model->vector(word);
-            if (next == nullptr) {
-                continue;
+            if (next.empty()) {
+                if (!_model->subwordVector(word, subwordVector)) {
+                    continue;
+                }
+                next = subwordVector;
             }
             for (uint16_t i = 0; i < _model->vectorSize(); ++i) {
-                (*this)[i] += (*next)[i];
+                (*this)[i] += next[i];
             }
         }
         float med = 0.0f;
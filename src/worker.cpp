@@ -1,13 +1,22 @@
 #include <stdexcept>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 #include "worker.hpp"
 
 namespace wordvec {
-    trainThread_t::trainThread_t(uint8_t _id, const sharedData_t &_sharedData) :
-            m_sharedData(_sharedData), m_randomDevice(), m_randomGenerator(m_randomDevice()),
+    namespace {
+        /// loss is calculated for each lossSampleRate-th output layer evaluation
+        const std::size_t lossSampleRate = 16;
+        const float minProbability = 1e-6f;
+    }
+
+    trainThread_t::trainThread_t(uint16_t _id, const sharedData_t &_sharedData) :
+            m_sharedData(_sharedData), m_id(_id), m_randomDevice(), m_randomGenerator(m_randomDevice()),
             m_rndWindowShift(0, static_cast<short>((m_sharedData.trainSettings->window - 1))),
             m_downSampling(), m_nsDistribution(), m_hiddenLayerVals(), m_hiddenLayerErrors(),
-            m_wordReader(), m_thread() {
+            m_wordReader(), m_sentence(), m_iterations(m_sharedData.trainSettings->iterations), m_thread() {
 
         if (!m_sharedData.trainSettings) {
             throw std::runtime_error("train settings are not initialized");
@@ -16,9 +25,9 @@ namespace wordvec {
             throw std::runtime_error("vocabulary object is not initialized");
         }
 
-        if (m_sharedData.trainSettings->sample > 0.0f) {
+        if ((m_sharedData.trainSettings->sample > 0.0f) && !m_sharedData.sentenceQueue) {
             m_downSampling.reset(new downSampling_t(m_sharedData.trainSettings->sample,
-                                                    m_sharedData.vocabulary->trainWords()));
+                                                    m_sharedData.vocabulary->frequenciesSum()));
         }
 
         if (m_sharedData.trainSettings->negative > 0) {
@@ -27,18 +36,93 @@ namespace wordvec {
             m_nsDistribution.reset(new nsDistribution_t(frequencies));
         }
 
+        if (!m_sharedData.matrices) {
+            throw std::runtime_error("train matrices are not initialized");
+        }
+        m_bpWeights = m_sharedData.matrices->bpWeights();
+        if (!m_sharedData.inputOptimizer || !m_sharedData.outputOptimizer) {
+            throw std::runtime_error("optimizers are not initialized");
+        }
+        m_inputOptimizer = m_sharedData.inputOptimizer.get();
+        m_outputOptimizer = m_sharedData.outputOptimizer.get();
+        if (m_sharedData.subwords) {
+            if (!m_sharedData.subwordsOptimizer) {
+                throw std::runtime_error("optimizers are not initialized");
+            }
+            m_subwords = m_sharedData.subwords.get();
+            m_subwordsOptimizer = m_sharedData.subwordsOptimizer.get();
+        }
+        if (m_sharedData.documents) {
+            if (!m_sharedData.documentsOptimizer) {
+                throw std::runtime_error("optimizers are not initialized");
+            }
+            m_documents = m_sharedData.documents.get();
+            m_documentsOptimizer = m_sharedData.documentsOptimizer.get();
+            m_frozen = m_documents->frozen();
+        }
+        if (m_sharedData.trainSettings->hot_rows > 0) {
+            // HS updates inner nodes of the Huffman tree, nodes closer to the root have greater IDs
+            auto rows = m_sharedData.vocabulary->size();
+            if (m_sharedData.trainSettings->with_hs) {
+                rows = (rows > 0) ? (rows - 1) : 0;
+            }
+            m_hotRows = std::min<std::size_t>(m_sharedData.trainSettings->hot_rows, rows);
+            m_hotFirst = m_sharedData.trainSettings->with_hs ? (rows - m_hotRows) : 0;
+            m_hotCache.resize(m_hotRows * m_sharedData.trainSettings->size);
+            m_hotBase.resize(m_hotCache.size());
+            m_hotDirty.resize(m_hotRows, 0);
+        }
+
+        if (m_sharedData.telemetry) {
+            m_counters = m_sharedData.telemetry->counters(_id);
+        }
+        m_exchange = m_sharedData.exchange.get();
+
         if (m_sharedData.trainSettings->with_hs && !m_sharedData.huffmanTree) {
             throw std::runtime_error("Huffman tree object is not initialized");
         }
 
         m_hiddenLayerErrors.reset(new std::vector<float>(m_sharedData.trainSettings->size));
-        if (!m_sharedData.trainSettings->with_sg) {
+        if (!m_sharedData.trainSettings->with_sg || (m_subwords != nullptr) || (m_documents != nullptr)) {
             m_hiddenLayerVals.reset(new std::vector<float>(m_sharedData.trainSettings->size));
         }
 
+        if (m_sharedData.resumeFrom && m_sharedData.resumeFrom->resumable()) {
+            if (m_sharedData.resumeFrom->trainThreads.size() != m_sharedData.trainSettings->threads) {
+                throw std::runtime_error("checkpoint: train threads number mismatch");
+            }
+            auto const &state = m_sharedData.resumeFrom->trainThreads[_id];
+            checkpoint_t::rngState(state.rng, m_randomGenerator);
+            m_processedWords = state.words;
+            m_iterations = state.iteration;
+            m_resumeOffset = state.offset;
+        }
+
+        if (m_sharedData.sentenceQueue) {
+            // pipelined mode, sentences are read and encoded by encoder threads
+            return;
+        }
+
+        if (m_sharedData.corpus) {
+            // sentences are read from the encoded train data set
+            m_corpus = m_sharedData.corpus.get();
+            m_firstSentence = m_corpus->sentences() * _id / m_sharedData.trainSettings->threads;
+            m_lastSentence = m_corpus->sentences() * (_id + 1u) / m_sharedData.trainSettings->threads;
+            return;
+        }
         if (!m_sharedData.fileMapper) {
             throw std::runtime_error("file mapper object is not initialized");
         }
+        if (m_documents != nullptr) {
+            // documents are read one by one, each document is a single line
+            m_firstDocument = m_documents->size() * _id / m_sharedData.trainSettings->threads;
+            m_lastDocument = m_documents->size() * (_id + 1u) / m_sharedData.trainSettings->threads;
+            m_wordReader.reset(new word_reader_t<file_mapper_t>(*m_sharedData.fileMapper,
+                                                              m_sharedData.trainSettings->delims,
+                                                              m_sharedData.trainSettings->eos));
+            return;
+        }
+
         auto shift = m_sharedData.fileMapper->size() / m_sharedData.trainSettings->threads;
         auto startFrom = shift * _id;
         auto stopAt = (_id == m_sharedData.trainSettings->threads - 1)
@@ -47,41 +131,61 @@ namespace wordvec {
                                                           m_sharedData.trainSettings->delims,
                                                           m_sharedData.trainSettings->eos,
                                                           startFrom, stopAt));
+        if ((m_resumeOffset >= 0) && (m_iterations > 0)) {
+            m_wordReader->seek(m_resumeOffset);
+        }
     }
 
-    void trainThread_t::worker(std::vector<float> &_trainMatrix) noexcept {
-        for (auto i = m_sharedData.trainSettings->iterations; i > 0; --i) {
+    void trainThread_t::worker() noexcept {
+        auto trainMatrix = m_sharedData.matrices->trainMatrix();
+        mergeHotRows();
+        if (m_sharedData.sentenceQueue) {
+            pipelinedWorker(trainMatrix);
+            return;
+        }
+        if (m_documents != nullptr) {
+            documentsWorker(trainMatrix);
+            return;
+        }
+        if (m_corpus != nullptr) {
+            corpusWorker(trainMatrix);
+            return;
+        }
+
+        auto wordsPerAllThreads = m_sharedData.trainSettings->iterations
+                                  * m_sharedData.vocabulary->trainWords();
+        auto wordsPerAlpha = wordsPerAllThreads / 10000;
+        std::string word;
+        for (auto i = m_iterations; i > 0; --i) {
             bool exitFlag = false;
             std::size_t threadProcessedWords = 0;
             std::size_t prvThreadProcessedWords = 0;
-            m_wordReader->reset();
-            auto wordsPerAllThreads = m_sharedData.trainSettings->iterations
-                              * m_sharedData.vocabulary->trainWords();
-            auto wordsPerAlpha = wordsPerAllThreads / 10000;
+            if (m_resumeOffset < 0) {
+                m_wordReader->reset();
+            } else {
+                m_resumeOffset = -1; // reader is already positioned to the resumed sentence
+            }
             while (!exitFlag) {
                 // calc alpha
                 if (threadProcessedWords - prvThreadProcessedWords > wordsPerAlpha) { // next 0.01% processed
-                    *m_sharedData.processedWords += threadProcessedWords - prvThreadProcessedWords;
+                    updateAlpha(threadProcessedWords - prvThreadProcessedWords, wordsPerAllThreads);
                     prvThreadProcessedWords = threadProcessedWords;
+                }
 
-                    float ratio =
-                            static_cast<float>(*(m_sharedData.processedWords)) / wordsPerAllThreads;
-
-                    auto curAlpha = m_sharedData.trainSettings->alpha * (1 - ratio);
-                    if (curAlpha < m_sharedData.trainSettings->alpha * 0.0001f) {
-                        curAlpha = m_sharedData.trainSettings->alpha * 0.0001f;
-                    }
-                    (*m_sharedData.alpha) = curAlpha;
-
-                    if (m_sharedData.progressCallback != nullptr) {
-                        m_sharedData.progressCallback(curAlpha, ratio * 100.0f);
-                    }
+                if (m_sharedData.checkpointer && m_sharedData.checkpointer->requested(m_checkpointGeneration)) {
+                    updateAlpha(threadProcessedWords - prvThreadProcessedWords, wordsPerAllThreads);
+                    prvThreadProcessedWords = threadProcessedWords;
+                    mergeHotRows();
+                    m_sharedData.checkpointer->capture(m_sharedData.checkpointer->trainSlot(m_id),
+                                                       m_checkpointGeneration,
+                                                       state(i, m_wordReader->offset()));
                 }
 
                 // read sentence
-                std::vector<const vocabulary_t::wordData_t *> sentence;
+                auto readStart = timestamp();
+                auto sentenceStart = threadProcessedWords;
+                m_sentence.clear();
                 while (true) {
-                    std::string word;
                     if (!m_wordReader->next_word(word)) {
                         exitFlag = true; // EOF or end of requested region
                         break;
@@ -102,21 +206,337 @@ namespace wordvec {
                             continue; // skip this word
                         }
                     }
-                    sentence.push_back(wordData);
+                    m_sentence.push_back(wordData->index);
                 }
 
-                if (m_sharedData.trainSettings->with_sg) {
-                    skipGram(sentence, _trainMatrix);
-                } else {
-                    cbow(sentence, _trainMatrix);
+                auto trainStart = timestamp();
+                train(m_sentence.data(), m_sentence.size(), trainMatrix);
+                if (m_hotUpdates >= m_sharedData.trainSettings->hot_rows_sync) {
+                    mergeHotRows();
+                }
+                if (m_counters != nullptr) {
+                    publish(threadProcessedWords - sentenceStart, m_sentence.size(),
+                            trainStart - readStart, timestamp() - trainStart);
+                }
+            }
+            updateAlpha(threadProcessedWords - prvThreadProcessedWords, wordsPerAllThreads);
+        }
+        mergeHotRows();
+
+        if (m_sharedData.checkpointer) {
+            m_sharedData.checkpointer->finish(m_sharedData.checkpointer->trainSlot(m_id), state(0, 0));
+        }
+    }
+
+    void trainThread_t::pipelinedWorker(float *_trainMatrix) noexcept {
+        auto wordsPerAllThreads = m_sharedData.trainSettings->iterations
+                                  * m_sharedData.vocabulary->trainWords();
+        auto wordsPerAlpha = wordsPerAllThreads / 10000;
+        std::size_t threadProcessedWords = 0;
+        auto readStart = timestamp();
+        while (auto batch = m_sharedData.sentenceQueue->pop()) {
+            auto trainStart = timestamp();
+            std::size_t sentenceStart = 0;
+            for (auto sentenceEnd:batch->sentences) {
+                train(batch->words.data() + sentenceStart, sentenceEnd - sentenceStart, _trainMatrix);
+                sentenceStart = sentenceEnd;
+                if (m_hotUpdates >= m_sharedData.trainSettings->hot_rows_sync) {
+                    mergeHotRows();
+                }
+            }
+            threadProcessedWords += batch->processedWords;
+            if (m_counters != nullptr) {
+                publish(batch->processedWords, batch->words.size(), trainStart - readStart, timestamp() - trainStart);
+            }
+            m_sharedData.sentenceQueue->release(batch);
+
+            if (threadProcessedWords > wordsPerAlpha) { // next 0.01% processed
+                updateAlpha(threadProcessedWords, wordsPerAllThreads);
+                threadProcessedWords = 0;
+            }
+
+            if (m_sharedData.checkpointer && m_sharedData.checkpointer->requested(m_checkpointGeneration)) {
+                updateAlpha(threadProcessedWords, wordsPerAllThreads);
+                threadProcessedWords = 0;
+                mergeHotRows();
+                m_sharedData.checkpointer->capture(m_sharedData.checkpointer->trainSlot(m_id),
+                                                   m_checkpointGeneration, state(0, 0));
+            }
+            readStart = timestamp();
+        }
+        updateAlpha(threadProcessedWords, wordsPerAllThreads);
+        mergeHotRows();
+
+        if (m_sharedData.checkpointer) {
+            m_sharedData.checkpointer->finish(m_sharedData.checkpointer->trainSlot(m_id), state(0, 0));
+        }
+    }
+
+    void trainThread_t::documentsWorker(float *_trainMatrix) noexcept {
+        auto wordsPerAllThreads = m_sharedData.trainSettings->iterations
+                                  * m_sharedData.vocabulary->trainWords();
+        auto wordsPerAlpha = wordsPerAllThreads / 10000;
+        std::size_t threadProcessedWords = 0;
+        std::string word;
+        for (auto i = m_iterations; i > 0; --i) {
+            for (auto d = m_firstDocument; d < m_lastDocument; ++d) {
+                if (threadProcessedWords > wordsPerAlpha) { // next 0.01% processed
+                    updateAlpha(threadProcessedWords, wordsPerAllThreads);
+                    threadProcessedWords = 0;
+                }
+
+                if (m_sharedData.checkpointer && m_sharedData.checkpointer->requested(m_checkpointGeneration)) {
+                    updateAlpha(threadProcessedWords, wordsPerAllThreads);
+                    threadProcessedWords = 0;
+                    mergeHotRows();
+                    m_sharedData.checkpointer->capture(m_sharedData.checkpointer->trainSlot(m_id),
+                                                       m_checkpointGeneration, state(i, 0));
+                }
+
+                // read document
+                auto readStart = timestamp();
+                std::size_t documentWords = 0;
+                m_sentence.clear();
+                m_wordReader->seek(m_documents->offset(d));
+                while (m_wordReader->next_word(word) && !word.empty()) {
+                    auto wordData = m_sharedData.vocabulary->data(word);
+                    if (wordData == nullptr) {
+                        continue; // no such word
+                    }
+
+                    documentWords++;
+
+                    if (m_sharedData.trainSettings->sample > 0.0f) { // down-sampling...
+                        if ((*m_downSampling)(wordData->frequency, m_randomGenerator)) {
+                            continue; // skip this word
+                        }
+                    }
+                    m_sentence.push_back(wordData->index);
+                }
+                threadProcessedWords += documentWords;
+
+                auto trainStart = timestamp();
+                document(d, m_sentence.data(), m_sentence.size(), _trainMatrix);
+                if (m_hotUpdates >= m_sharedData.trainSettings->hot_rows_sync) {
+                    mergeHotRows();
+                }
+                if (m_counters != nullptr) {
+                    publish(documentWords, m_sentence.size(), trainStart - readStart, timestamp() - trainStart);
                 }
             }
         }
+        updateAlpha(threadProcessedWords, wordsPerAllThreads);
+        mergeHotRows();
+
+        if (m_sharedData.checkpointer) {
+            m_sharedData.checkpointer->finish(m_sharedData.checkpointer->trainSlot(m_id), state(0, 0));
+        }
     }
 
-    inline void trainThread_t::cbow(const std::vector<const vocabulary_t::wordData_t *> &_sentence,
-                                    std::vector<float> &_trainMatrix) noexcept {
-        for (std::size_t i = 0; i < _sentence.size(); ++i) {
+    void trainThread_t::corpusWorker(float *_trainMatrix) noexcept {
+        auto wordsPerAllThreads = m_sharedData.trainSettings->iterations
+                                  * m_sharedData.vocabulary->trainWords();
+        auto wordsPerAlpha = wordsPerAllThreads / 10000;
+        std::size_t threadProcessedWords = 0;
+        for (auto i = m_iterations; i > 0; --i) {
+            for (auto s = m_firstSentence; s < m_lastSentence; ++s) {
+                if (threadProcessedWords > wordsPerAlpha) { // next 0.01% processed
+                    updateAlpha(threadProcessedWords, wordsPerAllThreads);
+                    threadProcessedWords = 0;
+                }
+
+                // copy sentence
+                auto readStart = timestamp();
+                auto sentenceBegin = m_corpus->sentenceBegin(s);
+                auto sentenceEnd = m_corpus->sentenceEnd(s);
+                m_sentence.clear();
+                for (auto w = sentenceBegin; w != sentenceEnd; ++w) {
+                    if (m_sharedData.trainSettings->sample > 0.0f) { // down-sampling...
+                        if ((*m_downSampling)(m_corpus->frequency(*w), m_randomGenerator)) {
+                            continue; // skip this word
+                        }
+                    }
+                    m_sentence.push_back(*w);
+                }
+                auto sentenceWords = static_cast<std::size_t>(sentenceEnd - sentenceBegin);
+                threadProcessedWords += sentenceWords;
+
+                auto trainStart = timestamp();
+                train(m_sentence.data(), m_sentence.size(), _trainMatrix);
+                if (m_hotUpdates >= m_sharedData.trainSettings->hot_rows_sync) {
+                    mergeHotRows();
+                }
+                if (m_counters != nullptr) {
+                    publish(sentenceWords, m_sentence.size(), trainStart - readStart, timestamp() - trainStart);
+                }
+            }
+        }
+        updateAlpha(threadProcessedWords, wordsPerAllThreads);
+        mergeHotRows();
+    }
+
+    inline void trainThread_t::updateAlpha(std::size_t _processedWords, std::size_t _wordsPerAllThreads) noexcept {
+        if (_processedWords == 0) {
+            return;
+        }
+        m_processedWords += _processedWords;
+        auto processedWords = (*m_sharedData.processedWords += _processedWords);
+        if (m_sharedData.epochMonitor) {
+            m_sharedData.epochMonitor->update(processedWords);
+        }
+
+        float ratio = static_cast<float>(processedWords) / _wordsPerAllThreads;
+
+        auto curAlpha = m_sharedData.trainSettings->alpha * (1 - ratio);
+        if (curAlpha < m_sharedData.trainSettings->alpha * 0.0001f) {
+            curAlpha = m_sharedData.trainSettings->alpha * 0.0001f;
+        }
+        (*m_sharedData.alpha) = curAlpha;
+
+        if (m_sharedData.progressCallback != nullptr) {
+            m_sharedData.progressCallback(curAlpha, ratio * 100.0f);
+        }
+    }
+
+    inline checkpoint_t::threadState_t trainThread_t::state(uint8_t _iteration, off_t _offset) const noexcept {
+        checkpoint_t::threadState_t ret;
+        ret.iteration = _iteration;
+        ret.offset = _offset;
+        ret.words = m_processedWords;
+        try {
+            ret.rng = checkpoint_t::rngState(m_randomGenerator);
+        } catch (...) {
+            // thread is resumed with a new random generator state
+        }
+
+        return ret;
+    }
+
+    inline std::size_t trainThread_t::timestamp() const noexcept {
+        if (m_counters == nullptr) {
+            return 0;
+        }
+        return static_cast<std::size_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    inline void trainThread_t::publish(std::size_t _words, std::size_t _trainedWords,
+                                       std::size_t _readTime, std::size_t _trainTime) noexcept {
+        telemetry_t::counters_t::add(m_counters->words, _words);
+        telemetry_t::counters_t::add(m_counters->skippedWords, _words - _trainedWords);
+        telemetry_t::counters_t::add(m_counters->readTime, _readTime);
+        telemetry_t::counters_t::add(m_counters->trainTime, _trainTime);
+        telemetry_t::counters_t::add(m_counters->pairs, m_pairs);
+        m_pairs = 0;
+        if (m_lossSamples > 0) {
+            telemetry_t::counters_t::add(m_counters->lossSamples, m_lossSamples);
+            telemetry_t::counters_t::add(m_counters->lossSum, m_lossSum);
+            m_lossSamples = 0;
+            m_lossSum = 0.0;
+        }
+    }
+
+    inline void trainThread_t::sampleLoss(float _f, bool _label) noexcept {
+        if ((m_counters == nullptr) || (++m_lossCounter % lossSampleRate != 0)) {
+            return;
+        }
+        auto probability = _label ? _f : 1.0f - _f;
+        m_lossSum -= std::log(std::max(probability, minProbability));
+        m_lossSamples++;
+    }
+
+    inline bool trainThread_t::cached(std::size_t _index) const noexcept {
+        return (_index >= m_hotFirst) && (_index < m_hotFirst + m_hotRows);
+    }
+
+    inline float *trainThread_t::outputRow(std::size_t _index) noexcept {
+        if (!cached(_index)) {
+            return m_bpWeights + _index * m_sharedData.trainSettings->size;
+        }
+        m_hotDirty[_index - m_hotFirst] = 1;
+        m_hotUpdates++;
+        return &m_hotCache[(_index - m_hotFirst) * m_sharedData.trainSettings->size];
+    }
+
+    void trainThread_t::mergeHotRows() noexcept {
+        auto size = m_sharedData.trainSettings->size;
+        for (std::size_t i = 0; i < m_hotRows; ++i) {
+            auto sharedRow = m_bpWeights + (m_hotFirst + i) * size;
+            auto cacheRow = &m_hotCache[i * size];
+            auto baseRow = &m_hotBase[i * size];
+            if (m_hotDirty[i] != 0) {
+                // add local updates made since the previous merge, other threads' updates are kept
+                for (std::size_t j = 0; j < size; ++j) {
+                    sharedRow[j] += cacheRow[j] - baseRow[j];
+                }
+                m_hotDirty[i] = 0;
+                if (m_exchange != nullptr) {
+                    m_exchange->touchOutput(m_hotFirst + i);
+                }
+            }
+            std::copy(sharedRow, sharedRow + size, cacheRow);
+            std::copy(cacheRow, cacheRow + size, baseRow);
+        }
+        m_hotUpdates = 0;
+    }
+
+    inline void trainThread_t::addInput(std::size_t _index, const float *_trainMatrix,
+                                        float *_hiddenLayer) const noexcept {
+        auto size = m_sharedData.trainSettings->size;
+        auto row = _trainMatrix + _index * size;
+        if (m_subwords == nullptr) {
+            for (std::size_t k = 0; k < size; ++k) {
+                _hiddenLayer[k] += row[k];
+            }
+            return;
+        }
+
+        auto ngramsBegin = m_subwords->ngramsBegin(_index);
+        auto ngramsEnd = m_subwords->ngramsEnd(_index);
+        auto scale = 1.0f / static_cast<float>(ngramsEnd - ngramsBegin + 1);
+        for (std::size_t k = 0; k < size; ++k) {
+            _hiddenLayer[k] += row[k] * scale;
+        }
+        for (auto i = ngramsBegin; i != ngramsEnd; ++i) {
+            auto ngramRow = m_subwords->vectors() + static_cast<std::size_t>(*i) * size;
+            for (std::size_t k = 0; k < size; ++k) {
+                _hiddenLayer[k] += ngramRow[k] * scale;
+            }
+        }
+    }
+
+    inline void trainThread_t::updateInput(std::size_t _index, float *_trainMatrix, const float *_errors) noexcept {
+        auto size = m_sharedData.trainSettings->size;
+        if (m_subwords == nullptr) {
+            m_inputOptimizer->update(_trainMatrix + _index * size, _index, _errors, 1.0f);
+        } else {
+            // errors are distributed over the averaged rows
+            auto ngramsBegin = m_subwords->ngramsBegin(_index);
+            auto ngramsEnd = m_subwords->ngramsEnd(_index);
+            auto scale = 1.0f / static_cast<float>(ngramsEnd - ngramsBegin + 1);
+            m_inputOptimizer->update(_trainMatrix + _index * size, _index, _errors, scale);
+            for (auto i = ngramsBegin; i != ngramsEnd; ++i) {
+                m_subwordsOptimizer->update(m_subwords->vectors() + static_cast<std::size_t>(*i) * size, *i,
+                                            _errors, scale);
+            }
+        }
+        if (m_exchange != nullptr) {
+            m_exchange->touchInput(_index);
+        }
+    }
+
+    inline void trainThread_t::train(const std::size_t *_sentence, std::size_t _length,
+                                     float *_trainMatrix) noexcept {
+        if (m_sharedData.trainSettings->with_sg) {
+            skipGram(_sentence, _length, _trainMatrix);
+        } else {
+            cbow(_sentence, _length, _trainMatrix);
+        }
+    }
+
+    inline void trainThread_t::cbow(const std::size_t *_sentence, std::size_t _length,
+                                    float *_trainMatrix) noexcept {
+        for (std::size_t i = 0; i < _length; ++i) {
             // hidden layers initialized with 0 values
             std::memset(m_hiddenLayerVals->data(), 0, m_hiddenLayerVals->size() * sizeof(float));
             std::memset(m_hiddenLayerErrors->data(), 0, m_hiddenLayerErrors->size() * sizeof(float));
@@ -129,26 +549,24 @@ namespace wordvec {
                 }
 
                 auto posRndWindow = i - m_sharedData.trainSettings->window + j;
-                if (posRndWindow >= _sentence.size()) {
+                if (posRndWindow >= _length) {
                     continue;
                 }
-                for (std::size_t k = 0; k < m_sharedData.trainSettings->size; ++k) {
-                    (*m_hiddenLayerVals)[k] += _trainMatrix[k + _sentence[posRndWindow]->index
-                                                           * m_sharedData.trainSettings->size];
-                }
+                addInput(_sentence[posRndWindow], _trainMatrix, m_hiddenLayerVals->data());
                 cw++;
             }
             if (cw == 0) {
                 continue;
             }
+            m_pairs++;
             for (std::size_t j = 0; j < m_sharedData.trainSettings->size; j++) {
                 (*m_hiddenLayerVals)[j] /= cw;
             }
 
             if (m_sharedData.trainSettings->with_hs) {
-                hierarchicalSoftmax(_sentence[i]->index, *m_hiddenLayerErrors, *m_hiddenLayerVals, 0);
+                hierarchicalSoftmax(_sentence[i], *m_hiddenLayerErrors, m_hiddenLayerVals->data(), 0);
             } else {
-                negativeSampling(_sentence[i]->index, *m_hiddenLayerErrors, *m_hiddenLayerVals, 0);
+                negativeSampling(_sentence[i], *m_hiddenLayerErrors, m_hiddenLayerVals->data(), 0);
             }
 
             // hidden -> in
@@ -158,20 +576,17 @@ namespace wordvec {
                 }
 
                 auto posRndWindow = i - m_sharedData.trainSettings->window + j;
-                if (posRndWindow >= _sentence.size()) {
+                if (posRndWindow >= _length) {
                     continue;
                 }
-                for (std::size_t k = 0; k < m_sharedData.trainSettings->size; ++k) {
-                    _trainMatrix[k + _sentence[posRndWindow]->index * m_sharedData.trainSettings->size]
-                            += (*m_hiddenLayerErrors)[k];
-                }
+                updateInput(_sentence[posRndWindow], _trainMatrix, m_hiddenLayerErrors->data());
             }
         }
     }
 
-    inline void trainThread_t::skipGram(const std::vector<const vocabulary_t::wordData_t *> &_sentence,
-                                        std::vector<float> &_trainMatrix) noexcept {
-        for (std::size_t i = 0; i < _sentence.size(); ++i) {
+    inline void trainThread_t::skipGram(const std::size_t *_sentence, std::size_t _length,
+                                        float *_trainMatrix) noexcept {
+        for (std::size_t i = 0; i < _length; ++i) {
             auto rndShift = m_rndWindowShift(m_randomGenerator);
             for (auto j = rndShift; j < m_sharedData.trainSettings->window * 2 + 1 - rndShift; ++j) {
                 if (j == m_sharedData.trainSettings->window) {
@@ -179,39 +594,102 @@ namespace wordvec {
                 }
 
                 auto posRndWindow = i - m_sharedData.trainSettings->window + j;
-                if (posRndWindow >= _sentence.size()) {
+                if (posRndWindow >= _length) {
                     continue;
                 }
                 // shift to the selected word vector in the matrix
-                auto shift = _sentence[posRndWindow]->index * m_sharedData.trainSettings->size;
+                const float *trainLayer = _trainMatrix;
+                auto shift = _sentence[posRndWindow] * m_sharedData.trainSettings->size;
+                if (m_subwords != nullptr) {
+                    // word vector is composed of the word row and its n-grams vectors
+                    std::memset(m_hiddenLayerVals->data(), 0, m_hiddenLayerVals->size() * sizeof(float));
+                    addInput(_sentence[posRndWindow], _trainMatrix, m_hiddenLayerVals->data());
+                    trainLayer = m_hiddenLayerVals->data();
+                    shift = 0;
+                }
+                m_pairs++;
 
                 // hidden layer initialized with 0 values
                 std::memset(m_hiddenLayerErrors->data(), 0, m_hiddenLayerErrors->size() * sizeof(float));
 
                 if (m_sharedData.trainSettings->with_hs) {
-                    hierarchicalSoftmax(_sentence[i]->index, (*m_hiddenLayerErrors), _trainMatrix, shift);
+                    hierarchicalSoftmax(_sentence[i], (*m_hiddenLayerErrors), trainLayer, shift);
                 } else {
-                    negativeSampling(_sentence[i]->index, (*m_hiddenLayerErrors), _trainMatrix, shift);
+                    negativeSampling(_sentence[i], (*m_hiddenLayerErrors), trainLayer, shift);
                 }
 
-                for (std::size_t k = 0; k < m_sharedData.trainSettings->size; ++k) {
-                    _trainMatrix[k + shift] += (*m_hiddenLayerErrors)[k];
+                updateInput(_sentence[posRndWindow], _trainMatrix, m_hiddenLayerErrors->data());
+            }
+        }
+    }
+
+    inline void trainThread_t::document(std::size_t _document, const std::size_t *_sentence, std::size_t _length,
+                                        float *_trainMatrix) noexcept {
+        auto documentRow = m_documents->vectors() + _document * m_sharedData.trainSettings->size;
+        for (std::size_t i = 0; i < _length; ++i) {
+            const float *trainLayer = documentRow;
+            auto rndShift = m_rndWindowShift(m_randomGenerator);
+            if (m_sharedData.trainSettings->with_dm) {
+                // hidden layer is the average of the document vector and the word context
+                std::copy(documentRow, documentRow + m_sharedData.trainSettings->size, m_hiddenLayerVals->data());
+                std::size_t cw = 1;
+                for (auto j = rndShift; j < m_sharedData.trainSettings->window * 2 + 1 - rndShift; ++j) {
+                    if (j == m_sharedData.trainSettings->window) {
+                        continue;
+                    }
+
+                    auto posRndWindow = i - m_sharedData.trainSettings->window + j;
+                    if (posRndWindow >= _length) {
+                        continue;
+                    }
+                    addInput(_sentence[posRndWindow], _trainMatrix, m_hiddenLayerVals->data());
+                    cw++;
+                }
+                for (std::size_t j = 0; j < m_sharedData.trainSettings->size; j++) {
+                    (*m_hiddenLayerVals)[j] /= cw;
                 }
+                trainLayer = m_hiddenLayerVals->data();
+            }
+            m_pairs++;
+
+            // hidden layer initialized with 0 values
+            std::memset(m_hiddenLayerErrors->data(), 0, m_hiddenLayerErrors->size() * sizeof(float));
+
+            if (m_sharedData.trainSettings->with_hs) {
+                hierarchicalSoftmax(_sentence[i], (*m_hiddenLayerErrors), trainLayer, 0);
+            } else {
+                negativeSampling(_sentence[i], (*m_hiddenLayerErrors), trainLayer, 0);
+            }
+
+            m_documentsOptimizer->update(documentRow, _document, m_hiddenLayerErrors->data(), 1.0f);
+            if (!m_sharedData.trainSettings->with_dm || m_frozen) {
+                continue;
+            }
+            for (auto j = rndShift; j < m_sharedData.trainSettings->window * 2 + 1 - rndShift; ++j) {
+                if (j == m_sharedData.trainSettings->window) {
+                    continue;
+                }
+
+                auto posRndWindow = i - m_sharedData.trainSettings->window + j;
+                if (posRndWindow >= _length) {
+                    continue;
+                }
+                updateInput(_sentence[posRndWindow], _trainMatrix, m_hiddenLayerErrors->data());
             }
         }
     }
 
     inline void trainThread_t::hierarchicalSoftmax(std::size_t _index,
                                                    std::vector<float> &_hiddenLayer,
-                                                   std::vector<float> &_trainLayer,
+                                                   const float *_trainLayer,
                                                    std::size_t _trainLayerShift) noexcept {
         auto huffmanData = m_sharedData.huffmanTree->huffmanData(_index);
         for (std::size_t i = 0; i < huffmanData->huffmanCode.size(); ++i) {
-            auto l2 = huffmanData->huffmanPoint[i] * m_sharedData.trainSettings->size;
+            auto outputLayer = outputRow(huffmanData->huffmanPoint[i]);
             // Propagate hidden -> output
             float f = 0.0f;
             for (std::size_t j = 0; j < m_sharedData.trainSettings->size; ++j) {
-                f += _trainLayer[j + _trainLayerShift] * (*m_sharedData.bpWeights)[j + l2];
+                f += _trainLayer[j + _trainLayerShift] * outputLayer[j];
             }
             if (f < -m_sharedData.trainSettings->table_max) {
 //            f = 0.0f;
@@ -226,21 +704,28 @@ namespace wordvec {
                                                                          2))];
             }
 
-            auto gradientXalpha = (1.0f - static_cast<float>(huffmanData->huffmanCode[i]) - f) * (*m_sharedData.alpha);
+            sampleLoss(f, huffmanData->huffmanCode[i] == 0);
+            auto gradient = (1.0f - static_cast<float>(huffmanData->huffmanCode[i]) - f)
+                            * m_outputOptimizer->errorScale();
             // Propagate errors output -> hidden
             for (std::size_t j = 0; j < m_sharedData.trainSettings->size; ++j) {
-                _hiddenLayer[j] += gradientXalpha * (*m_sharedData.bpWeights)[j + l2];
+                _hiddenLayer[j] += gradient * outputLayer[j];
+            }
+            if (m_frozen) {
+                continue;
             }
             // Learn weights hidden -> output
-            for (std::size_t j = 0; j < m_sharedData.trainSettings->size; ++j) {
-                (*m_sharedData.bpWeights)[j + l2] += gradientXalpha * _trainLayer[j + _trainLayerShift];
+            m_outputOptimizer->update(outputLayer, huffmanData->huffmanPoint[i],
+                                      _trainLayer + _trainLayerShift, gradient);
+            if ((m_exchange != nullptr) && !cached(huffmanData->huffmanPoint[i])) {
+                m_exchange->touchOutput(huffmanData->huffmanPoint[i]); // cached rows are touched on merge
             }
         }
     }
 
     inline void trainThread_t::negativeSampling(std::size_t _index,
                                                 std::vector<float> &_hiddenLayer,
-                                                std::vector<float> &_trainLayer,
+                                                const float *_trainLayer,
                                                 std::size_t _trainLayerShift) noexcept {
         for (std::size_t i = 0; i < static_cast<std::size_t>(m_sharedData.trainSettings->negative) + 1; ++i) {
             std::size_t target = 0;
@@ -255,11 +740,11 @@ namespace wordvec {
                 }
             }
 
-            auto l2 = target * m_sharedData.trainSettings->size;
+            auto outputLayer = outputRow(target);
             // Propagate hidden -> output
             float f = 0.0f;
             for (std::size_t j = 0; j < m_sharedData.trainSettings->size; ++j) {
-                f += _trainLayer[j + _trainLayerShift] * (*m_sharedData.bpWeights)[j + l2];
+                f += _trainLayer[j + _trainLayerShift] * outputLayer[j];
             }
             if (f < -m_sharedData.trainSettings->table_max) {
                 f = 0.0f;  // original approach
@@ -274,14 +759,19 @@ namespace wordvec {
                                                                          2))];
             }
 
-            auto gradientXalpha = (static_cast<float>(label) - f) * (*m_sharedData.alpha);
+            sampleLoss(f, label);
+            auto gradient = (static_cast<float>(label) - f) * m_outputOptimizer->errorScale();
             // Propagate errors output -> hidden
             for (std::size_t j = 0; j < m_sharedData.trainSettings->size; ++j) {
-                _hiddenLayer[j] += gradientXalpha * (*m_sharedData.bpWeights)[j + l2];
+                _hiddenLayer[j] += gradient * outputLayer[j];
+            }
+            if (m_frozen) {
+                continue;
             }
             // Learn weights hidden -> output
-            for (std::size_t j = 0; j < m_sharedData.trainSettings->size; ++j) {
-                (*m_sharedData.bpWeights)[j + l2] += gradientXalpha * _trainLayer[j + _trainLayerShift];
+            m_outputOptimizer->update(outputLayer, target, _trainLayer + _trainLayerShift, gradient);
+            if ((m_exchange != nullptr) && !cached(target)) {
+                m_exchange->touchOutput(target); // cached rows are touched on merge
             }
         }
     }
@@ -14,6 +14,16 @@
 #include "huffman.hpp"
 #include "nsDistribution.hpp"
 #include "downSampling.hpp"
+#include "optimizer.hpp"
+#include "subwords.hpp"
+#include "documents.hpp"
+#include "corpus.hpp"
+#include "sentenceQueue.hpp"
+#include "checkpoint.hpp"
+#include "matrix.hpp"
+#include "telemetry.hpp"
+#include "exchange.hpp"
+#include "topology.hpp"
 
 namespace wordvec {
     /**
@@ -24,6 +34,17 @@ namespace wordvec {
      *  speedup training - Hierarchical Softmax (HS) and Negative Sampling (NS).
      *  It is possible to choose any of the following algorithms combination - CBOW/HS or CBOW/NS or Skip-Gram/HS or
      *  Skip-Gram/NS.
+     *  In paragraph vectors mode each thread trains vectors of its own range of documents (train data set lines):
+     *  PV-DBOW predicts document words by the document vector, PV-DM predicts a word by the average of the document
+     *  vector and the word context. Words vectors and back propagation weights may be frozen to infer vectors of
+     *  new documents.
+     *  In corpus mode sentences are read from the train data set encoded in memory, so several models are trained
+     *  on one tokenized copy of the data set, each thread trains its own range of sentences.
+     *  If subwords are enabled, input word vector is the average of the word row and its n-grams bucket vectors.
+     *  Optionally each thread keeps private copies of the hot_rows most frequently updated back propagation weights
+     *  rows (the most frequent words for NS, the Huffman tree nodes closest to the root for HS). Updates of these
+     *  rows are accumulated in the copies and merged into the shared matrix every hot_rows_sync updates, so threads
+     *  do not fight for the same cache lines.
     */
     class trainThread_t final {
     public:
@@ -34,16 +55,44 @@ namespace wordvec {
             std::shared_ptr<train_setting_t> trainSettings; ///< trainSettings structure
             std::shared_ptr<vocabulary_t> vocabulary; ///< words data
             std::shared_ptr<file_mapper_t> fileMapper; ///< train data file access object
-            std::shared_ptr<std::vector<float>> bpWeights; ///< back propagation weights
+            std::shared_ptr<trainMatrices_t> matrices; ///< input matrix and back propagation weights
             std::shared_ptr<std::vector<float>> expTable; ///< exp(x) / (exp(x) + 1) values lookup table
             std::shared_ptr<huffmanTree_t> huffmanTree; ///< Huffman tree used by hierarchical softmax
             std::shared_ptr<std::atomic<std::size_t>> processedWords; ///< total words processed by train threads
             std::shared_ptr<std::atomic<float>> alpha; ///< current learning rate
+            std::shared_ptr<rowOptimizer_t> inputOptimizer; ///< input matrix optimizer
+            std::shared_ptr<rowOptimizer_t> outputOptimizer; ///< back propagation weights optimizer
+            std::shared_ptr<subwords_t> subwords; ///< words n-grams and their bucket vectors, may be nullptr
+            std::shared_ptr<rowOptimizer_t> subwordsOptimizer; ///< bucket vectors optimizer, may be nullptr
+            std::shared_ptr<documents_t> documents; ///< paragraph vectors mode documents, may be nullptr
+            std::shared_ptr<rowOptimizer_t> documentsOptimizer; ///< document vectors optimizer, may be nullptr
+            std::shared_ptr<corpus_t> corpus; ///< encoded train data set in corpus mode, may be nullptr
+            std::shared_ptr<std::vector<int>> cpus; ///< CPU each train thread is pinned to, may be nullptr
             std::function<void(float, float)> progressCallback = nullptr; ///< callback with alpha and training percent
+            std::shared_ptr<sentenceQueue_t> sentenceQueue; ///< encoded sentences source in pipelined mode
+            std::shared_ptr<checkpoint_t> resumeFrom; ///< checkpoint the training is resumed from
+            std::shared_ptr<checkpointer_t> checkpointer; ///< periodic checkpoints writer
+            std::shared_ptr<epochMonitor_t> epochMonitor; ///< per epoch page faults counter
+            std::shared_ptr<telemetry_t> telemetry; ///< train threads counters, may be nullptr
+            std::shared_ptr<exchange_t> exchange; ///< distributed training parameter exchange, may be nullptr
         };
 
     private:
         sharedData_t m_sharedData;
+        const uint16_t m_id;
+        float *m_bpWeights = nullptr;
+        rowOptimizer_t *m_inputOptimizer = nullptr;
+        rowOptimizer_t *m_outputOptimizer = nullptr;
+        subwords_t *m_subwords = nullptr;
+        rowOptimizer_t *m_subwordsOptimizer = nullptr;
+        documents_t *m_documents = nullptr;
+        rowOptimizer_t *m_documentsOptimizer = nullptr;
+        bool m_frozen = false;
+        std::size_t m_firstDocument = 0;
+        std::size_t m_lastDocument = 0;
+        const corpus_t *m_corpus = nullptr;
+        std::size_t m_firstSentence = 0;
+        std::size_t m_lastSentence = 0;
 
         std::random_device m_randomDevice;
         std::mt19937_64 m_randomGenerator;
@@ -53,6 +102,23 @@ namespace wordvec {
         std::unique_ptr<std::vector<float>> m_hiddenLayerVals;
         std::unique_ptr<std::vector<float>> m_hiddenLayerErrors;
         std::unique_ptr<word_reader_t<file_mapper_t>> m_wordReader;
+        std::vector<std::size_t> m_sentence;
+        uint8_t m_iterations = 0;
+        off_t m_resumeOffset = -1;
+        std::size_t m_processedWords = 0;
+        uint32_t m_checkpointGeneration = 0;
+        telemetry_t::counters_t *m_counters = nullptr;
+        exchange_t *m_exchange = nullptr;
+        std::size_t m_pairs = 0;
+        std::size_t m_lossCounter = 0;
+        std::size_t m_lossSamples = 0;
+        double m_lossSum = 0.0;
+        std::size_t m_hotFirst = 0;
+        std::size_t m_hotRows = 0;
+        std::size_t m_hotUpdates = 0;
+        std::vector<float> m_hotCache;
+        std::vector<float> m_hotBase;
+        std::vector<uint8_t> m_hotDirty;
         std::unique_ptr<std::thread> m_thread;
 
     public:
@@ -61,14 +127,14 @@ namespace wordvec {
          * @param _id thread ID, starting from 0
          * @param _sharedData sharedData object instantiated outside of the thread
         */
-        trainThread_t(uint8_t _id, const sharedData_t &_sharedData);
+        trainThread_t(uint16_t _id, const sharedData_t &_sharedData);
 
-        /**
-         * Launchs the thread
-         * @param[out] _trainMatrix - train model matrix
-        */
-        void launch(std::vector<float> &_trainMatrix) noexcept {
-            m_thread.reset(new std::thread(&trainThread_t::worker, this, std::ref(_trainMatrix)));
+        /// Launchs the thread, pins it to its CPU if the placement is set
+        void launch() noexcept {
+            m_thread.reset(new std::thread(&trainThread_t::worker, this));
+            if (m_sharedData.cpus && (m_id < m_sharedData.cpus->size())) {
+                topology_t::pin(*m_thread, (*m_sharedData.cpus)[m_id]);
+            }
         }
         /// Joins to the thread
         void join() noexcept {
@@ -76,18 +142,36 @@ namespace wordvec {
         }
 
     private:
-        void worker(std::vector<float> &_trainMatrix) noexcept;
+        void worker() noexcept;
+        void pipelinedWorker(float *_trainMatrix) noexcept;
+        void documentsWorker(float *_trainMatrix) noexcept;
+        void corpusWorker(float *_trainMatrix) noexcept;
 
-        inline void cbow(const std::vector<const vocabulary_t::wordData_t *> &_sentence,
-                         std::vector<float> &_trainMatrix) noexcept;
-        inline void skipGram(const std::vector<const vocabulary_t::wordData_t *> &_sentence,
-                             std::vector<float> &_trainMatrix) noexcept;
+        inline void updateAlpha(std::size_t _processedWords, std::size_t _wordsPerAllThreads) noexcept;
+        inline checkpoint_t::threadState_t state(uint8_t _iteration, off_t _offset) const noexcept;
+        inline std::size_t timestamp() const noexcept;
+        inline void publish(std::size_t _words, std::size_t _trainedWords,
+                            std::size_t _readTime, std::size_t _trainTime) noexcept;
+        inline void sampleLoss(float _f, bool _label) noexcept;
+        inline bool cached(std::size_t _index) const noexcept;
+        inline float *outputRow(std::size_t _index) noexcept;
+        void mergeHotRows() noexcept;
+        inline void addInput(std::size_t _index, const float *_trainMatrix, float *_hiddenLayer) const noexcept;
+        inline void updateInput(std::size_t _index, float *_trainMatrix, const float *_errors) noexcept;
+        inline void train(const std::size_t *_sentence, std::size_t _length,
+                          float *_trainMatrix) noexcept;
+        inline void cbow(const std::size_t *_sentence, std::size_t _length,
+                         float *_trainMatrix) noexcept;
+        inline void skipGram(const std::size_t *_sentence, std::size_t _length,
+                             float *_trainMatrix) noexcept;
+        inline void document(std::size_t _document, const std::size_t *_sentence, std::size_t _length,
+                             float *_trainMatrix) noexcept;
         inline void  hierarchicalSoftmax(std::size_t _index,
                                          std::vector<float> &_hiddenLayer,
-                                         std::vector<float> &_trainLayer, std::size_t _trainLayerShift) noexcept;
+                                         const float *_trainLayer, std::size_t _trainLayerShift) noexcept;
         inline void negativeSampling(std::size_t _index,
                                      std::vector<float> &_hiddenLayer,
-                                     std::vector<float> &_trainLayer, std::size_t _trainLayerShift) noexcept;
+                                     const float *_trainLayer, std::size_t _trainLayerShift) noexcept;
     };
 
 }
@@ -34,6 +34,8 @@ int main(int argc, char * const *argv) {
 //        ifs.exceptions(std::ifstream::failbit | std::ifstream::badbit);
         ifs.exceptions(std::ifstream::failbit);
         ifs.open(argv[2]);
+        // end of file sets failbit too, so exceptions are used to detect open failure only
+        ifs.exceptions(std::ifstream::goodbit);
     } catch (...) {
         std::cerr << "Can not open file: " << argv[2] << std::endl;
         return 2;
@@ -44,13 +46,9 @@ int main(int argc, char * const *argv) {
     std::size_t testSets = 0;
     std::size_t sectionSets = 0;
     std::string word1, word2, word3, word4;
-    while (!ifs.eof()) {
+    while (ifs >> word1) {
         std::size_t idx = 0;
         std::size_t pos = model->modelSize();
-        ifs >> word1;
-        if (word1.empty()) {
-            continue;
-        }
         if (word1 == ":") {
             if (sectionAccuracy > 0.0f) {
                 sectionAccuracy = std::sqrt(sectionAccuracy / sectionSets);
@@ -63,9 +61,8 @@ int main(int argc, char * const *argv) {
             std::cout << sectionName << std::endl;
             continue;
         }
-        ifs >> word2 >> word3 >> word4;
-        if (word2.empty() || word3.empty() || word4.empty()) {
-            continue;
+        if (!(ifs >> word2 >> word3 >> word4)) {
+            break;
         }
         std::transform(word1.begin(), word1.end(), word1.begin(), tolower);
         std::transform(word2.begin(), word2.end(), word2.begin(), tolower);
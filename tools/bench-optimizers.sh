@@ -0,0 +1,47 @@
+#!/bin/sh
+# Time to accuracy of SGD, AdaGrad and Adam on the same corpus. Each optimizer trains models of 1..<epochs>
+# iterations with the same settings, wv-accuracy scores every model on the analogies test set. Train time is
+# the wall time of wv-trainer, vocabulary building included.
+#
+# Usage: tools/bench-optimizers.sh <train_file> <analogies_test_set_file> [epochs] [threads]
+# Environment: BIN_DIR - directory of wv-trainer and wv-accuracy (default bin), TRAIN_OPTIONS - more
+# wv-trainer options shared by all runs (e.g. "-g -s 300"), WORK_DIR - models directory (default /tmp)
+
+if [ $# -lt 2 ]; then
+    sed -n '2,8p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+
+trainFile=$1
+testSet=$2
+epochs=${3:-3}
+threads=${4:-$(nproc)}
+binDir=${BIN_DIR:-bin}
+workDir=${WORK_DIR:-/tmp}
+model="$workDir/bench-optimizers.$$.bin"
+
+# optimizer and its starting learning rate, adaptive methods need smaller rates
+runs="sgd:0.05 adagrad:0.05 adam:0.005"
+
+printf "%-8s %-6s %-6s %10s %10s\n" optimizer alpha epochs seconds accuracy
+for run in $runs; do
+    optimizer=${run%%:*}
+    alpha=${run#*:}
+    epoch=1
+    while [ "$epoch" -le "$epochs" ]; do
+        start=$(date +%s.%N)
+        # shellcheck disable=SC2086
+        if ! "$binDir/wv-trainer" -f "$trainFile" -o "$model" -t "$threads" -i "$epoch" -O "$optimizer" \
+                -a "$alpha" $TRAIN_OPTIONS > /dev/null; then
+            echo "wv-trainer failed: $optimizer, $epoch epochs" >&2
+            rm -f "$model"
+            exit 2
+        fi
+        finish=$(date +%s.%N)
+        accuracy=$("$binDir/wv-accuracy" "$model" "$testSet" | sed -n 's/^Model accuracy: //p')
+        printf "%-8s %-6s %-6s %10.2f %10s\n" "$optimizer" "$alpha" "$epoch" \
+            "$(echo "$start $finish" | awk '{print $2 - $1}')" "${accuracy:-n/a}"
+        epoch=$((epoch + 1))
+    done
+done
+rm -f "$model"
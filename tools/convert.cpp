@@ -0,0 +1,82 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+
+namespace {
+    double seconds(const std::chrono::steady_clock::time_point &_start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+}
+
+int main(int argc, char * const *argv) {
+    // --time reports load and save wall times
+    auto timed = (argc > 1) && (std::string(argv[1]) == "--time");
+    auto program = argv[0];
+    if (timed) {
+        --argc;
+        ++argv;
+    }
+    const std::vector<std::string> formats = {"native", "native-fp16", "native-int8", "native-pq", "native-opq",
+                                              "word2vec"};
+    std::string format = (argc > 1) ? argv[1] : "";
+    if ((argc < 4) || (argc > 5) || (std::find(formats.begin(), formats.end(), format) == formats.end())) {
+        std::cerr << "Usage:" << std::endl
+                  << program << " [--time] [native|native-fp16|native-int8|native-pq|native-opq|word2vec] "
+                  << "[input_model_file_name] [output_model_file_name] [max_words]" << std::endl
+                  << "\tConverts word2vec binary, word2vec/GloVe text or indexed native model file (detected by" << std::endl
+                  << "\tits header) to the specified format. Vectors of native files are stored normalized," << std::endl
+                  << "\tnative-fp16 and native-int8 files keep a quantized copy of the vectors as well." << std::endl
+                  << "\tnative-pq and native-opq (rotated) files keep product quantization codes only," << std::endl
+                  << "\tone byte per 4 vector values." << std::endl
+                  << "\tOptional max_words keeps the first words only, the most frequent ones of frequency ordered"
+                  << std::endl << "\tfiles. --time prints load and save wall times, e.g. to compare loaders of two"
+                  << std::endl << "\tbuilds" << std::endl;
+        return 1;
+    }
+
+    try {
+        wordvec::load_setting_t loadSettings;
+        if (argc == 5) {
+            loadSettings.max_words = std::stoul(argv[4]);
+        }
+        if (format == "native-fp16") {
+            loadSettings.storage = wordvec::storage_t::fp16;
+        } else if (format == "native-int8") {
+            loadSettings.storage = wordvec::storage_t::int8;
+        } else if ((format == "native-pq") || (format == "native-opq")) {
+            loadSettings.storage = wordvec::storage_t::pq;
+            loadSettings.pq.rotation = (format == "native-opq");
+        }
+        std::unique_ptr<wordvec::w2vModel_t> model(new wordvec::w2vModel_t());
+        auto start = std::chrono::steady_clock::now();
+        if (!model->load(argv[2], loadSettings)) {
+            throw std::runtime_error(model->errMsg());
+        }
+        auto loadSeconds = seconds(start);
+        start = std::chrono::steady_clock::now();
+        auto saved = (format == "word2vec") ? model->save(argv[3]) : model->saveNative(argv[3]);
+        if (!saved) {
+            throw std::runtime_error(model->errMsg());
+        }
+        auto saveSeconds = seconds(start);
+        std::cout << model->modelSize() << " words, vector size " << model->vectorSize()
+                  << (model->withSubwords() ? ", with n-grams vectors" : "") << std::endl;
+        if (timed) {
+            std::cout << "loaded in " << std::fixed << std::setprecision(3) << loadSeconds << " s, saved in "
+                      << saveSeconds << " s" << std::endl;
+        }
+    } catch (const std::exception &_e) {
+        std::cerr << _e.what() << std::endl;
+        return 2;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
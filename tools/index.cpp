@@ -0,0 +1,187 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+
+namespace {
+    const std::size_t nearestAmount = 10;
+    const std::vector<uint16_t> efValues = {16, 32, 64, 128, 256, 512};
+    const std::vector<uint16_t> nprobeValues = {1, 2, 4, 8, 16, 32, 64};
+    const std::vector<uint16_t> rerankValues = {1, 2, 4, 8, 16, 32, 64};
+    const std::vector<uint16_t> quantizedRerankValues = {0, 1, 2, 4, 8, 16};
+
+    double seconds(const std::chrono::steady_clock::time_point &_start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+}
+
+int main(int argc, char * const *argv) {
+    if ((argc < 3) || (argc > 7)) {
+        std::cerr << "Usage:" << std::endl
+                  << argv[0] << " [model_file_name] [index_file_name] [hnsw|ivf|ivfpq|simhash] [m|lists|bits]"
+                  << " [ef_construction] [queries]" << std::endl
+                  << argv[0] << " [model_file_name] - [fp16|int8|pq|opq] [subspaces] [-] [queries]" << std::endl
+                  << "\tBuilds HNSW graph, inverted file, inverted file with pq residuals or SimHash codes index of"
+                  << std::endl
+                  << "\tword2vec or native model file by all cores and saves it. Recall@" << nearestAmount
+                  << " and latency of index search are" << std::endl
+                  << "\tcompared with exact search for several ef (nprobe, rerank) values on vocabulary words queries"
+                  << std::endl
+                  << "\t(default hnsw, m 16, ef_construction 200, square root of words lists, 256 bits, 200 queries)."
+                  << std::endl
+                  << "\tThe second form quantizes rows of the model instead and compares recall, latency and rows"
+                  << std::endl
+                  << "\tmemory of the quantized search with fp32 exact search for several rerank values" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::string type = (argc > 3) ? argv[3] : "hnsw";
+        auto quantized = (type == "fp16") || (type == "int8") || (type == "pq") || (type == "opq");
+        if ((type != "hnsw") && (type != "ivf") && (type != "ivfpq") && (type != "simhash") && !quantized) {
+            throw std::runtime_error("unknown index type " + type);
+        }
+        wordvec::pq_setting_t pqSettings;
+        pqSettings.rotation = (type == "opq");
+        wordvec::hnsw_setting_t hnswSettings;
+        wordvec::ivf_setting_t ivfSettings;
+        ivfSettings.with_pq = (type == "ivfpq");
+        wordvec::simhash_setting_t simhashSettings;
+        if ((argc > 4) && (std::string(argv[4]) != "-")) {
+            hnswSettings.m = static_cast<uint16_t>(std::stoul(argv[4]));
+            ivfSettings.lists = static_cast<uint32_t>(std::stoul(argv[4]));
+            simhashSettings.bits = static_cast<uint16_t>(std::stoul(argv[4]));
+            pqSettings.subspaces = static_cast<uint16_t>(std::stoul(argv[4]));
+        }
+        if ((argc > 5) && !quantized) {
+            hnswSettings.ef_construction = static_cast<uint16_t>(std::stoul(argv[5]));
+        }
+        std::size_t queries = (argc > 6) ? std::stoul(argv[6]) : 200;
+
+        std::unique_ptr<wordvec::w2vModel_t> model(new wordvec::w2vModel_t());
+        if (!model->load(argv[1])) {
+            throw std::runtime_error(model->errMsg());
+        }
+        queries = std::min(queries, model->modelSize());
+        if (queries == 0) {
+            throw std::runtime_error("model is empty");
+        }
+
+        // queries are spread over the vocabulary, frequent and rare words are queried
+        std::vector<std::size_t> ids(queries);
+        std::vector<std::vector<std::pair<std::string, float>>> exact(queries);
+        for (std::size_t i = 0; i < queries; ++i) {
+            ids[i] = i * model->modelSize() / queries;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < queries; ++i) {
+            model->nearest(model->vectorAt(ids[i]), exact[i], nearestAmount);
+        }
+        auto exactMs = seconds(start) * 1000.0 / static_cast<double>(queries);
+
+        // recall of the nearest() results and their latency compared with exact search
+        std::vector<std::pair<std::string, float>> found;
+        auto measure = [&](double &_recall, double &_ms) {
+            std::size_t matches = 0;
+            std::size_t total = 0;
+            double searchSeconds = 0.0;
+            for (std::size_t i = 0; i < queries; ++i) {
+                start = std::chrono::steady_clock::now();
+                model->nearest(model->vectorAt(ids[i]), found, nearestAmount);
+                searchSeconds += seconds(start);
+                for (auto const &j:exact[i]) {
+                    matches += std::any_of(found.begin(), found.end(), [&j](const std::pair<std::string, float> &_f) {
+                        return _f.first == j.first;
+                    }) ? 1 : 0;
+                }
+                total += exact[i].size();
+            }
+            _recall = (total > 0) ? static_cast<double>(matches) / static_cast<double>(total) : 1.0;
+            _ms = searchSeconds * 1000.0 / static_cast<double>(queries);
+        };
+        auto printRow = [](const std::string &_name, double _recall, double _ms) {
+            std::cout << std::setw(8) << _name << std::setw(12) << std::setprecision(4) << _recall
+                      << std::setw(12) << std::setprecision(3) << _ms << std::endl;
+        };
+
+        if (quantized) {
+            start = std::chrono::steady_clock::now();
+            auto done = (type == "fp16") ? model->quantize(wordvec::storage_t::fp16)
+                        : (type == "int8") ? model->quantize(wordvec::storage_t::int8)
+                        : model->quantize(pqSettings);
+            if (!done) {
+                throw std::runtime_error(model->errMsg());
+            }
+            auto quantizeSeconds = seconds(start);
+            auto fp32Bytes = model->modelSize() * model->vectorSize() * sizeof(float);
+            auto rowsBytes = model->quantizedBytes();
+            std::cout << model->modelSize() << " words, vector size " << model->vectorSize() << ", quantized in "
+                      << std::fixed << std::setprecision(1) << quantizeSeconds << " s" << std::endl
+                      << "rows memory: fp32 " << std::setprecision(2) << static_cast<double>(fp32Bytes) / 1048576.0
+                      << " MB, " << type << " " << static_cast<double>(rowsBytes) / 1048576.0 << " MB ("
+                      << std::setprecision(1) << static_cast<double>(fp32Bytes) / static_cast<double>(rowsBytes)
+                      << "x smaller)" << std::endl
+                      << std::setw(8) << "rerank" << std::setw(12) << "recall" << std::setw(12) << "ms/query"
+                      << std::endl;
+            printRow("exact", 1.0, exactMs);
+            for (auto const &rerank:quantizedRerankValues) {
+                model->quantizedRerank(rerank);
+                double recall = 0.0;
+                double ms = 0.0;
+                measure(recall, ms);
+                printRow(std::to_string(rerank), recall, ms);
+            }
+
+            return 0;
+        }
+
+        start = std::chrono::steady_clock::now();
+        auto built = false;
+        if (type == "hnsw") {
+            built = model->buildIndex(hnswSettings);
+        } else if (type == "simhash") {
+            built = model->buildIndex(simhashSettings);
+        } else {
+            built = model->buildIndex(ivfSettings);
+        }
+        if (!built) {
+            throw std::runtime_error(model->errMsg());
+        }
+        auto buildSeconds = seconds(start);
+        if (!model->saveIndex(argv[2])) {
+            throw std::runtime_error(model->errMsg());
+        }
+        std::string breadthName = "nprobe";
+        auto breadthValues = nprobeValues;
+        if (type == "hnsw") {
+            breadthName = "ef";
+            breadthValues = efValues;
+        } else if (type == "simhash") {
+            breadthName = "rerank";
+            breadthValues = rerankValues;
+        }
+        std::cout << model->modelSize() << " words, vector size " << model->vectorSize() << ", index built in "
+                  << std::fixed << std::setprecision(1) << buildSeconds << " s" << std::endl
+                  << std::setw(8) << breadthName << std::setw(12) << "recall"
+                  << std::setw(12) << "ms/query" << std::endl;
+        printRow("exact", 1.0, exactMs);
+        for (auto const &breadth:breadthValues) {
+            model->indexBreadth(breadth);
+            double recall = 0.0;
+            double ms = 0.0;
+            measure(recall, ms);
+            printRow(std::to_string(breadth), recall, ms);
+        }
+    } catch (const std::exception &_e) {
+        std::cerr << _e.what() << std::endl;
+        return 2;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <stdexcept>
+
+#include "word_vector.hpp"
+
+// The tool uses load(), key(), vector() and nearest() of the model only, so it builds against older revisions of
+// the library to compare exact search throughput, e.g.:
+// g++ -std=c++11 -O3 -march=native -Iinclude tools/nearest.cpp bin/src/libword-vec.a -pthread -o wv-nearest
+namespace {
+    double seconds(const std::chrono::steady_clock::time_point &_start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+}
+
+int main(int argc, char * const *argv) {
+    if ((argc < 2) || (argc > 4)) {
+        std::cerr << "Usage:" << std::endl
+                  << argv[0] << " [model_file_name] [queries] [amount]" << std::endl
+                  << "\tMeasures single thread throughput of exact nearest words search on vocabulary words queries"
+                  << std::endl
+                  << "\tspread over the vocabulary (default 100 queries, 10 nearest words). The checksum is the sum"
+                  << std::endl
+                  << "\tof found distances, it is the same for implementations returning the same words" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::size_t queries = (argc > 2) ? std::stoul(argv[2]) : 100;
+        std::size_t amount = (argc > 3) ? std::stoul(argv[3]) : 10;
+
+        std::unique_ptr<wordvec::w2vModel_t> model(new wordvec::w2vModel_t());
+        auto start = std::chrono::steady_clock::now();
+        if (!model->load(argv[1])) {
+            throw std::runtime_error(model->errMsg());
+        }
+        auto loadSeconds = seconds(start);
+        if ((model->modelSize() == 0) || (queries == 0)) {
+            throw std::runtime_error("model is empty");
+        }
+
+        std::vector<std::string> words(queries);
+        for (std::size_t i = 0; i < queries; ++i) {
+            words[i] = model->key(i * model->modelSize() / queries);
+        }
+        std::vector<std::pair<std::string, float>> found;
+        // the first query pages the rows in
+        model->nearest(model->vector(words.front()), found, amount);
+
+        double checksum = 0.0;
+        start = std::chrono::steady_clock::now();
+        for (auto const &i:words) {
+            model->nearest(model->vector(i), found, amount);
+            for (auto const &j:found) {
+                checksum += j.second;
+            }
+        }
+        auto searchSeconds = seconds(start);
+
+        std::cout << model->modelSize() << " words, vector size " << model->vectorSize() << ", loaded in "
+                  << std::fixed << std::setprecision(2) << loadSeconds << " s" << std::endl
+                  << queries << " queries, " << amount << " nearest: " << std::setprecision(3)
+                  << searchSeconds * 1000.0 / static_cast<double>(queries) << " ms/query, " << std::setprecision(1)
+                  << static_cast<double>(queries) / searchSeconds << " queries/s, checksum "
+                  << std::setprecision(4) << checksum << std::endl;
+    } catch (const std::exception &_e) {
+        std::cerr << _e.what() << std::endl;
+        return 2;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 
 #include "word_vector.hpp"
 
@@ -40,10 +43,153 @@ static void usage(const char *_name) {
             << "\tSet the word delimiter chars; default is \" \\n,.-!?:;/\\\"#$%&'()*+<=>@[]\\\\^_`{|}~\\t\\v\\f\\r\"" << std::endl
             << "  -e, --end-of-sentence <chars>" << std::endl
             << "\tSet the end of sentence chars; default is \".\\n?!\"" << std::endl
+            << "  -r, --readers <value>" << std::endl
+            << "\tUse <int> dedicated threads to read and encode train data for train threads (pipelined mode);" << std::endl
+            << "\tdefault is 0, train threads read their own parts of train data" << std::endl
+            << "  -q, --queue-size <value>" << std::endl
+            << "\tSet max number of encoded sentence batches waiting for train threads; default is 64" << std::endl
+            << "  -b, --batch-words <value>" << std::endl
+            << "\tSet number of words in an encoded sentence batch; default is 10000" << std::endl
+            << "  -c, --checkpoint-file <file>" << std::endl
+            << "\tPeriodically save training state to <file>, the final state is saved at the end of training" << std::endl
+            << "  -k, --checkpoint-interval <value>" << std::endl
+            << "\tSet interval between checkpoints in seconds; default is 600, 0 - final checkpoint only" << std::endl
+            << "  -R, --resume" << std::endl
+            << "\tResume training from the checkpoint file if it exists, train settings are taken from" << std::endl
+            << "\tthe checkpoint. Train data file must be the same" << std::endl
+            << "  -B, --base-checkpoint <file>" << std::endl
+            << "\tContinue training of a model from its final checkpoint <file> on new train data. Vocabulary" << std::endl
+            << "\tfrequencies are merged, new words are added, vector size and approximation method are taken" << std::endl
+            << "\tfrom the checkpoint. Use -a to set the learning rate for new data" << std::endl
+            << "  -M, --matrix-file <file>" << std::endl
+            << "\tKeep train matrices in memory mapped <file> instead of RAM, for vocabularies larger than RAM." << std::endl
+            << "\tThe file must not exist, it is removed after training or becomes the final checkpoint" << std::endl
+            << "\twithout copying if -c file is on the same file system" << std::endl
+            << "  -S, --stats-file <file>" << std::endl
+            << "\tWrite train threads telemetry (throughput, sampled loss, read/train time) to <file>" << std::endl
+            << "\tas JSON lines" << std::endl
+            << "  -T, --stats-interval <value>" << std::endl
+            << "\tSet telemetry reporting interval in seconds; default is 10, 0 - final report only" << std::endl
+            << "  -V, --vocabulary-file <file>" << std::endl
+            << "\tLoad vocabulary from <file> if it exists, otherwise build it and save to <file>" << std::endl
+            << "  -P, --peers <host:port,...>" << std::endl
+            << "\tDistributed training: comma separated addresses of all trainer processes, each process" << std::endl
+            << "\ttrains on its own train data file (shard) and exchanges updated matrix rows with peers." << std::endl
+            << "\tCommon vocabulary file (-V) is required" << std::endl
+            << "  -N, --rank <int>" << std::endl
+            << "\tIndex of this process address in the peers list; default is 0" << std::endl
+            << "  -Y, --sync-rounds <int>" << std::endl
+            << "\tNumber of parameters exchange rounds during distributed training; default is 100" << std::endl
+            << "  -K, --hot-rows <int>" << std::endl
+            << "\tEach train thread keeps private copies of <int> most frequently updated output rows and merges" << std::endl
+            << "\tthem into the shared matrix periodically, reduces contention of many threads; default is 0" << std::endl
+            << "  -U, --hot-rows-sync <int>" << std::endl
+            << "\tNumber of private rows updates between merges; default is 4096" << std::endl
+            << "  -O, --optimizer <sgd|adagrad|adam>" << std::endl
+            << "\tSet the optimization method: SGD with linearly decayed learning rate, AdaGrad or lazy Adam" << std::endl
+            << "\twith per element learning rates; default is sgd. Adaptive methods need smaller -a values," << std::endl
+            << "\te.g. 0.01 - 0.05 for adagrad and 0.001 - 0.005 for adam" << std::endl
+            << "  -H, --ngram-buckets <int>" << std::endl
+            << "\tRepresent words by their vectors and hashed character n-gram vectors stored in <int> buckets," << std::endl
+            << "\tso vectors of out of vocabulary words can be built from the model; default is 0 (disabled)." << std::endl
+            << "\tCheckpoints and distributed training are not supported with n-grams" << std::endl
+            << "  -j, --min-ngram <int>" << std::endl
+            << "\tSet minimum n-gram length in characters; default is 3" << std::endl
+            << "  -J, --max-ngram <int>" << std::endl
+            << "\tSet maximum n-gram length in characters; default is 6" << std::endl
+            << "  -D, --documents <dbow|dm>" << std::endl
+            << "\tTrain paragraph vectors of documents (PV-DBOW or PV-DM) instead of word vectors. Each line" << std::endl
+            << "\tof the train file is a document, its ID is the line number. Output is a doc2vec model" << std::endl
+            << "  -I, --infer <checkpoint>" << std::endl
+            << "\tInfer paragraph vectors of train file lines with frozen weights of the final <checkpoint>" << std::endl
+            << "\tof paragraph vectors training. Threads, iterations, learning rate and sample are used" << std::endl
+            << "  -G, --with-glove" << std::endl
+            << "\tTrain GloVe vectors on a co-occurrence matrix counted once instead of word2vec ones. Iterations" << std::endl
+            << "\tare passes over the co-occurrence file, optimizer is AdaGrad unless adam is set by -O" << std::endl
+            << "  -X, --glove-x-max <value>" << std::endl
+            << "\tSet co-occurrence count the GloVe weighting function saturates at; default is 100" << std::endl
+            << "  -C, --cooccurrence-file <file>" << std::endl
+            << "\tKeep the co-occurrence file built with -G in <file> and reuse it if it exists and matches the" << std::endl
+            << "\tvocabulary and window, otherwise it is rebuilt; default is a temporary file next to the train file" << std::endl
+            << "  -E, --cooccurrence-memory <value>" << std::endl
+            << "\tSet memory limit of co-occurrence counting in MB, counts are spilled to disk over it; default is 1024" << std::endl
+            << "  -W, --sweep <configs>" << std::endl
+            << "\tTrain several models at once on one vocabulary and one tokenized copy of the train data." << std::endl
+            << "\tConfigurations are separated by ';', each is a comma separated list of size, window, negative," << std::endl
+            << "\tsample, alpha, iter, hs, sg or threads values overriding other options, e.g." << std::endl
+            << "\t\"size=100,window=5;size=200,window=8\". Configurations share -t threads unless threads are set," << std::endl
+            << "\tmodel of N-th configuration is saved to <model-file>.N; -M and checkpoints are not supported" << std::endl
+            << "  -A, --affinity <cores|numa|cpu-list>" << std::endl
+            << "\tPin train threads to CPUs: one thread per physical core spread over NUMA nodes, filling" << std::endl
+            << "\tNUMA nodes one by one, or an explicit CPU list like \"0-7,16\". Topology is read from sysfs," << std::endl
+            << "\tthe layout is written to the telemetry file; default is no pinning" << std::endl
+            << "  -F, --save-mode <mmap|stream>" << std::endl
+            << "\tWrite the model file through a mapping of the pre-sized file or through bounded buffers by pwrite" << std::endl
+            << "\twithout pre-sizing the file (faster on network filesystems); default is mmap" << std::endl
+            << "  -Z, --atomic-save" << std::endl
+            << "\tWrite the model to a temporary file renamed to the model file name when it is complete;" << std::endl
+            << "\tdefault is false" << std::endl
+            << "  -p, --progress-interval <ms>" << std::endl
+            << "\tProgress is reported by a separate thread each <ms> milliseconds, train threads never wait" << std::endl
+            << "\tfor the output; 0 reports from train threads; default is 100" << std::endl
             << "  -v, --verbose " << std::endl
             << "\tShow training process details; default is false" << std::endl;
 }
 
+// parses sweep configurations "key=value,...;key=value,..." applied to the base settings
+static bool sweepSettings(const std::string &_spec, const wordvec::train_setting_t &_base,
+                          std::vector<wordvec::train_setting_t> &_settings) {
+    std::vector<bool> threadsSet;
+    std::istringstream configs(_spec);
+    std::string config;
+    while (std::getline(configs, config, ';')) {
+        wordvec::train_setting_t settings = _base;
+        bool withThreads = false;
+        std::istringstream params(config);
+        std::string param;
+        while (std::getline(params, param, ',')) {
+            auto eq = param.find('=');
+            if (eq == std::string::npos) {
+                return false;
+            }
+            auto key = param.substr(0, eq);
+            auto value = param.substr(eq + 1);
+            if (key == "size") {
+                settings.size = static_cast<uint16_t>(std::stoi(value));
+            } else if (key == "window") {
+                settings.window = static_cast<uint8_t>(std::stoi(value));
+            } else if (key == "negative") {
+                settings.negative = static_cast<uint8_t>(std::stoi(value));
+            } else if (key == "sample") {
+                settings.sample = std::stof(value);
+            } else if (key == "alpha") {
+                settings.alpha = std::stof(value);
+            } else if (key == "iter") {
+                settings.iterations = static_cast<uint8_t>(std::stoi(value));
+            } else if (key == "hs") {
+                settings.with_hs = (std::stoi(value) != 0);
+            } else if (key == "sg") {
+                settings.with_sg = (std::stoi(value) != 0);
+            } else if (key == "threads") {
+                settings.threads = static_cast<uint16_t>(std::stoi(value));
+                withThreads = true;
+            } else {
+                return false;
+            }
+        }
+        _settings.push_back(settings);
+        threadsSet.push_back(withThreads);
+    }
+    // configurations without their own threads number share the base threads
+    for (std::size_t i = 0; i < _settings.size(); ++i) {
+        if (!threadsSet[i]) {
+            _settings[i].threads = static_cast<uint16_t>(std::max<std::size_t>(_base.threads / _settings.size(), 1));
+        }
+    }
+
+    return !_settings.empty();
+}
+
 static struct option longopts[] = {
         {"train-file",      required_argument,  nullptr,   'f' },
         {"model-file",      required_argument,  nullptr,   'o' },
@@ -60,6 +206,37 @@ static struct option longopts[] = {
         {"with-skip-gram",  no_argument,        nullptr,   'g' },
         {"word-delimiters", required_argument,  nullptr,   'd' },
         {"end-of-sentence", required_argument,  nullptr,   'e' },
+        {"readers",         required_argument,  nullptr,   'r' },
+        {"queue-size",      required_argument,  nullptr,   'q' },
+        {"batch-words",     required_argument,  nullptr,   'b' },
+        {"checkpoint-file", required_argument,  nullptr,   'c' },
+        {"checkpoint-interval", required_argument, nullptr, 'k' },
+        {"resume",          no_argument,        nullptr,   'R' },
+        {"base-checkpoint", required_argument,  nullptr,   'B' },
+        {"matrix-file",     required_argument,  nullptr,   'M' },
+        {"stats-file",      required_argument,  nullptr,   'S' },
+        {"stats-interval",  required_argument,  nullptr,   'T' },
+        {"vocabulary-file", required_argument,  nullptr,   'V' },
+        {"peers",           required_argument,  nullptr,   'P' },
+        {"rank",            required_argument,  nullptr,   'N' },
+        {"sync-rounds",     required_argument,  nullptr,   'Y' },
+        {"hot-rows",        required_argument,  nullptr,   'K' },
+        {"hot-rows-sync",   required_argument,  nullptr,   'U' },
+        {"optimizer",       required_argument,  nullptr,   'O' },
+        {"ngram-buckets",   required_argument,  nullptr,   'H' },
+        {"min-ngram",       required_argument,  nullptr,   'j' },
+        {"max-ngram",       required_argument,  nullptr,   'J' },
+        {"documents",       required_argument,  nullptr,   'D' },
+        {"infer",           required_argument,  nullptr,   'I' },
+        {"with-glove",      no_argument,        nullptr,   'G' },
+        {"glove-x-max",     required_argument,  nullptr,   'X' },
+        {"cooccurrence-file", required_argument, nullptr,  'C' },
+        {"cooccurrence-memory", required_argument, nullptr, 'E' },
+        {"sweep",           required_argument,  nullptr,   'W' },
+        {"affinity",        required_argument,  nullptr,   'A' },
+        {"save-mode",       required_argument,  nullptr,   'F' },
+        {"atomic-save",     no_argument,        nullptr,   'Z' },
+        {"progress-interval", required_argument, nullptr,  'p' },
         {"verbose",         no_argument,        nullptr,   'v' },
         { nullptr, 0, nullptr, 0 }
 };
@@ -69,10 +246,14 @@ int main(int argc, char * const *argv) {
     std::string modelFile;
     std::string stopWordsFile;
     bool verbose = false;
+    bool documents = false;
+    std::string inferFrom;
+    std::string sweep;
     wordvec::train_setting_t trainSettings;
+    wordvec::save_setting_t saveSettings;
 
     int ch = 0;
-    while ((ch = getopt_long(argc, argv, "f:o:x:s:w:l:hn:t:i:m:a:gd:e:v?", longopts, nullptr)) != -1) {
+    while ((ch = getopt_long(argc, argv, "f:o:x:s:w:l:hn:t:i:m:a:gd:e:r:q:b:c:k:RB:M:S:T:V:P:N:Y:K:U:O:H:j:J:D:I:GX:C:E:W:A:F:Zp:v?", longopts, nullptr)) != -1) {
         switch (ch) {
             case 'f':
                 trainFile = optarg;
@@ -99,7 +280,7 @@ int main(int argc, char * const *argv) {
                 trainSettings.negative = static_cast<uint8_t>(std::stoi(optarg));
                 break;
             case 't':
-                trainSettings.threads = static_cast<uint8_t>(std::stoi(optarg));
+                trainSettings.threads = static_cast<uint16_t>(std::stoi(optarg));
                 break;
             case 'i':
                 trainSettings.iterations = static_cast<uint8_t>(std::stoi(optarg));
@@ -119,6 +300,130 @@ int main(int argc, char * const *argv) {
             case 'e':
                 trainSettings.eos = optarg;
                 break;
+            case 'r':
+                trainSettings.readers = static_cast<uint8_t>(std::stoi(optarg));
+                break;
+            case 'q':
+                trainSettings.queue_sz = static_cast<uint16_t>(std::stoi(optarg));
+                break;
+            case 'b':
+                trainSettings.batch_words = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'c':
+                trainSettings.checkpoint_file = optarg;
+                break;
+            case 'k':
+                trainSettings.checkpoint_interval = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'R':
+                trainSettings.resume = true;
+                break;
+            case 'B':
+                trainSettings.base_checkpoint = optarg;
+                break;
+            case 'M':
+                trainSettings.matrix_file = optarg;
+                break;
+            case 'S':
+                trainSettings.stats_file = optarg;
+                break;
+            case 'T':
+                trainSettings.stats_interval = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'V':
+                trainSettings.vocabulary_file = optarg;
+                break;
+            case 'P':
+                trainSettings.peers = optarg;
+                break;
+            case 'N':
+                trainSettings.rank = static_cast<uint16_t>(std::stoi(optarg));
+                break;
+            case 'Y':
+                trainSettings.sync_rounds = static_cast<uint16_t>(std::stoi(optarg));
+                break;
+            case 'K':
+                trainSettings.hot_rows = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'U':
+                trainSettings.hot_rows_sync = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'O':
+                if (std::string(optarg) == "sgd") {
+                    trainSettings.optimizer = wordvec::optimizer_t::sgd;
+                } else if (std::string(optarg) == "adagrad") {
+                    trainSettings.optimizer = wordvec::optimizer_t::adagrad;
+                } else if (std::string(optarg) == "adam") {
+                    trainSettings.optimizer = wordvec::optimizer_t::adam;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'H':
+                trainSettings.ngram_buckets = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'j':
+                trainSettings.min_ngram = static_cast<uint8_t>(std::stoi(optarg));
+                break;
+            case 'J':
+                trainSettings.max_ngram = static_cast<uint8_t>(std::stoi(optarg));
+                break;
+            case 'D':
+                if (std::string(optarg) == "dbow") {
+                    trainSettings.with_dm = false;
+                } else if (std::string(optarg) == "dm") {
+                    trainSettings.with_dm = true;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                documents = true;
+                break;
+            case 'I':
+                inferFrom = optarg;
+                break;
+            case 'G':
+                trainSettings.with_glove = true;
+                break;
+            case 'X':
+                trainSettings.glove_x_max = std::stof(optarg);
+                break;
+            case 'C':
+                trainSettings.cooccurrence_file = optarg;
+                break;
+            case 'E':
+                trainSettings.cooccurrence_memory = static_cast<uint32_t>(std::stoul(optarg));
+                break;
+            case 'W':
+                sweep = optarg;
+                break;
+            case 'A':
+                if (std::string(optarg) == "cores") {
+                    trainSettings.placement = wordvec::placement_t::cores;
+                } else if (std::string(optarg) == "numa") {
+                    trainSettings.placement = wordvec::placement_t::numa;
+                } else {
+                    trainSettings.placement = wordvec::placement_t::list;
+                    trainSettings.cpu_list = optarg;
+                }
+                break;
+            case 'F':
+                if (std::string(optarg) == "stream") {
+                    saveSettings.mode = wordvec::save_mode_t::stream;
+                } else if (std::string(optarg) == "mmap") {
+                    saveSettings.mode = wordvec::save_mode_t::mmap;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'Z':
+                saveSettings.atomic = true;
+                break;
+            case 'p':
+                trainSettings.progress_interval = static_cast<uint32_t>(std::stoul(optarg));
+                break;
             case 'v':
                 verbose = true;
                 break;
@@ -130,7 +435,7 @@ int main(int argc, char * const *argv) {
         }
     }
 
-    if (trainFile.empty() || modelFile.empty()) {
+    if (trainFile.empty() || modelFile.empty() || (trainSettings.resume && trainSettings.checkpoint_file.empty())) {
         usage(argv[0]);
         return 1;
     }
@@ -139,7 +444,8 @@ int main(int argc, char * const *argv) {
         std::cout << "Train data file: " << trainFile << std::endl;
         std::cout << "Output model file: " << modelFile << std::endl;
         std::cout << "Stop-words file: " << stopWordsFile << std::endl;
-        std::cout << "Training model: " << (trainSettings.with_sg?"Skip-Gram":"CBOW") << std::endl;
+        std::cout << "Training model: "
+                  << (trainSettings.with_glove ? "GloVe" : (trainSettings.with_sg ? "Skip-Gram" : "CBOW")) << std::endl;
         std::cout << "Sample approximation method: ";
         if (trainSettings.with_hs) {
             std::cout << "Hierarchical softmax" << std::endl;
@@ -148,15 +454,166 @@ int main(int argc, char * const *argv) {
                       << static_cast<int>(trainSettings.negative) << std::endl;
         }
         std::cout << "Number of training threads: " << static_cast<int>(trainSettings.threads) << std::endl;
+        if (trainSettings.readers > 0) {
+            std::cout << "Number of reader threads: " << static_cast<int>(trainSettings.readers) << std::endl;
+            std::cout << "Sentence queue size: " << trainSettings.queue_sz << std::endl;
+            std::cout << "Words per sentence batch: " << trainSettings.batch_words << std::endl;
+        }
         std::cout << "Number of training iterations: " << static_cast<int>(trainSettings.iterations) << std::endl;
         std::cout << "Min word frequency: " << static_cast<int>(trainSettings.min_freq) << std::endl;
         std::cout << "Vector size: " << static_cast<int>(trainSettings.size) << std::endl;
         std::cout << "Max skip length: " << static_cast<int>(trainSettings.window) << std::endl;
         std::cout << "Threshold for occurrence of words: " << trainSettings.sample << std::endl;
         std::cout << "Starting learning rate: " << trainSettings.alpha << std::endl;
+        std::cout << "Optimizer: ";
+        switch (trainSettings.optimizer) {
+            case wordvec::optimizer_t::sgd:
+                std::cout << "SGD" << std::endl;
+                break;
+            case wordvec::optimizer_t::adagrad:
+                std::cout << "AdaGrad" << std::endl;
+                break;
+            case wordvec::optimizer_t::adam:
+                std::cout << "lazy Adam" << std::endl;
+                break;
+        }
+        if (!trainSettings.base_checkpoint.empty()) {
+            std::cout << "Base model checkpoint: " << trainSettings.base_checkpoint << std::endl;
+        }
+        if (!trainSettings.checkpoint_file.empty()) {
+            std::cout << "Checkpoint file: " << trainSettings.checkpoint_file
+                      << (trainSettings.resume ? " (resume)" : "") << std::endl;
+            std::cout << "Checkpoint interval: " << trainSettings.checkpoint_interval << " sec" << std::endl;
+        }
+        if (!trainSettings.matrix_file.empty()) {
+            std::cout << "Matrix file: " << trainSettings.matrix_file << std::endl;
+        }
+        if (!trainSettings.stats_file.empty()) {
+            std::cout << "Telemetry file: " << trainSettings.stats_file << std::endl;
+        }
+        std::cout << "Telemetry interval: " << trainSettings.stats_interval << " sec" << std::endl;
+        if (!trainSettings.vocabulary_file.empty()) {
+            std::cout << "Vocabulary file: " << trainSettings.vocabulary_file << std::endl;
+        }
+        if (!trainSettings.peers.empty()) {
+            std::cout << "Peers: " << trainSettings.peers << ", rank " << trainSettings.rank
+                      << ", exchange rounds " << trainSettings.sync_rounds << std::endl;
+        }
+        if (trainSettings.ngram_buckets > 0) {
+            std::cout << "Character n-grams: " << static_cast<int>(trainSettings.min_ngram) << " - "
+                      << static_cast<int>(trainSettings.max_ngram) << " chars, "
+                      << trainSettings.ngram_buckets << " buckets" << std::endl;
+        }
+        if (trainSettings.with_glove) {
+            std::cout << "GloVe x max: " << trainSettings.glove_x_max << std::endl;
+            std::cout << "Co-occurrence file: "
+                      << (trainSettings.cooccurrence_file.empty() ? "temporary" : trainSettings.cooccurrence_file)
+                      << ", counting memory " << trainSettings.cooccurrence_memory << " MB" << std::endl;
+        }
+        switch (trainSettings.placement) {
+            case wordvec::placement_t::none:
+                break;
+            case wordvec::placement_t::list:
+                std::cout << "Thread placement: CPUs " << trainSettings.cpu_list << std::endl;
+                break;
+            case wordvec::placement_t::cores:
+                std::cout << "Thread placement: one per physical core" << std::endl;
+                break;
+            case wordvec::placement_t::numa:
+                std::cout << "Thread placement: fill NUMA nodes" << std::endl;
+                break;
+        }
+        std::cout << "Progress interval: " << trainSettings.progress_interval << " ms" << std::endl;
+        if (trainSettings.hot_rows > 0) {
+            std::cout << "Thread private hot rows: " << trainSettings.hot_rows
+                      << ", merged each " << trainSettings.hot_rows_sync << " updates" << std::endl;
+        }
         std::cout << std::endl << std::flush;
     }
 
+    if (documents || !inferFrom.empty()) {
+        std::function<void(float, float)> progressCallback = nullptr;
+        if (verbose) {
+            progressCallback = [] (float _alpha, float _percent) {
+                std::cout << '\r'
+                          << "alpha: "
+                          << std::fixed << std::setprecision(6)
+                          << _alpha
+                          << ", progress: "
+                          << std::fixed << std::setprecision(2)
+                          << _percent << "%"
+                          << std::flush;
+            };
+        }
+        wordvec::d2vModel_t d2vModel(trainSettings.size);
+        bool done = inferFrom.empty()
+                    ? d2vModel.train(trainSettings, trainFile, stopWordsFile, nullptr, nullptr, progressCallback)
+                    : d2vModel.infer(trainSettings, inferFrom, trainFile, 0, progressCallback);
+        if (verbose) {
+            std::cout << std::endl << "Documents: " << d2vModel.modelSize() << std::endl;
+        }
+        if (!done) {
+            std::cerr << "Training failed: " << d2vModel.errMsg() << std::endl;
+            return 2;
+        }
+        if (!d2vModel.save(modelFile)) {
+            std::cerr << "Model file saving failed: " << d2vModel.errMsg() << std::endl;
+            return 3;
+        }
+
+        return 0;
+    }
+
+    if (!sweep.empty()) {
+        std::vector<wordvec::train_setting_t> sweepConfigs;
+        if (!sweepSettings(sweep, trainSettings, sweepConfigs)) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::vector<wordvec::w2vModel_t> models;
+        std::vector<wordvec::train_stats_t> stats;
+        std::string errMsg;
+        std::vector<float> progress(sweepConfigs.size(), 0.0f);
+        wordvec::w2vModel_t::sweepProgressCallback_t progressCallback = nullptr;
+        if (verbose) {
+            progressCallback = [&progress] (std::size_t _config, float, float _percent) {
+                progress[_config] = _percent;
+                std::cout << "\rprogress:";
+                for (auto const &i:progress) {
+                    std::cout << " " << std::fixed << std::setprecision(2) << i << "%";
+                }
+                std::cout << std::flush;
+            };
+        }
+        if (!wordvec::w2vModel_t::sweep(sweepConfigs, trainFile, stopWordsFile, models, stats, errMsg,
+                                        nullptr, nullptr, progressCallback)) {
+            std::cerr << "Training failed: " << errMsg << std::endl;
+            return 2;
+        }
+        if (verbose) {
+            std::cout << std::endl;
+        }
+
+        // throughput summary, one line per configuration
+        for (std::size_t i = 0; i < models.size(); ++i) {
+            auto const &config = sweepConfigs[i];
+            std::cout << i << ": size " << config.size << ", window " << static_cast<int>(config.window)
+                      << ", negative " << static_cast<int>(config.negative) << ", sample " << config.sample
+                      << ", threads " << static_cast<int>(config.threads) << " - "
+                      << std::fixed << std::setprecision(2) << stats[i].seconds << " sec, "
+                      << std::setprecision(0) << stats[i].total.words_per_sec << " words/sec, "
+                      << stats[i].total.pairs_per_sec << " pairs/sec, loss: "
+                      << std::setprecision(4) << stats[i].total.loss << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            if (!models[i].save(modelFile + "." + std::to_string(i), saveSettings)) {
+                std::cerr << "Model file saving failed: " << models[i].errMsg() << std::endl;
+                return 3;
+            }
+        }
+
+        return 0;
+    }
+
     wordvec::w2vModel_t model;
     bool trained;
     if (verbose) {
@@ -182,6 +639,35 @@ int main(int argc, char * const *argv) {
                                             << std::fixed << std::setprecision(2)
                                             << _percent << "%"
                                             << std::flush;
+                              },
+                              [] (const wordvec::pipeline_stats_t &_stats) {
+                                  std::cout << std::endl
+                                            << "Sentence batches: " << _stats.batches << std::endl
+                                            << "Queue depth (avg/max/size): "
+                                            << std::fixed << std::setprecision(2) << _stats.avg_queue_depth
+                                            << "/" << _stats.max_queue_depth
+                                            << "/" << _stats.queue_size << std::endl
+                                            << "Reader stalls on full queue: " << _stats.producer_stalls
+                                            << " (" << _stats.producer_stall_ms << " ms)" << std::endl
+                                            << "Trainer stalls on empty queue: " << _stats.consumer_stalls
+                                            << " (" << _stats.consumer_stall_ms << " ms)" << std::flush;
+                              },
+                              [] (const wordvec::epoch_stats_t &_stats) {
+                                  std::cout << std::endl
+                                            << "Epoch " << _stats.epoch << ": "
+                                            << std::fixed << std::setprecision(2) << _stats.seconds << " sec, "
+                                            << "page faults (major/minor): "
+                                            << _stats.major_faults << "/" << _stats.minor_faults << std::flush;
+                              },
+                              [] (const wordvec::train_stats_t &_stats) {
+                                  std::cout << std::endl
+                                            << std::fixed << std::setprecision(2) << _stats.seconds << " sec: "
+                                            << std::setprecision(0) << _stats.total.words_per_sec << " words/sec, "
+                                            << _stats.total.pairs_per_sec << " pairs/sec, loss: "
+                                            << std::setprecision(4) << _stats.total.loss
+                                            << ", skipped words: " << _stats.total.skipped_words
+                                            << ", read/train ms: " << _stats.total.read_ms
+                                            << "/" << _stats.total.train_ms << std::endl << std::flush;
                               }
         );
         std::cout << std::endl;
@@ -193,7 +679,7 @@ int main(int argc, char * const *argv) {
         return 2;
     }
 
-    if (!model.save(modelFile)) {
+    if (!model.save(modelFile, saveSettings)) {
         std::cerr << "Model file saving failed: " << model.errMsg() << std::endl;
         return 3;
     }